@@ -1,22 +1,48 @@
 #pragma once
 
 #include "GEngine/app.h"
+#include "GEngine/atmosphere_lut_cache.h"
+#include "GEngine/atmosphere_parameters.h"
+#include "GEngine/atmosphere_reference.h"
+#include "GEngine/bounds.h"
 #include "GEngine/camera.h"
 #include "GEngine/common.h"
 #include "GEngine/editor_ui.h"
 #include "GEngine/framebuffer.h"
+#include "GEngine/gl_state_cache.h"
 #include "GEngine/glfw_window.h"
 #include "GEngine/input_system.h"
+#include "GEngine/job_system.h"
+#include "GEngine/light_cluster.h"
 #include "GEngine/log.h"
+#include "GEngine/material_texture_arrays.h"
 #include "GEngine/mesh.h"
+#include "GEngine/mip_generator.h"
+#include "GEngine/occlusion_culler.h"
+#include "GEngine/pixel_unpack_ring.h"
+#include "GEngine/program_cache.h"
 #include "GEngine/render_pass.h"
+#include "GEngine/render_scene.h"
 #include "GEngine/render_system.h"
 #include "GEngine/renderbuffer.h"
 #include "GEngine/shader.h"
+#include "GEngine/shader_hot_reload.h"
+#include "GEngine/shader_preprocessor.h"
+#include "GEngine/shader_variants.h"
 #include "GEngine/singleton.h"
 #include "GEngine/texture.h"
+#include "GEngine/texture_compression.h"
+#include "GEngine/texture_cooker.h"
+#include "GEngine/texture_streamer.h"
+#include "GEngine/texture_upload_queue.h"
 
 #include "GEngine/renderpass/IBL_pass.h"
+#include "GEngine/renderpass/depth_pass.h"
+#include "GEngine/renderpass/forward_pass.h"
+#include "GEngine/renderpass/hiz_pass.h"
+#include "GEngine/renderpass/light_culling_pass.h"
+#include "GEngine/renderpass/occlusion_culling_pass.h"
+#include "GEngine/renderpass/shadow_pass.h"
 #include "GEngine/renderpass/skybox_pass.h"
 #include "GEngine/renderpass/precomputed_atmosphere_pass.h"
 
@@ -4,13 +4,18 @@
 #include "GEngine/app.h"
 #include "GEngine/render_system.h"
 #include "GEngine/input_system.h"
+#include "GEngine/gl_state_cache.h"
 #include "GEngine/shader.h"
+#include "GEngine/shader_hot_reload.h"
 #include "GEngine/log.h"
 #include "GEngine/mesh.h"
 #include "GEngine/texture.h"
+#include "GEngine/texture_streamer.h"
+#include "GEngine/texture_upload_queue.h"
 #include "glm/ext/matrix_transform.hpp"
 #include "singleton.h"
 #include "GEngine/animator.h"
+#include "GEngine/job_system.h"
 
 #include <glm/gtx/string_cast.hpp>
 
@@ -26,16 +31,23 @@ GLvoid GEngine::CApp::Init()
 {
   
   GEngine::CLog::Init();
+  CSingleton<CJobSystem>()->Init();
   CSingleton<CRenderSystem>()->GetOrCreateWindow()->Init();
   window_ = CSingleton<CRenderSystem>()->GetOrCreateWindow()->GetGLFWwindow();
   CSingleton<CInputSystem>()->Init(); 
   CSingleton<CRenderSystem>()->Init();
 
-  // renderpass init
+  // renderpass init, every shader is submitted before the first Init()
   auto passes = CSingleton<CRenderSystem>()->GetRenderPass();
-  for (int i = 0; i < passes.size(); i++) {
+  for (size_t i = 0; i < passes.size(); i++) {
+    passes[i]->PrepareShaders();
+  }
+  for (size_t i = 0; i < passes.size(); i++) {
     passes[i]->Init();
   }
+  // the driver compiled them during the Init()s, resolve the rest here so no
+  // program blocks (or logs its errors) in the middle of the first frame
+  GEngine::Shader::FinishPendingPrograms();
 }
 
 GLvoid GEngine::CApp::RunMainLoop() {
@@ -49,6 +61,12 @@ GLvoid GEngine::CApp::RunMainLoop() {
     CSingleton<CRenderSystem>()->GetOrCreateWindow()->SetViewport();
     
     CalculateTime();
+    // frame boundary, no pass is using a program while it gets swapped
+    CSingleton<CShaderHotReload>()->Tick();
+    // mips requested by last frame's draws
+    CSingleton<CTextureStreamer>()->Tick();
+    // texture uploads, capped per frame
+    CSingleton<CTextureUploadQueue>()->Tick();
     CSingleton<CRenderSystem>()->GetOrCreateMainCamera()->Tick();
     glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -78,8 +96,27 @@ GLvoid GEngine::CApp::RunMainLoop() {
     glm::mat4 projection_view_model = projection * view * model;
 
 
+    // pick up programs the driver finished in the background
+    GEngine::Shader::PollPendingPrograms();
+
+    // state calls of the passes, the UI below is not counted
+    auto state_cache = CSingleton<CGLStateCache>();
+    auto &stats = CSingleton<CRenderSystem>()->GetRenderStats();
+    stats.gl_state_calls_issued_ = state_cache->GetIssuedCount();
+    stats.gl_state_calls_filtered_ = state_cache->GetFilteredCount();
+    auto streamer = CSingleton<CTextureStreamer>();
+    stats.streamed_textures_ = static_cast<unsigned int>(streamer->GetStreamedCount());
+    stats.streamed_resident_mb_ = streamer->GetResidentBytes() / float(1 << 20);
+    stats.texture_uploaded_mb_ = CSingleton<CTextureUploadQueue>()->GetUploadedBytes() / float(1 << 20);
+    stats.texture_upload_pending_mb_ = CSingleton<CTextureUploadQueue>()->GetPendingBytes() / float(1 << 20);
+    stats.streamed_levels_uploaded_ = streamer->GetUploadedLevels();
+    stats.streamed_levels_evicted_ = streamer->GetEvictedLevels();
+
     // ticking main GUI
     CSingleton<CRenderSystem>()->GetOrCreateMainUI()->Tick();
+    // imgui binds its own program, textures & VAO
+    state_cache->Invalidate();
+    state_cache->ResetCounters();
     
     auto err = glGetError();
     if(err!=GL_NO_ERROR) {
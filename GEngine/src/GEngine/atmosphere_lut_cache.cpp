@@ -0,0 +1,187 @@
+#include "GEngine/atmosphere_lut_cache.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/log.h"
+#include "GEngine/singleton.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+constexpr uint32_t kCacheMagic = 0x43554c41; // "ALUC"
+// bump when the precompute shaders change the texture contents
+constexpr uint32_t kCacheVersion = 1;
+} // namespace
+
+uint64_t GEngine::CAtmosphereLUTCache::Hash(uint64_t hash, const void *data, size_t size) {
+  const auto *bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+uint64_t GEngine::CAtmosphereLUTCache::Hash(uint64_t hash, const std::vector<double> &values) {
+  uint64_t size = values.size();
+  hash = Hash(hash, &size, sizeof(size));
+  return Hash(hash, values.data(), values.size() * sizeof(double));
+}
+
+GEngine::CAtmosphereLUTCache::SImage GEngine::CAtmosphereLUTCache::QueryImage(const STexture &texture) {
+  SImage image;
+  image.target_ = texture.target_;
+  CSingleton<CGLStateCache>()->BindTexture(texture.target_, texture.id_);
+  glGetTexLevelParameteriv(texture.target_, 0, GL_TEXTURE_INTERNAL_FORMAT, &image.internal_format_);
+  glGetTexLevelParameteriv(texture.target_, 0, GL_TEXTURE_WIDTH, &image.width_);
+  glGetTexLevelParameteriv(texture.target_, 0, GL_TEXTURE_HEIGHT, &image.height_);
+  glGetTexLevelParameteriv(texture.target_, 0, GL_TEXTURE_DEPTH, &image.depth_);
+  bool rgba = image.internal_format_ == GL_RGBA32F || image.internal_format_ == GL_RGBA16F;
+  bool half = image.internal_format_ == GL_RGBA16F || image.internal_format_ == GL_RGB16F;
+  image.format_ = rgba ? GL_RGBA : GL_RGB;
+  image.type_ = half ? GL_HALF_FLOAT : GL_FLOAT;
+  image.data_.resize(static_cast<size_t>(image.width_) * image.height_ * std::max(1, image.depth_) * (rgba ? 4 : 3) *
+                     (half ? 2 : 4));
+  return image;
+}
+
+std::string GEngine::CAtmosphereLUTCache::GetPath(uint64_t key) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.lut", static_cast<unsigned long long>(key));
+  return (std::filesystem::path(directory_) / name).string();
+}
+
+bool GEngine::CAtmosphereLUTCache::ReadFile(const std::string &path, uint64_t &key, std::vector<SImage> &images) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  uint32_t count = 0;
+  file.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+  file.read(reinterpret_cast<char *>(&version), sizeof(version));
+  file.read(reinterpret_cast<char *>(&key), sizeof(key));
+  file.read(reinterpret_cast<char *>(&count), sizeof(count));
+  if (!file || magic != kCacheMagic || version != kCacheVersion || count > 16) {
+    return false;
+  }
+  images.resize(count);
+  for (auto &image : images) {
+    SLayout layout;
+    file.read(reinterpret_cast<char *>(&layout), sizeof(layout));
+    if (!file || layout.bytes_ > (1ull << 32)) {
+      return false;
+    }
+    image.target_ = layout.target_;
+    image.internal_format_ = layout.internal_format_;
+    image.width_ = layout.width_;
+    image.height_ = layout.height_;
+    image.depth_ = layout.depth_;
+    image.format_ = layout.format_;
+    image.type_ = layout.type_;
+    image.data_.resize(layout.bytes_);
+    file.read(image.data_.data(), static_cast<std::streamsize>(layout.bytes_));
+  }
+  return static_cast<bool>(file);
+}
+
+bool GEngine::CAtmosphereLUTCache::WriteFile(const std::string &path, uint64_t key, const std::vector<SImage> &images) {
+  std::error_code error;
+  std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+  // write next to the final file and rename, a crash never leaves half a cache
+  std::string temp_path = path + ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      GE_WARN("Failed to write atmosphere LUT cache '{0}'", temp_path);
+      return false;
+    }
+    uint32_t count = static_cast<uint32_t>(images.size());
+    file.write(reinterpret_cast<const char *>(&kCacheMagic), sizeof(kCacheMagic));
+    file.write(reinterpret_cast<const char *>(&kCacheVersion), sizeof(kCacheVersion));
+    file.write(reinterpret_cast<const char *>(&key), sizeof(key));
+    file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    for (const auto &image : images) {
+      SLayout layout;
+      layout.target_ = image.target_;
+      layout.internal_format_ = image.internal_format_;
+      layout.width_ = image.width_;
+      layout.height_ = image.height_;
+      layout.depth_ = image.depth_;
+      layout.format_ = image.format_;
+      layout.type_ = image.type_;
+      layout.bytes_ = image.data_.size();
+      file.write(reinterpret_cast<const char *>(&layout), sizeof(layout));
+      file.write(image.data_.data(), static_cast<std::streamsize>(image.data_.size()));
+    }
+  }
+  std::filesystem::rename(temp_path, path, error);
+  if (error) {
+    GE_WARN("Failed to store atmosphere LUT cache '{0}': {1}", path, error.message());
+    return false;
+  }
+  return true;
+}
+
+bool GEngine::CAtmosphereLUTCache::Load(uint64_t key, const std::vector<STexture> &textures) {
+  if (!enabled_) {
+    return false;
+  }
+  std::string path = GetPath(key);
+  if (!std::filesystem::exists(path)) {
+    miss_count_++;
+    return false;
+  }
+  // read everything before touching the textures, a short file leaves them as they are
+  uint64_t stored_key = 0;
+  std::vector<SImage> images;
+  bool valid = ReadFile(path, stored_key, images) && stored_key == key && images.size() == textures.size();
+  for (size_t i = 0; valid && i < textures.size(); i++) {
+    SImage expected = QueryImage(textures[i]);
+    const SImage &stored = images[i];
+    valid = stored.target_ == expected.target_ && stored.internal_format_ == expected.internal_format_ &&
+            stored.width_ == expected.width_ && stored.height_ == expected.height_ &&
+            stored.depth_ == expected.depth_ && stored.format_ == expected.format_ &&
+            stored.type_ == expected.type_ && stored.data_.size() == expected.data_.size();
+  }
+  if (!valid) {
+    GE_WARN("Atmosphere LUT cache '{0}' is stale or corrupt, precomputing", path);
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    miss_count_++;
+    return false;
+  }
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (size_t i = 0; i < textures.size(); i++) {
+    const SImage &image = images[i];
+    CSingleton<CGLStateCache>()->BindTexture(image.target_, textures[i].id_);
+    if (image.target_ == GL_TEXTURE_3D) {
+      glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, image.width_, image.height_, image.depth_, image.format_,
+                      image.type_, image.data_.data());
+    } else {
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width_, image.height_, image.format_, image.type_,
+                      image.data_.data());
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  hit_count_++;
+  return true;
+}
+
+void GEngine::CAtmosphereLUTCache::Store(uint64_t key, const std::vector<STexture> &textures) {
+  if (!enabled_) {
+    return;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  std::vector<SImage> images;
+  for (const auto &texture : textures) {
+    images.push_back(QueryImage(texture));
+    glGetTexImage(texture.target_, 0, images.back().format_, images.back().type_, images.back().data_.data());
+  }
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  WriteFile(GetPath(key), key, images);
+}
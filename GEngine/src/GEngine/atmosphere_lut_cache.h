@@ -0,0 +1,76 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace GEngine {
+// be sure to call CAtmosphereLUTCache method with CSingleton<CAtmosphereLUTCache>()->func();
+// disk cache of the precomputed atmosphere textures (transmittance,
+// scattering, single mie, irradiance). The key hashes every model parameter,
+// the textures are stored as read back (glGetTexImage) and re-uploaded into
+// the already allocated textures, a file that doesn't match their sizes or
+// formats is a miss.
+class CAtmosphereLUTCache {
+public:
+  struct STexture {
+    GLenum target_; // GL_TEXTURE_2D or GL_TEXTURE_3D
+    GLuint id_;
+  };
+  // level 0 of a texture as stored in the file, format_ and type_ are the
+  // glGetTexImage ones (GL_RGB/GL_RGBA of GL_FLOAT/GL_HALF_FLOAT)
+  struct SImage {
+    GLenum target_ = 0;
+    GLint internal_format_ = 0;
+    GLint width_ = 0;
+    GLint height_ = 0;
+    GLint depth_ = 0;
+    GLenum format_ = 0;
+    GLenum type_ = 0;
+    std::vector<char> data_;
+  };
+
+  void SetDirectory(const std::string &directory) { directory_ = directory; }
+  void SetEnabled(bool enabled) { enabled_ = enabled; }
+  bool IsEnabled() const { return enabled_; }
+
+  // 64 bit FNV-1a, chain the calls starting from kHashSeed
+  static constexpr uint64_t kHashSeed = 0xcbf29ce484222325ull;
+  static uint64_t Hash(uint64_t hash, const void *data, size_t size);
+  static uint64_t Hash(uint64_t hash, const std::vector<double> &values);
+  template <typename T> static uint64_t Hash(uint64_t hash, const T &value) { return Hash(hash, &value, sizeof(T)); }
+
+  // true if every texture was filled from the cache
+  bool Load(uint64_t key, const std::vector<STexture> &textures);
+  void Store(uint64_t key, const std::vector<STexture> &textures);
+
+  // file io without GL, for the offline bakers
+  std::string GetPath(uint64_t key) const;
+  static bool ReadFile(const std::string &path, uint64_t &key, std::vector<SImage> &images);
+  static bool WriteFile(const std::string &path, uint64_t key, const std::vector<SImage> &images);
+
+  unsigned int GetHitCount() const { return hit_count_; }
+  unsigned int GetMissCount() const { return miss_count_; }
+
+private:
+  // file header of every image
+  struct SLayout {
+    GLenum target_ = 0;
+    GLint internal_format_ = 0;
+    GLint width_ = 0;
+    GLint height_ = 0;
+    GLint depth_ = 0;
+    GLenum format_ = 0;
+    GLenum type_ = 0;
+    uint64_t bytes_ = 0;
+  };
+
+  // an image with the size and formats of the texture, data_ allocated
+  static SImage QueryImage(const STexture &texture);
+
+  std::string directory_ = "../../cache/atmosphere";
+  bool enabled_ = true;
+  unsigned int hit_count_ = 0;
+  unsigned int miss_count_ = 0;
+};
+} // namespace GEngine
@@ -0,0 +1,175 @@
+#include "GEngine/atmosphere_parameters.h"
+#include "GEngine/atmosphere_lut_cache.h"
+#include <cassert>
+#include <cmath>
+
+GEngine::SAtmosphereParameters GEngine::SAtmosphereParameters::Earth(bool use_ozone, bool use_constant_solar_spectrum,
+                                                                     bool half_precision,
+                                                                     unsigned int num_precomputed_wavelengths,
+                                                                     bool combine_scattering_textures) {
+  constexpr double kSolarIrradiance[48] = {
+      1.11776, 1.14259, 1.01249, 1.14716, 1.72765, 1.73054, 1.6887,  1.61253,
+      1.91198, 2.03474, 2.02042, 2.02212, 1.93377, 1.95809, 1.91686, 1.8298,
+      1.8685,  1.8931,  1.85149, 1.8504,  1.8341,  1.8345,  1.8147,  1.78158,
+      1.7533,  1.6965,  1.68194, 1.64654, 1.6048,  1.52143, 1.55622, 1.5113,
+      1.474,   1.4482,  1.41018, 1.36775, 1.34188, 1.31429, 1.28303, 1.26758,
+      1.2367,  1.2082,  1.18737, 1.14683, 1.12362, 1.1058,  1.07124, 1.04992};
+  constexpr double kOzoneCrossSection[48] = {
+      1.18e-27,  2.182e-28, 2.818e-28, 6.636e-28, 1.527e-27, 2.763e-27,
+      5.52e-27,  8.451e-27, 1.582e-26, 2.316e-26, 3.669e-26, 4.924e-26,
+      7.752e-26, 9.016e-26, 1.48e-25,  1.602e-25, 2.139e-25, 2.755e-25,
+      3.091e-25, 3.5e-25,   4.266e-25, 4.672e-25, 4.398e-25, 4.701e-25,
+      5.019e-25, 4.305e-25, 3.74e-25,  3.215e-25, 2.662e-25, 2.238e-25,
+      1.852e-25, 1.473e-25, 1.209e-25, 9.423e-26, 7.455e-26, 6.566e-26,
+      5.105e-26, 4.15e-26,  4.228e-26, 3.237e-26, 2.451e-26, 2.801e-26,
+      2.534e-26, 1.624e-26, 1.465e-26, 2.078e-26, 1.383e-26, 7.105e-27};
+  constexpr double kDobsonUnit = 2.687e20;
+  constexpr double kMaxOzoneNumberDensity = 300.0 * kDobsonUnit / 15000.0;
+  constexpr double kConstantSolarIrradiance = 1.5;
+  constexpr double kBottomRadius = 6360000.0;
+  constexpr double kTopRadius = 6420000.0;
+  constexpr double kRayleigh = 1.24062e-6;
+  constexpr double kRayleighScaleHeight = 8000.0;
+  constexpr double kMieScaleHeight = 1200.0;
+  constexpr double kMieAngstromAlpha = 0.0;
+  constexpr double kMieAngstromBeta = 5.328e-3;
+  constexpr double kMieSingleScatteringAlbedo = 0.9;
+  constexpr double kMiePhaseFunctionG = 0.8;
+  constexpr double kGroundAlbedo = 0.1;
+
+  constexpr double kPi = 3.1415926;
+
+  SAtmosphereParameters parameters;
+  parameters.sun_angular_radius_ = 0.00935 / 2.0;
+  parameters.bottom_radius_ = kBottomRadius;
+  parameters.top_radius_ = kTopRadius;
+  parameters.rayleigh_density_ = {DensityProfileLayer(0.0, 1.0, -1.0 / kRayleighScaleHeight, 0.0, 0.0)};
+  parameters.mie_density_ = {DensityProfileLayer(0.0, 1.0, -1.0 / kMieScaleHeight, 0.0, 0.0)};
+  parameters.absorption_density_ = {DensityProfileLayer(25000.0, 0.0, 0.0, 1.0 / 15000.0, -2.0 / 3.0),
+                                    DensityProfileLayer(0.0, 0.0, 0.0, -1.0 / 15000.0, 8.0 / 3.0)};
+  parameters.mie_phase_function_g_ = kMiePhaseFunctionG;
+  parameters.max_sun_zenith_angle_ = (half_precision ? 102.0 : 120.0) / 180.0 * kPi;
+  parameters.length_unit_in_meters_ = 1000.0;
+  parameters.num_precomputed_wavelengths_ = num_precomputed_wavelengths;
+  parameters.combine_scattering_textures_ = combine_scattering_textures;
+  parameters.half_precision_ = half_precision;
+
+  // scattering parameters of wavelength from 360nm to 830nm
+  for (int l = kLambdaMin; l <= kLambdaMax; l += 10) {
+    double lambda = static_cast<double>(l) * 1e-3; // micro-meters
+    double mie = kMieAngstromBeta / kMieScaleHeight * pow(lambda, -kMieAngstromAlpha);
+    parameters.wavelengths_.push_back(l);
+    if (use_constant_solar_spectrum) {
+      parameters.solar_irradiance_.push_back(kConstantSolarIrradiance);
+    } else {
+      parameters.solar_irradiance_.push_back(kSolarIrradiance[(l - kLambdaMin) / 10]);
+    }
+    parameters.rayleigh_scattering_.push_back(kRayleigh * pow(lambda, -4));
+    parameters.mie_scattering_.push_back(mie * kMieSingleScatteringAlbedo);
+    parameters.mie_extinction_.push_back(mie);
+    parameters.absorption_extinction_.push_back(
+        use_ozone ? kMaxOzoneNumberDensity * kOzoneCrossSection[(l - kLambdaMin) / 10] : 0.0);
+    parameters.ground_albedo_.push_back(kGroundAlbedo);
+  }
+  return parameters;
+}
+
+std::vector<GEngine::SAtmosphereParameters::SWavelengthBatch>
+GEngine::SAtmosphereParameters::GetWavelengthBatches() const {
+  std::vector<SWavelengthBatch> batches;
+  if (num_precomputed_wavelengths_ <= 3) {
+    batches.push_back({{kLambdaR, kLambdaG, kLambdaB}, {1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0}});
+    return batches;
+  }
+  int num_iterations = (num_precomputed_wavelengths_ + 2) / 3;
+  double dlambda = static_cast<double>(kLambdaMax - kLambdaMin) / (3 * num_iterations);
+  for (int i = 0; i < num_iterations; ++i) {
+    std::array<double, 3> lambdas{kLambdaMin + (3 * i + 0.5) * dlambda, kLambdaMin + (3 * i + 1.5) * dlambda,
+                                  kLambdaMin + (3 * i + 2.5) * dlambda};
+    auto coeff = [dlambda](double lambda, int component) {
+      // Note that we don't include MAX_LUMINOUS_EFFICACY here, to avoid
+      // artefacts due to too large values when using half precision on GPU.
+      // We add this term back in kAtmosphereShader, via
+      // SKY_SPECTRAL_RADIANCE_TO_LUMINANCE (see also the comments in the
+      // Model constructor).
+      double x = CieColorMatchingFunctionTableValue(lambda, 1);
+      double y = CieColorMatchingFunctionTableValue(lambda, 2);
+      double z = CieColorMatchingFunctionTableValue(lambda, 3);
+      return static_cast<float>((XYZ_TO_SRGB[component * 3] * x + XYZ_TO_SRGB[component * 3 + 1] * y +
+                                 XYZ_TO_SRGB[component * 3 + 2] * z) *
+                                dlambda);
+    };
+    batches.push_back({lambdas,
+                       {coeff(lambdas[0], 0), coeff(lambdas[1], 0), coeff(lambdas[2], 0), coeff(lambdas[0], 1),
+                        coeff(lambdas[1], 1), coeff(lambdas[2], 1), coeff(lambdas[0], 2), coeff(lambdas[1], 2),
+                        coeff(lambdas[2], 2)}});
+  }
+  return batches;
+}
+
+uint64_t GEngine::SAtmosphereParameters::Hash(bool rgb_format_supported) const {
+  using Cache = CAtmosphereLUTCache;
+  auto hash_layers = [](uint64_t hash, const std::vector<DensityProfileLayer> &layers) {
+    hash = Cache::Hash(hash, layers.size());
+    for (const auto &layer : layers) {
+      double values[] = {layer.width, layer.exp_term, layer.exp_scale, layer.linear_term, layer.constant_term};
+      hash = Cache::Hash(hash, values);
+    }
+    return hash;
+  };
+  uint64_t hash = Cache::kHashSeed;
+  hash = Cache::Hash(hash, wavelengths_);
+  hash = Cache::Hash(hash, solar_irradiance_);
+  hash = Cache::Hash(hash, sun_angular_radius_);
+  hash = Cache::Hash(hash, bottom_radius_);
+  hash = Cache::Hash(hash, top_radius_);
+  hash = hash_layers(hash, rayleigh_density_);
+  hash = Cache::Hash(hash, rayleigh_scattering_);
+  hash = hash_layers(hash, mie_density_);
+  hash = Cache::Hash(hash, mie_scattering_);
+  hash = Cache::Hash(hash, mie_extinction_);
+  hash = Cache::Hash(hash, mie_phase_function_g_);
+  hash = hash_layers(hash, absorption_density_);
+  hash = Cache::Hash(hash, absorption_extinction_);
+  hash = Cache::Hash(hash, ground_albedo_);
+  hash = Cache::Hash(hash, max_sun_zenith_angle_);
+  hash = Cache::Hash(hash, length_unit_in_meters_);
+  // the texture formats depend on rgb_format_supported
+  int flags[] = {static_cast<int>(num_precomputed_wavelengths_), combine_scattering_textures_, half_precision_,
+                 rgb_format_supported};
+  hash = Cache::Hash(hash, flags);
+  int sizes[] = {TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT, SCATTERING_TEXTURE_R_SIZE,
+                 SCATTERING_TEXTURE_MU_SIZE,  SCATTERING_TEXTURE_MU_S_SIZE, SCATTERING_TEXTURE_NU_SIZE,
+                 IRRADIANCE_TEXTURE_WIDTH,    IRRADIANCE_TEXTURE_HEIGHT};
+  return Cache::Hash(hash, sizes);
+}
+
+double GEngine::SAtmosphereParameters::Interpolate(const std::vector<double> &wavelengths,
+                   const std::vector<double> &wavelength_function,
+                   double wavelength) {
+  assert(wavelength_function.size() == wavelengths.size());
+  if (wavelength < wavelengths[0]) {
+    return wavelength_function[0];
+  }
+  for (unsigned int i = 0; i < wavelengths.size() - 1; ++i) {
+    if (wavelength < wavelengths[i + 1]) {
+      double u = (wavelength - wavelengths[i]) / (wavelengths[i + 1] - wavelengths[i]);
+      return wavelength_function[i] * (1.0 - u) + wavelength_function[i + 1] * u;
+    }
+  }
+  return wavelength_function[wavelength_function.size() - 1];
+}
+
+double GEngine::SAtmosphereParameters::CieColorMatchingFunctionTableValue(double wavelength, int column) {
+  if (wavelength <= kLambdaMin || wavelength >= kLambdaMax) {
+    return 0.0;
+  }
+  double u = (wavelength - kLambdaMin) / 5.0;
+  int row = static_cast<int>(std::floor(u));
+  assert(row >= 0 && row + 1 < 95);
+  assert(CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[4 * row] <= wavelength &&
+         CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[4 * (row + 1)] >= wavelength);
+  u -= row;
+  return CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[4 * row + column] * (1.0 - u) +
+      CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[4 * (row + 1) + column] * u;
+}
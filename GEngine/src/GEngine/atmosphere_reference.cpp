@@ -0,0 +1,732 @@
+#include "GEngine/atmosphere_reference.h"
+#include "GEngine/job_system.h"
+#include "GEngine/singleton.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <string>
+
+namespace {
+using GEngine::DensityProfileLayer;
+using dvec2 = glm::dvec2;
+using dvec3 = glm::dvec3;
+using dvec4 = glm::dvec4;
+
+constexpr double kPi = 3.14159265358979323846;
+
+// the ATMOSPHERE constant of the GLSL header, in length units
+struct SDensityProfile {
+  DensityProfileLayer layers_[2];
+};
+
+struct SAtmosphere {
+  dvec3 solar_irradiance_;
+  double sun_angular_radius_;
+  double bottom_radius_;
+  double top_radius_;
+  SDensityProfile rayleigh_density_;
+  dvec3 rayleigh_scattering_;
+  SDensityProfile mie_density_;
+  dvec3 mie_scattering_;
+  dvec3 mie_extinction_;
+  double mie_phase_function_g_;
+  SDensityProfile absorption_density_;
+  dvec3 absorption_extinction_;
+  dvec3 ground_albedo_;
+  double mu_s_min_;
+};
+
+// GL_LINEAR + GL_CLAMP_TO_EDGE lookups of float rgb textures
+struct STexture2D {
+  int width_;
+  int height_;
+  std::vector<glm::vec3> texels_;
+
+  STexture2D(int width, int height) : width_(width), height_(height), texels_(width * height) {}
+  glm::vec3 &At(int x, int y) { return texels_[y * width_ + x]; }
+  const glm::vec3 &At(int x, int y) const { return texels_[y * width_ + x]; }
+  dvec3 Sample(const dvec2 &uv) const;
+};
+
+struct STexture3D {
+  int width_;
+  int height_;
+  int depth_;
+  std::vector<glm::vec3> texels_;
+
+  STexture3D(int width, int height, int depth)
+      : width_(width), height_(height), depth_(depth), texels_(width * height * depth) {}
+  glm::vec3 &At(int x, int y, int z) { return texels_[(z * height_ + y) * width_ + x]; }
+  const glm::vec3 &At(int x, int y, int z) const { return texels_[(z * height_ + y) * width_ + x]; }
+  dvec3 Sample(const dvec3 &uvw) const;
+};
+
+void LinearTaps(double coord, int size, int &i0, int &i1, double &t) {
+  double x = coord * size - 0.5;
+  double x0 = std::floor(x);
+  t = x - x0;
+  i0 = std::clamp(static_cast<int>(x0), 0, size - 1);
+  i1 = std::clamp(static_cast<int>(x0) + 1, 0, size - 1);
+}
+
+dvec3 STexture2D::Sample(const dvec2 &uv) const {
+  int x0, x1, y0, y1;
+  double tx, ty;
+  LinearTaps(uv.x, width_, x0, x1, tx);
+  LinearTaps(uv.y, height_, y0, y1, ty);
+  dvec3 bottom = glm::mix(dvec3(At(x0, y0)), dvec3(At(x1, y0)), tx);
+  dvec3 top = glm::mix(dvec3(At(x0, y1)), dvec3(At(x1, y1)), tx);
+  return glm::mix(bottom, top, ty);
+}
+
+dvec3 STexture3D::Sample(const dvec3 &uvw) const {
+  int x0, x1, y0, y1, z0, z1;
+  double tx, ty, tz;
+  LinearTaps(uvw.x, width_, x0, x1, tx);
+  LinearTaps(uvw.y, height_, y0, y1, ty);
+  LinearTaps(uvw.z, depth_, z0, z1, tz);
+  auto layer = [&](int z) {
+    dvec3 bottom = glm::mix(dvec3(At(x0, y0, z)), dvec3(At(x1, y0, z)), tx);
+    dvec3 top = glm::mix(dvec3(At(x0, y1, z)), dvec3(At(x1, y1, z)), tx);
+    return glm::mix(bottom, top, ty);
+  };
+  return glm::mix(layer(z0), layer(z1), tz);
+}
+
+/* kernels, same names and structure as atmosphere_functions.glsl */
+
+double ClampCosine(double mu) { return std::clamp(mu, -1.0, 1.0); }
+
+double ClampDistance(double d) { return std::max(d, 0.0); }
+
+double ClampRadius(const SAtmosphere &atmosphere, double r) {
+  return std::clamp(r, atmosphere.bottom_radius_, atmosphere.top_radius_);
+}
+
+double SafeSqrt(double a) { return std::sqrt(std::max(a, 0.0)); }
+
+double DistanceToTopAtmosphereBoundary(const SAtmosphere &atmosphere, double r, double mu) {
+  double discriminant = r * r * (mu * mu - 1.0) + atmosphere.top_radius_ * atmosphere.top_radius_;
+  return ClampDistance(-r * mu + SafeSqrt(discriminant));
+}
+
+double DistanceToBottomAtmosphereBoundary(const SAtmosphere &atmosphere, double r, double mu) {
+  double discriminant = r * r * (mu * mu - 1.0) + atmosphere.bottom_radius_ * atmosphere.bottom_radius_;
+  return ClampDistance(-r * mu - SafeSqrt(discriminant));
+}
+
+bool RayIntersectsGround(const SAtmosphere &atmosphere, double r, double mu) {
+  return mu < 0.0 && r * r * (mu * mu - 1.0) + atmosphere.bottom_radius_ * atmosphere.bottom_radius_ >= 0.0;
+}
+
+double GetLayerDensity(const DensityProfileLayer &layer, double altitude) {
+  double density = layer.exp_term * std::exp(layer.exp_scale * altitude) + layer.linear_term * altitude +
+                   layer.constant_term;
+  return std::clamp(density, 0.0, 1.0);
+}
+
+double GetProfileDensity(const SDensityProfile &profile, double altitude) {
+  return altitude < profile.layers_[0].width ? GetLayerDensity(profile.layers_[0], altitude)
+                                             : GetLayerDensity(profile.layers_[1], altitude);
+}
+
+double ComputeOpticalLengthToTopAtmosphereBoundary(const SAtmosphere &atmosphere, const SDensityProfile &profile,
+                                                   double r, double mu) {
+  constexpr int kSampleCount = 500;
+  double dx = DistanceToTopAtmosphereBoundary(atmosphere, r, mu) / kSampleCount;
+  double result = 0.0;
+  for (int i = 0; i <= kSampleCount; ++i) {
+    double d_i = i * dx;
+    double r_i = std::sqrt(d_i * d_i + 2.0 * r * mu * d_i + r * r);
+    double y_i = GetProfileDensity(profile, r_i - atmosphere.bottom_radius_);
+    double weight_i = (i == 0 || i == kSampleCount) ? 0.5 : 1.0;
+    result += y_i * weight_i * dx;
+  }
+  return result;
+}
+
+dvec3 ComputeTransmittanceToTopAtmosphereBoundary(const SAtmosphere &atmosphere, double r, double mu) {
+  return glm::exp(
+      -(atmosphere.rayleigh_scattering_ *
+            ComputeOpticalLengthToTopAtmosphereBoundary(atmosphere, atmosphere.rayleigh_density_, r, mu) +
+        atmosphere.mie_extinction_ *
+            ComputeOpticalLengthToTopAtmosphereBoundary(atmosphere, atmosphere.mie_density_, r, mu) +
+        atmosphere.absorption_extinction_ *
+            ComputeOpticalLengthToTopAtmosphereBoundary(atmosphere, atmosphere.absorption_density_, r, mu)));
+}
+
+double GetTextureCoordFromUnitRange(double x, int texture_size) {
+  return 0.5 / texture_size + x * (1.0 - 1.0 / texture_size);
+}
+
+double GetUnitRangeFromTextureCoord(double u, int texture_size) {
+  return (u - 0.5 / texture_size) / (1.0 - 1.0 / texture_size);
+}
+
+dvec2 GetTransmittanceTextureUvFromRMu(const SAtmosphere &atmosphere, double r, double mu) {
+  double H = std::sqrt(atmosphere.top_radius_ * atmosphere.top_radius_ -
+                       atmosphere.bottom_radius_ * atmosphere.bottom_radius_);
+  double rho = SafeSqrt(r * r - atmosphere.bottom_radius_ * atmosphere.bottom_radius_);
+  double d = DistanceToTopAtmosphereBoundary(atmosphere, r, mu);
+  double d_min = atmosphere.top_radius_ - r;
+  double d_max = rho + H;
+  double x_mu = (d - d_min) / (d_max - d_min);
+  double x_r = rho / H;
+  return dvec2(GetTextureCoordFromUnitRange(x_mu, GEngine::TRANSMITTANCE_TEXTURE_WIDTH),
+               GetTextureCoordFromUnitRange(x_r, GEngine::TRANSMITTANCE_TEXTURE_HEIGHT));
+}
+
+void GetRMuFromTransmittanceTextureUv(const SAtmosphere &atmosphere, const dvec2 &uv, double &r, double &mu) {
+  double x_mu = GetUnitRangeFromTextureCoord(uv.x, GEngine::TRANSMITTANCE_TEXTURE_WIDTH);
+  double x_r = GetUnitRangeFromTextureCoord(uv.y, GEngine::TRANSMITTANCE_TEXTURE_HEIGHT);
+  double H = std::sqrt(atmosphere.top_radius_ * atmosphere.top_radius_ -
+                       atmosphere.bottom_radius_ * atmosphere.bottom_radius_);
+  double rho = H * x_r;
+  r = std::sqrt(rho * rho + atmosphere.bottom_radius_ * atmosphere.bottom_radius_);
+  double d_min = atmosphere.top_radius_ - r;
+  double d_max = rho + H;
+  double d = d_min + x_mu * (d_max - d_min);
+  mu = d == 0.0 ? 1.0 : (H * H - rho * rho - d * d) / (2.0 * r * d);
+  mu = ClampCosine(mu);
+}
+
+dvec3 GetTransmittanceToTopAtmosphereBoundary(const SAtmosphere &atmosphere, const STexture2D &transmittance_texture,
+                                              double r, double mu) {
+  return transmittance_texture.Sample(GetTransmittanceTextureUvFromRMu(atmosphere, r, mu));
+}
+
+dvec3 GetTransmittance(const SAtmosphere &atmosphere, const STexture2D &transmittance_texture, double r, double mu,
+                       double d, bool ray_r_mu_intersects_ground) {
+  double r_d = ClampRadius(atmosphere, std::sqrt(d * d + 2.0 * r * mu * d + r * r));
+  double mu_d = ClampCosine((r * mu + d) / r_d);
+  if (ray_r_mu_intersects_ground) {
+    return glm::min(GetTransmittanceToTopAtmosphereBoundary(atmosphere, transmittance_texture, r_d, -mu_d) /
+                        GetTransmittanceToTopAtmosphereBoundary(atmosphere, transmittance_texture, r, -mu),
+                    dvec3(1.0));
+  }
+  return glm::min(GetTransmittanceToTopAtmosphereBoundary(atmosphere, transmittance_texture, r, mu) /
+                      GetTransmittanceToTopAtmosphereBoundary(atmosphere, transmittance_texture, r_d, mu_d),
+                  dvec3(1.0));
+}
+
+dvec3 GetTransmittanceToSun(const SAtmosphere &atmosphere, const STexture2D &transmittance_texture, double r,
+                            double mu_s) {
+  double sin_theta_h = atmosphere.bottom_radius_ / r;
+  double cos_theta_h = -std::sqrt(std::max(1.0 - sin_theta_h * sin_theta_h, 0.0));
+  return GetTransmittanceToTopAtmosphereBoundary(atmosphere, transmittance_texture, r, mu_s) *
+         glm::smoothstep(-sin_theta_h * atmosphere.sun_angular_radius_, sin_theta_h * atmosphere.sun_angular_radius_,
+                         mu_s - cos_theta_h);
+}
+
+void ComputeSingleScatteringIntegrand(const SAtmosphere &atmosphere, const STexture2D &transmittance_texture,
+                                      double r, double mu, double mu_s, double nu, double d,
+                                      bool ray_r_mu_intersects_ground, dvec3 &rayleigh, dvec3 &mie) {
+  double r_d = ClampRadius(atmosphere, std::sqrt(d * d + 2.0 * r * mu * d + r * r));
+  double mu_s_d = ClampCosine((r * mu_s + d * nu) / r_d);
+  dvec3 transmittance =
+      GetTransmittance(atmosphere, transmittance_texture, r, mu, d, ray_r_mu_intersects_ground) *
+      GetTransmittanceToSun(atmosphere, transmittance_texture, r_d, mu_s_d);
+  rayleigh = transmittance * GetProfileDensity(atmosphere.rayleigh_density_, r_d - atmosphere.bottom_radius_);
+  mie = transmittance * GetProfileDensity(atmosphere.mie_density_, r_d - atmosphere.bottom_radius_);
+}
+
+double DistanceToNearestAtmosphereBoundary(const SAtmosphere &atmosphere, double r, double mu,
+                                           bool ray_r_mu_intersects_ground) {
+  return ray_r_mu_intersects_ground ? DistanceToBottomAtmosphereBoundary(atmosphere, r, mu)
+                                    : DistanceToTopAtmosphereBoundary(atmosphere, r, mu);
+}
+
+void ComputeSingleScattering(const SAtmosphere &atmosphere, const STexture2D &transmittance_texture, double r,
+                             double mu, double mu_s, double nu, bool ray_r_mu_intersects_ground, dvec3 &rayleigh,
+                             dvec3 &mie) {
+  constexpr int kSampleCount = 50;
+  double dx = DistanceToNearestAtmosphereBoundary(atmosphere, r, mu, ray_r_mu_intersects_ground) / kSampleCount;
+  dvec3 rayleigh_sum(0.0);
+  dvec3 mie_sum(0.0);
+  for (int i = 0; i <= kSampleCount; ++i) {
+    double d_i = i * dx;
+    dvec3 rayleigh_i;
+    dvec3 mie_i;
+    ComputeSingleScatteringIntegrand(atmosphere, transmittance_texture, r, mu, mu_s, nu, d_i,
+                                     ray_r_mu_intersects_ground, rayleigh_i, mie_i);
+    double weight_i = (i == 0 || i == kSampleCount) ? 0.5 : 1.0;
+    rayleigh_sum += rayleigh_i * weight_i;
+    mie_sum += mie_i * weight_i;
+  }
+  rayleigh = rayleigh_sum * dx * atmosphere.solar_irradiance_ * atmosphere.rayleigh_scattering_;
+  mie = mie_sum * dx * atmosphere.solar_irradiance_ * atmosphere.mie_scattering_;
+}
+
+double RayleighPhaseFunction(double nu) {
+  double k = 3.0 / (16.0 * kPi);
+  return k * (1.0 + nu * nu);
+}
+
+double MiePhaseFunction(double g, double nu) {
+  double k = 3.0 / (8.0 * kPi) * (1.0 - g * g) / (2.0 + g * g);
+  return k * (1.0 + nu * nu) / std::pow(1.0 + g * g - 2.0 * g * nu, 1.5);
+}
+
+dvec4 GetScatteringTextureUvwzFromRMuMuSNu(const SAtmosphere &atmosphere, double r, double mu, double mu_s,
+                                           double nu, bool ray_r_mu_intersects_ground) {
+  using namespace GEngine;
+  double H = std::sqrt(atmosphere.top_radius_ * atmosphere.top_radius_ -
+                       atmosphere.bottom_radius_ * atmosphere.bottom_radius_);
+  double rho = SafeSqrt(r * r - atmosphere.bottom_radius_ * atmosphere.bottom_radius_);
+  double u_r = GetTextureCoordFromUnitRange(rho / H, SCATTERING_TEXTURE_R_SIZE);
+  double r_mu = r * mu;
+  double discriminant = r_mu * r_mu - r * r + atmosphere.bottom_radius_ * atmosphere.bottom_radius_;
+  double u_mu;
+  if (ray_r_mu_intersects_ground) {
+    double d = -r_mu - SafeSqrt(discriminant);
+    double d_min = r - atmosphere.bottom_radius_;
+    double d_max = rho;
+    u_mu = 0.5 - 0.5 * GetTextureCoordFromUnitRange(d_max == d_min ? 0.0 : (d - d_min) / (d_max - d_min),
+                                                    SCATTERING_TEXTURE_MU_SIZE / 2);
+  } else {
+    double d = -r_mu + SafeSqrt(discriminant + H * H);
+    double d_min = atmosphere.top_radius_ - r;
+    double d_max = rho + H;
+    u_mu = 0.5 + 0.5 * GetTextureCoordFromUnitRange((d - d_min) / (d_max - d_min), SCATTERING_TEXTURE_MU_SIZE / 2);
+  }
+  double d = DistanceToTopAtmosphereBoundary(atmosphere, atmosphere.bottom_radius_, mu_s);
+  double d_min = atmosphere.top_radius_ - atmosphere.bottom_radius_;
+  double d_max = H;
+  double a = (d - d_min) / (d_max - d_min);
+  double D = DistanceToTopAtmosphereBoundary(atmosphere, atmosphere.bottom_radius_, atmosphere.mu_s_min_);
+  double A = (D - d_min) / (d_max - d_min);
+  double u_mu_s = GetTextureCoordFromUnitRange(std::max(1.0 - a / A, 0.0) / (1.0 + a), SCATTERING_TEXTURE_MU_S_SIZE);
+  double u_nu = (nu + 1.0) / 2.0;
+  return dvec4(u_nu, u_mu_s, u_mu, u_r);
+}
+
+void GetRMuMuSNuFromScatteringTextureUvwz(const SAtmosphere &atmosphere, const dvec4 &uvwz, double &r, double &mu,
+                                          double &mu_s, double &nu, bool &ray_r_mu_intersects_ground) {
+  using namespace GEngine;
+  double H = std::sqrt(atmosphere.top_radius_ * atmosphere.top_radius_ -
+                       atmosphere.bottom_radius_ * atmosphere.bottom_radius_);
+  double rho = H * GetUnitRangeFromTextureCoord(uvwz.w, SCATTERING_TEXTURE_R_SIZE);
+  r = std::sqrt(rho * rho + atmosphere.bottom_radius_ * atmosphere.bottom_radius_);
+  if (uvwz.z < 0.5) {
+    double d_min = r - atmosphere.bottom_radius_;
+    double d_max = rho;
+    double d = d_min + (d_max - d_min) *
+                           GetUnitRangeFromTextureCoord(1.0 - 2.0 * uvwz.z, SCATTERING_TEXTURE_MU_SIZE / 2);
+    mu = d == 0.0 ? -1.0 : ClampCosine(-(rho * rho + d * d) / (2.0 * r * d));
+    ray_r_mu_intersects_ground = true;
+  } else {
+    double d_min = atmosphere.top_radius_ - r;
+    double d_max = rho + H;
+    double d = d_min + (d_max - d_min) *
+                           GetUnitRangeFromTextureCoord(2.0 * uvwz.z - 1.0, SCATTERING_TEXTURE_MU_SIZE / 2);
+    mu = d == 0.0 ? 1.0 : ClampCosine((H * H - rho * rho - d * d) / (2.0 * r * d));
+    ray_r_mu_intersects_ground = false;
+  }
+  double x_mu_s = GetUnitRangeFromTextureCoord(uvwz.y, SCATTERING_TEXTURE_MU_S_SIZE);
+  double d_min = atmosphere.top_radius_ - atmosphere.bottom_radius_;
+  double d_max = H;
+  double D = DistanceToTopAtmosphereBoundary(atmosphere, atmosphere.bottom_radius_, atmosphere.mu_s_min_);
+  double A = (D - d_min) / (d_max - d_min);
+  double a = (A - x_mu_s * A) / (1.0 + x_mu_s * A);
+  double d = d_min + std::min(a, A) * (d_max - d_min);
+  mu_s = d == 0.0 ? 1.0 : ClampCosine((H * H - d * d) / (2.0 * atmosphere.bottom_radius_ * d));
+  nu = ClampCosine(uvwz.x * 2.0 - 1.0);
+}
+
+void GetRMuMuSNuFromScatteringTextureFragCoord(const SAtmosphere &atmosphere, const dvec3 &frag_coord, double &r,
+                                               double &mu, double &mu_s, double &nu,
+                                               bool &ray_r_mu_intersects_ground) {
+  using namespace GEngine;
+  const dvec4 kScatteringTextureSize(SCATTERING_TEXTURE_NU_SIZE - 1, SCATTERING_TEXTURE_MU_S_SIZE,
+                                     SCATTERING_TEXTURE_MU_SIZE, SCATTERING_TEXTURE_R_SIZE);
+  double frag_coord_nu = std::floor(frag_coord.x / SCATTERING_TEXTURE_MU_S_SIZE);
+  double frag_coord_mu_s = std::fmod(frag_coord.x, static_cast<double>(SCATTERING_TEXTURE_MU_S_SIZE));
+  dvec4 uvwz = dvec4(frag_coord_nu, frag_coord_mu_s, frag_coord.y, frag_coord.z) / kScatteringTextureSize;
+  GetRMuMuSNuFromScatteringTextureUvwz(atmosphere, uvwz, r, mu, mu_s, nu, ray_r_mu_intersects_ground);
+  nu = std::clamp(nu, mu * mu_s - std::sqrt((1.0 - mu * mu) * (1.0 - mu_s * mu_s)),
+                  mu * mu_s + std::sqrt((1.0 - mu * mu) * (1.0 - mu_s * mu_s)));
+}
+
+dvec3 GetScattering(const SAtmosphere &atmosphere, const STexture3D &scattering_texture, double r, double mu,
+                    double mu_s, double nu, bool ray_r_mu_intersects_ground) {
+  using namespace GEngine;
+  dvec4 uvwz = GetScatteringTextureUvwzFromRMuMuSNu(atmosphere, r, mu, mu_s, nu, ray_r_mu_intersects_ground);
+  double tex_coord_x = uvwz.x * (SCATTERING_TEXTURE_NU_SIZE - 1);
+  double tex_x = std::floor(tex_coord_x);
+  double lerp = tex_coord_x - tex_x;
+  dvec3 uvw0((tex_x + uvwz.y) / SCATTERING_TEXTURE_NU_SIZE, uvwz.z, uvwz.w);
+  dvec3 uvw1((tex_x + 1.0 + uvwz.y) / SCATTERING_TEXTURE_NU_SIZE, uvwz.z, uvwz.w);
+  return scattering_texture.Sample(uvw0) * (1.0 - lerp) + scattering_texture.Sample(uvw1) * lerp;
+}
+
+dvec3 GetScattering(const SAtmosphere &atmosphere, const STexture3D &single_rayleigh_scattering_texture,
+                    const STexture3D &single_mie_scattering_texture, const STexture3D &multiple_scattering_texture,
+                    double r, double mu, double mu_s, double nu, bool ray_r_mu_intersects_ground,
+                    int scattering_order) {
+  if (scattering_order == 1) {
+    dvec3 rayleigh =
+        GetScattering(atmosphere, single_rayleigh_scattering_texture, r, mu, mu_s, nu, ray_r_mu_intersects_ground);
+    dvec3 mie =
+        GetScattering(atmosphere, single_mie_scattering_texture, r, mu, mu_s, nu, ray_r_mu_intersects_ground);
+    return rayleigh * RayleighPhaseFunction(nu) + mie * MiePhaseFunction(atmosphere.mie_phase_function_g_, nu);
+  }
+  return GetScattering(atmosphere, multiple_scattering_texture, r, mu, mu_s, nu, ray_r_mu_intersects_ground);
+}
+
+dvec2 GetIrradianceTextureUvFromRMuS(const SAtmosphere &atmosphere, double r, double mu_s) {
+  double x_r = (r - atmosphere.bottom_radius_) / (atmosphere.top_radius_ - atmosphere.bottom_radius_);
+  double x_mu_s = mu_s * 0.5 + 0.5;
+  return dvec2(GetTextureCoordFromUnitRange(x_mu_s, GEngine::IRRADIANCE_TEXTURE_WIDTH),
+               GetTextureCoordFromUnitRange(x_r, GEngine::IRRADIANCE_TEXTURE_HEIGHT));
+}
+
+void GetRMuSFromIrradianceTextureUv(const SAtmosphere &atmosphere, const dvec2 &uv, double &r, double &mu_s) {
+  double x_mu_s = GetUnitRangeFromTextureCoord(uv.x, GEngine::IRRADIANCE_TEXTURE_WIDTH);
+  double x_r = GetUnitRangeFromTextureCoord(uv.y, GEngine::IRRADIANCE_TEXTURE_HEIGHT);
+  r = atmosphere.bottom_radius_ + x_r * (atmosphere.top_radius_ - atmosphere.bottom_radius_);
+  mu_s = ClampCosine(2.0 * x_mu_s - 1.0);
+}
+
+dvec3 GetIrradiance(const SAtmosphere &atmosphere, const STexture2D &irradiance_texture, double r, double mu_s) {
+  return irradiance_texture.Sample(GetIrradianceTextureUvFromRMuS(atmosphere, r, mu_s));
+}
+
+dvec3 ComputeScatteringDensity(const SAtmosphere &atmosphere, const STexture2D &transmittance_texture,
+                               const STexture3D &single_rayleigh_scattering_texture,
+                               const STexture3D &single_mie_scattering_texture,
+                               const STexture3D &multiple_scattering_texture, const STexture2D &irradiance_texture,
+                               double r, double mu, double mu_s, double nu, int scattering_order) {
+  dvec3 zenith_direction(0.0, 0.0, 1.0);
+  dvec3 omega(std::sqrt(1.0 - mu * mu), 0.0, mu);
+  double sun_dir_x = omega.x == 0.0 ? 0.0 : (nu - mu * mu_s) / omega.x;
+  double sun_dir_y = std::sqrt(std::max(1.0 - sun_dir_x * sun_dir_x - mu_s * mu_s, 0.0));
+  dvec3 omega_s(sun_dir_x, sun_dir_y, mu_s);
+
+  constexpr int kSampleCount = 16;
+  constexpr double dphi = kPi / kSampleCount;
+  constexpr double dtheta = kPi / kSampleCount;
+  // the density at the texel doesn't depend on the direction
+  double rayleigh_density = GetProfileDensity(atmosphere.rayleigh_density_, r - atmosphere.bottom_radius_);
+  double mie_density = GetProfileDensity(atmosphere.mie_density_, r - atmosphere.bottom_radius_);
+  dvec3 rayleigh_mie(0.0);
+  for (int l = 0; l < kSampleCount; ++l) {
+    double theta = (l + 0.5) * dtheta;
+    double cos_theta = std::cos(theta);
+    double sin_theta = std::sin(theta);
+    bool ray_r_theta_intersects_ground = RayIntersectsGround(atmosphere, r, cos_theta);
+    double distance_to_ground = 0.0;
+    dvec3 transmittance_to_ground(0.0);
+    dvec3 ground_albedo(0.0);
+    if (ray_r_theta_intersects_ground) {
+      distance_to_ground = DistanceToBottomAtmosphereBoundary(atmosphere, r, cos_theta);
+      transmittance_to_ground =
+          GetTransmittance(atmosphere, transmittance_texture, r, cos_theta, distance_to_ground, true);
+      ground_albedo = atmosphere.ground_albedo_;
+    }
+    for (int m = 0; m < 2 * kSampleCount; ++m) {
+      double phi = (m + 0.5) * dphi;
+      dvec3 omega_i(std::cos(phi) * sin_theta, std::sin(phi) * sin_theta, cos_theta);
+      double domega_i = dtheta * dphi * std::sin(theta);
+      double nu1 = glm::dot(omega_s, omega_i);
+      dvec3 incident_radiance = GetScattering(atmosphere, single_rayleigh_scattering_texture,
+                                              single_mie_scattering_texture, multiple_scattering_texture, r,
+                                              omega_i.z, mu_s, nu1, ray_r_theta_intersects_ground,
+                                              scattering_order - 1);
+      dvec3 ground_normal = glm::normalize(zenith_direction * r + omega_i * distance_to_ground);
+      dvec3 ground_irradiance =
+          GetIrradiance(atmosphere, irradiance_texture, atmosphere.bottom_radius_, glm::dot(ground_normal, omega_s));
+      incident_radiance += transmittance_to_ground * ground_albedo * (1.0 / kPi) * ground_irradiance;
+      double nu2 = glm::dot(omega, omega_i);
+      rayleigh_mie += incident_radiance *
+                      (atmosphere.rayleigh_scattering_ * rayleigh_density * RayleighPhaseFunction(nu2) +
+                       atmosphere.mie_scattering_ * mie_density *
+                           MiePhaseFunction(atmosphere.mie_phase_function_g_, nu2)) *
+                      domega_i;
+    }
+  }
+  return rayleigh_mie;
+}
+
+dvec3 ComputeMultipleScattering(const SAtmosphere &atmosphere, const STexture2D &transmittance_texture,
+                                const STexture3D &scattering_density_texture, double r, double mu, double mu_s,
+                                double nu, bool ray_r_mu_intersects_ground) {
+  constexpr int kSampleCount = 50;
+  double dx = DistanceToNearestAtmosphereBoundary(atmosphere, r, mu, ray_r_mu_intersects_ground) / kSampleCount;
+  dvec3 rayleigh_mie_sum(0.0);
+  for (int i = 0; i <= kSampleCount; ++i) {
+    double d_i = i * dx;
+    double r_i = ClampRadius(atmosphere, std::sqrt(d_i * d_i + 2.0 * r * mu * d_i + r * r));
+    double mu_i = ClampCosine((r * mu + d_i) / r_i);
+    double mu_s_i = ClampCosine((r * mu_s + d_i * nu) / r_i);
+    dvec3 rayleigh_mie_i =
+        GetScattering(atmosphere, scattering_density_texture, r_i, mu_i, mu_s_i, nu, ray_r_mu_intersects_ground) *
+        GetTransmittance(atmosphere, transmittance_texture, r, mu, d_i, ray_r_mu_intersects_ground) * dx;
+    double weight_i = (i == 0 || i == kSampleCount) ? 0.5 : 1.0;
+    rayleigh_mie_sum += rayleigh_mie_i * weight_i;
+  }
+  return rayleigh_mie_sum;
+}
+
+dvec3 ComputeDirectIrradiance(const SAtmosphere &atmosphere, const STexture2D &transmittance_texture, double r,
+                              double mu_s) {
+  double alpha_s = atmosphere.sun_angular_radius_;
+  double average_cosine_factor =
+      mu_s < -alpha_s ? 0.0 : (mu_s > alpha_s ? mu_s : (mu_s + alpha_s) * (mu_s + alpha_s) / (4.0 * alpha_s));
+  return atmosphere.solar_irradiance_ *
+         GetTransmittanceToTopAtmosphereBoundary(atmosphere, transmittance_texture, r, mu_s) * average_cosine_factor;
+}
+
+dvec3 ComputeIndirectIrradiance(const SAtmosphere &atmosphere, const STexture3D &single_rayleigh_scattering_texture,
+                                const STexture3D &single_mie_scattering_texture,
+                                const STexture3D &multiple_scattering_texture, double r, double mu_s,
+                                int scattering_order) {
+  constexpr int kSampleCount = 32;
+  constexpr double dphi = kPi / kSampleCount;
+  constexpr double dtheta = kPi / kSampleCount;
+  dvec3 result(0.0);
+  dvec3 omega_s(std::sqrt(1.0 - mu_s * mu_s), 0.0, mu_s);
+  for (int j = 0; j < kSampleCount / 2; ++j) {
+    double theta = (j + 0.5) * dtheta;
+    for (int i = 0; i < 2 * kSampleCount; ++i) {
+      double phi = (i + 0.5) * dphi;
+      dvec3 omega(std::cos(phi) * std::sin(theta), std::sin(phi) * std::sin(theta), std::cos(theta));
+      double domega = dtheta * dphi * std::sin(theta);
+      double nu = glm::dot(omega, omega_s);
+      result += GetScattering(atmosphere, single_rayleigh_scattering_texture, single_mie_scattering_texture,
+                              multiple_scattering_texture, r, omega.z, mu_s, nu, false, scattering_order) *
+                omega.z * domega;
+    }
+  }
+  return result;
+}
+
+/* texture drivers, one call per fragment shader of PrecomputedAtmosphereModel::Precompute */
+
+// func(x, y, z) for every texel, rows of all layers spread over the workers
+template <typename Func> void ForEachTexel(int width, int height, int depth, const Func &func) {
+  GEngine::CSingleton<GEngine::CJobSystem>()->ParallelFor(
+      static_cast<unsigned int>(height * depth), 4, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int row = begin; row < end; ++row) {
+          int y = static_cast<int>(row) % height;
+          int z = static_cast<int>(row) / height;
+          for (int x = 0; x < width; ++x) {
+            func(x, y, z);
+          }
+        }
+      });
+}
+
+// the GLSL header prints the constants with std::to_string, round the same
+// way so a diff against the GPU measures the kernels
+double GlslConstant(double value) { return std::stod(std::to_string(value)); }
+
+SDensityProfile ResolveProfile(std::vector<DensityProfileLayer> layers, double length_unit_in_meters) {
+  while (layers.size() < 2) {
+    layers.insert(layers.begin(), DensityProfileLayer());
+  }
+  SDensityProfile profile;
+  for (int i = 0; i < 2; ++i) {
+    profile.layers_[i] = DensityProfileLayer(GlslConstant(layers[i].width / length_unit_in_meters),
+                                             GlslConstant(layers[i].exp_term),
+                                             GlslConstant(layers[i].exp_scale * length_unit_in_meters),
+                                             GlslConstant(layers[i].linear_term * length_unit_in_meters),
+                                             GlslConstant(layers[i].constant_term));
+  }
+  return profile;
+}
+
+SAtmosphere ResolveAtmosphere(const GEngine::SAtmosphereParameters &parameters, const std::array<double, 3> &lambdas) {
+  auto spectrum = [&](const std::vector<double> &values, double scale) {
+    dvec3 result;
+    for (int i = 0; i < 3; ++i) {
+      result[i] = GlslConstant(
+          GEngine::SAtmosphereParameters::Interpolate(parameters.wavelengths_, values, lambdas[i]) * scale);
+    }
+    return result;
+  };
+  double unit = parameters.length_unit_in_meters_;
+  SAtmosphere atmosphere;
+  atmosphere.solar_irradiance_ = spectrum(parameters.solar_irradiance_, 1.0);
+  atmosphere.sun_angular_radius_ = GlslConstant(parameters.sun_angular_radius_);
+  atmosphere.bottom_radius_ = GlslConstant(parameters.bottom_radius_ / unit);
+  atmosphere.top_radius_ = GlslConstant(parameters.top_radius_ / unit);
+  atmosphere.rayleigh_density_ = ResolveProfile(parameters.rayleigh_density_, unit);
+  atmosphere.rayleigh_scattering_ = spectrum(parameters.rayleigh_scattering_, unit);
+  atmosphere.mie_density_ = ResolveProfile(parameters.mie_density_, unit);
+  atmosphere.mie_scattering_ = spectrum(parameters.mie_scattering_, unit);
+  atmosphere.mie_extinction_ = spectrum(parameters.mie_extinction_, unit);
+  atmosphere.mie_phase_function_g_ = GlslConstant(parameters.mie_phase_function_g_);
+  atmosphere.absorption_density_ = ResolveProfile(parameters.absorption_density_, unit);
+  atmosphere.absorption_extinction_ = spectrum(parameters.absorption_extinction_, unit);
+  atmosphere.ground_albedo_ = spectrum(parameters.ground_albedo_, 1.0);
+  atmosphere.mu_s_min_ = GlslConstant(std::cos(parameters.max_sun_zenith_angle_));
+  return atmosphere;
+}
+
+// luminance_from_radiance * radiance, the matrix is row major like the transposed uniform
+glm::vec3 ToLuminance(const std::array<float, 9> &m, const dvec3 &radiance) {
+  return glm::vec3(m[0] * radiance.x + m[1] * radiance.y + m[2] * radiance.z,
+                   m[3] * radiance.x + m[4] * radiance.y + m[5] * radiance.z,
+                   m[6] * radiance.x + m[7] * radiance.y + m[8] * radiance.z);
+}
+
+void ComputeTransmittanceTexture(const SAtmosphere &atmosphere, STexture2D &transmittance) {
+  ForEachTexel(transmittance.width_, transmittance.height_, 1, [&](int x, int y, int) {
+    dvec2 uv((x + 0.5) / transmittance.width_, (y + 0.5) / transmittance.height_);
+    double r, mu;
+    GetRMuFromTransmittanceTextureUv(atmosphere, uv, r, mu);
+    transmittance.At(x, y) = ComputeTransmittanceToTopAtmosphereBoundary(atmosphere, r, mu);
+  });
+}
+
+GEngine::CAtmosphereReference::SImage NewImage(int width, int height, int depth) {
+  GEngine::CAtmosphereReference::SImage image;
+  image.width_ = width;
+  image.height_ = height;
+  image.depth_ = depth;
+  image.texels_.assign(static_cast<size_t>(width) * height * depth, glm::vec4(0.0f));
+  return image;
+}
+} // namespace
+
+GEngine::CAtmosphereReference::SLuts GEngine::CAtmosphereReference::Precompute(const SAtmosphereParameters &parameters,
+                                                                               unsigned int num_scattering_orders) {
+  SLuts luts;
+  luts.transmittance_ = NewImage(TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT, 1);
+  luts.scattering_ = NewImage(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH);
+  luts.single_mie_scattering_ =
+      NewImage(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH);
+  luts.irradiance_ = NewImage(IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT, 1);
+
+  STexture2D transmittance(TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT);
+  STexture2D delta_irradiance(IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT);
+  STexture3D delta_rayleigh(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH);
+  STexture3D delta_mie(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH);
+  STexture3D delta_scattering_density(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH);
+  // aliased like delta_multiple_scattering_texture on the GPU
+  STexture3D &delta_multiple = delta_rayleigh;
+  auto scattering_index = [](int x, int y, int z) {
+    return (static_cast<size_t>(z) * SCATTERING_TEXTURE_HEIGHT + y) * SCATTERING_TEXTURE_WIDTH + x;
+  };
+  auto frag_coord = [](int x, int y, int z) { return dvec3(x + 0.5, y + 0.5, z + 0.5); };
+
+  std::vector<SAtmosphereParameters::SWavelengthBatch> batches = parameters.GetWavelengthBatches();
+  for (size_t batch = 0; batch < batches.size(); ++batch) {
+    SAtmosphere atmosphere = ResolveAtmosphere(parameters, batches[batch].lambdas_);
+    const auto &luminance_from_radiance = batches[batch].luminance_from_radiance_;
+    bool blend = batch > 0;
+
+    ComputeTransmittanceTexture(atmosphere, transmittance);
+
+    // direct irradiance goes to delta_irradiance only, the irradiance LUT
+    // keeps the sky irradiance
+    ForEachTexel(IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT, 1, [&](int x, int y, int) {
+      double r, mu_s;
+      GetRMuSFromIrradianceTextureUv(
+          atmosphere, dvec2((x + 0.5) / IRRADIANCE_TEXTURE_WIDTH, (y + 0.5) / IRRADIANCE_TEXTURE_HEIGHT), r, mu_s);
+      delta_irradiance.At(x, y) = ComputeDirectIrradiance(atmosphere, transmittance, r, mu_s);
+      if (!blend) {
+        luts.irradiance_.texels_[y * IRRADIANCE_TEXTURE_WIDTH + x] = glm::vec4(0.0f);
+      }
+    });
+
+    ForEachTexel(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH,
+                 [&](int x, int y, int z) {
+                   double r, mu, mu_s, nu;
+                   bool ray_r_mu_intersects_ground;
+                   GetRMuMuSNuFromScatteringTextureFragCoord(atmosphere, frag_coord(x, y, z), r, mu, mu_s, nu,
+                                                             ray_r_mu_intersects_ground);
+                   dvec3 rayleigh, mie;
+                   ComputeSingleScattering(atmosphere, transmittance, r, mu, mu_s, nu, ray_r_mu_intersects_ground,
+                                           rayleigh, mie);
+                   delta_rayleigh.At(x, y, z) = rayleigh;
+                   delta_mie.At(x, y, z) = mie;
+                   glm::vec3 rayleigh_luminance = ToLuminance(luminance_from_radiance, dvec3(glm::vec3(rayleigh)));
+                   glm::vec3 mie_luminance = ToLuminance(luminance_from_radiance, dvec3(glm::vec3(mie)));
+                   size_t index = scattering_index(x, y, z);
+                   glm::vec4 scattering(rayleigh_luminance, mie_luminance.r);
+                   glm::vec4 single_mie(mie_luminance, 0.0f);
+                   luts.scattering_.texels_[index] = blend ? luts.scattering_.texels_[index] + scattering : scattering;
+                   luts.single_mie_scattering_.texels_[index] =
+                       blend ? luts.single_mie_scattering_.texels_[index] + single_mie : single_mie;
+                 });
+
+    for (unsigned int scattering_order = 2; scattering_order <= num_scattering_orders; ++scattering_order) {
+      ForEachTexel(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH,
+                   [&](int x, int y, int z) {
+                     double r, mu, mu_s, nu;
+                     bool ray_r_mu_intersects_ground;
+                     GetRMuMuSNuFromScatteringTextureFragCoord(atmosphere, frag_coord(x, y, z), r, mu, mu_s, nu,
+                                                               ray_r_mu_intersects_ground);
+                     delta_scattering_density.At(x, y, z) = ComputeScatteringDensity(
+                         atmosphere, transmittance, delta_rayleigh, delta_mie, delta_multiple, delta_irradiance, r,
+                         mu, mu_s, nu, static_cast<int>(scattering_order));
+                   });
+
+      // the density step above was the last to read delta_irradiance
+      ForEachTexel(IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT, 1, [&](int x, int y, int) {
+        double r, mu_s;
+        GetRMuSFromIrradianceTextureUv(
+            atmosphere, dvec2((x + 0.5) / IRRADIANCE_TEXTURE_WIDTH, (y + 0.5) / IRRADIANCE_TEXTURE_HEIGHT), r, mu_s);
+        dvec3 irradiance = ComputeIndirectIrradiance(atmosphere, delta_rayleigh, delta_mie, delta_multiple, r, mu_s,
+                                                     static_cast<int>(scattering_order) - 1);
+        delta_irradiance.At(x, y) = irradiance;
+        luts.irradiance_.texels_[y * IRRADIANCE_TEXTURE_WIDTH + x] +=
+            glm::vec4(ToLuminance(luminance_from_radiance, dvec3(glm::vec3(irradiance))), 0.0f);
+      });
+
+      // delta_multiple aliases delta_rayleigh, which the density step above
+      // was the last to read
+      ForEachTexel(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH,
+                   [&](int x, int y, int z) {
+                     double r, mu, mu_s, nu;
+                     bool ray_r_mu_intersects_ground;
+                     GetRMuMuSNuFromScatteringTextureFragCoord(atmosphere, frag_coord(x, y, z), r, mu, mu_s, nu,
+                                                               ray_r_mu_intersects_ground);
+                     dvec3 multiple = ComputeMultipleScattering(atmosphere, transmittance, delta_scattering_density, r,
+                                                                mu, mu_s, nu, ray_r_mu_intersects_ground);
+                     delta_multiple.At(x, y, z) = multiple;
+                     luts.scattering_.texels_[scattering_index(x, y, z)] += glm::vec4(
+                         ToLuminance(luminance_from_radiance, dvec3(glm::vec3(multiple)) / RayleighPhaseFunction(nu)),
+                         0.0f);
+                   });
+    }
+  }
+
+  if (batches.size() > 1) {
+    // the batches left the transmittance of the last wavelengths
+    ComputeTransmittanceTexture(
+        ResolveAtmosphere(parameters, {SAtmosphereParameters::kLambdaR, SAtmosphereParameters::kLambdaG,
+                                       SAtmosphereParameters::kLambdaB}),
+        transmittance);
+  }
+  for (size_t i = 0; i < transmittance.texels_.size(); ++i) {
+    luts.transmittance_.texels_[i] = glm::vec4(transmittance.texels_[i], 0.0f);
+  }
+  return luts;
+}
+
+GEngine::CAtmosphereReference::SDiff GEngine::CAtmosphereReference::Compare(const SImage &image,
+                                                                            const SImage &reference, int channels) {
+  SDiff diff;
+  if (image.texels_.size() != reference.texels_.size() || image.texels_.empty()) {
+    diff.max_abs_error_ = diff.max_rel_error_ = diff.rmse_ = std::numeric_limits<double>::infinity();
+    return diff;
+  }
+  double squared_sum = 0.0;
+  for (size_t i = 0; i < image.texels_.size(); ++i) {
+    for (int c = 0; c < channels; ++c) {
+      double value = image.texels_[i][c];
+      double expected = reference.texels_[i][c];
+      double error = std::abs(value - expected);
+      diff.max_abs_error_ = std::max(diff.max_abs_error_, error);
+      if (std::abs(expected) > kRelativeEpsilon) {
+        diff.max_rel_error_ = std::max(diff.max_rel_error_, error / std::abs(expected));
+      }
+      squared_sum += error * error;
+    }
+  }
+  diff.rmse_ = std::sqrt(squared_sum / (static_cast<double>(image.texels_.size()) * channels));
+  return diff;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "GEngine/atmosphere_parameters.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace GEngine {
+// C++ port of the Bruneton precomputation kernels (atmosphere_functions.glsl):
+// transmittance, direct/indirect irradiance, single scattering, scattering
+// density and multiple scattering, run in the same order as
+// PrecomputedAtmosphereModel::Init with the texels of every texture (rows of
+// every 3D layer) spread over the CJobSystem workers. GL free, so LUTs can be
+// baked offline and the GPU textures diffed against it.
+class CAtmosphereReference {
+public:
+  // rgba texels, x fastest then y then layers, like glGetTexImage
+  struct SImage {
+    int width_ = 0;
+    int height_ = 0;
+    int depth_ = 1;
+    std::vector<glm::vec4> texels_;
+  };
+  // the layouts of the PrecomputedAtmosphereModel textures, scattering_ holds
+  // rayleigh + multiple scattering in rgb and the single mie red channel in a
+  struct SLuts {
+    SImage transmittance_;
+    SImage scattering_;
+    SImage single_mie_scattering_;
+    SImage irradiance_;
+  };
+  struct SDiff {
+    double max_abs_error_ = 0.0;
+    // relative to the reference texel, texels below kRelativeEpsilon skipped
+    double max_rel_error_ = 0.0;
+    double rmse_ = 0.0;
+  };
+  static constexpr double kRelativeEpsilon = 1e-6;
+
+  // the job system must be initialized, half_precision_ is ignored (float textures)
+  static SLuts Precompute(const SAtmosphereParameters &parameters, unsigned int num_scattering_orders = 4);
+  // the first channels of two images of the same size
+  static SDiff Compare(const SImage &image, const SImage &reference, int channels);
+};
+} // namespace GEngine
@@ -0,0 +1,69 @@
+#include "GEngine/bounds.h"
+#include <cmath>
+
+void GEngine::SAABB::Expand(const glm::vec3 &point) {
+  min_ = glm::min(min_, point);
+  max_ = glm::max(max_, point);
+}
+
+void GEngine::SAABB::Expand(const SAABB &other) {
+  if (!other.IsValid()) {
+    return;
+  }
+  min_ = glm::min(min_, other.min_);
+  max_ = glm::max(max_, other.max_);
+}
+
+GEngine::SAABB GEngine::SAABB::Transform(const glm::mat4 &matrix) const {
+  if (!IsValid()) {
+    return *this;
+  }
+  // Arvo's method: center + |M| * extent
+  glm::vec3 center = glm::vec3(matrix * glm::vec4(GetCenter(), 1.0f));
+  glm::vec3 extent = GetExtent();
+  glm::vec3 new_extent(0.0f);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      new_extent[i] += std::abs(matrix[j][i]) * extent[j];
+    }
+  }
+  SAABB result;
+  result.min_ = center - new_extent;
+  result.max_ = center + new_extent;
+  return result;
+}
+
+GEngine::CFrustum::CFrustum() {
+  for (auto &plane : planes_) {
+    plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+  }
+}
+
+GEngine::CFrustum::CFrustum(const glm::mat4 &view_projection) { Update(view_projection); }
+
+void GEngine::CFrustum::Update(const glm::mat4 &view_projection) {
+  // Gribb & Hartmann, rows of the matrix
+  glm::mat4 m = glm::transpose(view_projection);
+  planes_[0] = m[3] + m[0]; // left
+  planes_[1] = m[3] - m[0]; // right
+  planes_[2] = m[3] + m[1]; // bottom
+  planes_[3] = m[3] - m[1]; // top
+  planes_[4] = m[3] + m[2]; // near
+  planes_[5] = m[3] - m[2]; // far
+  for (auto &plane : planes_) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+}
+
+bool GEngine::CFrustum::IsBoxVisible(const SAABB &box) const {
+  glm::vec3 center = box.GetCenter();
+  glm::vec3 extent = box.GetExtent();
+  for (const auto &plane : planes_) {
+    glm::vec3 normal(plane);
+    float radius = glm::dot(extent, glm::abs(normal));
+    if (glm::dot(normal, center) + plane.w < -radius) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <limits>
+
+namespace GEngine {
+// axis aligned bounding box
+struct SAABB {
+  glm::vec3 min_ = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 max_ = glm::vec3(-std::numeric_limits<float>::max());
+
+  bool IsValid() const { return min_.x <= max_.x && min_.y <= max_.y && min_.z <= max_.z; }
+  glm::vec3 GetCenter() const { return (min_ + max_) * 0.5f; }
+  glm::vec3 GetExtent() const { return (max_ - min_) * 0.5f; }
+
+  void Expand(const glm::vec3 &point);
+  void Expand(const SAABB &other);
+  // bounds of the transformed box
+  SAABB Transform(const glm::mat4 &matrix) const;
+};
+
+// the 6 planes of a view-projection matrix, normals point inside
+class CFrustum {
+public:
+  CFrustum();
+  explicit CFrustum(const glm::mat4 &view_projection);
+
+  void Update(const glm::mat4 &view_projection);
+  bool IsBoxVisible(const SAABB &box) const;
+
+private:
+  glm::vec4 planes_[6];
+};
+} // namespace GEngine
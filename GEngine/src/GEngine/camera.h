@@ -31,6 +31,8 @@ public:
   };
 
   float GetFOV() const { return fov_; };
+  float GetNear() const { return near_; }
+  float GetFar() const { return far_; }
 
   bool GetCameraStatus() const { return camera_status_; }
   void SetCameraStatus(bool camera_status) { camera_status_ = camera_status; }
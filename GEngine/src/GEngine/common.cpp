@@ -1,4 +1,6 @@
 #include "GEngine/common.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/singleton.h"
 
 #include<GLFW/glfw3.h>
 
@@ -32,7 +34,7 @@ void SaveShaderToFile(const GLuint shader, const std::string& filename) {
 void SaveTexture(const GLenum texture_unit, const GLenum texture_target,
     const int texture_size, const std::string& filename) {
   std::unique_ptr<float[]> pixels(new float[texture_size * 4]);
-  glActiveTexture(texture_unit);
+  GEngine::CSingleton<GEngine::CGLStateCache>()->ActiveTexture(texture_unit);
   glGetTexImage(texture_target, 0, GL_RGBA, GL_FLOAT, pixels.get());
 
   std::ofstream output_stream(
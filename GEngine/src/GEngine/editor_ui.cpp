@@ -1,9 +1,15 @@
 #include "editor_ui.h"
 #include "app.h"
 #include "glfw_window.h"
+#include "ibl_cache.h"
 #include "imgui.h"
 #include "log.h"
+#include "program_cache.h"
+#include "shader_hot_reload.h"
 #include "render_system.h"
+#include "shader.h"
+#include "texture_streamer.h"
+#include "texture_upload_queue.h"
 #include <glm/glm.hpp>
 
 GEngine::CEditorUI::CEditorUI()
@@ -86,6 +92,62 @@ void GEngine::CEditorUI::Tick() {
     }
   }
 
+  // render pipeline switches
+  if (ImGui::CollapsingHeader("Pipeline")) {
+    ImGui::Checkbox("Depth pre-pass", &depth_prepass_);
+    ImGui::Combo("Occlusion culling", &occlusion_mode_, "Off\0Hi-Z\0Software\0");
+    if (ImGui::Checkbox("Shader hot reload", &shader_hot_reload_)) {
+      shader_hot_reload_ ? CSingleton<CShaderHotReload>()->Start() : CSingleton<CShaderHotReload>()->Stop();
+    }
+    ImGui::Checkbox("Material texture arrays", &material_texture_arrays_);
+    if (ImGui::SliderInt("Texture budget (MB)", &texture_budget_mb_, 32, 2048)) {
+      CSingleton<CTextureStreamer>()->SetBudget(static_cast<size_t>(texture_budget_mb_) << 20);
+    }
+    if (ImGui::SliderInt("Texture uploads (MB/frame)", &texture_upload_mb_, 1, 64)) {
+      CSingleton<CTextureUploadQueue>()->SetBytesPerFrame(static_cast<size_t>(texture_upload_mb_) << 20);
+    }
+    ImGui::Checkbox("Atmosphere compute precompute", &atmosphere_compute_precompute_);
+    if (ImGui::SameLine(); ImGui::Button("Precompute")) {
+      atmosphere_precompute_requested_ = true;
+    }
+    ImGui::Checkbox("Atmosphere sky-view LUT", &atmosphere_sky_view_lut_);
+    ImGui::Checkbox("Atmosphere IBL", &atmosphere_sky_capture_);
+  }
+
+  // per-frame counters & timings
+  if (ImGui::CollapsingHeader("Stats")) {
+    const auto &stats = CSingleton<CRenderSystem>()->GetRenderStats();
+    ImGui::Text("Depth pre-pass: %.3f ms (gpu), %u draws", stats.depth_prepass_ms_, stats.depth_prepass_draw_calls_);
+    ImGui::Text("Lit pass: %.3f ms (gpu)", stats.lit_pass_ms_);
+    ImGui::Text("Shader variants: %u, program switches: %u", stats.lit_shader_variants_, stats.lit_program_switches_);
+    ImGui::Text("Material texture arrays: %u arrays, %u layers, %u material binds", stats.material_texture_arrays_,
+                stats.material_texture_layers_, stats.lit_material_binds_);
+    ImGui::Text("Instancing: %u instances, %u draws", stats.instances_drawn_, stats.instanced_draw_calls_);
+    ImGui::Text("Program cache: %u hits, %u misses", CSingleton<CProgramCache>()->GetHitCount(),
+                CSingleton<CProgramCache>()->GetMissCount());
+    ImGui::Text("Programs still compiling: %zu", Shader::GetPendingProgramCount());
+    ImGui::Text("Shader reloads: %u, failed: %u", CSingleton<CShaderHotReload>()->GetReloadCount(),
+                CSingleton<CShaderHotReload>()->GetFailedReloadCount());
+    ImGui::Text("Occlusion culling: %.3f ms, %u/%u culled", stats.occlusion_cull_ms_, stats.occlusion_culled_, stats.occlusion_tested_);
+    ImGui::Text("Light clusters: %.3f ms", stats.light_cluster_build_ms_);
+    ImGui::Text("Lights: %u, light indices: %u", stats.cluster_light_count_, stats.cluster_light_index_count_);
+    ImGui::Text("Shadow cascades updated: %u, draw calls: %u", stats.shadow_cascades_updated_, stats.shadow_draw_calls_);
+    ImGui::Text("Texture streaming: %u textures, %.1f/%d MB resident", stats.streamed_textures_,
+                stats.streamed_resident_mb_, texture_budget_mb_);
+    ImGui::Text("Streamed levels: %u uploaded, %u evicted", stats.streamed_levels_uploaded_,
+                stats.streamed_levels_evicted_);
+    ImGui::Text("Texture uploads: %.2f MB this frame, %.1f MB queued", stats.texture_uploaded_mb_,
+                stats.texture_upload_pending_mb_);
+    ImGui::Text("GL state calls: %u issued, %u filtered", stats.gl_state_calls_issued_, stats.gl_state_calls_filtered_);
+    ImGui::Text("Atmosphere precompute: %.1f ms, %s, %u draws, %u dispatches", stats.atmosphere_precompute_ms_,
+                stats.atmosphere_compute_precompute_ ? "compute" : "fragment", stats.atmosphere_precompute_draw_calls_,
+                stats.atmosphere_precompute_dispatches_);
+    ImGui::Text("Sky-view LUT updates: %u", stats.sky_view_lut_updates_);
+    ImGui::Text("Dynamic IBL updates: %u", stats.ibl_dynamic_updates_);
+    ImGui::Text("IBL cache: %u hits, %u misses", CSingleton<CIBLCache>()->GetHitCount(),
+                CSingleton<CIBLCache>()->GetMissCount());
+  }
+
   // Precomputed Atmospherical Scattering
   if (ImGui::CollapsingHeader("Precomputed Scattering")) {
     ImGui::SliderFloat("height(Km)", &distance_, 7000.0f, 15000.0f);
@@ -95,6 +157,18 @@ void GEngine::CEditorUI::Tick() {
       view_angle_[0] = 1.57;
     ImGui::DragFloat2("sun angle", sun_angle_, 0.005f, -3.14f, 3.14f);
     ImGui::SliderFloat("exposure", &exposure_, 1.0f, 200.0f);
+    ImGui::Checkbox("ozone", &atmosphere_ozone_);
+    ImGui::SliderFloat("mie g", &atmosphere_mie_g_, 0.0f, 0.99f);
+    ImGui::SliderFloat("ground albedo", &atmosphere_ground_albedo_, 0.0f, 1.0f);
+    ImGui::SliderInt("precompute layers/frame", &atmosphere_layers_per_frame_, 1, 64);
+    if (atmosphere_precompute_progress_ < 1.0f) {
+      ImGui::ProgressBar(atmosphere_precompute_progress_, ImVec2(-1.0f, 0.0f), "re-precomputing");
+    }
+    ImGui::Checkbox("aerial perspective", &aerial_perspective_);
+    ImGui::SliderFloat("aerial perspective distance", &aerial_perspective_distance_, 10.0f, 20000.0f, "%.0f",
+                       ImGuiSliderFlags_Logarithmic);
+    ImGui::SliderFloat("meters per unit", &scene_meters_per_unit_, 0.01f, 100.0f, "%.2f",
+                       ImGuiSliderFlags_Logarithmic);
 
     ImGui::Text("DisplayContent");
     static int e = 0;
@@ -26,9 +26,43 @@ public:
   float sun_angle_[2] = {1.2, 0.7};
   float exposure_ = 10.0f;
 
+  // render pipeline switches
+  bool depth_prepass_ = true;
+  // 0: frustum only, 1: Hi-Z (gpu depth readback), 2: software occluders
+  int occlusion_mode_ = 0;
+  // rebuild programs when their .glsl files (or includes) are saved
+  bool shader_hot_reload_ = true;
+  // lit pass reads material textures from texture arrays, no per-draw binds
+  bool material_texture_arrays_ = true;
+  // CTextureStreamer budget
+  int texture_budget_mb_ = 256;
+  // CTextureUploadQueue cap
+  int texture_upload_mb_ = 8;
+  // atmosphere LUTs precomputed by compute shaders when GL 4.3 is available,
+  // the button re-precomputes them (bypassing the LUT cache) to time the path
+  bool atmosphere_compute_precompute_ = true;
+  bool atmosphere_precompute_requested_ = false;
+  // the sky pass samples a lat/long sky-view LUT instead of the 4D scattering
+  // lookup per pixel
+  bool atmosphere_sky_view_lut_ = true;
+  // the atmosphere renders the sky into a cubemap CIBLPass filters, both a
+  // face or a mip per frame
+  bool atmosphere_sky_capture_ = true;
+
   // for precomputed atmosphere scattering
   int texture_level_ = 0; 
   int display_content_ = 0;
+  // physical parameters, changes re-precompute the LUTs time-sliced
+  bool atmosphere_ozone_ = true;
+  float atmosphere_mie_g_ = 0.8f;
+  float atmosphere_ground_albedo_ = 0.1f;
+  // per-frame budget of the re-precomputation, in scattering texture layers
+  int atmosphere_layers_per_frame_ = 8;
+  float atmosphere_precompute_progress_ = 1.0f;
+  // aerial perspective froxels applied by the lit passes
+  bool aerial_perspective_ = true;
+  float aerial_perspective_distance_ = 2000.0f; // scene units
+  float scene_meters_per_unit_ = 1.0f;
 
 private:
   float sphere_color_[4] = {0.7f, 0.05f, 0.05f, 1.0f};  
@@ -1,10 +1,13 @@
 #include "GEngine/framebuffer.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/singleton.h"
 
 GEngine::CFrameBuffer::CFrameBuffer() {
   glGenFramebuffers(1, &id_);
 }
 
 GEngine::CFrameBuffer::~CFrameBuffer() {
+  CSingleton<CGLStateCache>()->OnFramebufferDeleted(id_);
   glDeleteFramebuffers(1, &id_);
 }
 
@@ -34,14 +37,14 @@ void GEngine::CFrameBuffer::SetStencilAttachment(const CAttachment &attachment)
 
 void GEngine::CFrameBuffer::SetAttachment(GLenum attachment_point,
                                           const CAttachment &attachment) {
-  glBindFramebuffer(GL_FRAMEBUFFER, id_);
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, id_);
   switch (attachment.GetType()) {
   case CAttachment::EAttachmentType::kNone:
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment_point, GL_RENDERBUFFER, 0);
     break;
   case CAttachment::EAttachmentType::kTexture:
     if(auto texture = attachment.GetTexture()){
-      glBindTexture(static_cast<GLenum>(texture->GetTarget()), texture->id_);
+      CSingleton<CGLStateCache>()->BindTexture(static_cast<GLenum>(texture->GetTarget()), texture->id_);
       // fixme: ibl_pass
       glFramebufferTexture(GL_FRAMEBUFFER, attachment_point, texture->id_, 0);
       // glFramebufferTexture(GL_FRAMEBUFFER, attachment_point, static_cast<GLenum>(texture->GetTarget()), texture->id_);
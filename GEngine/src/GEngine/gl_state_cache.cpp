@@ -0,0 +1,182 @@
+#include "GEngine/gl_state_cache.h"
+
+GEngine::CGLStateCache::CGLStateCache() { Invalidate(); }
+
+int GEngine::CGLStateCache::GetTargetIndex(GLenum target) {
+  switch (target) {
+  case GL_TEXTURE_2D:
+    return 0;
+  case GL_TEXTURE_3D:
+    return 1;
+  case GL_TEXTURE_CUBE_MAP:
+    return 2;
+  case GL_TEXTURE_2D_ARRAY:
+    return 3;
+  case GL_TEXTURE_BUFFER:
+    return 4;
+  default:
+    return -1;
+  }
+}
+
+bool GEngine::CGLStateCache::Filter(bool redundant) {
+  if (redundant) {
+    filtered_++;
+  } else {
+    issued_++;
+  }
+  return redundant;
+}
+
+void GEngine::CGLStateCache::UseProgram(GLuint program) {
+  if (Filter(program == program_)) {
+    return;
+  }
+  glUseProgram(program);
+  program_ = program;
+}
+
+void GEngine::CGLStateCache::BindVertexArray(GLuint vertex_array) {
+  if (Filter(vertex_array == vertex_array_)) {
+    return;
+  }
+  glBindVertexArray(vertex_array);
+  vertex_array_ = vertex_array;
+}
+
+void GEngine::CGLStateCache::ActiveTexture(GLenum unit) {
+  GLuint index = unit - GL_TEXTURE0;
+  if (Filter(index == active_unit_)) {
+    return;
+  }
+  glActiveTexture(unit);
+  active_unit_ = index;
+}
+
+void GEngine::CGLStateCache::BindTexture(GLenum target, GLuint texture) {
+  int target_index = GetTargetIndex(target);
+  GLuint *cached = nullptr;
+  if (target_index >= 0 && active_unit_ < kMaxTextureUnits) {
+    cached = &textures_[active_unit_][target_index];
+  }
+  if (Filter(cached && *cached == texture)) {
+    return;
+  }
+  glBindTexture(target, texture);
+  if (cached) {
+    *cached = texture;
+  }
+}
+
+void GEngine::CGLStateCache::BindTextureUnit(GLuint unit, GLenum target, GLuint texture) {
+  int target_index = GetTargetIndex(target);
+  if (target_index >= 0 && unit < kMaxTextureUnits && textures_[unit][target_index] == texture) {
+    // skip the glActiveTexture too
+    Filter(true);
+    return;
+  }
+  ActiveTexture(GL_TEXTURE0 + unit);
+  BindTexture(target, texture);
+}
+
+void GEngine::CGLStateCache::BindFramebuffer(GLenum target, GLuint framebuffer) {
+  bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+  bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+  if (Filter((!draw || draw_framebuffer_ == framebuffer) && (!read || read_framebuffer_ == framebuffer))) {
+    return;
+  }
+  glBindFramebuffer(target, framebuffer);
+  if (draw) {
+    draw_framebuffer_ = framebuffer;
+  }
+  if (read) {
+    read_framebuffer_ = framebuffer;
+  }
+}
+
+void GEngine::CGLStateCache::Viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+  std::array<GLint, 4> viewport = {x, y, width, height};
+  if (Filter(viewport_known_ && viewport == viewport_)) {
+    return;
+  }
+  glViewport(x, y, width, height);
+  viewport_ = viewport;
+  viewport_known_ = true;
+}
+
+void GEngine::CGLStateCache::SetEnabled(GLenum capability, bool enabled) {
+  auto it = enabled_.find(capability);
+  if (Filter(it != enabled_.end() && it->second == enabled)) {
+    return;
+  }
+  enabled ? glEnable(capability) : glDisable(capability);
+  enabled_[capability] = enabled;
+}
+
+bool GEngine::CGLStateCache::IsEnabled(GLenum capability) {
+  auto it = enabled_.find(capability);
+  if (it != enabled_.end()) {
+    return it->second;
+  }
+  bool enabled = glIsEnabled(capability) == GL_TRUE;
+  enabled_[capability] = enabled;
+  return enabled;
+}
+
+std::array<GLint, 4> GEngine::CGLStateCache::GetViewport() {
+  if (!viewport_known_) {
+    glGetIntegerv(GL_VIEWPORT, viewport_.data());
+    viewport_known_ = true;
+  }
+  return viewport_;
+}
+
+void GEngine::CGLStateCache::OnProgramDeleted(GLuint program) {
+  if (program_ == program) {
+    program_ = kUnknown;
+  }
+}
+
+void GEngine::CGLStateCache::OnTextureDeleted(GLuint texture) {
+  // GL unbinds it from every unit
+  for (auto &unit : textures_) {
+    for (auto &bound : unit) {
+      if (bound == texture) {
+        bound = 0;
+      }
+    }
+  }
+}
+
+void GEngine::CGLStateCache::OnVertexArrayDeleted(GLuint vertex_array) {
+  if (vertex_array_ == vertex_array) {
+    vertex_array_ = 0;
+  }
+}
+
+void GEngine::CGLStateCache::OnFramebufferDeleted(GLuint framebuffer) {
+  if (draw_framebuffer_ == framebuffer) {
+    draw_framebuffer_ = 0;
+  }
+  if (read_framebuffer_ == framebuffer) {
+    read_framebuffer_ = 0;
+  }
+}
+
+void GEngine::CGLStateCache::Invalidate() {
+  program_ = kUnknown;
+  vertex_array_ = kUnknown;
+  active_unit_ = kUnknown;
+  for (auto &unit : textures_) {
+    unit.fill(kUnknown);
+  }
+  draw_framebuffer_ = kUnknown;
+  read_framebuffer_ = kUnknown;
+  viewport_known_ = false;
+  enabled_.clear();
+}
+
+void GEngine::CGLStateCache::ResetCounters() {
+  issued_ = 0;
+  filtered_ = 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <glad/glad.h>
+#include <array>
+#include <unordered_map>
+
+namespace GEngine {
+// be sure to call CGLStateCache method with CSingleton<CGLStateCache>()->func();
+// shadow copy of the GL binding state (program, VAO, textures per unit,
+// framebuffers, viewport, enable bits), calls that would not change anything
+// are dropped. State starts unknown, the first call is always issued. Code
+// that talks to GL directly (ImGui, the atmosphere model) has to call
+// Invalidate() when it is done.
+class CGLStateCache {
+public:
+  CGLStateCache();
+
+  void UseProgram(GLuint program);
+  void BindVertexArray(GLuint vertex_array);
+  // unit is GL_TEXTURE0 + i, like glActiveTexture
+  void ActiveTexture(GLenum unit);
+  // on the active unit
+  void BindTexture(GLenum target, GLuint texture);
+  // the unit is only switched if the bind is not redundant
+  void BindTextureUnit(GLuint unit, GLenum target, GLuint texture);
+  void BindFramebuffer(GLenum target, GLuint framebuffer);
+  void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+  void Enable(GLenum capability) { SetEnabled(capability, true); }
+  void Disable(GLenum capability) { SetEnabled(capability, false); }
+  void SetEnabled(GLenum capability, bool enabled);
+
+  // the shadow copy, queried from GL (once) while unknown. For passes that
+  // change the state and restore what they found
+  bool IsEnabled(GLenum capability);
+  std::array<GLint, 4> GetViewport();
+
+  // before glDelete*, the names may be reused by new objects
+  void OnProgramDeleted(GLuint program);
+  void OnTextureDeleted(GLuint texture);
+  void OnVertexArrayDeleted(GLuint vertex_array);
+  void OnFramebufferDeleted(GLuint framebuffer);
+
+  void Invalidate();
+
+  unsigned int GetIssuedCount() const { return issued_; }
+  unsigned int GetFilteredCount() const { return filtered_; }
+  void ResetCounters();
+
+private:
+  static constexpr GLuint kUnknown = 0xFFFFFFFFu;
+  static constexpr int kMaxTextureUnits = 32;
+  // GL_TEXTURE_2D, 3D, CUBE_MAP, 2D_ARRAY, BUFFER, other targets are not cached
+  static constexpr int kTextureTargetCount = 5;
+  static int GetTargetIndex(GLenum target);
+
+  bool Filter(bool redundant);
+
+  GLuint program_ = kUnknown;
+  GLuint vertex_array_ = kUnknown;
+  GLuint active_unit_ = kUnknown; // index, not GL_TEXTUREi
+  std::array<std::array<GLuint, kTextureTargetCount>, kMaxTextureUnits> textures_;
+  GLuint draw_framebuffer_ = kUnknown;
+  GLuint read_framebuffer_ = kUnknown;
+  std::array<GLint, 4> viewport_;
+  bool viewport_known_ = false;
+  // missing: unknown
+  std::unordered_map<GLenum, bool> enabled_;
+
+  unsigned int issued_ = 0;
+  unsigned int filtered_ = 0;
+};
+} // namespace GEngine
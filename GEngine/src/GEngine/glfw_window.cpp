@@ -1,4 +1,6 @@
 #include "glfw_window.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/singleton.h"
 #include "common.h"
 #include <iostream>
 #include "log.h"
@@ -43,10 +45,10 @@ void GEngine::CGLFWWindow::Init() {
 
 void GEngine::CGLFWWindow::SetViewport() {
   int factor = WINDOW_CONFIG::IS_MACOS_WINDOW ? 2 : 1;
-  glViewport(static_cast<GLint>(WINDOW_CONFIG::VIEWPORT_LOWERLEFT_X),
-             static_cast<GLint>(WINDOW_CONFIG::VIEWPORT_LOWERLEFT_Y),
-             static_cast<GLsizei>(WINDOW_CONFIG::VIEWPORT_WIDTH * factor),
-             static_cast<GLsizei>(WINDOW_CONFIG::VIEWPORT_HEIGHT * factor));
+  CSingleton<CGLStateCache>()->Viewport(static_cast<GLint>(WINDOW_CONFIG::VIEWPORT_LOWERLEFT_X),
+                                        static_cast<GLint>(WINDOW_CONFIG::VIEWPORT_LOWERLEFT_Y),
+                                        static_cast<GLsizei>(WINDOW_CONFIG::VIEWPORT_WIDTH * factor),
+                                        static_cast<GLsizei>(WINDOW_CONFIG::VIEWPORT_HEIGHT * factor));
 }
 
 GLFWwindow* GEngine::CGLFWWindow::GetGLFWwindow() const {
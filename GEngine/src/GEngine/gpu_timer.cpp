@@ -0,0 +1,42 @@
+#include "GEngine/gpu_timer.h"
+
+GEngine::CGPUTimer::CGPUTimer() {}
+
+GEngine::CGPUTimer::~CGPUTimer() {
+  if (queries_[0] != 0) {
+    glDeleteQueries(kQueryCount, queries_);
+  }
+}
+
+void GEngine::CGPUTimer::Begin() {
+  if (queries_[0] == 0) {
+    glGenQueries(kQueryCount, queries_);
+  }
+  CollectResults();
+  glBeginQuery(GL_TIME_ELAPSED, queries_[current_]);
+}
+
+void GEngine::CGPUTimer::End() {
+  glEndQuery(GL_TIME_ELAPSED);
+  pending_[current_] = true;
+  current_ = (current_ + 1) % kQueryCount;
+}
+
+void GEngine::CGPUTimer::CollectResults() {
+  // oldest first, so elapsed_ms_ ends up with the newest finished query
+  for (int i = 0; i < kQueryCount; i++) {
+    int index = (current_ + i) % kQueryCount;
+    if (!pending_[index]) {
+      continue;
+    }
+    GLint available = 0;
+    glGetQueryObjectiv(queries_[index], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+      continue;
+    }
+    GLuint64 elapsed_ns = 0;
+    glGetQueryObjectui64v(queries_[index], GL_QUERY_RESULT, &elapsed_ns);
+    elapsed_ms_ = static_cast<float>(elapsed_ns) * 1e-6f;
+    pending_[index] = false;
+  }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <glad/glad.h>
+
+namespace GEngine {
+// GL_TIME_ELAPSED query ring, results are read a few frames later so the
+// cpu never waits on the gpu. Timers can't be nested.
+class CGPUTimer {
+public:
+  CGPUTimer();
+  ~CGPUTimer();
+  CGPUTimer(const CGPUTimer &) = delete;
+  CGPUTimer &operator=(const CGPUTimer &) = delete;
+
+  void Begin();
+  void End();
+  // latest available measurement
+  float GetElapsedMs() const { return elapsed_ms_; }
+
+private:
+  void CollectResults();
+
+  static constexpr int kQueryCount = 4;
+  unsigned int queries_[kQueryCount] = {0};
+  bool pending_[kQueryCount] = {false};
+  int current_ = 0;
+  float elapsed_ms_ = 0.0f;
+};
+} // namespace GEngine
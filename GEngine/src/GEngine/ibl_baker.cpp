@@ -0,0 +1,268 @@
+#include "GEngine/ibl_baker.h"
+#include "GEngine/job_system.h"
+#include "GEngine/singleton.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr float kPi = 3.14159265358979f;
+
+// the face and (sc, tc) of a direction, inverse of CSphericalHarmonics::CubemapDirection
+int FaceCoordinates(const glm::vec3 &d, float &sc, float &tc) {
+  glm::vec3 a = glm::abs(d);
+  if (a.x >= a.y && a.x >= a.z) {
+    sc = (d.x > 0.0f ? -d.z : d.z) / a.x;
+    tc = -d.y / a.x;
+    return d.x > 0.0f ? 0 : 1;
+  }
+  if (a.y >= a.z) {
+    sc = d.x / a.y;
+    tc = (d.y > 0.0f ? d.z : -d.z) / a.y;
+    return d.y > 0.0f ? 2 : 3;
+  }
+  sc = (d.z > 0.0f ? d.x : -d.x) / a.z;
+  tc = -d.y / a.z;
+  return d.z > 0.0f ? 4 : 5;
+}
+
+// bilinear within the face, clamped at its edges
+glm::vec3 SampleLevel(const GEngine::CIBLBaker::SCubemapLevel &level, const glm::vec3 &direction) {
+  float sc, tc;
+  int face = FaceCoordinates(direction, sc, tc);
+  int size = level.size_;
+  float u = std::clamp((sc + 1.0f) * 0.5f * size - 0.5f, 0.0f, size - 1.0f);
+  float v = std::clamp((tc + 1.0f) * 0.5f * size - 0.5f, 0.0f, size - 1.0f);
+  int x0 = static_cast<int>(u);
+  int y0 = static_cast<int>(v);
+  int x1 = std::min(x0 + 1, size - 1);
+  int y1 = std::min(y0 + 1, size - 1);
+  float fx = u - x0;
+  float fy = v - y0;
+  const std::vector<glm::vec3> &texels = level.faces_[face];
+  glm::vec3 top = glm::mix(texels[y0 * size + x0], texels[y0 * size + x1], fx);
+  glm::vec3 bottom = glm::mix(texels[y1 * size + x0], texels[y1 * size + x1], fx);
+  return glm::mix(top, bottom, fy);
+}
+
+// http://holger.dammertz.org/stuff/notes_HammersleyOnHemisphere.html
+glm::vec2 Hammersley(unsigned int i, unsigned int count) {
+  uint32_t bits = i;
+  bits = (bits << 16u) | (bits >> 16u);
+  bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+  bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+  bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+  bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+  return glm::vec2(static_cast<float>(i) / static_cast<float>(count), static_cast<float>(bits) * 2.3283064365386963e-10f);
+}
+
+// the GGX distributed half vector around n
+glm::vec3 ImportanceSampleGGX(const glm::vec2 &xi, const glm::vec3 &n, float roughness) {
+  float a = roughness * roughness;
+  float phi = 2.0f * kPi * xi.x;
+  float cos_theta = std::sqrt((1.0f - xi.y) / (1.0f + (a * a - 1.0f) * xi.y));
+  float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
+  glm::vec3 h(std::cos(phi) * sin_theta, std::sin(phi) * sin_theta, cos_theta);
+  glm::vec3 up = std::abs(n.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+  glm::vec3 tangent = glm::normalize(glm::cross(up, n));
+  glm::vec3 bitangent = glm::cross(n, tangent);
+  return glm::normalize(tangent * h.x + bitangent * h.y + n * h.z);
+}
+
+// Schlick-GGX with the IBL k = roughness^2 / 2
+float GeometrySchlickGGX(float n_dot_v, float roughness) {
+  float k = roughness * roughness / 2.0f;
+  return n_dot_v / (n_dot_v * (1.0f - k) + k);
+}
+} // namespace
+
+unsigned int GEngine::SIBLBakeSettings::GetPrefilteredSampleCount(float roughness) const {
+  if (roughness <= 0.0f) {
+    return 1;
+  }
+  if (!filtered_importance_sampling_) {
+    return prefiltered_samples_;
+  }
+  return std::max(kMinPrefilteredSamples, static_cast<unsigned int>(std::ceil(prefiltered_samples_ * roughness)));
+}
+
+GEngine::CIBLBaker::SCubemapLevel GEngine::CIBLBaker::FromPixels(const std::array<const uint8_t *, 6> &faces,
+                                                                 int size, int channels) {
+  SCubemapLevel level;
+  level.size_ = size;
+  for (int face = 0; face < 6; face++) {
+    level.faces_[face].resize(static_cast<size_t>(size) * size);
+    const uint8_t *pixels = faces[face];
+    for (auto &texel : level.faces_[face]) {
+      // a single channel face is uploaded as GL_RED
+      texel = channels >= 3 ? glm::vec3(pixels[0], pixels[1], pixels[2]) : glm::vec3(pixels[0], 0.0f, 0.0f);
+      texel /= 255.0f;
+      pixels += channels;
+    }
+  }
+  return level;
+}
+
+std::vector<GEngine::CIBLBaker::SCubemapLevel> GEngine::CIBLBaker::BuildMipChain(SCubemapLevel level0) {
+  std::vector<SCubemapLevel> chain;
+  chain.push_back(std::move(level0));
+  while (chain.back().size_ > 1) {
+    const SCubemapLevel &source = chain.back();
+    SCubemapLevel level;
+    level.size_ = source.size_ / 2;
+    for (int face = 0; face < 6; face++) {
+      level.faces_[face].resize(static_cast<size_t>(level.size_) * level.size_);
+      const std::vector<glm::vec3> &texels = source.faces_[face];
+      for (int y = 0; y < level.size_; y++) {
+        for (int x = 0; x < level.size_; x++) {
+          int sx = x * 2, sy = y * 2, s = source.size_;
+          level.faces_[face][y * level.size_ + x] = 0.25f * (texels[sy * s + sx] + texels[sy * s + sx + 1] +
+                                                             texels[(sy + 1) * s + sx] + texels[(sy + 1) * s + sx + 1]);
+        }
+      }
+    }
+    chain.push_back(std::move(level));
+  }
+  return chain;
+}
+
+glm::vec3 GEngine::CIBLBaker::Sample(const std::vector<SCubemapLevel> &chain, const glm::vec3 &direction,
+                                     float lod) {
+  lod = std::clamp(lod, 0.0f, static_cast<float>(chain.size() - 1));
+  int level = static_cast<int>(lod);
+  float blend = lod - level;
+  glm::vec3 color = SampleLevel(chain[level], direction);
+  if (blend > 0.0f && level + 1 < static_cast<int>(chain.size())) {
+    color = glm::mix(color, SampleLevel(chain[level + 1], direction), blend);
+  }
+  return color;
+}
+
+GEngine::CIBLBaker::SResult GEngine::CIBLBaker::Bake(const std::vector<SCubemapLevel> &chain,
+                                                     const SIBLBakeSettings &settings) {
+  SResult result;
+  result.irradiance_ = ProjectIrradiance(chain);
+  result.prefiltered_ = Prefilter(chain, settings);
+  result.brdf_lut_ = IntegrateBRDF(settings.brdf_lut_size_, settings.brdf_lut_samples_);
+  return result;
+}
+
+GEngine::SIrradianceSH GEngine::CIBLBaker::ProjectIrradiance(const std::vector<SCubemapLevel> &chain) {
+  size_t index = 0;
+  while (chain[index].size_ > kIrradianceSHSize && index + 1 < chain.size()) {
+    index++;
+  }
+  const SCubemapLevel &level = chain[index];
+  std::array<const float *, 6> faces;
+  for (int face = 0; face < 6; face++) {
+    faces[face] = &level.faces_[face][0].x;
+  }
+  return CSphericalHarmonics::ProjectCubemap(faces, level.size_, 3);
+}
+
+std::vector<GEngine::CIBLBaker::SCubemapLevel> GEngine::CIBLBaker::Prefilter(const std::vector<SCubemapLevel> &chain,
+                                                                            const SIBLBakeSettings &settings,
+                                                                            bool reference) {
+  int levels = settings.prefiltered_levels_;
+  std::vector<SCubemapLevel> result(levels);
+  float source_size = static_cast<float>(chain[0].size_);
+  float texel_solid_angle = 4.0f * kPi / (6.0f * source_size * source_size);
+  for (int l = 0; l < levels; l++) {
+    SCubemapLevel &level = result[l];
+    level.size_ = std::max(1, settings.prefiltered_size_ >> l);
+    for (auto &face : level.faces_) {
+      face.resize(static_cast<size_t>(level.size_) * level.size_);
+    }
+    float roughness = levels > 1 ? static_cast<float>(l) / static_cast<float>(levels - 1) : 0.0f;
+    // the lod the GPU derives from the screen space derivatives of the direction
+    float target_lod = std::log2(source_size / static_cast<float>(level.size_));
+
+    // the half vectors around +z and their source lods are the same for every texel
+    struct SSample {
+      glm::vec3 h_;
+      float lod_;
+    };
+    std::vector<SSample> samples;
+    unsigned int sample_count = reference ? settings.prefiltered_samples_
+                                          : settings.GetPrefilteredSampleCount(roughness);
+    if (roughness == 0.0f) {
+      // a mirror lobe, every sample is n
+      samples.push_back({glm::vec3(0.0f, 0.0f, 1.0f), reference ? 0.0f : target_lod});
+    } else {
+      float a2 = roughness * roughness * roughness * roughness;
+      for (unsigned int i = 0; i < sample_count; i++) {
+        glm::vec3 h = ImportanceSampleGGX(Hammersley(i, sample_count), glm::vec3(0.0f, 0.0f, 1.0f), roughness);
+        if (2.0f * h.z * h.z - 1.0f <= 0.0f) {
+          continue;
+        }
+        float lod = reference ? 0.0f : target_lod;
+        if (!reference && settings.filtered_importance_sampling_) {
+          // pdf of l with n = v: D(h) (n.h) / (4 (v.h)) = D(h) / 4
+          float d = h.z * h.z * (a2 - 1.0f) + 1.0f;
+          float pdf = a2 / (kPi * d * d) / 4.0f;
+          float sample_solid_angle = 1.0f / (static_cast<float>(sample_count) * pdf + 0.0001f);
+          lod = std::max(0.5f * std::log2(sample_solid_angle / texel_solid_angle) + 1.0f, 0.0f);
+        }
+        samples.push_back({h, lod});
+      }
+    }
+
+    unsigned int rows = static_cast<unsigned int>(6 * level.size_);
+    CSingleton<CJobSystem>()->ParallelFor(rows, 4, [&](unsigned int begin, unsigned int end) {
+      for (unsigned int row = begin; row < end; row++) {
+        int face = static_cast<int>(row) / level.size_;
+        int y = static_cast<int>(row) % level.size_;
+        float tc = -1.0f + (y + 0.5f) * 2.0f / level.size_;
+        for (int x = 0; x < level.size_; x++) {
+          float sc = -1.0f + (x + 0.5f) * 2.0f / level.size_;
+          glm::vec3 n = glm::normalize(CSphericalHarmonics::CubemapDirection(face, sc, tc));
+          glm::vec3 up = std::abs(n.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+          glm::vec3 tangent = glm::normalize(glm::cross(up, n));
+          glm::vec3 bitangent = glm::cross(n, tangent);
+          glm::vec3 sum(0.0f);
+          float weight = 0.0f;
+          for (const SSample &sample : samples) {
+            glm::vec3 h = tangent * sample.h_.x + bitangent * sample.h_.y + n * sample.h_.z;
+            float n_dot_l = 2.0f * sample.h_.z * sample.h_.z - 1.0f;
+            glm::vec3 l = glm::normalize(2.0f * sample.h_.z * h - n);
+            sum += Sample(chain, l, sample.lod_) * n_dot_l;
+            weight += n_dot_l;
+          }
+          level.faces_[face][y * level.size_ + x] = sum / weight;
+        }
+      }
+    });
+  }
+  return result;
+}
+
+std::vector<glm::vec2> GEngine::CIBLBaker::IntegrateBRDF(int size, unsigned int sample_count) {
+  std::vector<glm::vec2> lut(static_cast<size_t>(size) * size);
+  const glm::vec3 n(0.0f, 0.0f, 1.0f);
+  CSingleton<CJobSystem>()->ParallelFor(static_cast<unsigned int>(size), 4, [&](unsigned int begin, unsigned int end) {
+    for (unsigned int y = begin; y < end; y++) {
+      float roughness = (y + 0.5f) / size;
+      for (int x = 0; x < size; x++) {
+        float n_dot_v = (x + 0.5f) / size;
+        glm::vec3 v(std::sqrt(1.0f - n_dot_v * n_dot_v), 0.0f, n_dot_v);
+        float scale = 0.0f;
+        float bias = 0.0f;
+        for (unsigned int i = 0; i < sample_count; i++) {
+          glm::vec3 h = ImportanceSampleGGX(Hammersley(i, sample_count), n, roughness);
+          glm::vec3 l = glm::normalize(2.0f * glm::dot(v, h) * h - v);
+          float n_dot_l = std::max(l.z, 0.0f);
+          if (n_dot_l > 0.0f) {
+            float n_dot_h = std::max(h.z, 0.0f);
+            float v_dot_h = std::max(glm::dot(v, h), 0.0f);
+            float g = GeometrySchlickGGX(n_dot_v, roughness) * GeometrySchlickGGX(n_dot_l, roughness);
+            float g_vis = g * v_dot_h / (n_dot_h * n_dot_v);
+            float fc = std::pow(1.0f - v_dot_h, 5.0f);
+            scale += (1.0f - fc) * g_vis;
+            bias += fc * g_vis;
+          }
+        }
+        lut[y * size + x] = glm::vec2(scale, bias) / static_cast<float>(sample_count);
+      }
+    }
+  });
+  return lut;
+}
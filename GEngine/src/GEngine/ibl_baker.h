@@ -0,0 +1,66 @@
+#pragma once
+#include "GEngine/spherical_harmonics.h"
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace GEngine {
+// what CIBLPass bakes from a skybox, part of the CIBLCache key
+struct SIBLBakeSettings {
+  // the prefiltered cubemap, roughness level / (levels - 1) in mip level
+  int prefiltered_size_ = 256;
+  int prefiltered_levels_ = 8;
+  // filtered importance sampling (Krivanek & Colbert, GPU Gems 3 ch. 20): a
+  // sample reads the source mip whose texel solid angle matches the one of
+  // the sample from its GGX pdf. Without it every sample reads the mip of
+  // the target texel size, like the derivatives of the direction select
+  bool filtered_importance_sampling_ = true;
+  // samples of the roughest level, fewer in proportion to the roughness
+  // with filtered importance sampling, the same on every rough level without
+  unsigned int prefiltered_samples_ = 1024;
+  // split sum scale & bias, NdotV in x and roughness in y
+  int brdf_lut_size_ = 512;
+  unsigned int brdf_lut_samples_ = 1024;
+
+  static constexpr unsigned int kMinPrefilteredSamples = 64;
+  // 1 for the mirror level (roughness 0)
+  unsigned int GetPrefilteredSampleCount(float roughness) const;
+};
+
+// CPU port of the IBL bake (ibl_sh_frag, ibl_prefiltered_frag and
+// ibl_brdf_frag.glsl): SH9 irradiance, GGX prefiltered mips and the BRDF
+// LUT, texels spread over the CJobSystem workers. GL free, for the offline
+// baker of headless builds.
+class CIBLBaker {
+public:
+  // rgb texels of the 6 faces in the GL order, rows from tc = -1 like glGetTexImage
+  struct SCubemapLevel {
+    int size_ = 0;
+    std::array<std::vector<glm::vec3>, 6> faces_;
+  };
+  struct SResult {
+    SIrradianceSH irradiance_;
+    std::vector<SCubemapLevel> prefiltered_;
+    std::vector<glm::vec2> brdf_lut_;
+  };
+
+  // rgb or rgba 8 bit faces like CSkyboxPass uploads them (linear, / 255)
+  static SCubemapLevel FromPixels(const std::array<const uint8_t *, 6> &faces, int size, int channels);
+  // level 0 then 2x2 box filtered levels down to 1x1, like glGenerateMipmap
+  static std::vector<SCubemapLevel> BuildMipChain(SCubemapLevel level0);
+  // trilinear, lod in source levels
+  static glm::vec3 Sample(const std::vector<SCubemapLevel> &chain, const glm::vec3 &direction, float lod);
+
+  // the job system must be initialized
+  static SResult Bake(const std::vector<SCubemapLevel> &chain, const SIBLBakeSettings &settings);
+  static SIrradianceSH ProjectIrradiance(const std::vector<SCubemapLevel> &chain);
+  // reference: every sample from level 0, the ground truth of the benchmark
+  static std::vector<SCubemapLevel> Prefilter(const std::vector<SCubemapLevel> &chain,
+                                              const SIBLBakeSettings &settings, bool reference = false);
+  static std::vector<glm::vec2> IntegrateBRDF(int size, unsigned int sample_count);
+
+  // the first level of at most this size is projected to SH, like CIBLPass
+  static constexpr int kIrradianceSHSize = 128;
+};
+} // namespace GEngine
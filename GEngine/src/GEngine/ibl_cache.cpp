@@ -0,0 +1,171 @@
+#include "GEngine/ibl_cache.h"
+#include "GEngine/atmosphere_lut_cache.h"
+#include "GEngine/log.h"
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+constexpr uint32_t kCacheMagic = 0x434c4249; // "IBLC"
+// bump when the bake (shaders or CIBLBaker) changes the contents
+constexpr uint32_t kCacheVersion = 2;
+
+size_t PrefilteredHalfCount(int size, int levels) {
+  size_t count = 0;
+  for (int level = 0; level < levels; level++) {
+    size_t level_size = static_cast<size_t>(std::max(1, size >> level));
+    count += 6 * level_size * level_size * 3;
+  }
+  return count;
+}
+
+template <typename T> void ReadVector(std::ifstream &file, std::vector<T> &values, size_t count) {
+  values.resize(count);
+  file.read(reinterpret_cast<char *>(values.data()), static_cast<std::streamsize>(count * sizeof(T)));
+}
+
+template <typename T> void WriteVector(std::ofstream &file, const std::vector<T> &values) {
+  file.write(reinterpret_cast<const char *>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+}
+} // namespace
+
+uint64_t GEngine::CIBLCache::HashFace(int width, int height, int channels, const uint8_t *pixels) {
+  uint64_t hash = CAtmosphereLUTCache::kHashSeed;
+  hash = CAtmosphereLUTCache::Hash(hash, width);
+  hash = CAtmosphereLUTCache::Hash(hash, height);
+  hash = CAtmosphereLUTCache::Hash(hash, channels);
+  return CAtmosphereLUTCache::Hash(hash, pixels, static_cast<size_t>(width) * height * channels);
+}
+
+uint64_t GEngine::CIBLCache::HashSkybox(const std::array<uint64_t, 6> &face_hashes) {
+  return CAtmosphereLUTCache::Hash(CAtmosphereLUTCache::kHashSeed, face_hashes.data(), sizeof(face_hashes));
+}
+
+uint64_t GEngine::CIBLCache::GetKey(uint64_t skybox_hash, const SIBLBakeSettings &settings) {
+  uint64_t hash = CAtmosphereLUTCache::Hash(CAtmosphereLUTCache::kHashSeed, skybox_hash);
+  hash = CAtmosphereLUTCache::Hash(hash, settings.prefiltered_size_);
+  hash = CAtmosphereLUTCache::Hash(hash, settings.prefiltered_levels_);
+  hash = CAtmosphereLUTCache::Hash(hash, settings.filtered_importance_sampling_);
+  hash = CAtmosphereLUTCache::Hash(hash, settings.prefiltered_samples_);
+  hash = CAtmosphereLUTCache::Hash(hash, settings.brdf_lut_size_);
+  return CAtmosphereLUTCache::Hash(hash, settings.brdf_lut_samples_);
+}
+
+GEngine::CIBLCache::SEntry GEngine::CIBLCache::FromBake(const CIBLBaker::SResult &result,
+                                                        const SIBLBakeSettings &settings) {
+  SEntry entry;
+  entry.irradiance_ = result.irradiance_;
+  entry.prefiltered_size_ = settings.prefiltered_size_;
+  entry.prefiltered_levels_ = static_cast<int>(result.prefiltered_.size());
+  entry.prefiltered_.reserve(PrefilteredHalfCount(entry.prefiltered_size_, entry.prefiltered_levels_));
+  for (const auto &level : result.prefiltered_) {
+    for (const auto &face : level.faces_) {
+      for (const glm::vec3 &texel : face) {
+        entry.prefiltered_.push_back(glm::packHalf1x16(texel.r));
+        entry.prefiltered_.push_back(glm::packHalf1x16(texel.g));
+        entry.prefiltered_.push_back(glm::packHalf1x16(texel.b));
+      }
+    }
+  }
+  entry.brdf_lut_size_ = settings.brdf_lut_size_;
+  entry.brdf_lut_.reserve(result.brdf_lut_.size() * 2);
+  for (const glm::vec2 &texel : result.brdf_lut_) {
+    entry.brdf_lut_.push_back(glm::packHalf1x16(texel.x));
+    entry.brdf_lut_.push_back(glm::packHalf1x16(texel.y));
+  }
+  return entry;
+}
+
+std::string GEngine::CIBLCache::GetPath(uint64_t key) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.ibl", static_cast<unsigned long long>(key));
+  return (std::filesystem::path(directory_) / name).string();
+}
+
+bool GEngine::CIBLCache::ReadFile(const std::string &path, uint64_t &key, SEntry &entry) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  file.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+  file.read(reinterpret_cast<char *>(&version), sizeof(version));
+  file.read(reinterpret_cast<char *>(&key), sizeof(key));
+  file.read(reinterpret_cast<char *>(entry.irradiance_.coefficients_.data()), sizeof(entry.irradiance_.coefficients_));
+  file.read(reinterpret_cast<char *>(&entry.prefiltered_size_), sizeof(entry.prefiltered_size_));
+  file.read(reinterpret_cast<char *>(&entry.prefiltered_levels_), sizeof(entry.prefiltered_levels_));
+  file.read(reinterpret_cast<char *>(&entry.brdf_lut_size_), sizeof(entry.brdf_lut_size_));
+  if (!file || magic != kCacheMagic || version != kCacheVersion || entry.prefiltered_size_ <= 0 ||
+      entry.prefiltered_size_ > 4096 || entry.prefiltered_levels_ <= 0 || entry.prefiltered_levels_ > 16 ||
+      entry.brdf_lut_size_ <= 0 || entry.brdf_lut_size_ > 4096) {
+    return false;
+  }
+  ReadVector(file, entry.prefiltered_, PrefilteredHalfCount(entry.prefiltered_size_, entry.prefiltered_levels_));
+  ReadVector(file, entry.brdf_lut_, static_cast<size_t>(entry.brdf_lut_size_) * entry.brdf_lut_size_ * 2);
+  return static_cast<bool>(file);
+}
+
+bool GEngine::CIBLCache::WriteFile(const std::string &path, uint64_t key, const SEntry &entry) {
+  std::error_code error;
+  std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+  // write next to the final file and rename, a crash never leaves half a cache
+  std::string temp_path = path + ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      GE_WARN("Failed to write IBL cache '{0}'", temp_path);
+      return false;
+    }
+    file.write(reinterpret_cast<const char *>(&kCacheMagic), sizeof(kCacheMagic));
+    file.write(reinterpret_cast<const char *>(&kCacheVersion), sizeof(kCacheVersion));
+    file.write(reinterpret_cast<const char *>(&key), sizeof(key));
+    file.write(reinterpret_cast<const char *>(entry.irradiance_.coefficients_.data()),
+               sizeof(entry.irradiance_.coefficients_));
+    file.write(reinterpret_cast<const char *>(&entry.prefiltered_size_), sizeof(entry.prefiltered_size_));
+    file.write(reinterpret_cast<const char *>(&entry.prefiltered_levels_), sizeof(entry.prefiltered_levels_));
+    file.write(reinterpret_cast<const char *>(&entry.brdf_lut_size_), sizeof(entry.brdf_lut_size_));
+    WriteVector(file, entry.prefiltered_);
+    WriteVector(file, entry.brdf_lut_);
+  }
+  std::filesystem::rename(temp_path, path, error);
+  if (error) {
+    GE_WARN("Failed to store IBL cache '{0}': {1}", path, error.message());
+    return false;
+  }
+  return true;
+}
+
+bool GEngine::CIBLCache::Load(uint64_t key, const SIBLBakeSettings &settings, SEntry &entry) {
+  if (!enabled_) {
+    return false;
+  }
+  std::string path = GetPath(key);
+  if (!std::filesystem::exists(path)) {
+    miss_count_++;
+    return false;
+  }
+  uint64_t stored_key = 0;
+  bool valid = ReadFile(path, stored_key, entry) && stored_key == key &&
+               entry.prefiltered_size_ == settings.prefiltered_size_ &&
+               entry.prefiltered_levels_ == settings.prefiltered_levels_ &&
+               entry.brdf_lut_size_ == settings.brdf_lut_size_;
+  if (!valid) {
+    GE_WARN("IBL cache '{0}' is stale or corrupt, baking", path);
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    miss_count_++;
+    return false;
+  }
+  hit_count_++;
+  return true;
+}
+
+void GEngine::CIBLCache::Store(uint64_t key, const SEntry &entry) {
+  if (!enabled_) {
+    return;
+  }
+  WriteFile(GetPath(key), key, entry);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "GEngine/ibl_baker.h"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace GEngine {
+// be sure to call CIBLCache method with CSingleton<CIBLCache>()->func();
+// disk cache of what CIBLPass bakes from a skybox: the SH9 irradiance, the
+// prefiltered cubemap mips and the BRDF LUT. The key hashes the decoded
+// skybox faces and the SIBLBakeSettings, the textures are stored as half
+// floats in the layout glGetTexImage returns them. GL free, CIBLPass and the
+// offline baker convert.
+class CIBLCache {
+public:
+  struct SEntry {
+    SIrradianceSH irradiance_;
+    int prefiltered_size_ = 0;
+    int prefiltered_levels_ = 0;
+    // GL_RGB half floats, level by level, the 6 faces of a level in the GL order
+    std::vector<uint16_t> prefiltered_;
+    int brdf_lut_size_ = 0;
+    // GL_RG half floats
+    std::vector<uint16_t> brdf_lut_;
+  };
+
+  void SetDirectory(const std::string &directory) { directory_ = directory; }
+  void SetEnabled(bool enabled) { enabled_ = enabled; }
+  bool IsEnabled() const { return enabled_; }
+
+  // a face as CSkyboxPass decodes it, the skybox hashes its 6 faces in order
+  static uint64_t HashFace(int width, int height, int channels, const uint8_t *pixels);
+  static uint64_t HashSkybox(const std::array<uint64_t, 6> &face_hashes);
+  static uint64_t GetKey(uint64_t skybox_hash, const SIBLBakeSettings &settings);
+  // the half float layouts of SEntry
+  static SEntry FromBake(const CIBLBaker::SResult &result, const SIBLBakeSettings &settings);
+
+  // true if the entry was read and matches the sizes of settings
+  bool Load(uint64_t key, const SIBLBakeSettings &settings, SEntry &entry);
+  void Store(uint64_t key, const SEntry &entry);
+
+  std::string GetPath(uint64_t key) const;
+  static bool ReadFile(const std::string &path, uint64_t &key, SEntry &entry);
+  static bool WriteFile(const std::string &path, uint64_t key, const SEntry &entry);
+
+  unsigned int GetHitCount() const { return hit_count_; }
+  unsigned int GetMissCount() const { return miss_count_; }
+
+private:
+  std::string directory_ = "../../cache/ibl";
+  bool enabled_ = true;
+  unsigned int hit_count_ = 0;
+  unsigned int miss_count_ = 0;
+};
+} // namespace GEngine
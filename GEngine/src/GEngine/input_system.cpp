@@ -1,4 +1,6 @@
 #include "input_system.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/singleton.h"
 #include "log.h"
 
 // static members of CInputSystem
@@ -80,8 +82,8 @@ void GEngine::CInputSystem::KeyCallBackFunction(GLFWwindow *window, int key,
 
 void GEngine::CInputSystem::FrameSizeCallBackFunction(GLFWwindow *window,
                                                       int width, int height) {
-  glViewport(static_cast<GLint>(0), static_cast<GLint>(0),
-             static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+  CSingleton<CGLStateCache>()->Viewport(static_cast<GLint>(0), static_cast<GLint>(0),
+                                        static_cast<GLsizei>(width), static_cast<GLsizei>(height));
 }
 
 void GEngine::CInputSystem::CursorPosCallBackFunction(GLFWwindow *window, double pos_x, double pos_y) {
@@ -0,0 +1,122 @@
+#include "GEngine/job_system.h"
+#include <algorithm>
+
+GEngine::CJobSystem::CJobSystem() {}
+
+GEngine::CJobSystem::~CJobSystem() { Shutdown(); }
+
+void GEngine::CJobSystem::Init(unsigned int num_workers) {
+  if (!workers_.empty()) {
+    return;
+  }
+  if (num_workers == 0) {
+    unsigned int hardware_threads = std::thread::hardware_concurrency();
+    num_workers = hardware_threads > 1 ? hardware_threads - 1 : 1;
+  }
+  stopping_ = false;
+  for (unsigned int i = 0; i < num_workers; i++) {
+    workers_.emplace_back(&CJobSystem::WorkerLoop, this);
+  }
+}
+
+void GEngine::CJobSystem::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  condition_.notify_all();
+  for (auto &worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+  workers_.clear();
+}
+
+std::future<void> GEngine::CJobSystem::Submit(std::function<void()> job) {
+  std::packaged_task<void()> task(std::move(job));
+  auto future = task.get_future();
+  if (workers_.empty()) {
+    // no worker yet, run it right away
+    task();
+    return future;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back(std::move(task));
+  }
+  condition_.notify_one();
+  return future;
+}
+
+void GEngine::CJobSystem::ParallelFor(unsigned int count, unsigned int min_batch,
+    const std::function<void(unsigned int, unsigned int)> &func) {
+  if (count == 0) {
+    return;
+  }
+  min_batch = std::max(min_batch, 1u);
+  unsigned int num_threads = GetWorkerCount() + 1;
+  // a few chunks per thread so uneven chunks balance out
+  unsigned int batch = std::max(min_batch, count / (num_threads * 4));
+  unsigned int num_chunks = (count + batch - 1) / batch;
+  if (num_chunks <= 1 || workers_.empty()) {
+    func(0, count);
+    return;
+  }
+
+  std::atomic<unsigned int> next_chunk{0};
+  auto run_chunks = [&]() {
+    for (unsigned int chunk = next_chunk++; chunk < num_chunks; chunk = next_chunk++) {
+      unsigned int begin = chunk * batch;
+      func(begin, std::min(begin + batch, count));
+    }
+  };
+
+  unsigned int num_helpers = std::min(GetWorkerCount(), num_chunks - 1);
+  std::vector<std::future<void>> helpers;
+  helpers.reserve(num_helpers);
+  for (unsigned int i = 0; i < num_helpers; i++) {
+    helpers.push_back(Submit(run_chunks));
+  }
+  run_chunks();
+  // keep the caller busy while helpers finish, this also avoids a deadlock
+  // when ParallelFor is called from inside a job
+  for (auto &helper : helpers) {
+    while (helper.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      if (!RunPendingJob()) {
+        std::this_thread::yield();
+      }
+    }
+    helper.get();
+  }
+}
+
+void GEngine::CJobSystem::WorkerLoop() {
+  while (true) {
+    std::packaged_task<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      condition_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+      if (stopping_ && jobs_.empty()) {
+        return;
+      }
+      task = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    task();
+  }
+}
+
+bool GEngine::CJobSystem::RunPendingJob() {
+  std::packaged_task<void()> task;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (jobs_.empty()) {
+      return false;
+    }
+    task = std::move(jobs_.front());
+    jobs_.pop_front();
+  }
+  task();
+  return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace GEngine {
+// be sure to call CJobSystem method with CSingleton<CJobSystem>()->func();
+// a small worker pool for cpu-side work (culling, baking, decoding...),
+// jobs must never touch the GL context
+class CJobSystem {
+public:
+  CJobSystem();
+  ~CJobSystem();
+  CJobSystem(const CJobSystem &) = delete;
+  CJobSystem &operator=(const CJobSystem &) = delete;
+
+  // 0: use std::thread::hardware_concurrency() - 1 workers
+  void Init(unsigned int num_workers = 0);
+  void Shutdown();
+
+  unsigned int GetWorkerCount() const { return static_cast<unsigned int>(workers_.size()); }
+
+  // run job on a worker thread, the returned future becomes ready when it's done
+  std::future<void> Submit(std::function<void()> job);
+
+  // split [0, count) into chunks of at least min_batch elements and call
+  // func(begin, end) for each chunk, the calling thread joins the work and
+  // the call returns when every chunk is finished
+  void ParallelFor(unsigned int count, unsigned int min_batch,
+                   const std::function<void(unsigned int, unsigned int)> &func);
+
+private:
+  void WorkerLoop();
+  bool RunPendingJob();
+
+  std::vector<std::thread> workers_;
+  std::deque<std::packaged_task<void()>> jobs_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool stopping_ = false;
+};
+} // namespace GEngine
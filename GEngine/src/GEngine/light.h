@@ -16,6 +16,8 @@ public:
   glm::vec3 intensity_ = glm::vec3(0.5f);
   glm::vec3 position_  = glm::vec3(0.0f);
   glm::vec3 direction_ = glm::vec3(0.0f, -1.0f, 0.0f);
+  // Directional: the first shadow casting one gets cascaded shadow maps
+  bool cast_shadow_ = true;
   // Omni
   float radius_ = 10.0f;
   // Spot
@@ -0,0 +1,220 @@
+#include "GEngine/light_cluster.h"
+#include "GEngine/job_system.h"
+#include "GEngine/singleton.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+GEngine::CLightClusterBuilder::CLightClusterBuilder(unsigned int tiles_x, unsigned int tiles_y, unsigned int slices_z) {
+  SetGridSize(tiles_x, tiles_y, slices_z);
+}
+
+GEngine::CLightClusterBuilder::~CLightClusterBuilder() {}
+
+void GEngine::CLightClusterBuilder::SetGridSize(unsigned int tiles_x, unsigned int tiles_y, unsigned int slices_z) {
+  tiles_x_ = std::max(tiles_x, 1u);
+  tiles_y_ = std::max(tiles_y, 1u);
+  slices_z_ = std::max(slices_z, 1u);
+  cluster_grid_.assign(GetClusterCount(), glm::uvec2(0));
+  slice_indices_.resize(slices_z_);
+  // force the cluster AABBs to be rebuilt
+  cached_near_ = cached_far_ = 0.0f;
+}
+
+unsigned int GEngine::CLightClusterBuilder::GetSliceIndex(float view_depth) const {
+  float slice = std::log(std::max(view_depth, near_)) * slice_scale_bias_.x - slice_scale_bias_.y;
+  return std::min(static_cast<unsigned int>(std::max(slice, 0.0f)), slices_z_ - 1);
+}
+
+void GEngine::CLightClusterBuilder::UpdateClusterBounds(const glm::mat4 &projection, float near, float far) {
+  if (projection == cached_projection_ && near == cached_near_ && far == cached_far_) {
+    return;
+  }
+  cached_projection_ = projection;
+  cached_near_ = near_ = near;
+  cached_far_ = far_ = far;
+
+  float log_depth_ratio = std::log(far / near);
+  slice_scale_bias_.x = static_cast<float>(slices_z_) / log_depth_ratio;
+  slice_scale_bias_.y = static_cast<float>(slices_z_) * std::log(near) / log_depth_ratio;
+
+  // ndc = (P00 * x + P20 * z) / -z  =>  x = (ndc + P20) * depth / P00
+  auto ViewX = [&](float ndc, float depth) { return (ndc + projection[2][0]) * depth / projection[0][0]; };
+  auto ViewY = [&](float ndc, float depth) { return (ndc + projection[2][1]) * depth / projection[1][1]; };
+
+  cluster_min_.resize(GetClusterCount());
+  cluster_max_.resize(GetClusterCount());
+  for (unsigned int k = 0; k < slices_z_; k++) {
+    float slice_near = near * std::pow(far / near, static_cast<float>(k) / slices_z_);
+    float slice_far = near * std::pow(far / near, static_cast<float>(k + 1) / slices_z_);
+    for (unsigned int j = 0; j < tiles_y_; j++) {
+      float ndc_y0 = -1.0f + 2.0f * j / tiles_y_;
+      float ndc_y1 = -1.0f + 2.0f * (j + 1) / tiles_y_;
+      for (unsigned int i = 0; i < tiles_x_; i++) {
+        float ndc_x0 = -1.0f + 2.0f * i / tiles_x_;
+        float ndc_x1 = -1.0f + 2.0f * (i + 1) / tiles_x_;
+        float xs[4] = {ViewX(ndc_x0, slice_near), ViewX(ndc_x0, slice_far),
+                       ViewX(ndc_x1, slice_near), ViewX(ndc_x1, slice_far)};
+        float ys[4] = {ViewY(ndc_y0, slice_near), ViewY(ndc_y0, slice_far),
+                       ViewY(ndc_y1, slice_near), ViewY(ndc_y1, slice_far)};
+        unsigned int cluster = i + tiles_x_ * (j + tiles_y_ * k);
+        cluster_min_[cluster] = glm::vec3(*std::min_element(xs, xs + 4), *std::min_element(ys, ys + 4), -slice_far);
+        cluster_max_[cluster] = glm::vec3(*std::max_element(xs, xs + 4), *std::max_element(ys, ys + 4), -slice_near);
+      }
+    }
+  }
+}
+
+void GEngine::CLightClusterBuilder::Build(const std::vector<std::shared_ptr<CLight>> &lights,
+                                          const glm::mat4 &view, const glm::mat4 &projection,
+                                          float near, float far) {
+  auto start_time = std::chrono::high_resolution_clock::now();
+  UpdateClusterBounds(projection, near, far);
+
+  // 1. pack the lights, global lights go first
+  light_data_.clear();
+  light_bounds_.clear();
+  glm::mat3 view_rotation(view);
+  bool shadow_assigned = false;
+  for (int pass = 0; pass < 2; pass++) {
+    for (const auto &light : lights) {
+      bool is_global = light->type_ == CLight::LightType::Directional ||
+                       light->type_ == CLight::LightType::Ambient;
+      if (is_global != (pass == 0)) {
+        continue;
+      }
+      EShaderLightType type = EShaderLightType::kOmni;
+      switch (light->type_) {
+      case CLight::LightType::Ambient:     type = EShaderLightType::kAmbient; break;
+      case CLight::LightType::Omni:        type = EShaderLightType::kOmni; break;
+      case CLight::LightType::Spot:        type = EShaderLightType::kSpot; break;
+      case CLight::LightType::Directional: type = EShaderLightType::kDirectional; break;
+      }
+      SClusterLight packed;
+      glm::vec3 view_position = glm::vec3(view * glm::vec4(light->position_, 1.0f));
+      packed.position_radius_ = glm::vec4(view_position, light->radius_);
+      packed.color_type_ = glm::vec4(light->intensity_, static_cast<float>(type));
+      packed.direction_cos_outer_ = glm::vec4(glm::normalize(view_rotation * light->direction_),
+                                              std::cos(glm::radians(light->outer_angle)));
+      packed.cos_inner_ = glm::vec4(std::cos(glm::radians(light->inner_angle)), 0.0f, 0.0f, 0.0f);
+      if (type == EShaderLightType::kDirectional && light->cast_shadow_ && !shadow_assigned) {
+        // matches the light picked by CCascadedShadowPass
+        packed.cos_inner_.y = 1.0f;
+        shadow_assigned = true;
+      }
+
+      if (!is_global) {
+        // cull against the depth range, then find the conservative cluster range
+        float depth = -view_position.z;
+        float radius = light->radius_;
+        float min_depth = std::max(depth - radius, near);
+        float max_depth = std::min(depth + radius, far);
+        if (min_depth > max_depth) {
+          continue;
+        }
+        float ndc_min_x = 1.0f, ndc_max_x = -1.0f, ndc_min_y = 1.0f, ndc_max_y = -1.0f;
+        for (float d : {min_depth, max_depth}) {
+          for (float sign : {-1.0f, 1.0f}) {
+            float ndc_x = (projection[0][0] * (view_position.x + sign * radius)) / d - projection[2][0];
+            float ndc_y = (projection[1][1] * (view_position.y + sign * radius)) / d - projection[2][1];
+            ndc_min_x = std::min(ndc_min_x, ndc_x); ndc_max_x = std::max(ndc_max_x, ndc_x);
+            ndc_min_y = std::min(ndc_min_y, ndc_y); ndc_max_y = std::max(ndc_max_y, ndc_y);
+          }
+        }
+        if (ndc_max_x < -1.0f || ndc_min_x > 1.0f || ndc_max_y < -1.0f || ndc_min_y > 1.0f) {
+          continue;
+        }
+        auto ToTile = [](float ndc, unsigned int tiles) {
+          int tile = static_cast<int>(std::floor((ndc * 0.5f + 0.5f) * tiles));
+          return static_cast<unsigned int>(std::clamp(tile, 0, static_cast<int>(tiles) - 1));
+        };
+        SLightBounds bounds;
+        bounds.center_ = view_position;
+        bounds.radius_ = radius;
+        bounds.light_index_ = static_cast<unsigned int>(light_data_.size());
+        bounds.min_cluster_ = glm::uvec3(ToTile(ndc_min_x, tiles_x_), ToTile(ndc_min_y, tiles_y_), GetSliceIndex(min_depth));
+        bounds.max_cluster_ = glm::uvec3(ToTile(ndc_max_x, tiles_x_), ToTile(ndc_max_y, tiles_y_), GetSliceIndex(max_depth));
+        light_bounds_.push_back(bounds);
+      }
+      light_data_.push_back(packed);
+    }
+    if (pass == 0) {
+      global_light_count_ = static_cast<unsigned int>(light_data_.size());
+    }
+  }
+
+  // 2. bin the lights, every slice is independent
+  if (multithreaded_) {
+    CSingleton<CJobSystem>()->ParallelFor(slices_z_, 1, [this](unsigned int begin, unsigned int end) {
+      std::vector<unsigned int> slice_lights;
+      for (unsigned int k = begin; k < end; k++) {
+        BuildSlice(k, slice_lights);
+      }
+    });
+  } else {
+    std::vector<unsigned int> slice_lights;
+    for (unsigned int k = 0; k < slices_z_; k++) {
+      BuildSlice(k, slice_lights);
+    }
+  }
+
+  // 3. merge the per slice lists into one compact index list
+  size_t total_indices = 0;
+  for (const auto &indices : slice_indices_) {
+    total_indices += indices.size();
+  }
+  light_indices_.resize(total_indices);
+  unsigned int base = 0;
+  unsigned int clusters_per_slice = tiles_x_ * tiles_y_;
+  for (unsigned int k = 0; k < slices_z_; k++) {
+    std::copy(slice_indices_[k].begin(), slice_indices_[k].end(), light_indices_.begin() + base);
+    for (unsigned int c = k * clusters_per_slice; c < (k + 1) * clusters_per_slice; c++) {
+      cluster_grid_[c].x += base;
+    }
+    base += static_cast<unsigned int>(slice_indices_[k].size());
+  }
+
+  auto end_time = std::chrono::high_resolution_clock::now();
+  build_time_ms_ = std::chrono::duration<float, std::milli>(end_time - start_time).count();
+}
+
+void GEngine::CLightClusterBuilder::BuildSlice(unsigned int slice, std::vector<unsigned int> &slice_lights) {
+  // lights touching this depth slice
+  slice_lights.clear();
+  for (unsigned int l = 0; l < light_bounds_.size(); l++) {
+    if (light_bounds_[l].min_cluster_.z <= slice && slice <= light_bounds_[l].max_cluster_.z) {
+      slice_lights.push_back(l);
+    }
+  }
+
+  auto &indices = slice_indices_[slice];
+  indices.clear();
+  for (unsigned int j = 0; j < tiles_y_; j++) {
+    for (unsigned int i = 0; i < tiles_x_; i++) {
+      unsigned int cluster = i + tiles_x_ * (j + tiles_y_ * slice);
+      unsigned int offset = static_cast<unsigned int>(indices.size());
+      unsigned int count = 0;
+      const glm::vec3 &box_min = cluster_min_[cluster];
+      const glm::vec3 &box_max = cluster_max_[cluster];
+      for (unsigned int l : slice_lights) {
+        const auto &bounds = light_bounds_[l];
+        if (i < bounds.min_cluster_.x || i > bounds.max_cluster_.x ||
+            j < bounds.min_cluster_.y || j > bounds.max_cluster_.y) {
+          continue;
+        }
+        // sphere-AABB test against the cluster
+        glm::vec3 closest = glm::clamp(bounds.center_, box_min, box_max);
+        glm::vec3 delta = closest - bounds.center_;
+        if (glm::dot(delta, delta) > bounds.radius_ * bounds.radius_) {
+          continue;
+        }
+        indices.push_back(bounds.light_index_);
+        if (++count >= max_lights_per_cluster_) {
+          break;
+        }
+      }
+      // offsets are relative to the slice until the merge step
+      cluster_grid_[cluster] = glm::uvec2(offset, count);
+    }
+  }
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "GEngine/light.h"
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+namespace GEngine {
+
+// packed light layout shared with the shaders (4 texels of RGBA32F per light)
+struct SClusterLight {
+  glm::vec4 position_radius_;     // view space position, radius
+  glm::vec4 color_type_;          // color * intensity, light type
+  glm::vec4 direction_cos_outer_; // view space direction, cos(outer_angle)
+  glm::vec4 cos_inner_;           // cos(inner_angle), has cascaded shadows, unused
+};
+
+// Clustered (froxel) light assignment: the view frustum is split in
+// tiles_x * tiles_y screen tiles and slices_z exponential depth slices, every
+// omni/spot light is binned into the clusters its bounding sphere touches.
+// Directional and ambient lights are global and stored at the front of the
+// light list. The builder is pure cpu code, so it can be benchmarked without
+// a GL context.
+class CLightClusterBuilder {
+public:
+  enum class EShaderLightType : uint8_t { kOmni = 0, kSpot, kDirectional, kAmbient };
+
+  CLightClusterBuilder(unsigned int tiles_x = 16, unsigned int tiles_y = 9, unsigned int slices_z = 24);
+  ~CLightClusterBuilder();
+
+  void SetGridSize(unsigned int tiles_x, unsigned int tiles_y, unsigned int slices_z);
+  void SetMaxLightsPerCluster(unsigned int max_lights) { max_lights_per_cluster_ = max_lights; }
+  void SetMultithreaded(bool multithreaded) { multithreaded_ = multithreaded; }
+
+  // bin the lights for the given camera, near & far must match the projection
+  void Build(const std::vector<std::shared_ptr<CLight>> &lights,
+             const glm::mat4 &view, const glm::mat4 &projection,
+             float near, float far);
+
+  glm::uvec3 GetGridSize() const { return glm::uvec3(tiles_x_, tiles_y_, slices_z_); }
+  unsigned int GetClusterCount() const { return tiles_x_ * tiles_y_ * slices_z_; }
+  // slice = log(view_depth) * scale - bias
+  glm::vec2 GetSliceScaleBias() const { return slice_scale_bias_; }
+
+  const std::vector<SClusterLight> &GetLightData() const { return light_data_; }
+  unsigned int GetGlobalLightCount() const { return global_light_count_; }
+  // (offset, count) into the light index list for each cluster
+  const std::vector<glm::uvec2> &GetClusterGrid() const { return cluster_grid_; }
+  const std::vector<unsigned int> &GetLightIndices() const { return light_indices_; }
+
+  float GetBuildTime() const { return build_time_ms_; }
+
+private:
+  struct SLightBounds {
+    glm::vec3 center_;
+    float radius_;
+    unsigned int light_index_;
+    glm::uvec3 min_cluster_;
+    glm::uvec3 max_cluster_;
+  };
+
+  void UpdateClusterBounds(const glm::mat4 &projection, float near, float far);
+  void BuildSlice(unsigned int slice, std::vector<unsigned int> &slice_lights);
+  unsigned int GetSliceIndex(float view_depth) const;
+
+  unsigned int tiles_x_;
+  unsigned int tiles_y_;
+  unsigned int slices_z_;
+  unsigned int max_lights_per_cluster_ = 128;
+  bool multithreaded_ = true;
+
+  // cached cluster AABBs (view space), rebuilt when the projection changes
+  glm::mat4 cached_projection_ = glm::mat4(0.0f);
+  float cached_near_ = 0.0f;
+  float cached_far_ = 0.0f;
+  std::vector<glm::vec3> cluster_min_;
+  std::vector<glm::vec3> cluster_max_;
+  glm::vec2 slice_scale_bias_ = glm::vec2(0.0f);
+  float near_ = 0.1f;
+  float far_ = 300.0f;
+
+  std::vector<SLightBounds> light_bounds_;
+  // per slice results, merged after the parallel pass
+  std::vector<std::vector<unsigned int>> slice_indices_;
+
+  std::vector<SClusterLight> light_data_;
+  unsigned int global_light_count_ = 0;
+  std::vector<glm::uvec2> cluster_grid_;
+  std::vector<unsigned int> light_indices_;
+
+  float build_time_ms_ = 0.0f;
+};
+} // namespace GEngine
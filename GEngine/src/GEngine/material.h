@@ -1,9 +1,19 @@
 #pragma once
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <memory>
 #include "GEngine/texture.h"
 
 namespace GEngine {
+// texture set of a material, selects the shader permutation (see CShaderVariants)
+enum EMaterialFeature : uint32_t {
+  kMaterialFeatureBaseColorTexture         = 1u << 0,
+  kMaterialFeatureNormalTexture            = 1u << 1,
+  kMaterialFeatureMetallicRoughnessTexture = 1u << 2,
+  kMaterialFeatureAOTexture                = 1u << 3,
+  kMaterialFeatureAlphaTest                = 1u << 4,
+};
+
 class CMaterial {
   enum class MATERIAL_TYPE {
     Phong,
@@ -45,5 +55,21 @@ public:
 
   // todo: Disney Principled BSDF
 
+  // the lit pass discards on base color alpha, such surfaces can't use the
+  // position-only depth stream
+  bool IsAlphaTested() const {
+    return basecolor_texture_ != nullptr && basecolor_texture_->internal_format_ == CTexture::EPixelFormat::kRGBA;
+  }
+
+  uint32_t GetFeatureMask() const {
+    uint32_t mask = 0;
+    if (basecolor_texture_ != nullptr) mask |= kMaterialFeatureBaseColorTexture;
+    if (normal_texture_ != nullptr)    mask |= kMaterialFeatureNormalTexture;
+    if (unknown_texture_ != nullptr)   mask |= kMaterialFeatureMetallicRoughnessTexture;
+    if (ao_texture_ != nullptr)        mask |= kMaterialFeatureAOTexture;
+    if (IsAlphaTested())               mask |= kMaterialFeatureAlphaTest;
+    return mask;
+  }
+
 };
 } // namespace GEngine
\ No newline at end of file
@@ -0,0 +1,217 @@
+#include "GEngine/material_texture_arrays.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/log.h"
+#include "GEngine/mesh.h"
+#include "GEngine/singleton.h"
+#include "GEngine/texture_streamer.h"
+#include "GEngine/texture_upload_queue.h"
+#include <algorithm>
+#include <glm/glm.hpp>
+
+GEngine::CMaterialTextureArrays::CMaterialTextureArrays() {}
+
+GEngine::CMaterialTextureArrays::~CMaterialTextureArrays() {}
+
+size_t GEngine::CMaterialTextureArrays::GetLayerCount() const {
+  size_t layers = 0;
+  for (const auto &bucket : buckets_) {
+    layers += bucket.layers_.size();
+  }
+  return layers;
+}
+
+int GEngine::CMaterialTextureArrays::AddTexture(const CTexture *texture) {
+  auto it = texture_slots_.find(texture);
+  if (it != texture_slots_.end()) {
+    return it->second;
+  }
+  int bucket_index = -1;
+  for (int i = 0; i < static_cast<int>(buckets_.size()); i++) {
+    const auto &bucket = buckets_[i];
+    if (bucket.width_ == texture->GetWidth() && bucket.height_ == texture->GetHeight() &&
+        bucket.compressed_format_ == texture->compressed_format_ && bucket.mip_levels_ == texture->mip_levels_ &&
+        static_cast<int>(bucket.layers_.size()) < max_layers_) {
+      bucket_index = i;
+      break;
+    }
+  }
+  if (bucket_index < 0) {
+    if (static_cast<int>(buckets_.size()) >= kMaxArrays) {
+      return -1;
+    }
+    SBucket bucket;
+    bucket.width_ = texture->GetWidth();
+    bucket.height_ = texture->GetHeight();
+    bucket.compressed_format_ = texture->compressed_format_;
+    bucket.mip_levels_ = texture->mip_levels_;
+    buckets_.push_back(bucket);
+    bucket_index = static_cast<int>(buckets_.size()) - 1;
+  }
+  auto &layers = buckets_[bucket_index].layers_;
+  int slot = (bucket_index << 16) | static_cast<int>(layers.size());
+  layers.push_back(texture);
+  texture_slots_[texture] = slot;
+  return slot;
+}
+
+void GEngine::CMaterialTextureArrays::Build(const std::vector<const CMesh *> &meshes) {
+  buckets_.clear();
+  texture_slots_.clear();
+  material_indices_.clear();
+  // the layers are copied on the gpu, queued levels must have landed
+  CSingleton<CTextureUploadQueue>()->Flush();
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers_);
+  max_layers_ = std::min(max_layers_, 0xFFFF);
+
+  std::vector<glm::ivec4> slots;
+  std::vector<glm::vec4> params;
+  for (const CMesh *mesh : meshes) {
+    for (const auto &material : mesh->materials_) {
+      if (material == nullptr || material_indices_.count(material.get())) {
+        continue;
+      }
+      // same slots as the HAS_* defines of CShaderVariants
+      const CTexture *textures[kSlotCount] = {material->basecolor_texture_.get(), material->normal_texture_.get(),
+                                              material->unknown_texture_.get(), material->ao_texture_.get()};
+      glm::ivec4 material_slots(-1);
+      bool packed = true;
+      for (int i = 0; i < kSlotCount; i++) {
+        if (textures[i] != nullptr && textures[i]->GetWidth() > 0) {
+          // the array copies would pin the full resolution
+          material_slots[i] = CSingleton<CTextureStreamer>()->IsStreamed(textures[i]) ? -1 : AddTexture(textures[i]);
+          packed = packed && material_slots[i] >= 0;
+        }
+      }
+      if (!packed) {
+        material_indices_[material.get()] = -1;
+        continue;
+      }
+      material_indices_[material.get()] = static_cast<int>(slots.size());
+      slots.push_back(material_slots);
+      params.push_back(glm::vec4(material->basecolor_, material->default_metallic_));
+      params.push_back(glm::vec4(material->default_roughness_, 0.0f, 0.0f, 0.0f));
+    }
+  }
+  CopyLayers();
+
+  slots_ = std::make_unique<CTextureBuffer>(GL_RGBA32I);
+  slots_->Upload(slots.data(), slots.size() * sizeof(glm::ivec4));
+  params_ = std::make_unique<CTextureBuffer>(GL_RGBA32F);
+  params_->Upload(params.data(), params.size() * sizeof(glm::vec4));
+  GE_INFO("Material texture arrays: {0} materials, {1} textures in {2} arrays", slots.size(), GetLayerCount(),
+          buckets_.size());
+}
+
+void GEngine::CMaterialTextureArrays::CopyLayers() {
+  auto state = CSingleton<CGLStateCache>();
+  GLuint fbos[2];
+  glGenFramebuffers(2, fbos);
+  state->BindFramebuffer(GL_READ_FRAMEBUFFER, fbos[0]);
+  state->BindFramebuffer(GL_DRAW_FRAMEBUFFER, fbos[1]);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glDrawBuffer(GL_COLOR_ATTACHMENT0);
+  for (auto &bucket : buckets_) {
+    if (bucket.compressed_format_) {
+      CopyCompressedLayers(bucket);
+      continue;
+    }
+    bucket.array_ = std::make_shared<CTexture>(CTexture::ETarget::kTexture2DArray);
+    bucket.array_->SetWidth(bucket.width_);
+    bucket.array_->SetHeight(bucket.height_);
+    bucket.array_->mip_levels_ = bucket.mip_levels_;
+    state->BindTexture(GL_TEXTURE_2D_ARRAY, bucket.array_->id_);
+    for (int level = 0; level < bucket.mip_levels_; level++) {
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, std::max(1, bucket.width_ >> level),
+                   std::max(1, bucket.height_ >> level), static_cast<GLsizei>(bucket.layers_.size()), 0, GL_RGBA,
+                   GL_UNSIGNED_BYTE, nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, bucket.mip_levels_ - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                    bucket.mip_levels_ > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // every level of the CPU generated chain (CMipGenerator), the layers
+    // sample the same texels as the bound textures. R8 & RGB8 sources blit to
+    // (r, 0, 0, 1) & (rgb, 1)
+    for (int level = 0; level < bucket.mip_levels_; level++) {
+      int width = std::max(1, bucket.width_ >> level);
+      int height = std::max(1, bucket.height_ >> level);
+      for (size_t layer = 0; layer < bucket.layers_.size(); layer++) {
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, bucket.layers_[layer]->id_,
+                               level);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, bucket.array_->id_, level,
+                                  static_cast<GLint>(layer));
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+      }
+    }
+  }
+  // 1x1 white for the elements without a bucket
+  unsigned char white[4] = {255, 255, 255, 255};
+  fallback_array_ = std::make_shared<CTexture>(CTexture::ETarget::kTexture2DArray);
+  state->BindTexture(GL_TEXTURE_2D_ARRAY, fallback_array_->id_);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, 1, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  state->BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  state->BindFramebuffer(GL_FRAMEBUFFER, 0);
+  state->OnFramebufferDeleted(fbos[0]);
+  state->OnFramebufferDeleted(fbos[1]);
+  glDeleteFramebuffers(2, fbos);
+}
+
+void GEngine::CMaterialTextureArrays::CopyCompressedLayers(SBucket &bucket) {
+  // blocks can't be blitted, they take a round trip through client memory
+  auto state = CSingleton<CGLStateCache>();
+  bucket.array_ = std::make_shared<CTexture>(CTexture::ETarget::kTexture2DArray);
+  bucket.array_->SetWidth(bucket.width_);
+  bucket.array_->SetHeight(bucket.height_);
+  bucket.array_->compressed_format_ = bucket.compressed_format_;
+  bucket.array_->mip_levels_ = bucket.mip_levels_;
+  auto layer_count = static_cast<GLsizei>(bucket.layers_.size());
+  std::vector<uint8_t> blocks;
+  for (int level = 0; level < bucket.mip_levels_; level++) {
+    int width = std::max(1, bucket.width_ >> level);
+    int height = std::max(1, bucket.height_ >> level);
+    GLint level_bytes = 0;
+    state->BindTexture(GL_TEXTURE_2D, bucket.layers_[0]->id_);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &level_bytes);
+    state->BindTexture(GL_TEXTURE_2D_ARRAY, bucket.array_->id_);
+    glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, bucket.compressed_format_, width, height, layer_count, 0,
+                           level_bytes * layer_count, nullptr);
+    blocks.resize(level_bytes);
+    for (GLsizei layer = 0; layer < layer_count; layer++) {
+      state->BindTexture(GL_TEXTURE_2D, bucket.layers_[layer]->id_);
+      glGetCompressedTexImage(GL_TEXTURE_2D, level, blocks.data());
+      state->BindTexture(GL_TEXTURE_2D_ARRAY, bucket.array_->id_);
+      glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, bucket.compressed_format_,
+                                level_bytes, blocks.data());
+    }
+  }
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, bucket.mip_levels_ - 1);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                  bucket.mip_levels_ > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  state->BindTexture(GL_TEXTURE_2D, 0);
+}
+
+int GEngine::CMaterialTextureArrays::GetMaterialIndex(const CMaterial *material) const {
+  auto it = material_indices_.find(material);
+  return it == material_indices_.end() ? -1 : it->second;
+}
+
+void GEngine::CMaterialTextureArrays::Bind(const std::shared_ptr<Shader> &shader) const {
+  if (!slots_) {
+    return;
+  }
+  // unused elements still need a sampler2DArray on their unit, a unit shared
+  // by samplers of different types fails the draw
+  for (int i = 0; i < kMaxArrays; i++) {
+    auto array = i < static_cast<int>(buckets_.size()) ? buckets_[i].array_ : fallback_array_;
+    shader->SetTexture("u_material_arrays[" + std::to_string(i) + "]", array);
+  }
+  shader->SetTexture("u_material_slots", slots_->GetTexture());
+  shader->SetTexture("u_material_params", params_->GetTexture());
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "GEngine/material.h"
+#include "GEngine/shader.h"
+#include "GEngine/texture.h"
+#include "GEngine/texture_buffer.h"
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace GEngine {
+class CMesh;
+
+// material textures copied into 2D texture arrays, one array per texture
+// size, plus a material table in texture buffers: per material the packed
+// (array << 16 | layer) of base color, normal, metallic-roughness & ao, and
+// the constant factors. A draw only sets u_material_index, no texture binds.
+// ARB_bindless_texture and SSBOs are not available on GL 4.1 (macOS), the
+// texture buffers stand in for the material SSBO. Every level is copied, a
+// bucket holds textures of the same mip count. Block compressed textures go
+// to arrays of their own format.
+class CMaterialTextureArrays {
+public:
+  static constexpr int kMaxArrays = 8; // u_material_arrays[] in sponza_PBR_FS
+  static constexpr int kSlotCount = 4;
+
+  CMaterialTextureArrays();
+  ~CMaterialTextureArrays();
+
+  // gpu copies only (framebuffer blits), the source textures are kept
+  void Build(const std::vector<const CMesh *> &meshes);
+  // -1 if a texture of the material did not fit, draw it with bound textures
+  int GetMaterialIndex(const CMaterial *material) const;
+  void Bind(const std::shared_ptr<Shader> &shader) const;
+
+  size_t GetArrayCount() const { return buckets_.size(); }
+  size_t GetLayerCount() const;
+  size_t GetMaterialCount() const { return material_indices_.size(); }
+
+private:
+  struct SBucket {
+    int width_ = 0;
+    int height_ = 0;
+    // compressed sources keep their format, others become RGBA8
+    GLenum compressed_format_ = 0;
+    int mip_levels_ = 1;
+    std::vector<const CTexture *> layers_;
+    std::shared_ptr<CTexture> array_;
+  };
+  // packed (array << 16 | layer), -1 if there's no room left
+  int AddTexture(const CTexture *texture);
+  void CopyLayers();
+  void CopyCompressedLayers(SBucket &bucket);
+
+  std::vector<SBucket> buckets_;
+  std::shared_ptr<CTexture> fallback_array_;
+  std::map<const CTexture *, int> texture_slots_;
+  std::map<const CMaterial *, int> material_indices_;
+  int max_layers_ = 256;
+  std::unique_ptr<CTextureBuffer> slots_;  // GL_RGBA32I, one texel per material
+  std::unique_ptr<CTextureBuffer> params_; // GL_RGBA32F, (base color, metallic), (roughness, 0, 0, 0)
+};
+} // namespace GEngine
@@ -1,7 +1,11 @@
 #include "GEngine/mesh.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/job_system.h"
+#include "GEngine/singleton.h"
 #include "GEngine/log.h"
 #include "GEngine/material.h"
 #include "GEngine/shader.h"
+#include "GEngine/texture_streamer.h"
 #include "assimp/GltfMaterial.h"
 #include "assimp/material.h"
 #include "assimp/types.h"
@@ -9,6 +13,7 @@
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/vector3.h>
+#include <algorithm>
 #include <tuple>
 #include <glm/gtc/type_ptr.hpp>
 
@@ -18,6 +23,7 @@
 #define TANGENT_LOCATION    3
 #define BONE_ID             4
 #define WEIGHTS             5
+#define WORLD_MAT_LOCATION  6 // mat4, uses 6 to 9
 
 #define MAX_BONE_INFLUENCE 4
 #define MAX_TOTAL_BONE 200
@@ -34,7 +40,7 @@ bool GEngine::CMesh::LoadMesh(const std::string &filename) {
 
   // create VAO
   glGenVertexArrays(1, &VAO_);
-  glBindVertexArray(VAO_);
+  CSingleton<CGLStateCache>()->BindVertexArray(VAO_);
   // Create buffers for vertex attributes
   glGenBuffers(NUM_BUFFERS, buffers_);
   // EBO
@@ -56,7 +62,7 @@ bool GEngine::CMesh::LoadMesh(const std::string &filename) {
     GE_ERROR("Failed parsing scene in {0}: {1}", filename, importer.GetErrorString());
   }
 
-  glBindVertexArray(0);
+  CSingleton<CGLStateCache>()->BindVertexArray(0);
   return success;
 }
 
@@ -96,6 +102,7 @@ bool GEngine::CMesh::InitFromScene(const aiScene* scene, const std::string &file
       std::vector<float> a_bone_weight;
 
       positions_.push_back(glm::vec3(a_pos.x, a_pos.y, a_pos.z));
+      meshes_[i].bounds_.Expand(positions_.back());
       normals_.push_back(glm::vec3(a_normal.x, a_normal.y, a_normal.z));
       texcoords_.push_back(glm::vec2(a_texcoord.x, a_texcoord.y));
       tangents_.push_back(glm::vec3(a_tangent.x, a_tangent.y, a_tangent.z));
@@ -150,6 +157,7 @@ bool GEngine::CMesh::InitFromScene(const aiScene* scene, const std::string &file
       indices_.push_back(face.mIndices[2]);
     }
     num_faces_ += ai_mesh->mNumFaces;;
+    bounds_.Expand(meshes_[i].bounds_);
   }
 
   // Parse Materials
@@ -191,6 +199,32 @@ bool GEngine::CMesh::InitFromScene(const aiScene* scene, const std::string &file
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers_[INDEX_BUFFER]);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices_[0]) * indices_.size(), &indices_[0], GL_STATIC_DRAW);
 
+  // per instance world matrix, starts with a single identity
+  glm::mat4 identity(1.0f);
+  glBindBuffer(GL_ARRAY_BUFFER, buffers_[WORLD_MAT]);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4), glm::value_ptr(identity), GL_STREAM_DRAW);
+  instance_capacity_ = 1;
+  auto SetupInstanceAttributes = [this]() {
+    glBindBuffer(GL_ARRAY_BUFFER, buffers_[WORLD_MAT]);
+    for (int column = 0; column < 4; column++) {
+      glEnableVertexAttribArray(WORLD_MAT_LOCATION + column);
+      glVertexAttribPointer(WORLD_MAT_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                            (void *)(sizeof(glm::vec4) * column));
+      glVertexAttribDivisor(WORLD_MAT_LOCATION + column, 1);
+    }
+  };
+  SetupInstanceAttributes();
+
+  // position-only VAO sharing the position & index buffers
+  glGenVertexArrays(1, &position_only_VAO_);
+  CSingleton<CGLStateCache>()->BindVertexArray(position_only_VAO_);
+  glBindBuffer(GL_ARRAY_BUFFER, buffers_[POSITION]);
+  glEnableVertexAttribArray(POISITION_LOCATION);
+  glVertexAttribPointer(POISITION_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, 0);
+  SetupInstanceAttributes();
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers_[INDEX_BUFFER]);
+  CSingleton<CGLStateCache>()->BindVertexArray(VAO_);
+
   return glGetError() == GL_NO_ERROR;
 }
 
@@ -230,20 +264,31 @@ bool GEngine::CMesh::ParseMaterials(const aiScene *scene, const std::string& fil
     }
   
     // diffuse & basecolor texture
-    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_DIFFUSE, materials_[idx]->diffuse_texture_);
-    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_BASE_COLOR, materials_[idx]->basecolor_texture_);
+    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_DIFFUSE, ETextureUsage::kColor,
+                        materials_[idx]->diffuse_texture_);
+    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_BASE_COLOR, ETextureUsage::kColor,
+                        materials_[idx]->basecolor_texture_);
     // some models mess up HeightMap and NormalMap
-    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_HEIGHT, materials_[idx]->normal_texture_);
-    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_NORMALS, materials_[idx]->normal_texture_);
+    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_HEIGHT, ETextureUsage::kNormal,
+                        materials_[idx]->normal_texture_);
+    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_NORMALS, ETextureUsage::kNormal,
+                        materials_[idx]->normal_texture_);
     // maybe the [alpha] channel in diffuse texture
-    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_OPACITY, materials_[idx]->alpha_texture_); 
-    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_DIFFUSE_ROUGHNESS, materials_[idx]->roughness_texture_);
-    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_METALNESS, materials_[idx]->metallic_texture_);
-    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_AMBIENT_OCCLUSION, materials_[idx]->ao_texture_);
-    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_EMISSION_COLOR, materials_[idx]->emissive_texture_);
+    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_OPACITY, ETextureUsage::kSingleChannel,
+                        materials_[idx]->alpha_texture_);
+    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_DIFFUSE_ROUGHNESS, ETextureUsage::kSingleChannel,
+                        materials_[idx]->roughness_texture_);
+    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_METALNESS, ETextureUsage::kSingleChannel,
+                        materials_[idx]->metallic_texture_);
+    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_AMBIENT_OCCLUSION, ETextureUsage::kSingleChannel,
+                        materials_[idx]->ao_texture_);
+    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_EMISSION_COLOR, ETextureUsage::kColor,
+                        materials_[idx]->emissive_texture_);
     // roughness-metallic for glTF format (g,b channel)
-    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_UNKNOWN, materials_[idx]->unknown_texture_);
+    LoadMaterialTexture(p_material, filedir, idx, aiTextureType_UNKNOWN, ETextureUsage::kData,
+                        materials_[idx]->unknown_texture_);
   }
+  LoadPendingTextures();
   return true;
 }
 
@@ -251,6 +296,7 @@ bool GEngine::CMesh::LoadMaterialTexture(const aiMaterial *material,
                                          std::string &filedir,
                                          int material_index,
                                          aiTextureType type,
+                                         ETextureUsage usage,
                                          std::shared_ptr<CTexture>& texture) {
   texture = nullptr;
   if (material->GetTextureCount(type) > 0) {
@@ -267,92 +313,201 @@ bool GEngine::CMesh::LoadMaterialTexture(const aiMaterial *material,
 
       std::string full_path = filedir + "/" + p;
 
-      texture = std::make_shared<CTexture>(full_path, CTexture::ETarget::kTexture2D);
-      if (!texture) {
-        GE_ERROR("Error loading texture '{0}' at index '{1}'", full_path, material_index);
-        return false;
-      }
+      // decoded by LoadPendingTextures, the slot stays valid as materials are shared_ptr
+      pending_textures_.push_back({full_path, usage, &texture});
       GE_INFO("Load texture '{0}' at index '{1}'", full_path, material_index);
     }
   }
   return true;
 }
 
+void GEngine::CMesh::LoadPendingTextures() {
+  // one decode job per file (materials share textures), the mip chains are
+  // built on the workers, the GL thread only uploads
+  std::map<std::string, size_t> unique_paths;
+  std::vector<std::pair<std::string, ETextureUsage>> files;
+  for (const auto &pending : pending_textures_) {
+    if (unique_paths.emplace(pending.path_, files.size()).second) {
+      files.push_back({pending.path_, pending.usage_});
+    }
+  }
+  std::vector<SDecodedImage> images(files.size());
+  std::vector<std::future<void>> jobs;
+  jobs.reserve(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    jobs.push_back(CSingleton<CJobSystem>()->Submit(
+        [&images, &files, i]() { images[i] = CTexture::DecodeImage(files[i].first, files[i].second); }));
+  }
+  std::vector<std::shared_ptr<CTexture>> textures(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    jobs[i].wait();
+    if (!images[i].ok_) {
+      GE_ERROR("Error loading texture '{0}'", files[i].first);
+      continue;
+    }
+    // streamed textures keep their decoded levels for the finer mips
+    auto streamer = CSingleton<CTextureStreamer>();
+    bool streamed = streamer->IsEnabled() &&
+                    (!images[i].compressed_ || CBlockCompressor::IsSupportedByContext(images[i].compressed_image_.format_));
+    if (streamed) {
+      textures[i] = streamer->CreateStreamedTexture(std::move(images[i]));
+    } else {
+      textures[i] = std::make_shared<CTexture>(std::move(images[i]));
+    }
+    // the decoded levels are not needed anymore
+    images[i] = SDecodedImage();
+    loaded_textures_.push_back(textures[i]);
+  }
+  for (const auto &pending : pending_textures_) {
+    *pending.slot_ = textures[unique_paths[pending.path_]];
+  }
+  pending_textures_.clear();
+}
+
 // suppose our mesh contains at most 1 texture 
 void GEngine::CMesh::Render(std::shared_ptr<GEngine::Shader> shader) {
-  glBindVertexArray(VAO_);
+  CSingleton<CGLStateCache>()->BindVertexArray(VAO_);
   for (int i = 0; i < meshes_.size(); i++) {
-    auto material_index = meshes_[i].material_index_;
+    ApplyMaterial(shader, i);
 
-    // set uniforms
-    if(materials_[material_index]->mat_desc_.has_base_color) {
-      shader->SetVec3("u_diffuse_color", materials_[material_index]->basecolor_);
-    }
-    // todo: set uniforms according to mat_desc_
+    // set animation uniforms
 
-    // common
-    shader->SetBool("has_diffuse_texture", false);
-    if (materials_[material_index]->diffuse_texture_ != nullptr) {
-      shader->SetBool("has_diffuse_texture", true);
-      shader->SetTexture("texture_diffuse", materials_[material_index]->diffuse_texture_);
-    }
-    shader->SetBool("has_normal_texture", false);
-    if (materials_[material_index]->normal_texture_ != nullptr) {
-      shader->SetBool("has_normal_texture", true);
-      shader->SetTexture("texture_normal", materials_[material_index]->normal_texture_);
-    } 
-    // discard if alpha!=1, blending not implemented
-    shader->SetBool("has_alpha_texture", false);
-    if (materials_[material_index]->alpha_texture_ != nullptr) {
-      shader->SetBool("has_alpha_texture", true);
-      shader->SetTexture("texture_alpha", materials_[material_index]->alpha_texture_);
-    }
-    // pbr
-    shader->SetBool("has_base_color_texture", false);
-    if (materials_[material_index]->basecolor_texture_ != nullptr) {
-      shader->SetBool("has_base_color_texture", true);
-      shader->SetTexture("texture_base_color", materials_[material_index]->basecolor_texture_);
-    }
-    shader->SetBool("has_metallic_texture", false);
-    if (materials_[material_index]->metallic_texture_ != nullptr) {
-      shader->SetBool("has_metallic_texture", true);
-      shader->SetTexture("texture_metallic", materials_[material_index]->metallic_texture_);
-    }
-    shader->SetBool("has_roughness_texture", false);
-    if (materials_[material_index]->roughness_texture_ != nullptr) {
-      shader->SetBool("has_roughness_texture", true);
-      shader->SetTexture("texture_roughness", materials_[material_index]->roughness_texture_);
-    }
-    if (materials_[material_index]->ao_texture_ != nullptr) {
-      shader->SetTexture("texture_ao", materials_[material_index]->ao_texture_);
-    }
-    if (materials_[material_index]->emissive_texture_ != nullptr) {
-      shader->SetTexture("texture_emissive", materials_[material_index]->emissive_texture_);
-    }
-    if (materials_[material_index]->unknown_texture_ != nullptr) {
-      shader->SetTexture("texture_metallic_roughness", materials_[material_index]->unknown_texture_);
-    }
+    CSingleton<CGLStateCache>()->Enable(GL_DEPTH_TEST);
+    shader->Use();
+    DrawSubMesh(i);
+  }
+  CSingleton<CGLStateCache>()->BindVertexArray(0);
+}
 
-    // set animation uniforms
+void GEngine::CMesh::ApplyMaterial(std::shared_ptr<GEngine::Shader> shader, unsigned int index) {
+  auto material_index = meshes_[index].material_index_;
+
+  // set uniforms
+  if(materials_[material_index]->mat_desc_.has_base_color) {
+    shader->SetVec3("u_diffuse_color", materials_[material_index]->basecolor_);
+  }
+  // todo: set uniforms according to mat_desc_
+  // constants for the permutations without the matching texture
+  shader->SetVec3("u_basecolor", materials_[material_index]->basecolor_);
+  shader->SetFloat("u_metallic", materials_[material_index]->default_metallic_);
+  shader->SetFloat("u_roughness", materials_[material_index]->default_roughness_);
+
+  // common
+  shader->SetBool("has_diffuse_texture", false);
+  if (materials_[material_index]->diffuse_texture_ != nullptr) {
+    shader->SetBool("has_diffuse_texture", true);
+    shader->SetTexture("texture_diffuse", materials_[material_index]->diffuse_texture_);
+  }
+  shader->SetBool("has_normal_texture", false);
+  if (materials_[material_index]->normal_texture_ != nullptr) {
+    shader->SetBool("has_normal_texture", true);
+    shader->SetTexture("texture_normal", materials_[material_index]->normal_texture_);
+  } 
+  // discard if alpha!=1, blending not implemented
+  shader->SetBool("has_alpha_texture", false);
+  if (materials_[material_index]->alpha_texture_ != nullptr) {
+    shader->SetBool("has_alpha_texture", true);
+    shader->SetTexture("texture_alpha", materials_[material_index]->alpha_texture_);
+  }
+  // pbr
+  shader->SetBool("has_base_color_texture", false);
+  if (materials_[material_index]->basecolor_texture_ != nullptr) {
+    shader->SetBool("has_base_color_texture", true);
+    shader->SetTexture("texture_base_color", materials_[material_index]->basecolor_texture_);
+  }
+  shader->SetBool("has_metallic_texture", false);
+  if (materials_[material_index]->metallic_texture_ != nullptr) {
+    shader->SetBool("has_metallic_texture", true);
+    shader->SetTexture("texture_metallic", materials_[material_index]->metallic_texture_);
+  }
+  shader->SetBool("has_roughness_texture", false);
+  if (materials_[material_index]->roughness_texture_ != nullptr) {
+    shader->SetBool("has_roughness_texture", true);
+    shader->SetTexture("texture_roughness", materials_[material_index]->roughness_texture_);
+  }
+  if (materials_[material_index]->ao_texture_ != nullptr) {
+    shader->SetTexture("texture_ao", materials_[material_index]->ao_texture_);
+  }
+  if (materials_[material_index]->emissive_texture_ != nullptr) {
+    shader->SetTexture("texture_emissive", materials_[material_index]->emissive_texture_);
+  }
+  if (materials_[material_index]->unknown_texture_ != nullptr) {
+    shader->SetTexture("texture_metallic_roughness", materials_[material_index]->unknown_texture_);
+  }
+}
+
+void GEngine::CMesh::DrawSubMesh(unsigned int index) const {
+  glDrawElementsBaseVertex(GL_TRIANGLES,
+                           meshes_[index].num_indices_,
+                           GL_UNSIGNED_INT,
+                           (void *)(sizeof(unsigned int) * meshes_[index].base_index_),
+                           meshes_[index].base_vertex_);
+}
+
+void GEngine::CMesh::UploadInstances(const std::vector<glm::mat4> &world_transforms) {
+  if (world_transforms.empty()) {
+    return;
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, buffers_[WORLD_MAT]);
+  if (world_transforms.size() > instance_capacity_) {
+    instance_capacity_ = std::max(world_transforms.size(), instance_capacity_ * 2);
+  }
+  // orphan the old storage so draws still reading it don't stall the upload
+  glBufferData(GL_ARRAY_BUFFER, instance_capacity_ * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, world_transforms.size() * sizeof(glm::mat4), world_transforms.data());
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GEngine::CMesh::DrawSubMeshInstanced(unsigned int index, unsigned int instance_count) const {
+  glDrawElementsInstancedBaseVertex(GL_TRIANGLES,
+                                    meshes_[index].num_indices_,
+                                    GL_UNSIGNED_INT,
+                                    (void *)(sizeof(unsigned int) * meshes_[index].base_index_),
+                                    instance_count,
+                                    meshes_[index].base_vertex_);
+}
 
-    glEnable(GL_DEPTH_TEST);
+void GEngine::CMesh::RenderInstanced(std::shared_ptr<GEngine::Shader> shader, unsigned int instance_count) {
+  if (instance_count == 0) {
+    return;
+  }
+  CSingleton<CGLStateCache>()->BindVertexArray(VAO_);
+  for (unsigned int i = 0; i < meshes_.size(); i++) {
+    ApplyMaterial(shader, i);
     shader->Use();
-    glDrawElementsBaseVertex(GL_TRIANGLES,
-                            meshes_[i].num_indices_,
-                            GL_UNSIGNED_INT,
-                            (void *)(sizeof(unsigned int) * meshes_[i].base_index_),
-                            meshes_[i].base_vertex_);
+    DrawSubMeshInstanced(i, instance_count);
   }
-  glBindVertexArray(0);
+  CSingleton<CGLStateCache>()->BindVertexArray(0);
+}
+
+bool GEngine::CMesh::IsAlphaTested(unsigned int index) const {
+  auto material = GetSubMeshMaterial(index);
+  return material != nullptr && material->IsAlphaTested();
+}
+
+std::shared_ptr<GEngine::CMaterial> GEngine::CMesh::GetSubMeshMaterial(unsigned int index) const {
+  int material_index = meshes_[index].material_index_;
+  if (material_index < 0 || material_index >= static_cast<int>(materials_.size())) {
+    return nullptr;
+  }
+  return materials_[material_index];
 }
 
 void GEngine::CMesh::Clear() {
   loaded_textures_.clear();
+  bounds_ = SAABB();
   
   if (VAO_ != 0) {
+    CSingleton<CGLStateCache>()->OnVertexArrayDeleted(VAO_);
     glDeleteVertexArrays(1, &VAO_);
     VAO_ = 0;
   }
+  if (position_only_VAO_ != 0) {
+    CSingleton<CGLStateCache>()->OnVertexArrayDeleted(position_only_VAO_);
+    glDeleteVertexArrays(1, &position_only_VAO_);
+    position_only_VAO_ = 0;
+  }
+  instance_capacity_ = 0;
   if (buffers_[0] != 0) {
     for (int i = 0; i < NUM_BUFFERS; i++) {
       buffers_[i] = 0;
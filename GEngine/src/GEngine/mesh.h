@@ -1,6 +1,9 @@
 #pragma once
+#include "GEngine/bounds.h"
+#include "GEngine/gl_state_cache.h"
 #include "GEngine/material.h"
 #include "GEngine/shader.h"
+#include "GEngine/singleton.h"
 #include "GEngine/texture.h"
 #include <assimp/scene.h>
 #include <glad/glad.h>
@@ -28,9 +31,10 @@ public:
     TANGENT,
     BONE_ID,
     WEIGHTS,
-    // MVP_MAT & WORLD_MAT is only for instancing
-    // MVP_MAT,
-    // WORLD_MAT,
+    // WORLD_MAT is only for instancing, streamed every frame by UploadInstances().
+    // there is no MVP_MAT: every pass computes u_projection * (u_view * world)
+    // so depth pre-pass, shadow and lit pass positions stay invariant
+    WORLD_MAT,
     // NUM_BUFFERS is the numbers of buffers, not a buffer type
     NUM_BUFFERS,
   };
@@ -50,6 +54,7 @@ public:
     unsigned int base_vertex_;
     unsigned int base_index_;
     int material_index_;
+    SAABB bounds_; // model space
   };
 
   CMesh();
@@ -57,8 +62,29 @@ public:
   
   bool LoadMesh(const std::string &filename);
   void Render(std::shared_ptr<GEngine::Shader> shader);
+  // material uniforms & textures of one sub-mesh
+  void ApplyMaterial(std::shared_ptr<GEngine::Shader> shader, unsigned int index);
   void Clear();
 
+  // position-only stream for depth/shadow passes: bind once, then draw the
+  // sub-meshes without any material state
+  void BindPositionOnly() const { CSingleton<CGLStateCache>()->BindVertexArray(position_only_VAO_); }
+  void BindFullVertexStream() const { CSingleton<CGLStateCache>()->BindVertexArray(VAO_); }
+  void DrawSubMesh(unsigned int index) const;
+
+  // instancing: upload the world transforms once per frame and pass, then draw
+  // every sub-mesh once for all of them. Shaders read the transform from
+  // location 6-9 when u_instanced is set
+  void UploadInstances(const std::vector<glm::mat4> &world_transforms);
+  void DrawSubMeshInstanced(unsigned int index, unsigned int instance_count) const;
+  void RenderInstanced(std::shared_ptr<GEngine::Shader> shader, unsigned int instance_count);
+  bool IsAlphaTested(unsigned int index) const;
+  std::shared_ptr<CMaterial> GetSubMeshMaterial(unsigned int index) const;
+  const SAABB &GetBounds() const { return bounds_; }
+  // cpu copy of the geometry, e.g. for software occluders
+  const std::vector<glm::vec3> &GetPositions() const { return positions_; }
+  const std::vector<unsigned int> &GetIndices() const { return indices_; }
+
   // bone info getter
   std::map<std::string, std::shared_ptr<SBoneInfo>>& GetBoneInfoMap() { return bone_info_; }
   int& GetBoneCount() { return bone_counter_; }
@@ -72,6 +98,9 @@ public:
 
 private:
   unsigned int buffers_[NUM_BUFFERS] = {0};
+  unsigned int position_only_VAO_ = 0;
+  size_t instance_capacity_ = 0; // in matrices
+  SAABB bounds_;
   
   bool InitFromScene(const aiScene* scene, const std::string &filename);
 
@@ -84,7 +113,16 @@ private:
                            std::string &dir,
                            int index,
                            aiTextureType type,
+                           ETextureUsage usage,
                            std::shared_ptr<CTexture>& texture);
+  void LoadPendingTextures();
+
+  struct SPendingTexture {
+    std::string path_;
+    ETextureUsage usage_;
+    std::shared_ptr<CTexture> *slot_;
+  };
+  std::vector<SPendingTexture> pending_textures_;
 
   std::vector<glm::vec3> positions_;
   std::vector<glm::vec3> normals_;
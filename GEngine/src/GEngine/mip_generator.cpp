@@ -0,0 +1,223 @@
+#include "GEngine/mip_generator.h"
+#include "GEngine/job_system.h"
+#include "GEngine/singleton.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define GE_MIP_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define GE_MIP_NEON
+#endif
+
+namespace {
+// one rgba texel in a 128 bit register
+struct SFloat4 {
+#if defined(GE_MIP_SSE2)
+  __m128 v_;
+  static SFloat4 Zero() { return {_mm_setzero_ps()}; }
+  static SFloat4 Load(const float *p) { return {_mm_loadu_ps(p)}; }
+  void Store(float *p) const { _mm_storeu_ps(p, v_); }
+  void MultiplyAdd(const SFloat4 &a, float w) { v_ = _mm_add_ps(v_, _mm_mul_ps(a.v_, _mm_set1_ps(w))); }
+#elif defined(GE_MIP_NEON)
+  float32x4_t v_;
+  static SFloat4 Zero() { return {vdupq_n_f32(0.0f)}; }
+  static SFloat4 Load(const float *p) { return {vld1q_f32(p)}; }
+  void Store(float *p) const { vst1q_f32(p, v_); }
+  void MultiplyAdd(const SFloat4 &a, float w) { v_ = vmlaq_n_f32(v_, a.v_, w); }
+#else
+  float v_[4];
+  static SFloat4 Zero() { return {{0.0f, 0.0f, 0.0f, 0.0f}}; }
+  static SFloat4 Load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+  void Store(float *p) const { std::copy(v_, v_ + 4, p); }
+  void MultiplyAdd(const SFloat4 &a, float w) {
+    for (int i = 0; i < 4; i++) {
+      v_[i] += a.v_[i] * w;
+    }
+  }
+#endif
+};
+
+// the lit shader decodes base color with pow(c, 2.2)
+const std::array<float, 256> &GammaToLinearTable() {
+  static const std::array<float, 256> table = [] {
+    std::array<float, 256> values;
+    for (int i = 0; i < 256; i++) {
+      values[i] = std::pow(i / 255.0f, 2.2f);
+    }
+    return values;
+  }();
+  return table;
+}
+
+uint8_t ToUnorm8(float value) { return static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f); }
+
+float BesselI0(float x) {
+  float sum = 1.0f;
+  float term = 1.0f;
+  for (int k = 1; k < 20; k++) {
+    term *= (x * 0.5f / k) * (x * 0.5f / k);
+    sum += term;
+  }
+  return sum;
+}
+
+float Sinc(float x) {
+  if (std::abs(x) < 1e-5f) {
+    return 1.0f;
+  }
+  float px = 3.14159265f * x;
+  return std::sin(px) / px;
+}
+} // namespace
+
+int GEngine::CMipGenerator::GetLevelCount(int width, int height) {
+  return 1 + static_cast<int>(std::floor(std::log2(std::max(1, std::max(width, height)))));
+}
+
+float GEngine::CMipGenerator::KernelRadius(EMipFilter filter) {
+  return filter == EMipFilter::kBox ? 0.5f : 3.0f;
+}
+
+float GEngine::CMipGenerator::Kernel(EMipFilter filter, float x) {
+  float radius = KernelRadius(filter);
+  if (std::abs(x) >= radius) {
+    return 0.0f;
+  }
+  switch (filter) {
+  case EMipFilter::kBox:
+    return 1.0f;
+  case EMipFilter::kKaiser: {
+    const float alpha = 4.0f;
+    float t = x / radius;
+    return Sinc(x) * BesselI0(alpha * std::sqrt(1.0f - t * t)) / BesselI0(alpha);
+  }
+  case EMipFilter::kLanczos:
+    return Sinc(x) * Sinc(x / radius);
+  }
+  return 0.0f;
+}
+
+GEngine::CMipGenerator::STaps GEngine::CMipGenerator::ComputeTaps(int source_size, int destination_size,
+                                                                 const SOptions &options) {
+  // the kernel is stretched by the scale, in destination texel units
+  float scale = static_cast<float>(source_size) / destination_size;
+  float support = KernelRadius(options.filter_) * scale;
+  STaps taps;
+  taps.count_ = static_cast<int>(std::ceil(support * 2.0f)) + 1;
+  taps.first_.resize(destination_size);
+  taps.weights_.assign(static_cast<size_t>(destination_size) * taps.count_, 0.0f);
+  for (int d = 0; d < destination_size; d++) {
+    float center = (d + 0.5f) * scale;
+    int first = static_cast<int>(std::floor(center - support));
+    taps.first_[d] = first;
+    float *weights = &taps.weights_[static_cast<size_t>(d) * taps.count_];
+    float sum = 0.0f;
+    for (int t = 0; t < taps.count_; t++) {
+      float distance = (first + t + 0.5f - center) / scale;
+      weights[t] = Kernel(options.filter_, distance);
+      sum += weights[t];
+    }
+    for (int t = 0; t < taps.count_; t++) {
+      weights[t] /= sum;
+    }
+  }
+  return taps;
+}
+
+std::vector<std::vector<uint8_t>> GEngine::CMipGenerator::Generate(const uint8_t *pixels, int width, int height,
+                                                                   int channels, const SOptions &options) {
+  int level_count = GetLevelCount(width, height);
+  std::vector<std::vector<uint8_t>> levels(level_count);
+  levels[0].assign(pixels, pixels + static_cast<size_t>(width) * height * channels);
+  if (level_count == 1) {
+    return levels;
+  }
+  auto job_system = CSingleton<CJobSystem>();
+  bool color = options.usage_ == ETextureUsage::kColor;
+  bool normal = options.usage_ == ETextureUsage::kNormal && channels >= 3;
+  const auto &to_linear = GammaToLinearTable();
+
+  // float rgba of the current level, alpha stays linear
+  std::vector<float> source(static_cast<size_t>(width) * height * 4);
+  job_system->ParallelFor(static_cast<unsigned int>(height), 16, [&](unsigned int begin, unsigned int end) {
+    for (size_t i = static_cast<size_t>(begin) * width; i < static_cast<size_t>(end) * width; i++) {
+      float *texel = &source[i * 4];
+      texel[0] = texel[1] = texel[2] = 0.0f;
+      texel[3] = 1.0f;
+      for (int c = 0; c < channels; c++) {
+        uint8_t value = pixels[i * channels + c];
+        texel[c] = color && c < 3 ? to_linear[value] : value / 255.0f;
+      }
+    }
+  });
+
+  std::vector<float> horizontal;
+  std::vector<float> destination;
+  int source_width = width;
+  int source_height = height;
+  auto Address = [&](int i, int size) {
+    return options.wrap_ ? ((i % size) + size) % size : std::clamp(i, 0, size - 1);
+  };
+  for (int level = 1; level < level_count; level++) {
+    int level_width = std::max(1, source_width / 2);
+    int level_height = std::max(1, source_height / 2);
+    STaps taps_x = ComputeTaps(source_width, level_width, options);
+    STaps taps_y = ComputeTaps(source_height, level_height, options);
+
+    // separable, rows first
+    horizontal.resize(static_cast<size_t>(level_width) * source_height * 4);
+    job_system->ParallelFor(static_cast<unsigned int>(source_height), 8, [&](unsigned int begin, unsigned int end) {
+      for (unsigned int y = begin; y < end; y++) {
+        const float *row = &source[static_cast<size_t>(y) * source_width * 4];
+        for (int x = 0; x < level_width; x++) {
+          const float *weights = &taps_x.weights_[static_cast<size_t>(x) * taps_x.count_];
+          SFloat4 sum = SFloat4::Zero();
+          for (int t = 0; t < taps_x.count_; t++) {
+            sum.MultiplyAdd(SFloat4::Load(row + Address(taps_x.first_[x] + t, source_width) * 4), weights[t]);
+          }
+          sum.Store(&horizontal[(static_cast<size_t>(y) * level_width + x) * 4]);
+        }
+      }
+    });
+    destination.resize(static_cast<size_t>(level_width) * level_height * 4);
+    levels[level].resize(static_cast<size_t>(level_width) * level_height * channels);
+    job_system->ParallelFor(static_cast<unsigned int>(level_height), 8, [&](unsigned int begin, unsigned int end) {
+      for (unsigned int y = begin; y < end; y++) {
+        const float *weights = &taps_y.weights_[static_cast<size_t>(y) * taps_y.count_];
+        for (int x = 0; x < level_width; x++) {
+          SFloat4 sum = SFloat4::Zero();
+          for (int t = 0; t < taps_y.count_; t++) {
+            size_t row = Address(taps_y.first_[y] + t, source_height);
+            sum.MultiplyAdd(SFloat4::Load(&horizontal[(row * level_width + x) * 4]), weights[t]);
+          }
+          float *texel = &destination[(static_cast<size_t>(y) * level_width + x) * 4];
+          sum.Store(texel);
+          // the negative lobes overshoot
+          for (int c = 0; c < 4; c++) {
+            texel[c] = std::clamp(texel[c], 0.0f, 1.0f);
+          }
+          if (normal) {
+            float n[3] = {texel[0] * 2.0f - 1.0f, texel[1] * 2.0f - 1.0f, texel[2] * 2.0f - 1.0f};
+            float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (length > 1e-6f) {
+              for (int c = 0; c < 3; c++) {
+                texel[c] = n[c] / length * 0.5f + 0.5f;
+              }
+            }
+          }
+          uint8_t *out = &levels[level][(static_cast<size_t>(y) * level_width + x) * channels];
+          for (int c = 0; c < channels; c++) {
+            out[c] = ToUnorm8(color && c < 3 ? std::pow(texel[c], 1.0f / 2.2f) : texel[c]);
+          }
+        }
+      }
+    });
+    std::swap(source, destination);
+    source_width = level_width;
+    source_height = level_height;
+  }
+  return levels;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "GEngine/texture_compression.h"
+#include <cstdint>
+#include <vector>
+
+namespace GEngine {
+enum class EMipFilter {
+  kBox,
+  kKaiser,  // radius 3, alpha 4
+  kLanczos, // lanczos3
+};
+
+// cpu mip chain of an 8 bit image (1 to 4 channels), levels down to 1x1.
+// Each level is filtered from the previous one in float, color is filtered
+// in linear space and written back gamma encoded, normal maps are
+// renormalized per level. Rows are spread over the CJobSystem workers and
+// the 4 channels of a texel go through one SIMD register (SSE2 / NEON).
+class CMipGenerator {
+public:
+  struct SOptions {
+    EMipFilter filter_ = EMipFilter::kKaiser;
+    ETextureUsage usage_ = ETextureUsage::kColor;
+    // sample across the borders like GL_REPEAT, clamp otherwise
+    bool wrap_ = true;
+  };
+
+  // levels_[0] is a copy of the source
+  static std::vector<std::vector<uint8_t>> Generate(const uint8_t *pixels, int width, int height, int channels,
+                                                    const SOptions &options);
+  static int GetLevelCount(int width, int height);
+
+private:
+  // filter taps of every destination texel along one axis
+  struct STaps {
+    std::vector<int> first_;
+    int count_ = 0;
+    std::vector<float> weights_; // count_ per destination texel
+  };
+  static float Kernel(EMipFilter filter, float x);
+  static float KernelRadius(EMipFilter filter);
+  static STaps ComputeTaps(int source_size, int destination_size, const SOptions &options);
+};
+} // namespace GEngine
@@ -0,0 +1,196 @@
+#include "GEngine/occlusion_culler.h"
+#include <algorithm>
+#include <cmath>
+
+GEngine::COcclusionCuller::COcclusionCuller() {}
+
+GEngine::COcclusionCuller::~COcclusionCuller() {}
+
+void GEngine::COcclusionCuller::SetDepth(const float *depth, int width, int height, int source_level,
+                                         int source_width, int source_height, const glm::mat4 &view_projection) {
+  view_projection_ = view_projection;
+  width_ = width;
+  height_ = height;
+  source_width_ = source_width;
+  source_height_ = source_height;
+  source_level_ = source_level;
+  levels_.resize(1);
+  levels_[0].assign(depth, depth + static_cast<size_t>(width) * height);
+  BuildPyramid();
+  ready_ = true;
+}
+
+void GEngine::COcclusionCuller::BeginOccluders(int width, int height, const glm::mat4 &view_projection) {
+  view_projection_ = view_projection;
+  width_ = width;
+  height_ = height;
+  source_width_ = width;
+  source_height_ = height;
+  source_level_ = 0;
+  levels_.resize(1);
+  levels_[0].assign(static_cast<size_t>(width) * height, 1.0f);
+  rasterized_triangles_ = 0;
+  ready_ = false;
+}
+
+void GEngine::COcclusionCuller::RasterizeOccluder(const std::vector<glm::vec3> &positions,
+                                                  const std::vector<unsigned int> &indices,
+                                                  unsigned int base_index, unsigned int index_count,
+                                                  unsigned int base_vertex, const glm::mat4 &model) {
+  glm::mat4 model_view_projection = view_projection_ * model;
+  for (unsigned int i = base_index; i + 2 < base_index + index_count; i += 3) {
+    glm::vec4 v0 = model_view_projection * glm::vec4(positions[base_vertex + indices[i]], 1.0f);
+    glm::vec4 v1 = model_view_projection * glm::vec4(positions[base_vertex + indices[i + 1]], 1.0f);
+    glm::vec4 v2 = model_view_projection * glm::vec4(positions[base_vertex + indices[i + 2]], 1.0f);
+    RasterizeTriangle(v0, v1, v2);
+  }
+}
+
+void GEngine::COcclusionCuller::EndOccluders() {
+  BuildPyramid();
+  ready_ = true;
+}
+
+void GEngine::COcclusionCuller::RasterizeTriangle(const glm::vec4 &v0, const glm::vec4 &v1, const glm::vec4 &v2) {
+  // trivial reject against the side planes
+  for (int axis = 0; axis < 2; axis++) {
+    if (v0[axis] > v0.w && v1[axis] > v1.w && v2[axis] > v2.w) return;
+    if (v0[axis] < -v0.w && v1[axis] < -v1.w && v2[axis] < -v2.w) return;
+  }
+  // clip against the near plane (z >= -w)
+  glm::vec4 input[3] = {v0, v1, v2};
+  glm::vec4 clipped[4];
+  int clipped_count = 0;
+  for (int i = 0; i < 3; i++) {
+    const glm::vec4 &a = input[i];
+    const glm::vec4 &b = input[(i + 1) % 3];
+    float da = a.z + a.w;
+    float db = b.z + b.w;
+    if (da >= 0.0f) {
+      clipped[clipped_count++] = a;
+    }
+    if ((da >= 0.0f) != (db >= 0.0f)) {
+      clipped[clipped_count++] = a + (b - a) * (da / (da - db));
+    }
+  }
+  if (clipped_count < 3) {
+    return;
+  }
+
+  glm::vec3 screen[4];
+  for (int i = 0; i < clipped_count; i++) {
+    glm::vec3 ndc = glm::vec3(clipped[i]) / std::max(clipped[i].w, 1e-6f);
+    screen[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * width_, (ndc.y * 0.5f + 0.5f) * height_, ndc.z * 0.5f + 0.5f);
+  }
+  for (int i = 1; i + 1 < clipped_count; i++) {
+    RasterizeScreenTriangle(screen[0], screen[i], screen[i + 1]);
+  }
+  rasterized_triangles_++;
+}
+
+void GEngine::COcclusionCuller::RasterizeScreenTriangle(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2) {
+  float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+  if (std::abs(area) < 1e-8f) {
+    return;
+  }
+  int min_x = std::max(static_cast<int>(std::floor(std::min({p0.x, p1.x, p2.x}))), 0);
+  int max_x = std::min(static_cast<int>(std::ceil(std::max({p0.x, p1.x, p2.x}))), width_ - 1);
+  int min_y = std::max(static_cast<int>(std::floor(std::min({p0.y, p1.y, p2.y}))), 0);
+  int max_y = std::min(static_cast<int>(std::ceil(std::max({p0.y, p1.y, p2.y}))), height_ - 1);
+  if (min_x > max_x || min_y > max_y) {
+    return;
+  }
+  float inv_area = 1.0f / area;
+  auto &depth = levels_[0];
+  for (int y = min_y; y <= max_y; y++) {
+    float py = y + 0.5f;
+    for (int x = min_x; x <= max_x; x++) {
+      float px = x + 0.5f;
+      // barycentrics from the edge functions, either winding
+      float w0 = ((p1.x - px) * (p2.y - py) - (p1.y - py) * (p2.x - px)) * inv_area;
+      float w1 = ((p2.x - px) * (p0.y - py) - (p2.y - py) * (p0.x - px)) * inv_area;
+      float w2 = 1.0f - w0 - w1;
+      if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
+        continue;
+      }
+      float z = w0 * p0.z + w1 * p1.z + w2 * p2.z;
+      float &stored = depth[static_cast<size_t>(y) * width_ + x];
+      stored = std::min(stored, z);
+    }
+  }
+}
+
+void GEngine::COcclusionCuller::BuildPyramid() {
+  levels_.resize(1);
+  level_sizes_.clear();
+  level_sizes_.push_back(glm::ivec2(width_, height_));
+  while (level_sizes_.back().x > 1 || level_sizes_.back().y > 1) {
+    glm::ivec2 previous = level_sizes_.back();
+    glm::ivec2 size((previous.x + 1) / 2, (previous.y + 1) / 2);
+    const auto &source = levels_[level_sizes_.size() - 1];
+    std::vector<float> level(static_cast<size_t>(size.x) * size.y);
+    for (int y = 0; y < size.y; y++) {
+      int y0 = y * 2;
+      int y1 = std::min(y0 + 1, previous.y - 1);
+      for (int x = 0; x < size.x; x++) {
+        int x0 = x * 2;
+        int x1 = std::min(x0 + 1, previous.x - 1);
+        level[static_cast<size_t>(y) * size.x + x] =
+            std::max({source[static_cast<size_t>(y0) * previous.x + x0], source[static_cast<size_t>(y0) * previous.x + x1],
+                      source[static_cast<size_t>(y1) * previous.x + x0], source[static_cast<size_t>(y1) * previous.x + x1]});
+      }
+    }
+    levels_.push_back(std::move(level));
+    level_sizes_.push_back(size);
+  }
+}
+
+bool GEngine::COcclusionCuller::IsVisible(const SAABB &world_bounds) const {
+  if (!ready_ || !world_bounds.IsValid()) {
+    return true;
+  }
+  glm::vec3 ndc_min(1.0f), ndc_max(-1.0f);
+  for (int i = 0; i < 8; i++) {
+    glm::vec3 corner((i & 1) ? world_bounds.max_.x : world_bounds.min_.x,
+                     (i & 2) ? world_bounds.max_.y : world_bounds.min_.y,
+                     (i & 4) ? world_bounds.max_.z : world_bounds.min_.z);
+    glm::vec4 clip = view_projection_ * glm::vec4(corner, 1.0f);
+    if (clip.w <= 1e-5f || clip.z < -clip.w) {
+      // crosses the near plane, can't be tested
+      return true;
+    }
+    glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    ndc_min = glm::min(ndc_min, ndc);
+    ndc_max = glm::max(ndc_max, ndc);
+  }
+  if (ndc_max.x < -1.0f || ndc_min.x > 1.0f || ndc_max.y < -1.0f || ndc_min.y > 1.0f) {
+    // off screen, leave it to the frustum test
+    return true;
+  }
+  float box_depth = ndc_min.z * 0.5f + 0.5f;
+
+  // the rect in source texels, a texel of a level is the source texels shifted
+  // down, the last one also holds the folded remainder (CPU levels round up,
+  // which clamps the same way)
+  int x0 = std::clamp(static_cast<int>(std::floor((ndc_min.x * 0.5f + 0.5f) * source_width_)), 0, source_width_ - 1);
+  int x1 = std::clamp(static_cast<int>(std::floor((ndc_max.x * 0.5f + 0.5f) * source_width_)), 0, source_width_ - 1);
+  int y0 = std::clamp(static_cast<int>(std::floor((ndc_min.y * 0.5f + 0.5f) * source_height_)), 0, source_height_ - 1);
+  int y1 = std::clamp(static_cast<int>(std::floor((ndc_max.y * 0.5f + 0.5f) * source_height_)), 0, source_height_ - 1);
+
+  // pick the level where the rect covers at most 2x2 texels (3x3 when unaligned)
+  int extent = std::max(x1 - x0, y1 - y0) + 1;
+  int level = 0;
+  while ((extent >> (source_level_ + level)) > 2 && level + 1 < static_cast<int>(levels_.size())) {
+    level++;
+  }
+  const auto &depth = levels_[level];
+  glm::ivec2 size = level_sizes_[level];
+  int shift = source_level_ + level;
+  float max_depth = 0.0f;
+  for (int y = std::min(y0 >> shift, size.y - 1); y <= std::min(y1 >> shift, size.y - 1); y++) {
+    for (int x = std::min(x0 >> shift, size.x - 1); x <= std::min(x1 >> shift, size.x - 1); x++) {
+      max_depth = std::max(max_depth, depth[static_cast<size_t>(y) * size.x + x]);
+    }
+  }
+  return box_depth <= max_depth;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "GEngine/bounds.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace GEngine {
+// cpu side of the occlusion culling: a max-depth pyramid (window depth in
+// [0, 1]) and a conservative box test against it. The level 0 depth either
+// comes from the gpu Hi-Z readback (SetDepth) or from a small software
+// rasterizer fed with occluder triangles, the latter needs no GL at all.
+class COcclusionCuller {
+public:
+  COcclusionCuller();
+  ~COcclusionCuller();
+
+  // gpu path: depth rendered with view_projection, row 0 at the bottom. The
+  // depth is mip source_level of a Hi-Z of source_width x source_height, with
+  // floor sizes and the odd row/column folded into the last texel
+  void SetDepth(const float *depth, int width, int height, int source_level, int source_width, int source_height,
+                const glm::mat4 &view_projection);
+
+  // software path
+  void BeginOccluders(int width, int height, const glm::mat4 &view_projection);
+  void RasterizeOccluder(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices,
+                         unsigned int base_index, unsigned int index_count, unsigned int base_vertex,
+                         const glm::mat4 &model);
+  void EndOccluders();
+
+  // false only if the box is fully hidden behind the depth pyramid
+  bool IsVisible(const SAABB &world_bounds) const;
+
+  bool IsReady() const { return ready_; }
+  void Reset() { ready_ = false; }
+  int GetWidth() const { return width_; }
+  int GetHeight() const { return height_; }
+  unsigned int GetRasterizedTriangleCount() const { return rasterized_triangles_; }
+  const std::vector<float> &GetDepthLevel(int level) const { return levels_[level]; }
+
+private:
+  void BuildPyramid();
+  void RasterizeTriangle(const glm::vec4 &v0, const glm::vec4 &v1, const glm::vec4 &v2);
+  void RasterizeScreenTriangle(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2);
+
+  glm::mat4 view_projection_ = glm::mat4(1.0f);
+  int width_ = 0;
+  int height_ = 0;
+  // the screen size the box rects are computed at, levels_[0] is
+  // source_level_ mips below it
+  int source_width_ = 0;
+  int source_height_ = 0;
+  int source_level_ = 0;
+  bool ready_ = false;
+  unsigned int rasterized_triangles_ = 0;
+  // levels_[0] is full resolution, every level halves (rounding up)
+  std::vector<std::vector<float>> levels_;
+  std::vector<glm::ivec2> level_sizes_;
+};
+} // namespace GEngine
@@ -0,0 +1,68 @@
+#include "GEngine/pixel_unpack_ring.h"
+#include <cstring>
+
+GEngine::CPixelUnpackRing::CPixelUnpackRing(size_t slot_bytes, int slot_count)
+    : slots_(slot_count), slot_bytes_(slot_bytes) {
+  for (auto &slot : slots_) {
+    glGenBuffers(1, &slot.buffer_);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer_);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(slot_bytes_), nullptr, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+GEngine::CPixelUnpackRing::~CPixelUnpackRing() {
+  for (auto &slot : slots_) {
+    if (slot.fence_) {
+      glDeleteSync(slot.fence_);
+    }
+    glDeleteBuffers(1, &slot.buffer_);
+  }
+}
+
+bool GEngine::CPixelUnpackRing::Map() {
+  current_ = (current_ + 1) % static_cast<int>(slots_.size());
+  auto &slot = slots_[current_];
+  if (slot.fence_) {
+    // timeout 0, only polls
+    GLenum status = glClientWaitSync(slot.fence_, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      current_ = (current_ + static_cast<int>(slots_.size()) - 1) % static_cast<int>(slots_.size());
+      return false;
+    }
+    glDeleteSync(slot.fence_);
+    slot.fence_ = nullptr;
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer_);
+  mapped_ = static_cast<unsigned char *>(glMapBufferRange(
+      GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(slot_bytes_),
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  staged_bytes_ = 0;
+  return mapped_ != nullptr;
+}
+
+bool GEngine::CPixelUnpackRing::Stage(const void *data, size_t bytes, size_t &offset) {
+  // 16 byte aligned rows & blocks
+  size_t aligned = (staged_bytes_ + 15) & ~static_cast<size_t>(15);
+  if (!mapped_ || aligned + bytes > slot_bytes_) {
+    return false;
+  }
+  std::memcpy(mapped_ + aligned, data, bytes);
+  offset = aligned;
+  staged_bytes_ = aligned + bytes;
+  return true;
+}
+
+void GEngine::CPixelUnpackRing::Unmap() {
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slots_[current_].buffer_);
+  if (mapped_) {
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    mapped_ = nullptr;
+  }
+}
+
+void GEngine::CPixelUnpackRing::Submit() {
+  slots_[current_].fence_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
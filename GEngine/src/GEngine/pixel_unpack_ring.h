@@ -0,0 +1,41 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+namespace GEngine {
+// a ring of pixel unpack buffers for texture uploads that never wait for
+// the gpu: a slot is only reused once the fence of its last uploads passed,
+// so it can be mapped unsynchronized. Per frame:
+//   Map() -> Stage() the pixels -> Unmap() -> glTex*Image with the offsets -> Submit()
+class CPixelUnpackRing {
+public:
+  CPixelUnpackRing(size_t slot_bytes, int slot_count = 3);
+  ~CPixelUnpackRing();
+  CPixelUnpackRing(const CPixelUnpackRing &) = delete;
+  CPixelUnpackRing &operator=(const CPixelUnpackRing &) = delete;
+
+  // false if the gpu still reads the next slot, skip the uploads this frame
+  bool Map();
+  // copies into the mapped slot, false when it's full
+  bool Stage(const void *data, size_t bytes, size_t &offset);
+  // leaves the slot bound to GL_PIXEL_UNPACK_BUFFER, pass the offsets as pointers
+  void Unmap();
+  // fences the slot and unbinds it
+  void Submit();
+
+  size_t GetSlotBytes() const { return slot_bytes_; }
+  size_t GetStagedBytes() const { return staged_bytes_; }
+
+private:
+  struct SSlot {
+    GLuint buffer_ = 0;
+    GLsync fence_ = nullptr;
+  };
+  std::vector<SSlot> slots_;
+  size_t slot_bytes_;
+  int current_ = 0;
+  unsigned char *mapped_ = nullptr;
+  size_t staged_bytes_ = 0;
+};
+} // namespace GEngine
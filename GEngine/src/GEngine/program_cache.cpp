@@ -0,0 +1,134 @@
+#include "GEngine/program_cache.h"
+#include "GEngine/log.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+constexpr uint32_t kCacheMagic = 0x47504243; // "GPBC"
+
+uint64_t HashBytes(uint64_t hash, const void *data, size_t size) {
+  // 64 bit FNV-1a
+  const auto *bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+} // namespace
+
+GEngine::CProgramCache::CProgramCache() {}
+
+GEngine::CProgramCache::~CProgramCache() {}
+
+bool GEngine::CProgramCache::IsAvailable() {
+  if (!enabled_) {
+    return false;
+  }
+  if (available_ < 0) {
+    GLint format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    available_ = format_count > 0 ? 1 : 0;
+    if (available_) {
+      auto GetString = [](GLenum name) {
+        const GLubyte *value = glGetString(name);
+        return value ? std::string(reinterpret_cast<const char *>(value)) : std::string();
+      };
+      driver_identity_ = GetString(GL_VENDOR) + "|" + GetString(GL_RENDERER) + "|" + GetString(GL_VERSION);
+      std::error_code error;
+      std::filesystem::create_directories(directory_, error);
+      GE_INFO("Program binary cache in '{0}' for {1}", directory_, driver_identity_);
+    } else {
+      GE_INFO("Program binary cache disabled: the driver exposes no binary formats");
+    }
+  }
+  return available_ == 1;
+}
+
+uint64_t GEngine::CProgramCache::ComputeKey(const std::vector<SStageSource> &stages) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  hash = HashBytes(hash, driver_identity_.data(), driver_identity_.size());
+  for (const auto &stage : stages) {
+    hash = HashBytes(hash, &stage.stage_, sizeof(stage.stage_));
+    uint64_t size = stage.source_->size();
+    hash = HashBytes(hash, &size, sizeof(size));
+    hash = HashBytes(hash, stage.source_->data(), stage.source_->size());
+  }
+  return hash;
+}
+
+std::string GEngine::CProgramCache::GetPath(uint64_t key) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+  return (std::filesystem::path(directory_) / name).string();
+}
+
+bool GEngine::CProgramCache::Load(uint64_t key, GLuint program) {
+  std::string path = GetPath(key);
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    miss_count_++;
+    return false;
+  }
+  uint32_t magic = 0;
+  GLenum format = 0;
+  uint64_t size = 0;
+  file.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+  file.read(reinterpret_cast<char *>(&format), sizeof(format));
+  file.read(reinterpret_cast<char *>(&size), sizeof(size));
+  std::vector<char> binary;
+  if (file && magic == kCacheMagic && size > 0 && size < (256ull << 20)) {
+    binary.resize(size);
+    file.read(binary.data(), size);
+  }
+  file.close();
+
+  GLint link_status = GL_FALSE;
+  if (!binary.empty() && file) {
+    glProgramBinary(program, format, binary.data(), static_cast<GLsizei>(binary.size()));
+    glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+  }
+  if (link_status != GL_TRUE) {
+    // stale or corrupt, the caller rebuilds it and stores a fresh one
+    GE_WARN("Program binary '{0}' rejected, compiling from source", path);
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    miss_count_++;
+    return false;
+  }
+  hit_count_++;
+  return true;
+}
+
+void GEngine::CProgramCache::Store(uint64_t key, GLuint program) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(program, length, &length, &format, binary.data());
+
+  // write next to the final file and rename, a crash never leaves half a binary
+  std::string path = GetPath(key);
+  std::string temp_path = path + ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      GE_WARN("Failed to write program binary '{0}'", temp_path);
+      return;
+    }
+    uint64_t size = static_cast<uint64_t>(length);
+    file.write(reinterpret_cast<const char *>(&kCacheMagic), sizeof(kCacheMagic));
+    file.write(reinterpret_cast<const char *>(&format), sizeof(format));
+    file.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    file.write(binary.data(), length);
+  }
+  std::error_code error;
+  std::filesystem::rename(temp_path, path, error);
+  if (error) {
+    GE_WARN("Failed to store program binary '{0}': {1}", path, error.message());
+  }
+}
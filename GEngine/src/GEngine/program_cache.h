@@ -0,0 +1,46 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace GEngine {
+// be sure to call CProgramCache method with CSingleton<CProgramCache>()->func();
+// disk cache of linked programs (glGetProgramBinary / glProgramBinary). The
+// key hashes every stage source together with the driver identity, so a new
+// driver or an edited shader simply misses. A binary the driver rejects is
+// deleted and the caller compiles from source.
+class CProgramCache {
+public:
+  struct SStageSource {
+    GLenum stage_;
+    const std::string *source_;
+  };
+
+  CProgramCache();
+  ~CProgramCache();
+
+  void SetDirectory(const std::string &directory) { directory_ = directory; }
+  void SetEnabled(bool enabled) { enabled_ = enabled; }
+  // false when disabled or the driver has no binary formats (e.g. macOS)
+  bool IsAvailable();
+
+  uint64_t ComputeKey(const std::vector<SStageSource> &stages);
+  // true if program was linked from the cached binary
+  bool Load(uint64_t key, GLuint program);
+  void Store(uint64_t key, GLuint program);
+
+  unsigned int GetHitCount() const { return hit_count_; }
+  unsigned int GetMissCount() const { return miss_count_; }
+
+private:
+  std::string GetPath(uint64_t key) const;
+
+  std::string directory_ = "../../cache/programs";
+  bool enabled_ = true;
+  int available_ = -1; // queried on first use, needs a context
+  std::string driver_identity_;
+  unsigned int hit_count_ = 0;
+  unsigned int miss_count_ = 0;
+};
+} // namespace GEngine
@@ -30,6 +30,9 @@ public:
   // implemented by user
   virtual void Init() = 0;
   virtual void Tick() = 0;
+  // called for every pass before any Init(): create the shaders here so the
+  // driver compiles them while the passes load their assets
+  virtual void PrepareShaders() {}
 
   bool operator<(const CRenderPass& ohter) const;
   bool operator>(const CRenderPass& ohter) const;
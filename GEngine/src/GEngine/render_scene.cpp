@@ -1,10 +1,101 @@
-#include "render_scene.h"
-#include "light.h"
+#include "GEngine/render_scene.h"
+#include "GEngine/log.h"
+#include <algorithm>
 
-namespace GEngine {
-  class CRenderScene {
-    public:
+GEngine::CRenderScene::CRenderScene() {}
 
-    private:
-  };
-}
\ No newline at end of file
+GEngine::CRenderScene::~CRenderScene() {}
+
+void GEngine::CRenderScene::AddLight(const std::shared_ptr<CLight> &light) {
+  if (light == nullptr) {
+    GE_ERROR("Failed to add light: light is null");
+    return;
+  }
+  lights_.push_back(light);
+}
+
+void GEngine::CRenderScene::RemoveLight(const std::shared_ptr<CLight> &light) {
+  lights_.erase(std::remove(lights_.begin(), lights_.end(), light), lights_.end());
+}
+
+void GEngine::CRenderScene::AddRenderObject(const std::shared_ptr<CMesh> &mesh, const glm::mat4 &model) {
+  if (mesh == nullptr) {
+    GE_ERROR("Failed to add render object: mesh is null");
+    return;
+  }
+  SRenderObject object;
+  object.mesh_ = mesh;
+  object.model_ = model;
+  render_objects_.push_back(object);
+}
+
+void GEngine::CRenderScene::AddInstancedObject(const std::shared_ptr<CMesh> &mesh,
+                                               const std::vector<glm::mat4> &transforms) {
+  if (mesh == nullptr) {
+    GE_ERROR("Failed to add instanced object: mesh is null");
+    return;
+  }
+  SInstancedObject object;
+  object.mesh_ = mesh;
+  object.transforms_ = transforms;
+  object.world_bounds_.reserve(transforms.size());
+  for (const auto &transform : transforms) {
+    object.world_bounds_.push_back(mesh->GetBounds().Transform(transform));
+  }
+  instanced_objects_.push_back(std::move(object));
+}
+
+void GEngine::CRenderScene::Clear() {
+  lights_.clear();
+  render_objects_.clear();
+  instanced_objects_.clear();
+}
+
+GEngine::SAABB GEngine::CRenderScene::GetBounds() const {
+  SAABB bounds;
+  for (const auto &object : render_objects_) {
+    bounds.Expand(object.mesh_->GetBounds().Transform(object.model_));
+  }
+  for (const auto &object : instanced_objects_) {
+    for (const auto &instance_bounds : object.world_bounds_) {
+      bounds.Expand(instance_bounds);
+    }
+  }
+  return bounds;
+}
+
+void GEngine::CRenderScene::CollectDrawItems(const CFrustum &frustum, std::vector<SDrawItem> &draw_items) const {
+  for (const auto &object : render_objects_) {
+    if (!frustum.IsBoxVisible(object.mesh_->GetBounds().Transform(object.model_))) {
+      continue;
+    }
+    for (unsigned int i = 0; i < object.mesh_->meshes_.size(); i++) {
+      SAABB world_bounds = object.mesh_->meshes_[i].bounds_.Transform(object.model_);
+      if (!frustum.IsBoxVisible(world_bounds)) {
+        continue;
+      }
+      SDrawItem item;
+      item.mesh_ = object.mesh_.get();
+      item.sub_mesh_ = i;
+      item.model_ = object.model_;
+      item.world_bounds_ = world_bounds;
+      item.alpha_tested_ = object.mesh_->IsAlphaTested(i);
+      draw_items.push_back(item);
+    }
+  }
+}
+
+void GEngine::CRenderScene::CollectInstanceBatches(const CFrustum &frustum, std::vector<SInstanceBatch> &batches) const {
+  batches.resize(instanced_objects_.size());
+  for (size_t i = 0; i < instanced_objects_.size(); i++) {
+    const auto &object = instanced_objects_[i];
+    auto &batch = batches[i];
+    batch.mesh_ = object.mesh_.get();
+    batch.transforms_.clear();
+    for (size_t j = 0; j < object.transforms_.size(); j++) {
+      if (frustum.IsBoxVisible(object.world_bounds_[j])) {
+        batch.transforms_.push_back(object.transforms_[j]);
+      }
+    }
+  }
+}
@@ -1 +1,68 @@
-#pragma once
\ No newline at end of file
+#pragma once
+#include "GEngine/bounds.h"
+#include "GEngine/light.h"
+#include "GEngine/mesh.h"
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+namespace GEngine {
+// a render object is a mesh placed in the world
+struct SRenderObject {
+  std::shared_ptr<CMesh> mesh_;
+  glm::mat4 model_ = glm::mat4(1.0f);
+};
+
+// one mesh repeated with many world transforms, drawn with instancing
+struct SInstancedObject {
+  std::shared_ptr<CMesh> mesh_;
+  std::vector<glm::mat4> transforms_;
+  std::vector<SAABB> world_bounds_; // per instance
+};
+
+// visible instances of one SInstancedObject, ready for CMesh::UploadInstances
+struct SInstanceBatch {
+  CMesh *mesh_ = nullptr;
+  std::vector<glm::mat4> transforms_;
+};
+
+// one sub-mesh draw, produced by culling the scene
+struct SDrawItem {
+  CMesh *mesh_ = nullptr;
+  unsigned int sub_mesh_ = 0;
+  glm::mat4 model_ = glm::mat4(1.0f);
+  SAABB world_bounds_;
+  bool alpha_tested_ = false;
+};
+
+class CRenderScene {
+public:
+  CRenderScene();
+  ~CRenderScene();
+
+  void AddLight(const std::shared_ptr<CLight> &light);
+  void RemoveLight(const std::shared_ptr<CLight> &light);
+  const std::vector<std::shared_ptr<CLight>> &GetLights() const { return lights_; }
+
+  void AddRenderObject(const std::shared_ptr<CMesh> &mesh, const glm::mat4 &model = glm::mat4(1.0f));
+  const std::vector<SRenderObject> &GetRenderObjects() const { return render_objects_; }
+
+  void AddInstancedObject(const std::shared_ptr<CMesh> &mesh, const std::vector<glm::mat4> &transforms);
+  const std::vector<SInstancedObject> &GetInstancedObjects() const { return instanced_objects_; }
+
+  void Clear();
+
+  // world space bounds of every render object
+  SAABB GetBounds() const;
+  // append the sub-meshes intersecting the frustum to draw_items
+  void CollectDrawItems(const CFrustum &frustum, std::vector<SDrawItem> &draw_items) const;
+  // one batch per instanced object (same order), holding the instances
+  // intersecting the frustum. batches keep their capacity between frames
+  void CollectInstanceBatches(const CFrustum &frustum, std::vector<SInstanceBatch> &batches) const;
+
+private:
+  std::vector<std::shared_ptr<CLight>> lights_;
+  std::vector<SRenderObject> render_objects_;
+  std::vector<SInstancedObject> instanced_objects_;
+};
+} // namespace GEngine
@@ -0,0 +1,52 @@
+#pragma once
+
+namespace GEngine {
+// per-frame counters & timings shown in the editor "Stats" panel,
+// render passes write into CSingleton<CRenderSystem>()->GetRenderStats()
+struct SRenderStats {
+  // clustered lighting
+  float light_cluster_build_ms_ = 0.0f;
+  unsigned int cluster_light_count_ = 0;
+  unsigned int cluster_light_index_count_ = 0;
+  // depth pre-pass & lit pass (gpu time)
+  float depth_prepass_ms_ = 0.0f;
+  unsigned int depth_prepass_draw_calls_ = 0;
+  float lit_pass_ms_ = 0.0f;
+  unsigned int lit_shader_variants_ = 0;
+  unsigned int lit_program_switches_ = 0;
+  // draws that bound material textures, 0 when all come from texture arrays
+  unsigned int lit_material_binds_ = 0;
+  unsigned int material_texture_arrays_ = 0;
+  unsigned int material_texture_layers_ = 0;
+  // instancing (lit pass)
+  unsigned int instanced_draw_calls_ = 0;
+  unsigned int instances_drawn_ = 0;
+  // occlusion culling (sub-meshes inside the frustum / rejected by occlusion)
+  unsigned int occlusion_tested_ = 0;
+  unsigned int occlusion_culled_ = 0;
+  float occlusion_cull_ms_ = 0.0f;
+  // cascaded shadows
+  unsigned int shadow_cascades_updated_ = 0;
+  unsigned int shadow_draw_calls_ = 0;
+  // texture streaming
+  unsigned int streamed_textures_ = 0;
+  float streamed_resident_mb_ = 0.0f;
+  unsigned int streamed_levels_uploaded_ = 0;
+  unsigned int streamed_levels_evicted_ = 0;
+  // CTextureUploadQueue, this frame / still queued
+  float texture_uploaded_mb_ = 0.0f;
+  float texture_upload_pending_mb_ = 0.0f;
+  // last atmosphere LUT precomputation (not loaded from the cache)
+  float atmosphere_precompute_ms_ = 0.0f;
+  unsigned int atmosphere_precompute_draw_calls_ = 0;
+  unsigned int atmosphere_precompute_dispatches_ = 0;
+  bool atmosphere_compute_precompute_ = false;
+  // frames the sky-view LUT was rebuilt (sun or camera moved)
+  unsigned int sky_view_lut_updates_ = 0;
+  // irradiance & prefiltered maps CIBLPass rebuilt from the sky capture
+  unsigned int ibl_dynamic_updates_ = 0;
+  // CGLStateCache, state calls sent to GL / dropped as redundant
+  unsigned int gl_state_calls_issued_ = 0;
+  unsigned int gl_state_calls_filtered_ = 0;
+};
+} // namespace GEngine
@@ -1,5 +1,8 @@
 #include "GEngine/render_system.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/singleton.h"
 #include "log.h"
+#include "shader_hot_reload.h"
 #include <algorithm>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -15,6 +18,7 @@ GEngine::CRenderSystem::CRenderSystem()
 }
 
 void GEngine::CRenderSystem::Init() {
+  Shader::InitParallelCompile();
   // set up main camera
   if (!main_camera_) {
     main_camera_ = std::make_shared<CCamera>();
@@ -25,6 +29,9 @@ void GEngine::CRenderSystem::Init() {
     main_UI_ = std::make_shared<CEditorUI>();
     main_UI_->Init();
   }
+  if (main_UI_->shader_hot_reload_) {
+    CSingleton<CShaderHotReload>()->Start();
+  }
 }
 
 std::shared_ptr<GEngine::CGLFWWindow>
@@ -51,6 +58,27 @@ GEngine::CRenderSystem::GetOrCreateMainUI() {
   return main_UI_;
 }
 
+std::shared_ptr<GEngine::CRenderScene>
+GEngine::CRenderSystem::GetOrCreateMainScene() {
+  if (!main_scene_) {
+    main_scene_ = std::make_shared<GEngine::CRenderScene>();
+  }
+  return main_scene_;
+}
+
+void GEngine::CRenderSystem::AddLight(const std::shared_ptr<CLight> &light) {
+  GetOrCreateMainScene()->AddLight(light);
+}
+
+void GEngine::CRenderSystem::RegisterRenderObject(const std::shared_ptr<CMesh> &mesh, const glm::mat4 &model) {
+  GetOrCreateMainScene()->AddRenderObject(mesh, model);
+}
+
+void GEngine::CRenderSystem::RegisterInstancedObject(const std::shared_ptr<CMesh> &mesh,
+                                                     const std::vector<glm::mat4> &transforms) {
+  GetOrCreateMainScene()->AddInstancedObject(mesh, transforms);
+}
+
 std::any& GEngine::CRenderSystem::GetAnyDataByName(const std::string& name) {
   if(resource_center_.find(name) == resource_center_.end()) {
     GE_ERROR("'{0}' not exists in resource center.", name);
@@ -76,9 +104,9 @@ void GEngine::CRenderSystem::SetRenderPipelineType(ERenderPipelineType type) {
 }
 
 void GEngine::CRenderSystem::RenderCube() {
-  glBindVertexArray(GetOrCreateCubeVAO());
+  CSingleton<CGLStateCache>()->BindVertexArray(GetOrCreateCubeVAO());
   glDrawArrays(GL_TRIANGLES, 0, 36);
-  glBindVertexArray(0);
+  CSingleton<CGLStateCache>()->BindVertexArray(0);
 }
 
 int GEngine::CRenderSystem::GetOrCreateCubeVAO() {
@@ -138,7 +166,7 @@ int GEngine::CRenderSystem::CreateVAO(const GLvoid *vertex_data, int data_size,
               int indices_size, int *voVBO) {
   unsigned int VAO, VBO, EBO;
   glGenVertexArrays(1, &VAO);
-  glBindVertexArray(VAO);
+  CSingleton<CGLStateCache>()->BindVertexArray(VAO);
   glGenBuffers(1, &VBO);
   glBindBuffer(GL_ARRAY_BUFFER, VBO);
   glBufferData(GL_ARRAY_BUFFER, data_size, vertex_data, GL_STATIC_DRAW);
@@ -154,7 +182,7 @@ int GEngine::CRenderSystem::CreateVAO(const GLvoid *vertex_data, int data_size,
     offset += length;
     i++;
   }
-  glBindVertexArray(0);
+  CSingleton<CGLStateCache>()->BindVertexArray(0);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
   if(voVBO) {
@@ -236,7 +264,7 @@ void GEngine::CRenderSystem::RenderSphere() {
       }
     }
     
-    glBindVertexArray(sphere_VAO_);
+    CSingleton<CGLStateCache>()->BindVertexArray(sphere_VAO_);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
@@ -252,10 +280,10 @@ void GEngine::CRenderSystem::RenderSphere() {
     glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void *)(8 * sizeof(float)));
   }
 
-  glEnable(GL_DEPTH_TEST);
-  glBindVertexArray(sphere_VAO_);
+  CSingleton<CGLStateCache>()->Enable(GL_DEPTH_TEST);
+  CSingleton<CGLStateCache>()->BindVertexArray(sphere_VAO_);
   glDrawElements(GL_TRIANGLE_STRIP, sphere_index_count_, GL_UNSIGNED_INT, 0);
-  glBindVertexArray(0);
+  CSingleton<CGLStateCache>()->BindVertexArray(0);
 }
 
 unsigned int GEngine::CRenderSystem::LoadTexture(const std::string &path) {
@@ -281,7 +309,7 @@ unsigned int GEngine::CRenderSystem::LoadTexture(const std::string &path) {
       GE_ERROR("Texture format error: {}", path);
       stbi_image_free(data);
     }
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, textureID);
     glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
     glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -308,7 +336,7 @@ void GEngine::CRenderSystem::RegisterRenderPass(
   std::sort(render_passes_.begin(), render_passes_.end(),
             [](const std::shared_ptr<GEngine::CRenderPass> render_pass1,
                const std::shared_ptr<GEngine::CRenderPass> render_pass2) {
-              return render_pass1 < render_pass2;
+              return *render_pass1 < *render_pass2;
             });
   // render_passes_.insert(
   //     std::lower_bound(
@@ -320,6 +348,16 @@ void GEngine::CRenderSystem::RegisterRenderPass(
   //     render_pass);
 }
 
+std::shared_ptr<GEngine::CRenderPass>
+GEngine::CRenderSystem::GetRenderPassByType(CRenderPass::ERenderPassType type) const {
+  for (const auto &render_pass : render_passes_) {
+    if (render_pass->GetType() == type) {
+      return render_pass;
+    }
+  }
+  return nullptr;
+}
+
 void GEngine::CRenderSystem::RegisterAnyDataWithName(const std::string& name, std::any data) {
   if(!data.has_value()) {
     GE_ERROR("Failed to register data {0}.", name);
@@ -3,6 +3,8 @@
 #include "GEngine/editor_ui.h"
 #include "GEngine/glfw_window.h"
 #include "GEngine/render_pass.h"
+#include "GEngine/render_scene.h"
+#include "GEngine/render_stats.h"
 #include "GEngine/shader.h"
 #include "GEngine/singleton.h"
 #include <initializer_list>
@@ -30,9 +32,14 @@ public:
   std::shared_ptr<CGLFWWindow>  GetOrCreateWindow();
   std::shared_ptr<CCamera>      GetOrCreateMainCamera();
   std::shared_ptr<CEditorUI>    GetOrCreateMainUI();
+  std::shared_ptr<CRenderScene> GetOrCreateMainScene();
   // std::shared_ptr<CModel>&      GetOrCreateModelByPath(const std::string& path);
   std::any& GetAnyDataByName(const std::string& name);
+  // optional resources, check before GetAnyDataByName to avoid the error log
+  bool HasAnyDataWithName(const std::string& name) const { return resource_center_.find(name) != resource_center_.end(); }
   std::vector<std::shared_ptr<GEngine::CRenderPass>>& GetRenderPass() { return render_passes_; }
+  // first registered pass of the given type, nullptr if none
+  std::shared_ptr<CRenderPass> GetRenderPassByType(CRenderPass::ERenderPassType type) const;
   void SetRenderPipelineType(ERenderPipelineType type);
 
   void RenderCube();
@@ -47,6 +54,12 @@ public:
   unsigned int LoadTexture(const std::string &path);
   void RegisterRenderPass(const std::shared_ptr<CRenderPass>& render_pass);
   void RegisterAnyDataWithName(const std::string& name, std::any data);
+  // scene content, forwarded to the main scene
+  void AddLight(const std::shared_ptr<CLight>& light);
+  void RegisterRenderObject(const std::shared_ptr<CMesh>& mesh, const glm::mat4& model = glm::mat4(1.0f));
+  void RegisterInstancedObject(const std::shared_ptr<CMesh>& mesh, const std::vector<glm::mat4>& transforms);
+
+  SRenderStats& GetRenderStats() { return render_stats_; }
 
   std::map<std::string, std::shared_ptr<CTexture>> texture_center_;
 
@@ -57,6 +70,8 @@ private:
   std::shared_ptr<CGLFWWindow>  window_;
   std::shared_ptr<CCamera>      main_camera_; // main camera
   std::shared_ptr<CEditorUI>    main_UI_;     // main UI
+  std::shared_ptr<CRenderScene> main_scene_;  // main scene
+  SRenderStats render_stats_;
 
   std::vector<std::shared_ptr<CRenderPass>>  render_passes_;
   ERenderPipelineType render_pipeline_type_ = ERenderPipelineType::kForward;
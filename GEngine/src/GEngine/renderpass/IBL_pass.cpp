@@ -1,53 +1,76 @@
 #include "GEngine/renderpass/IBL_pass.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/ibl_cache.h"
+#include "GEngine/job_system.h"
 #include "GEngine/singleton.h"
 #include "GEngine/render_system.h"
+#include "GEngine/renderpass/precomputed_atmosphere_pass.h"
+#include "GEngine/texture_upload_queue.h"
 #define GLFW_INCLUDE_NONE
 #include "GLFW/glfw3.h"
 #include "glm/fwd.hpp"
 #include "log.h"
+#include <chrono>
 #include <memory>
 
+namespace {
+const glm::mat4 kCaptureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
+const glm::mat4 kCaptureViews[] = {
+    glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
+    glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
+    glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
+    glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f)),
+    glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
+    glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f))
+};
+} // namespace
+
 GEngine::CIBLPass::CIBLPass(const std::string &name, int order)
     : CRenderPass(name, order) {}
 
-GEngine::CIBLPass::~CIBLPass() {}
+GEngine::CIBLPass::~CIBLPass() {
+  if (sh_fence_) {
+    glDeleteSync(sh_fence_);
+  }
+  if (sh_pbo_) {
+    glDeleteBuffers(1, &sh_pbo_);
+  }
+  if (sh_fbo_) {
+    CSingleton<CGLStateCache>()->OnFramebufferDeleted(sh_fbo_);
+    glDeleteFramebuffers(1, &sh_fbo_);
+  }
+  if (empty_vao_) {
+    CSingleton<CGLStateCache>()->OnVertexArrayDeleted(empty_vao_);
+    glDeleteVertexArrays(1, &empty_vao_);
+  }
+}
+
+void GEngine::CIBLPass::PrepareShaders() {
+  std::string v_path("../../GEngine/src/GEngine/renderpass/ibl_irradiance_vert.glsl");
+  std::string prefiltered_f_path("../../GEngine/src/GEngine/renderpass/ibl_prefiltered_frag.glsl");
+  prefiltered_shader_ = std::make_shared<Shader>(v_path, prefiltered_f_path);
+  // the fullscreen triangle of the Hi-Z pass
+  std::string sh_v_path("../../GEngine/src/GEngine/renderpass/hiz_vert.glsl");
+  std::string sh_f_path("../../GEngine/src/GEngine/renderpass/ibl_sh_frag.glsl");
+  sh_shader_ = std::make_shared<Shader>(sh_v_path, sh_f_path);
+  std::string brdf_f_path("../../GEngine/src/GEngine/renderpass/ibl_brdf_frag.glsl");
+  brdf_shader_ = std::make_shared<Shader>(sh_v_path, brdf_f_path);
+}
 
 void GEngine::CIBLPass::Init() {
   glfwMakeContextCurrent(CSingleton<CRenderSystem>()->GetOrCreateWindow()->GetGLFWwindow());
   // Init Irradiance Map
-  glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+  CSingleton<CGLStateCache>()->Enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
   glGenFramebuffers(1, &fbo_);
   glGenRenderbuffers(1, &rbo_);
 
-  glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, fbo_);
   glBindRenderbuffer(GL_RENDERBUFFER, rbo_);
   glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo_);
 
-  irradiance_texture_ = std::make_shared<CTexture>(CTexture::ETarget::kTextureCubeMap);
-  irradiance_texture_->SetSWrapMode(CTexture::EWrapMode::kClampToEdge),
-  irradiance_texture_->SetTWrapMode(CTexture::EWrapMode::kClampToEdge),
-  irradiance_texture_->SetRWrapMode(CTexture::EWrapMode::kClampToEdge),
-  irradiance_texture_->SetMinFilter(CTexture::EMinFilter::kLinear);
-  irradiance_texture_->SetMagFilter(CTexture::EMagFilter::kLinear);
-  irradiance_texture_->SetWidth(32);
-  irradiance_texture_->SetHeight(32);
-
-  glBindTexture(GL_TEXTURE_CUBE_MAP, irradiance_texture_->id_);
-  for(unsigned int i=0; i<6; i++) {
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F,
-                 irradiance_texture_->GetWidth(), irradiance_texture_->GetHeight(), 
-                 0, GL_RGB, GL_FLOAT, nullptr);
-  }
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, static_cast<GLint>(irradiance_texture_->GetSWrapMode()));
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, static_cast<GLint>(irradiance_texture_->GetTWrapMode()));
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, static_cast<GLint>(irradiance_texture_->GetRWrapMode()));
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, static_cast<GLint>(irradiance_texture_->GetMinFilter())); 
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, static_cast<GLint>(irradiance_texture_->GetMagFilter()));
-  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-
-  glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
-  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 32, 32);
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, fbo_);
+  ResizeDepthBuffer(32, 32);
   // framebuffer_->SetColorAttachment(CAttachment(irradiance_texture_));
   // auto renderbuffer = std::make_shared<CRenderBuffer>();
   // renderbuffer->InitialzeStorage(CRenderBuffer::EPixelFormat::kDepthComponent24, 32, 32);
@@ -57,152 +80,414 @@ void GEngine::CIBLPass::Init() {
     GE_WARN("Framebuffer object is not complete");
   }
 
-  // make sure the skybox_texture is in texture_center_
-  glFinish();
+  // make sure the skybox_texture is in texture_center_ & its faces are uploaded
+  CSingleton<CTextureUploadQueue>()->Flush();
+
+  // the GPU SH projection of dynamic environments, 9 coefficients
+  sh_target_ = std::make_shared<CTexture>(CTexture::ETarget::kTexture2D);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, sh_target_->id_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, 9, 1, 0, GL_RGBA, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, 0);
+  glGenFramebuffers(1, &sh_fbo_);
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, sh_fbo_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sh_target_->id_, 0);
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, 0);
+  glGenBuffers(1, &sh_pbo_);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, sh_pbo_);
+  glBufferData(GL_PIXEL_PACK_BUFFER, 9 * 4 * sizeof(float), nullptr, GL_STREAM_READ);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glGenVertexArrays(1, &empty_vao_);
+
+  irradiance_sh_ = std::make_shared<SIrradianceSH>();
+
+  auto &texture_center = CSingleton<CRenderSystem>()->texture_center_;
+  if (texture_center.find("skybox_texture") == texture_center.end()) {
+    // no static skybox, the SH & map are filled from the atmosphere's sky capture in Tick
+    GenerateBRDFLUT();
+    prefiltered_texture_ = CreatePrefilteredMap(SSkyCapture::kSize, kDynamicMipLevels);
+    texture_center["prefiltered_texture"] = prefiltered_texture_;
+    texture_center["ibl_brdf_lut"] = specular_brdf_lut_;
+    return;
+  }
 
   // auto skybox_cubemap = CSingleton<GEngine::CRenderSystem>()->GetAnyDataByName("skybox_cubemap");
   // auto skybox_texture = std::any_cast<std::shared_ptr<CTexture>>(skybox_cubemap);
-  auto skybox_texture = CSingleton<CRenderSystem>()->texture_center_["skybox_texture"];
+  auto skybox_texture = texture_center["skybox_texture"];
 
-  // render irradiance map to off-screen framebuffer
-  GenerateIrradianceMap(skybox_texture);
+  // the bake of the same skybox faces & settings is loaded from the CIBLCache
+  auto start = std::chrono::steady_clock::now();
+  auto elapsed_ms = [&start]() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  };
+  auto render_system = CSingleton<CRenderSystem>();
+  uint64_t key = 0;
+  if (render_system->HasAnyDataWithName("skybox_hash")) {
+    key = CIBLCache::GetKey(std::any_cast<uint64_t>(render_system->GetAnyDataByName("skybox_hash")), bake_settings_);
+  }
+  if (key != 0 && LoadFromCache(key)) {
+    GE_INFO("IBL maps loaded from cache in {0:.1f} ms", elapsed_ms());
+  } else {
+    GenerateIrradianceSH(skybox_texture);
+    GeneratePrefilteredMap(skybox_texture, bake_settings_.prefiltered_levels_);
+    GenerateBRDFLUT();
+    glFinish();
+    GE_INFO("IBL maps baked in {0:.1f} ms", elapsed_ms());
+    if (key != 0) {
+      StoreToCache(key);
+    }
+  }
+  texture_center["prefiltered_texture"] = prefiltered_texture_;
+  texture_center["ibl_brdf_lut"] = specular_brdf_lut_;
+}
 
-  // CSingleton<GEngine::CRenderSystem>()->RegisterAnyDataWithName("irradiance_cubemap", irradiance_texture_);
-  CSingleton<CRenderSystem>()->texture_center_["irradiance_texture"] = irradiance_texture_;
+void GEngine::CIBLPass::Tick() {
+  // a new sky capture restarts the rebuild once the current one is done
+  auto render_system = CSingleton<CRenderSystem>();
+  auto &texture_center = render_system->texture_center_;
+  if (!dynamic_source_ && texture_center.find("sky_capture") != texture_center.end()) {
+    auto capture = std::any_cast<std::shared_ptr<SSkyCapture>>(render_system->GetAnyDataByName("sky_capture"));
+    if (capture->version_ != 0 && capture->version_ != dynamic_version_) {
+      dynamic_version_ = capture->version_;
+      dynamic_source_ = capture->cubemap_;
+      if (!pending_prefiltered_texture_ || pending_prefiltered_texture_->GetWidth() != SSkyCapture::kSize) {
+        pending_prefiltered_texture_ = CreatePrefilteredMap(SSkyCapture::kSize, kDynamicMipLevels);
+      }
+      dynamic_steps_.clear();
+      dynamic_steps_.push_back({-1, -1});
+      for (int level = 0; level < kDynamicMipLevels; level++) {
+        if (static_cast<unsigned int>(SSkyCapture::kSize >> level) >= kDynamicFaceStepSize) {
+          for (int face = 0; face < 6; face++) {
+            dynamic_steps_.push_back({level, face});
+          }
+        } else {
+          dynamic_steps_.push_back({level, -1});
+        }
+      }
+      dynamic_step_ = 0;
+    }
+  }
+  if (dynamic_source_) {
+    AdvanceDynamicUpdate();
+  }
+}
 
-  // Generate Prefiltered Map
-  int max_mip_levels = 8;
-  GeneratePrefilteredMap(skybox_texture, max_mip_levels);
-  CSingleton<CRenderSystem>()->texture_center_["prefiltered_texture"] = prefiltered_texture_;
+void GEngine::CIBLPass::AdvanceDynamicUpdate() {
+  const SDynamicStep &step = dynamic_steps_[dynamic_step_];
+  if (step.level_ < 0) {
+    ProjectIrradianceSH(dynamic_source_);
+  } else {
+    CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, fbo_);
+    for (int face = 0; face < 6; face++) {
+      if (step.face_ < 0 || step.face_ == face) {
+        RenderPrefilteredFace(dynamic_source_, *pending_prefiltered_texture_, step.level_, kDynamicMipLevels, face);
+      }
+    }
+  }
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, 0);
+  RestoreViewport();
 
-  // Load brdf_lut
-  // std::string lut_path = std::string("../../assets/textures/IBL/ibl_brdf_lut.png");
-  // auto sampler = std::make_shared<CSampler>(
-  //     CSampler::EMinFilter::kLinear, CSampler::EMagFilter::kLinear,
-  //     CSampler::EWrapMode::kClampToEdge, CSampler::EWrapMode::kClampToEdge);
-  // specular_brdf_lut_ = std::make_shared<CTexture>(lut_path, CTexture::ETarget::kTexture2D, true, sampler);
-  // CSingleton<CRenderSystem>()->texture_center_["ibl_brdf_lut"] = specular_brdf_lut_;
+  if (++dynamic_step_ == dynamic_steps_.size()) {
+    // the SH & the map change in the same frame, the readback finished frames ago
+    ReadIrradianceSH();
+    std::swap(prefiltered_texture_, pending_prefiltered_texture_);
+    auto render_system = CSingleton<CRenderSystem>();
+    render_system->texture_center_["prefiltered_texture"] = prefiltered_texture_;
+    render_system->GetRenderStats().ibl_dynamic_updates_++;
+    dynamic_source_.reset();
+  }
 }
 
-void GEngine::CIBLPass::Tick() {
-  // do nothing
-}
-
-// create an irradiance cubemap, stores in a FBO
-void GEngine::CIBLPass::GenerateIrradianceMap(std::shared_ptr<GEngine::CTexture> skybox_texture) {
-  glm::mat4 capture_projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
-  glm::mat4 capture_views[] = {
-      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f)),
-      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f))
-  };
-  std::string v_path("../../GEngine/src/GEngine/renderpass/ibl_irradiance_vert.glsl");
-  std::string f_path("../../GEngine/src/GEngine/renderpass/ibl_irradiance_frag.glsl");
-  shader_ = std::make_shared<Shader>(v_path, f_path);
-  shader_->SetTexture("cubemap_texture", skybox_texture);
-  // render irradiance map to off-screen framebuffer
-  shader_->Use();
-  shader_->SetMat4("projection", capture_projection);
-  glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
-  glViewport(0, 0, 32, 32);
+std::shared_ptr<GEngine::CTexture> GEngine::CIBLPass::CreatePrefilteredMap(int base_size, int levels) const {
+  auto prefiltered_texture = std::make_shared<CTexture>(CTexture::ETarget::kTextureCubeMap);
+  prefiltered_texture->SetSWrapMode(CTexture::EWrapMode::kClampToEdge),
+  prefiltered_texture->SetTWrapMode(CTexture::EWrapMode::kClampToEdge),
+  prefiltered_texture->SetRWrapMode(CTexture::EWrapMode::kClampToEdge),
+  prefiltered_texture->SetMinFilter(CTexture::EMinFilter::kLinearMipmapLinear);
+  prefiltered_texture->SetMagFilter(CTexture::EMagFilter::kLinear);
+  prefiltered_texture->SetWidth(base_size);
+  prefiltered_texture->SetHeight(base_size);
+  prefiltered_texture->has_mipmap_ = true;
+  prefiltered_texture->mip_levels_ = levels;
+
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_CUBE_MAP, prefiltered_texture->id_);
   for(unsigned int i=0; i<6; i++) {
-    shader_->SetMat4("view", capture_views[i]);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, irradiance_texture_->id_, 0);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, prefiltered_texture->GetWidth(), prefiltered_texture->GetHeight(), 0,
+                 GL_RGB, GL_FLOAT, NULL);
+  }
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, static_cast<GLint>(prefiltered_texture->GetSWrapMode()));
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, static_cast<GLint>(prefiltered_texture->GetTWrapMode()));
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, static_cast<GLint>(prefiltered_texture->GetRWrapMode()));
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, static_cast<GLint>(prefiltered_texture->GetMinFilter())); 
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, static_cast<GLint>(prefiltered_texture->GetMagFilter()));
+  // reserve space for lod, the levels past the roughest are never filled
+  glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  return prefiltered_texture;
+}
 
-    CSingleton<GEngine::CRenderSystem>()->RenderCube();
+std::shared_ptr<GEngine::CTexture> GEngine::CIBLPass::CreateBRDFLUT(int size) const {
+  auto brdf_lut = std::make_shared<CTexture>(CTexture::ETarget::kTexture2D);
+  brdf_lut->SetSWrapMode(CTexture::EWrapMode::kClampToEdge);
+  brdf_lut->SetTWrapMode(CTexture::EWrapMode::kClampToEdge);
+  brdf_lut->SetMinFilter(CTexture::EMinFilter::kLinear);
+  brdf_lut->SetMagFilter(CTexture::EMagFilter::kLinear);
+  brdf_lut->SetWidth(size);
+  brdf_lut->SetHeight(size);
+
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, brdf_lut->id_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, size, size, 0, GL_RG, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, 0);
+  return brdf_lut;
+}
+
+void GEngine::CIBLPass::ResizeDepthBuffer(unsigned int width, unsigned int height) {
+  if (width == depth_width_ && height == depth_height_) {
+    return;
   }
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  int screen_width, screen_height; 
+  depth_width_ = width;
+  depth_height_ = height;
+  glBindRenderbuffer(GL_RENDERBUFFER, rbo_);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+}
+
+void GEngine::CIBLPass::RestoreViewport() {
+  int screen_width, screen_height;
   auto window = CSingleton<CRenderSystem>()->GetOrCreateWindow()->GetGLFWwindow();
   glfwGetFramebufferSize(window, &screen_width, &screen_height);
-  glViewport(0, 0, screen_width, screen_height);
+  CSingleton<CGLStateCache>()->Viewport(0, 0, screen_width, screen_height);
+}
+
+// fbo_ bound
+void GEngine::CIBLPass::RenderPrefilteredFace(std::shared_ptr<GEngine::CTexture> source, const CTexture &target,
+                                              unsigned int level, unsigned int max_mip_levels, unsigned int face) {
+  shader_ = prefiltered_shader_;
+  shader_->SetTexture("cubemap_texture", source);
+  shader_->Use();
+  shader_->SetMat4("projection", kCaptureProjection);
+  unsigned int width = static_cast<unsigned int>(target.GetWidth() * std::pow(0.5, level));
+  unsigned int height = static_cast<unsigned int>(target.GetHeight() * std::pow(0.5, level));
+  ResizeDepthBuffer(width, height);
+  // renderbuffer->InitialzeStorage(CRenderBuffer::EPixelFormat::kDepthComponent24, width, height);
+  // framebuffer_->SetDepthAttachment(CAttachment(renderbuffer));
+  CSingleton<CGLStateCache>()->Viewport(0, 0, width, height);
+
+  float roughness = (float)level / (float)(max_mip_levels - 1);
+  shader_->SetFloat("roughness", roughness);
+  shader_->SetInt("sample_count", static_cast<int>(bake_settings_.GetPrefilteredSampleCount(roughness)));
+  shader_->SetBool("filtered", bake_settings_.filtered_importance_sampling_);
+  shader_->SetFloat("source_size", static_cast<float>(source->GetWidth()));
+  shader_->SetMat4("view", kCaptureViews[face]);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, target.id_, level);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    GE_WARN("Framebuffer object is not completed in IBL pass");
+  }
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  // glEnable(GL_DEPTH_TEST);
+  // glDepthFunc(GL_LEQUAL);
+  CSingleton<GEngine::CRenderSystem>()->RenderCube();
+}
+
+void GEngine::CIBLPass::GenerateIrradianceSH(std::shared_ptr<GEngine::CTexture> skybox_texture) {
+  // SH9 is smooth, a small mip is enough (GL_TEXTURE_CUBE_MAP_POSITIVE_X for the sizes)
+  auto start = std::chrono::steady_clock::now();
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_CUBE_MAP, skybox_texture->id_);
+  GLint level = 0;
+  GLint size = 0;
+  glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_WIDTH, &size);
+  GLint max_level = 0;
+  glGetTexParameteriv(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, &max_level);
+  // CSkyboxPass switches to a mipmap filter once it generated the mips, its
+  // CTexture doesn't know
+  GLint min_filter = GL_LINEAR;
+  glGetTexParameteriv(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, &min_filter);
+  bool has_mipmap = min_filter != GL_LINEAR && min_filter != GL_NEAREST;
+  if (has_mipmap) {
+    while (size > kIrradianceSHSize && level < max_level) {
+      level++;
+      size = std::max(1, size / 2);
+    }
+  }
+  std::vector<std::vector<float>> faces(6, std::vector<float>(static_cast<size_t>(size) * size * 3));
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  std::array<const float *, 6> face_data;
+  for (int face = 0; face < 6; face++) {
+    glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB, GL_FLOAT, faces[face].data());
+    face_data[face] = faces[face].data();
+  }
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+  *irradiance_sh_ = CSphericalHarmonics::ProjectCubemap(face_data, size, 3);
+  PublishIrradianceSH();
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  GE_INFO("Irradiance SH projected from 6x{0}^2 texels in {1:.1f} ms on {2} threads", size, ms,
+          CSingleton<CJobSystem>()->GetWorkerCount() + 1);
+}
+
+// fullscreen draw into sh_fbo_, the PBO read is queued behind it
+void GEngine::CIBLPass::ProjectIrradianceSH(std::shared_ptr<GEngine::CTexture> source) {
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, sh_fbo_);
+  CSingleton<CGLStateCache>()->Viewport(0, 0, 9, 1);
+  bool depth_test = CSingleton<CGLStateCache>()->IsEnabled(GL_DEPTH_TEST);
+  CSingleton<CGLStateCache>()->Disable(GL_DEPTH_TEST);
+  sh_shader_->SetTexture("cubemap_texture", source);
+  sh_shader_->Use();
+  sh_shader_->SetInt("u_grid_size", std::max(1, source->GetWidth() / 2));
+  CSingleton<CGLStateCache>()->BindVertexArray(empty_vao_);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  CSingleton<CGLStateCache>()->BindVertexArray(0);
+  CSingleton<CGLStateCache>()->SetEnabled(GL_DEPTH_TEST, depth_test);
+
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, sh_pbo_);
+  glReadPixels(0, 0, 9, 1, GL_RGBA, GL_FLOAT, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  if (sh_fence_) {
+    glDeleteSync(sh_fence_);
+  }
+  sh_fence_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void GEngine::CIBLPass::ReadIrradianceSH() {
+  if (!sh_fence_) {
+    return;
+  }
+  // signaled long ago unless the prefilter steps were skipped
+  glClientWaitSync(sh_fence_, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+  glDeleteSync(sh_fence_);
+  sh_fence_ = nullptr;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, sh_pbo_);
+  const float *texels =
+      static_cast<const float *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 9 * 4 * sizeof(float), GL_MAP_READ_BIT));
+  if (texels) {
+    for (int i = 0; i < 9; i++) {
+      irradiance_sh_->coefficients_[i] = glm::vec3(texels[i * 4], texels[i * 4 + 1], texels[i * 4 + 2]);
+    }
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    PublishIrradianceSH();
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void GEngine::CIBLPass::PublishIrradianceSH() {
+  auto render_system = CSingleton<CRenderSystem>();
+  if (!render_system->HasAnyDataWithName("irradiance_sh")) {
+    render_system->RegisterAnyDataWithName("irradiance_sh", irradiance_sh_);
+  }
 }
 
 void GEngine::CIBLPass::GeneratePrefilteredMap(std::shared_ptr<GEngine::CTexture> skybox_texture, int max_mip_levels) {
-  glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+  CSingleton<CGLStateCache>()->Enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
   // Init Prefiltered Cubemap & framebuffer
-  prefiltered_texture_ = std::make_shared<CTexture>(CTexture::ETarget::kTextureCubeMap);
-  prefiltered_texture_->SetSWrapMode(CTexture::EWrapMode::kClampToEdge),
-  prefiltered_texture_->SetTWrapMode(CTexture::EWrapMode::kClampToEdge),
-  prefiltered_texture_->SetRWrapMode(CTexture::EWrapMode::kClampToEdge),
-  prefiltered_texture_->SetMinFilter(CTexture::EMinFilter::kLinearMipmapLinear);
-  prefiltered_texture_->SetMagFilter(CTexture::EMagFilter::kLinear);
-  prefiltered_texture_->SetWidth(256);
-  prefiltered_texture_->SetHeight(256);
-  prefiltered_texture_->has_mipmap_ = true;
-
-  glBindTexture(GL_TEXTURE_CUBE_MAP, prefiltered_texture_->id_);
-  for(unsigned int i=0; i<6; i++) {
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, prefiltered_texture_->GetWidth(), prefiltered_texture_->GetHeight(), 0,
-                 GL_RGB, GL_FLOAT, NULL);
-  }
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, static_cast<GLint>(prefiltered_texture_->GetSWrapMode()));
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, static_cast<GLint>(prefiltered_texture_->GetTWrapMode()));
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, static_cast<GLint>(prefiltered_texture_->GetRWrapMode()));
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, static_cast<GLint>(prefiltered_texture_->GetMinFilter())); 
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, static_cast<GLint>(prefiltered_texture_->GetMagFilter()));
-  // reserve space for lod
-  glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  prefiltered_texture_ = CreatePrefilteredMap(bake_settings_.prefiltered_size_, max_mip_levels);
 
   // framebuffer_->SetColorAttachment(CAttachment(prefiltered_texture_));
   // auto renderbuffer = std::make_shared<CRenderBuffer>();
   // renderbuffer->InitialzeStorage(CRenderBuffer::EPixelFormat::kDepthComponent24, prefiltered_texture_->GetWidth(), prefiltered_texture_->GetHeight());
   // framebuffer_->SetDepthAttachment(CAttachment(renderbuffer));
 
-
   // render to cubemap texture
-  std::string v_path("../../GEngine/src/GEngine/renderpass/ibl_irradiance_vert.glsl");
-  std::string f_path("../../GEngine/src/GEngine/renderpass/ibl_prefiltered_frag.glsl");
-  shader_ = std::make_shared<Shader>(v_path, f_path);
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, fbo_);
+  // glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_->GetID());
+  for(unsigned int level=0; level<max_mip_levels; level++) {
+    for(unsigned int i=0; i<6; i++) {
+      RenderPrefilteredFace(skybox_texture, *prefiltered_texture_, level, max_mip_levels, i);
+    }
+  }
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, 0);
+  RestoreViewport();
+}
 
-  glm::mat4 capture_projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
-  glm::mat4 capture_views[] = {
-    glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-    glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-    glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-    glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f)),
-    glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-    glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f))
-  };
+void GEngine::CIBLPass::GenerateBRDFLUT() {
+  int size = bake_settings_.brdf_lut_size_;
+  specular_brdf_lut_ = CreateBRDFLUT(size);
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, fbo_);
+  // the render area is the intersection of the attachments
+  ResizeDepthBuffer(size, size);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, specular_brdf_lut_->id_, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    GE_WARN("Framebuffer object is not completed in IBL pass");
+  }
+  CSingleton<CGLStateCache>()->Viewport(0, 0, size, size);
+  bool depth_test = CSingleton<CGLStateCache>()->IsEnabled(GL_DEPTH_TEST);
+  CSingleton<CGLStateCache>()->Disable(GL_DEPTH_TEST);
+  brdf_shader_->Use();
+  brdf_shader_->SetInt("u_size", size);
+  brdf_shader_->SetInt("u_sample_count", static_cast<int>(bake_settings_.brdf_lut_samples_));
+  CSingleton<CGLStateCache>()->BindVertexArray(empty_vao_);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  CSingleton<CGLStateCache>()->BindVertexArray(0);
+  CSingleton<CGLStateCache>()->SetEnabled(GL_DEPTH_TEST, depth_test);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, 0);
+  RestoreViewport();
+}
 
-  shader_->Use();
-  shader_->SetTexture("cubemap_texture", skybox_texture);
-  shader_->SetMat4("projection", capture_projection);
+bool GEngine::CIBLPass::LoadFromCache(uint64_t key) {
+  CIBLCache::SEntry entry;
+  if (!CSingleton<CIBLCache>()->Load(key, bake_settings_, entry)) {
+    return false;
+  }
+  *irradiance_sh_ = entry.irradiance_;
+  PublishIrradianceSH();
+  prefiltered_texture_ = CreatePrefilteredMap(entry.prefiltered_size_, entry.prefiltered_levels_);
+  specular_brdf_lut_ = CreateBRDFLUT(entry.brdf_lut_size_);
 
-  glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
-  // glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_->GetID());
-  for(unsigned int level=0; level<max_mip_levels; level++) {
-    unsigned int width = static_cast<unsigned int>(prefiltered_texture_->GetWidth() * std::pow(0.5, level));
-    unsigned int height = static_cast<unsigned int>(prefiltered_texture_->GetHeight() * std::pow(0.5, level));
-    glBindRenderbuffer(GL_RENDERBUFFER, rbo_);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-      GE_WARN("Framebuffer object is not completed in IBL pass");
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_CUBE_MAP, prefiltered_texture_->id_);
+  const uint16_t *texels = entry.prefiltered_.data();
+  for (int level = 0; level < entry.prefiltered_levels_; level++) {
+    int size = std::max(1, entry.prefiltered_size_ >> level);
+    for (int face = 0; face < 6; face++) {
+      glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, 0, 0, size, size, GL_RGB, GL_HALF_FLOAT, texels);
+      texels += static_cast<size_t>(size) * size * 3;
     }
-    // renderbuffer->InitialzeStorage(CRenderBuffer::EPixelFormat::kDepthComponent24, width, height);
-    // framebuffer_->SetDepthAttachment(CAttachment(renderbuffer));
-    glViewport(0, 0, width, height);
+  }
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, specular_brdf_lut_->id_);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, entry.brdf_lut_size_, entry.brdf_lut_size_, GL_RG, GL_HALF_FLOAT,
+                  entry.brdf_lut_.data());
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  return true;
+}
 
-    float roughness = (float)level / (float)(max_mip_levels - 1);
-    shader_->SetFloat("roughness", roughness);
-    for(unsigned int i=0; i<6; i++) {
-      shader_->SetMat4("view", capture_views[i]);
-      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, prefiltered_texture_->id_, level);
-      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-      // glEnable(GL_DEPTH_TEST);
-      // glDepthFunc(GL_LEQUAL);
-      shader_->Use();
-      CSingleton<GEngine::CRenderSystem>()->RenderCube();
+void GEngine::CIBLPass::StoreToCache(uint64_t key) {
+  if (!CSingleton<CIBLCache>()->IsEnabled()) {
+    return;
+  }
+  CIBLCache::SEntry entry;
+  entry.irradiance_ = *irradiance_sh_;
+  entry.prefiltered_size_ = prefiltered_texture_->GetWidth();
+  entry.prefiltered_levels_ = bake_settings_.prefiltered_levels_;
+  entry.brdf_lut_size_ = specular_brdf_lut_->GetWidth();
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_CUBE_MAP, prefiltered_texture_->id_);
+  for (int level = 0; level < entry.prefiltered_levels_; level++) {
+    size_t size = static_cast<size_t>(std::max(1, entry.prefiltered_size_ >> level));
+    for (int face = 0; face < 6; face++) {
+      size_t offset = entry.prefiltered_.size();
+      entry.prefiltered_.resize(offset + size * size * 3);
+      glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB, GL_HALF_FLOAT,
+                    entry.prefiltered_.data() + offset);
     }
   }
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  int screen_width, screen_height;
-  auto window = CSingleton<CRenderSystem>()->GetOrCreateWindow()->GetGLFWwindow();
-  glfwGetFramebufferSize(window, &screen_width, &screen_height);
-  glViewport(0, 0, screen_width, screen_height);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  entry.brdf_lut_.resize(static_cast<size_t>(entry.brdf_lut_size_) * entry.brdf_lut_size_ * 2);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, specular_brdf_lut_->id_);
+  glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_HALF_FLOAT, entry.brdf_lut_.data());
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, 0);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  CSingleton<CIBLCache>()->Store(key, entry);
 }
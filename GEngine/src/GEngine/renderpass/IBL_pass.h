@@ -1,6 +1,8 @@
 #pragma once
 #include "GEngine/render_pass.h"
+#include "GEngine/ibl_baker.h"
 #include <string>
+#include <vector>
 
 namespace GEngine {
 class CIBLPass : public CRenderPass {
@@ -8,20 +10,78 @@ public:
   CIBLPass(const std::string &name, int order);
   virtual ~CIBLPass();
 
+  // split sum LUT into specular_brdf_lut_ ("ibl_brdf_lut")
   void GenerateBRDFLUT();
-  void GenerateIrradianceMap(std::shared_ptr<GEngine::CTexture> texture);
+  // SH9 of the irradiance on the CPU, from a mip of at most kIrradianceSHSize^2
+  void GenerateIrradianceSH(std::shared_ptr<GEngine::CTexture> texture);
   void GeneratePrefilteredMap(std::shared_ptr<GEngine::CTexture> texture, int max_mip_levels) ;
 
+  virtual void PrepareShaders() override;
   virtual void Init() override;
   virtual void Tick() override;
 
 private:
-  std::shared_ptr<GEngine::CTexture> irradiance_texture_;
+  // without contents, with the mips of base_size. Sampled up to levels - 1
+  // (mip_levels_), the roughness 1 level
+  std::shared_ptr<GEngine::CTexture> CreatePrefilteredMap(int base_size, int levels) const;
+  std::shared_ptr<GEngine::CTexture> CreateBRDFLUT(int size) const;
+  // the SH, prefiltered map & BRDF LUT of the skybox from/to the CIBLCache
+  bool LoadFromCache(uint64_t key);
+  void StoreToCache(uint64_t key);
+  // SH9 of the source cubemap into sh_target_ on the GPU, read back through
+  // sh_pbo_ by ReadIrradianceSH
+  void ProjectIrradianceSH(std::shared_ptr<GEngine::CTexture> source);
+  void ReadIrradianceSH();
+  // registers "irradiance_sh" once it holds coefficients, the forward pass
+  // keeps its flat ambient until then
+  void PublishIrradianceSH();
+  // renders a face (a mip) of target from the source cubemap into fbo_
+  void RenderPrefilteredFace(std::shared_ptr<GEngine::CTexture> source, const CTexture &target, unsigned int level,
+                             unsigned int max_mip_levels, unsigned int face);
+  void ResizeDepthBuffer(unsigned int width, unsigned int height);
+  void RestoreViewport();
+  // the next step of the rebuild from the atmosphere's SSkyCapture
+  void AdvanceDynamicUpdate();
+
+  // 64 -> 1, the mips of SSkyCapture::kSize
+  static constexpr int kDynamicMipLevels = 7;
+  // smaller mips are filtered in one step (all faces)
+  static constexpr unsigned int kDynamicFaceStepSize = 32;
+  // the file skybox mip projected on the CPU
+  static constexpr int kIrradianceSHSize = 128;
+
+  SIBLBakeSettings bake_settings_;
+  // "irradiance_sh" after the first projection, updated in place
+  std::shared_ptr<SIrradianceSH> irradiance_sh_;
   std::shared_ptr<GEngine::CTexture> prefiltered_texture_;
   std::shared_ptr<GEngine::CTexture> specular_brdf_lut_;
   std::shared_ptr<GEngine::CFrameBuffer> framebuffer_;
+  std::shared_ptr<Shader> sh_shader_;
+  // 9x1 RGBA32F, the coefficients of the last GPU projection
+  std::shared_ptr<GEngine::CTexture> sh_target_;
+  unsigned int sh_fbo_ = 0;
+  unsigned int sh_pbo_ = 0;
+  GLsync sh_fence_ = nullptr;
+  unsigned int empty_vao_ = 0;
+  std::shared_ptr<Shader> prefiltered_shader_;
+  std::shared_ptr<Shader> brdf_shader_;
+
+  // rebuilding from the sky capture, one step (SH projection, prefiltered
+  // face or small mip) per Tick into the pending map, swapped in with the
+  // SH after the last one. dynamic_source_ keeps the capture from being
+  // rendered into
+  std::shared_ptr<GEngine::CTexture> dynamic_source_;
+  std::shared_ptr<GEngine::CTexture> pending_prefiltered_texture_;
+  struct SDynamicStep {
+    int level_; // -1: SH projection
+    int face_;  // -1: all faces
+  };
+  std::vector<SDynamicStep> dynamic_steps_;
+  size_t dynamic_step_ = 0;
+  unsigned int dynamic_version_ = 0;
 
   // test
   unsigned int fbo_, rbo_;
+  unsigned int depth_width_ = 0, depth_height_ = 0;
 };
 } // namespace GEngine
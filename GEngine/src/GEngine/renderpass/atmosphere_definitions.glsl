@@ -0,0 +1,89 @@
+// atmosphere types & units, included after the generated texture size constants,
+// see https://ebruneton.github.io/precomputed_atmospheric_scattering/atmosphere/definitions.glsl.html
+#define Length float
+#define Wavelength float
+#define Angle float
+#define SolidAngle float
+#define Power float
+#define LuminousPower float
+#define Number float
+#define InverseLength float
+#define Area float
+#define Volume float
+#define NumberDensity float
+#define Irradiance float
+#define Radiance float
+#define SpectralPower float
+#define SpectralIrradiance float
+#define SpectralRadiance float
+#define SpectralRadianceDensity float
+#define ScatteringCoefficient float
+#define InverseSolidAngle float
+#define LuminousIntensity float
+#define Luminance float
+#define Illuminance float
+#define AbstractSpectrum vec3
+#define DimensionlessSpectrum vec3
+#define PowerSpectrum vec3
+#define IrradianceSpectrum vec3
+#define RadianceSpectrum vec3
+#define RadianceDensitySpectrum vec3
+#define ScatteringSpectrum vec3
+#define Position vec3
+#define Direction vec3
+#define Luminance3 vec3
+#define Illuminance3 vec3
+#define TransmittanceTexture sampler2D
+#define AbstractScatteringTexture sampler3D
+#define ReducedScatteringTexture sampler3D
+#define ScatteringTexture sampler3D
+#define ScatteringDensityTexture sampler3D
+#define IrradianceTexture sampler2D
+const Length m = 1.0;
+const Wavelength nm = 1.0;
+const Angle rad = 1.0;
+const SolidAngle sr = 1.0;
+const Power watt = 1.0;
+const LuminousPower lm = 1.0;
+const float PI = 3.14159265358979323846;
+const Length km = 1000.0 * m;
+const Area m2 = m * m;
+const Volume m3 = m * m * m;
+const Angle pi = PI * rad;
+const Angle deg = pi / 180.0;
+const Irradiance watt_per_square_meter = watt / m2;
+const Radiance watt_per_square_meter_per_sr = watt / (m2 * sr);
+const SpectralIrradiance watt_per_square_meter_per_nm = watt / (m2 * nm);
+const SpectralRadiance watt_per_square_meter_per_sr_per_nm = watt / (m2 * sr * nm);
+const SpectralRadianceDensity watt_per_cubic_meter_per_sr_per_nm = watt / (m3 * sr * nm);
+const LuminousIntensity cd = lm / sr;
+const LuminousIntensity kcd = 1000.0 * cd;
+const Luminance cd_per_square_meter = cd / m2;
+const Luminance kcd_per_square_meter = kcd / m2;
+
+struct DensityProfileLayer {
+  Length width;
+  Number exp_term;
+  InverseLength exp_scale;
+  InverseLength linear_term;
+  Number constant_term;
+};
+struct DensityProfile {
+  DensityProfileLayer layers[2];
+};
+struct AtmosphereParameters {
+  IrradianceSpectrum solar_irradiance;
+  Angle sun_angular_radius;
+  Length bottom_radius;
+  Length top_radius;
+  DensityProfile rayleigh_density;
+  ScatteringSpectrum rayleigh_scattering;
+  DensityProfile mie_density;
+  ScatteringSpectrum mie_scattering;
+  ScatteringSpectrum mie_extinction;
+  Number mie_phase_function_g;
+  DensityProfile absorption_density;
+  ScatteringSpectrum absorption_extinction;
+  DimensionlessSpectrum ground_albedo;
+  Number mu_s_min;
+};
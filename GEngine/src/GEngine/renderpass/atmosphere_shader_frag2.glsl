@@ -884,6 +884,13 @@ uniform sampler2D transmittance_texture;
 uniform sampler3D scattering_texture;
 uniform sampler3D single_mie_scattering_texture;
 uniform sampler2D irradiance_texture;
+// the g of the current model, ATMOSPHERE is a snapshot of the default one
+uniform float mie_phase_function_g;
+AtmosphereParameters GetAtmosphere() {
+    AtmosphereParameters atmosphere = ATMOSPHERE;
+    atmosphere.mie_phase_function_g = mie_phase_function_g;
+    return atmosphere;
+}
 #ifdef RADIANCE_API_ENABLED
 RadianceSpectrum GetSolarRadiance() {
     return ATMOSPHERE.solar_irradiance /
@@ -892,14 +899,14 @@ RadianceSpectrum GetSolarRadiance() {
 RadianceSpectrum GetSkyRadiance(
     Position camera, Direction view_ray, Length shadow_length,
     Direction sun_direction, out DimensionlessSpectrum transmittance) {
-    return GetSkyRadiance(ATMOSPHERE, transmittance_texture,
+    return GetSkyRadiance(GetAtmosphere(), transmittance_texture,
         scattering_texture, single_mie_scattering_texture,
         camera, view_ray, shadow_length, sun_direction, transmittance);
 }
 RadianceSpectrum GetSkyRadianceToPoint(
     Position camera, Position point, Length shadow_length,
     Direction sun_direction, out DimensionlessSpectrum transmittance) {
-    return GetSkyRadianceToPoint(ATMOSPHERE, transmittance_texture,
+    return GetSkyRadianceToPoint(GetAtmosphere(), transmittance_texture,
         scattering_texture, single_mie_scattering_texture,
         camera, point, shadow_length, sun_direction, transmittance);
 }
@@ -918,7 +925,7 @@ Luminance3 GetSolarLuminance() {
 Luminance3 GetSkyLuminance(
     Position camera, Direction view_ray, Length shadow_length,
     Direction sun_direction, out DimensionlessSpectrum transmittance) {
-    return GetSkyRadiance(ATMOSPHERE, transmittance_texture,
+    return GetSkyRadiance(GetAtmosphere(), transmittance_texture,
         scattering_texture, single_mie_scattering_texture,
         camera, view_ray, shadow_length, sun_direction, transmittance) *
         SKY_SPECTRAL_RADIANCE_TO_LUMINANCE;
@@ -926,7 +933,7 @@ Luminance3 GetSkyLuminance(
 Luminance3 GetSkyLuminanceToPoint(
     Position camera, Position point, Length shadow_length,
     Direction sun_direction, out DimensionlessSpectrum transmittance) {
-    return GetSkyRadianceToPoint(ATMOSPHERE, transmittance_texture,
+    return GetSkyRadianceToPoint(GetAtmosphere(), transmittance_texture,
         scattering_texture, single_mie_scattering_texture,
         camera, point, shadow_length, sun_direction, transmittance) *
         SKY_SPECTRAL_RADIANCE_TO_LUMINANCE;
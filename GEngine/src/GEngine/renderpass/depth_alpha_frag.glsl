@@ -0,0 +1,30 @@
+#version 410
+in vec2 TexCoords;
+
+#ifdef MATERIAL_TEXTURE_ARRAYS
+// the layer the lit pass samples, see CMaterialTextureArrays
+uniform sampler2DArray u_material_arrays[8];
+uniform isamplerBuffer u_material_slots;
+uniform int u_material_index;
+
+vec4 BaseColor(vec2 uv) {
+  int array_layer = texelFetch(u_material_slots, u_material_index)[0];
+  return texture(u_material_arrays[array_layer >> 16], vec3(uv, float(array_layer & 0xFFFF)));
+}
+const bool has_base_color_texture = true;
+#else
+uniform sampler2D texture_base_color;
+uniform bool has_base_color_texture;
+
+vec4 BaseColor(vec2 uv) {
+  return texture(texture_base_color, uv);
+}
+#endif
+
+// same alpha test, on the same texels, as the lit pass
+void main()
+{
+    if(has_base_color_texture && BaseColor(TexCoords).a < 0.5) {
+        discard;
+    }
+}
@@ -0,0 +1,21 @@
+#version 410
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 6) in mat4 aWorld; // per instance, see CMesh::UploadInstances
+
+out vec2 TexCoords;
+
+uniform mat4 u_model;
+uniform bool u_instanced;
+uniform mat4 u_view;
+uniform mat4 u_projection;
+
+invariant gl_Position;
+
+void main()
+{
+    TexCoords = aTexCoords;
+    mat4 model = u_instanced ? aWorld : u_model;
+    mat4 view_model_transform = u_view * model;
+    gl_Position = u_projection * view_model_transform * vec4(aPos, 1.0);
+}
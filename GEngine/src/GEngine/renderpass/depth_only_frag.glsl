@@ -0,0 +1,6 @@
+#version 410
+
+// depth only, no color output
+void main()
+{
+}
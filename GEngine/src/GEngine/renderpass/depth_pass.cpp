@@ -0,0 +1,182 @@
+#include "GEngine/renderpass/depth_pass.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/render_system.h"
+#include "GEngine/renderpass/occlusion_culling_pass.h"
+#include "GEngine/singleton.h"
+#include <algorithm>
+
+GEngine::CDepthPass::CDepthPass(const std::string &name, int order)
+    : CRenderPass(name, order, ERenderPassType::ZOnly) {}
+
+GEngine::CDepthPass::~CDepthPass() {}
+
+void GEngine::CDepthPass::Init() {
+  std::string v_path("../../GEngine/src/GEngine/renderpass/depth_only_vert.glsl");
+  std::string f_path("../../GEngine/src/GEngine/renderpass/depth_only_frag.glsl");
+  shader_ = std::make_shared<GEngine::Shader>(v_path, f_path);
+  std::string alpha_v_path("../../GEngine/src/GEngine/renderpass/depth_alpha_vert.glsl");
+  std::string alpha_f_path("../../GEngine/src/GEngine/renderpass/depth_alpha_frag.glsl");
+  alpha_shader_ = std::make_shared<GEngine::Shader>(alpha_v_path, alpha_f_path);
+  alpha_array_shader_ = Shader::CreateProgramFromFiles(
+      {{GL_VERTEX_SHADER, alpha_v_path}, {GL_FRAGMENT_SHADER, alpha_f_path}}, {"MATERIAL_TEXTURE_ARRAYS"});
+}
+
+std::shared_ptr<GEngine::Shader> &GEngine::CDepthPass::ApplyAlphaMaterial(const CMesh &mesh, unsigned int sub_mesh) {
+  auto material = mesh.GetSubMeshMaterial(sub_mesh);
+  int material_index = material_arrays_ ? material_arrays_->GetMaterialIndex(material.get()) : -1;
+  if (material_index >= 0) {
+    alpha_array_shader_->Use();
+    alpha_array_shader_->SetInt("u_material_index", material_index);
+    return alpha_array_shader_;
+  }
+  alpha_shader_->Use();
+  alpha_shader_->SetBool("has_base_color_texture", true);
+  alpha_shader_->SetTexture("texture_base_color", material->basecolor_texture_);
+  return alpha_shader_;
+}
+
+void GEngine::CDepthPass::Tick() {
+  auto render_system = CSingleton<CRenderSystem>();
+  auto &stats = render_system->GetRenderStats();
+  stats.depth_prepass_draw_calls_ = 0;
+  if (!render_system->GetOrCreateMainUI()->depth_prepass_) {
+    stats.depth_prepass_ms_ = 0.0f;
+    return;
+  }
+
+  auto camera = render_system->GetOrCreateMainCamera();
+  glm::mat4 view = camera->GetViewMatrix();
+  glm::mat4 projection = camera->GetProjectionMatrix();
+  glm::vec3 camera_position = camera->GetPosition();
+
+  // the culled sub-meshes and indirect commands CForwardPass draws, or
+  // frustum culled here
+  std::shared_ptr<SDrawList> draw_list;
+  if (render_system->HasAnyDataWithName("main_draw_list")) {
+    draw_list = std::any_cast<std::shared_ptr<SDrawList>>(render_system->GetAnyDataByName("main_draw_list"));
+  } else {
+    draw_items_.clear();
+    render_system->GetOrCreateMainScene()->CollectDrawItems(CFrustum(projection * view), draw_items_);
+  }
+  const auto &items = draw_list ? draw_list->items_ : draw_items_;
+  // alpha tested last, both groups front to back
+  draw_order_.resize(items.size());
+  for (size_t i = 0; i < items.size(); i++) {
+    draw_order_[i] = static_cast<unsigned int>(i);
+  }
+  std::sort(draw_order_.begin(), draw_order_.end(), [&](unsigned int a, unsigned int b) {
+    if (items[a].alpha_tested_ != items[b].alpha_tested_) {
+      return items[b].alpha_tested_;
+    }
+    glm::vec3 da = items[a].world_bounds_.GetCenter() - camera_position;
+    glm::vec3 db = items[b].world_bounds_.GetCenter() - camera_position;
+    return glm::dot(da, da) < glm::dot(db, db);
+  });
+  auto DrawItem = [&](unsigned int i) {
+    if (draw_list) {
+      glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                             reinterpret_cast<const void *>(i * sizeof(SDrawElementsIndirectCommand)));
+    } else {
+      items[i].mesh_->DrawSubMesh(items[i].sub_mesh_);
+    }
+    stats.depth_prepass_draw_calls_++;
+  };
+
+  // the arrays the lit pass samples this frame, see CForwardPass
+  material_arrays_.reset();
+  if (render_system->GetOrCreateMainUI()->material_texture_arrays_ &&
+      render_system->HasAnyDataWithName("material_texture_arrays")) {
+    material_arrays_ = std::any_cast<std::shared_ptr<CMaterialTextureArrays>>(
+        render_system->GetAnyDataByName("material_texture_arrays"));
+    material_arrays_->Bind(alpha_array_shader_);
+  }
+
+  gpu_timer_.Begin();
+  CSingleton<CGLStateCache>()->Enable(GL_DEPTH_TEST);
+  glDepthFunc(GL_LESS);
+  glDepthMask(GL_TRUE);
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  if (draw_list) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw_list->indirect_buffer_);
+  }
+
+  CMesh *bound_mesh = nullptr;
+  shader_->Use();
+  shader_->SetMat4("u_view", view);
+  shader_->SetMat4("u_projection", projection);
+  for (unsigned int i : draw_order_) {
+    const auto &item = items[i];
+    if (item.alpha_tested_) {
+      break;
+    }
+    if (item.mesh_ != bound_mesh) {
+      item.mesh_->BindPositionOnly();
+      bound_mesh = item.mesh_;
+    }
+    shader_->SetMat4("u_model", item.model_);
+    DrawItem(i);
+  }
+
+  // alpha tested surfaces discard exactly like the lit pass
+  bound_mesh = nullptr;
+  for (auto &shader : {alpha_shader_, alpha_array_shader_}) {
+    shader->Use();
+    shader->SetMat4("u_view", view);
+    shader->SetMat4("u_projection", projection);
+  }
+  for (unsigned int i : draw_order_) {
+    const auto &item = items[i];
+    if (!item.alpha_tested_) {
+      continue;
+    }
+    if (item.mesh_ != bound_mesh) {
+      item.mesh_->BindFullVertexStream();
+      bound_mesh = item.mesh_;
+    }
+    auto &shader = ApplyAlphaMaterial(*item.mesh_, item.sub_mesh_);
+    shader->SetMat4("u_model", item.model_);
+    DrawItem(i);
+  }
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  // instanced objects, uploaded once and drawn opaque sub-meshes first like above
+  render_system->GetOrCreateMainScene()->CollectInstanceBatches(CFrustum(projection * view), instance_batches_);
+  for (auto &shader : {shader_, alpha_shader_, alpha_array_shader_}) {
+    shader->Use();
+    shader->SetBool("u_instanced", true);
+  }
+  for (auto &batch : instance_batches_) {
+    if (batch.transforms_.empty()) {
+      continue;
+    }
+    batch.mesh_->UploadInstances(batch.transforms_);
+    for (int alpha_pass = 0; alpha_pass < 2; alpha_pass++) {
+      bool bound = false;
+      for (unsigned int i = 0; i < batch.mesh_->meshes_.size(); i++) {
+        if (batch.mesh_->IsAlphaTested(i) != (alpha_pass == 1)) {
+          continue;
+        }
+        if (!bound) {
+          alpha_pass == 0 ? batch.mesh_->BindPositionOnly() : batch.mesh_->BindFullVertexStream();
+          bound = true;
+        }
+        if (alpha_pass == 0) {
+          shader_->Use();
+        } else {
+          ApplyAlphaMaterial(*batch.mesh_, i);
+        }
+        batch.mesh_->DrawSubMeshInstanced(i, static_cast<unsigned int>(batch.transforms_.size()));
+        stats.depth_prepass_draw_calls_++;
+      }
+    }
+  }
+  for (auto &shader : {shader_, alpha_shader_, alpha_array_shader_}) {
+    shader->Use();
+    shader->SetBool("u_instanced", false);
+  }
+
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  CSingleton<CGLStateCache>()->BindVertexArray(0);
+  gpu_timer_.End();
+  stats.depth_prepass_ms_ = gpu_timer_.GetElapsedMs();
+}
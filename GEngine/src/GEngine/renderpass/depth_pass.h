@@ -0,0 +1,34 @@
+#pragma once
+#include "GEngine/gpu_timer.h"
+#include "GEngine/material_texture_arrays.h"
+#include "GEngine/render_pass.h"
+#include "GEngine/render_scene.h"
+#include <string>
+#include <vector>
+
+namespace GEngine {
+// depth pre-pass: opaque geometry of the main scene sorted front to back and
+// drawn position-only, the lit pass then runs with GL_EQUAL so hidden
+// fragments never reach the PBR shader. Toggled by CEditorUI::depth_prepass_
+class CDepthPass : public CRenderPass {
+public:
+  CDepthPass(const std::string &name, int order);
+  virtual ~CDepthPass();
+
+  virtual void Init() override;
+  virtual void Tick() override;
+
+private:
+  // binds the base color the lit pass alpha tests, from the arrays when it does
+  std::shared_ptr<Shader> &ApplyAlphaMaterial(const CMesh &mesh, unsigned int sub_mesh);
+
+  std::shared_ptr<Shader> alpha_shader_;
+  // MATERIAL_TEXTURE_ARRAYS, for the materials the lit pass samples from the arrays
+  std::shared_ptr<Shader> alpha_array_shader_;
+  std::vector<SDrawItem> draw_items_;
+  std::vector<unsigned int> draw_order_;
+  std::vector<SInstanceBatch> instance_batches_;
+  std::shared_ptr<CMaterialTextureArrays> material_arrays_;
+  CGPUTimer gpu_timer_;
+};
+} // namespace GEngine
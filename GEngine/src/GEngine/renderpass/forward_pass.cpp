@@ -0,0 +1,308 @@
+#include "GEngine/renderpass/forward_pass.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/light_cluster.h"
+#include "GEngine/log.h"
+#include "GEngine/render_system.h"
+#include "GEngine/renderpass/occlusion_culling_pass.h"
+#include "GEngine/renderpass/precomputed_atmosphere_pass.h"
+#include "GEngine/renderpass/shadow_pass.h"
+#include "GEngine/singleton.h"
+#include "GEngine/spherical_harmonics.h"
+#include "GEngine/texture_streamer.h"
+#include <algorithm>
+
+GEngine::CForwardPass::CForwardPass(const std::string &name, int order)
+    : CRenderPass(name, order, ERenderPassType::Opaque) {}
+
+GEngine::CForwardPass::~CForwardPass() {}
+
+void GEngine::CForwardPass::PrepareShaders() {
+  std::string v_path("../../shaders/sponza_PBR_VS.glsl");
+  std::string f_path("../../shaders/sponza_PBR_FS.glsl");
+  variants_ = std::make_shared<CShaderVariants>(v_path, f_path);
+  auto defines = CShaderVariants::MaterialFeatureDefines();
+  defines.push_back({kTextureArraysVariant, "MATERIAL_TEXTURE_ARRAYS"});
+  variants_->SetFeatureDefines(defines);
+  shader_ = variants_->GetVariant(0);
+
+  // submit the permutations of every material in the scene now, they compile
+  // while the other passes load. Later materials are compiled on first draw
+  auto scene = CSingleton<CRenderSystem>()->GetOrCreateMainScene();
+  auto RequestVariants = [this](const CMesh &mesh) {
+    for (unsigned int i = 0; i < mesh.meshes_.size(); i++) {
+      variants_->GetVariant(GetFeatureMask(mesh, i));
+      variants_->GetVariant(GetFeatureMask(mesh, i) | kTextureArraysVariant);
+    }
+  };
+  for (const auto &object : scene->GetRenderObjects()) {
+    RequestVariants(*object.mesh_);
+  }
+  for (const auto &object : scene->GetInstancedObjects()) {
+    RequestVariants(*object.mesh_);
+  }
+}
+
+uint32_t GEngine::CForwardPass::GetFeatureMask(const CMesh &mesh, unsigned int sub_mesh) {
+  auto material = mesh.GetSubMeshMaterial(sub_mesh);
+  return material ? material->GetFeatureMask() : 0u;
+}
+
+int GEngine::CForwardPass::GetArrayMaterialIndex(const CMesh &mesh, unsigned int sub_mesh) const {
+  if (!use_material_arrays_) {
+    return -1;
+  }
+  auto material = mesh.GetSubMeshMaterial(sub_mesh);
+  return material ? material_arrays_->GetMaterialIndex(material.get()) : -1;
+}
+
+void GEngine::CForwardPass::RequestTextureLevels(const CMesh &mesh, unsigned int sub_mesh, const SAABB &world_bounds,
+                                                 const glm::vec3 &eye, float pixels_per_unit) {
+  auto material = mesh.GetSubMeshMaterial(sub_mesh);
+  if (!material || !world_bounds.IsValid()) {
+    return;
+  }
+  // diameter on screen at the nearest point of the bounding sphere, assuming
+  // the uv range spans the sub-mesh once
+  float radius = glm::length(world_bounds.GetExtent());
+  float distance = std::max(glm::length(world_bounds.GetCenter() - eye) - radius, 1e-3f);
+  float screen_pixels = 2.0f * radius * pixels_per_unit / distance;
+  // one level finer, surfaces at grazing angles & uv tiling
+  CSingleton<CTextureStreamer>()->RequestMaterial(*material, screen_pixels * 2.0f);
+}
+
+void GEngine::CForwardPass::Init() {
+  dummy_shadow_map_ = std::make_shared<CTexture>(CTexture::ETarget::kTexture2DArray);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D_ARRAY, dummy_shadow_map_->id_);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, 1, 1, 1, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  const unsigned char no_aerial_perspective[4] = {0, 0, 0, 255};
+  dummy_aerial_perspective_ = std::make_shared<CTexture>(CTexture::ETarget::kTexture3D);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_3D, dummy_aerial_perspective_->id_);
+  glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8, 1, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, no_aerial_perspective);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_3D, 0);
+
+  // one copy of every material texture of the scene in texture arrays
+  auto scene = CSingleton<CRenderSystem>()->GetOrCreateMainScene();
+  std::vector<const CMesh *> meshes;
+  for (const auto &object : scene->GetRenderObjects()) {
+    meshes.push_back(object.mesh_.get());
+  }
+  for (const auto &object : scene->GetInstancedObjects()) {
+    meshes.push_back(object.mesh_.get());
+  }
+  material_arrays_ = std::make_shared<CMaterialTextureArrays>();
+  material_arrays_->Build(meshes);
+  CSingleton<CRenderSystem>()->RegisterAnyDataWithName("material_texture_arrays", material_arrays_);
+}
+
+void GEngine::CForwardPass::Tick() {
+  auto render_system = CSingleton<CRenderSystem>();
+  auto &texture_center = render_system->texture_center_;
+  if (texture_center.find("cluster_grid") == texture_center.end()) {
+    GE_WARN("CForwardPass needs a CLightCullingPass registered before it");
+    return;
+  }
+  auto cluster_builder = std::any_cast<std::shared_ptr<CLightClusterBuilder>>(
+      render_system->GetAnyDataByName("light_cluster"));
+
+  auto camera = render_system->GetOrCreateMainCamera();
+  std::array<GLint, 4> viewport = CSingleton<CGLStateCache>()->GetViewport();
+
+  bool depth_prepass = render_system->GetOrCreateMainUI()->depth_prepass_ &&
+                       render_system->GetRenderPassByType(ERenderPassType::ZOnly) != nullptr;
+  gpu_timer_.Begin();
+  CSingleton<CGLStateCache>()->Enable(GL_DEPTH_TEST);
+  if (depth_prepass) {
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+  }
+
+  // per frame state, set once on every variant used this frame
+  std::shared_ptr<SShadowCascades> cascades;
+  if (texture_center.find("shadow_cascades") != texture_center.end()) {
+    cascades = std::any_cast<std::shared_ptr<SShadowCascades>>(render_system->GetAnyDataByName("shadow_cascades"));
+  }
+  std::shared_ptr<SAerialPerspective> aerial_perspective;
+  if (texture_center.find("aerial_perspective") != texture_center.end()) {
+    aerial_perspective =
+        std::any_cast<std::shared_ptr<SAerialPerspective>>(render_system->GetAnyDataByName("aerial_perspective"));
+  }
+  // ambient irradiance of CIBLPass, in world space
+  std::shared_ptr<SIrradianceSH> irradiance_sh;
+  if (render_system->HasAnyDataWithName("irradiance_sh")) {
+    irradiance_sh = std::any_cast<std::shared_ptr<SIrradianceSH>>(render_system->GetAnyDataByName("irradiance_sh"));
+  }
+  // cascaded shadows, matrices go from view space to shadow map space
+  glm::mat4 bias = glm::mat4(0.5f, 0.0f, 0.0f, 0.0f,
+                             0.0f, 0.5f, 0.0f, 0.0f,
+                             0.0f, 0.0f, 0.5f, 0.0f,
+                             0.5f, 0.5f, 0.5f, 1.0f);
+  glm::mat4 inverse_view = glm::inverse(camera->GetViewMatrix());
+  prepared_variants_.clear();
+  auto &stats = render_system->GetRenderStats();
+  stats.lit_program_switches_ = 0;
+  stats.lit_material_binds_ = 0;
+  stats.material_texture_arrays_ = static_cast<unsigned int>(material_arrays_->GetArrayCount());
+  stats.material_texture_layers_ = static_cast<unsigned int>(material_arrays_->GetLayerCount());
+  use_material_arrays_ = render_system->GetOrCreateMainUI()->material_texture_arrays_;
+  Shader *bound_variant = nullptr;
+  auto BindVariant = [&](const std::shared_ptr<Shader> &shader, uint32_t mask) {
+    if (shader.get() == bound_variant) {
+      return;
+    }
+    bound_variant = shader.get();
+    stats.lit_program_switches_++;
+    if (std::find(prepared_variants_.begin(), prepared_variants_.end(), shader.get()) != prepared_variants_.end()) {
+      shader->Use();
+      return;
+    }
+    prepared_variants_.push_back(shader.get());
+    shader->SetTexture("u_light_data", texture_center["cluster_light_data"]);
+    shader->SetTexture("u_cluster_grid", texture_center["cluster_grid"]);
+    shader->SetTexture("u_light_indices", texture_center["cluster_light_indices"]);
+    shader->SetTexture("u_shadow_map", cascades ? cascades->shadow_map_ : dummy_shadow_map_);
+    shader->SetTexture("u_aerial_perspective",
+                       aerial_perspective ? aerial_perspective->volume_ : dummy_aerial_perspective_);
+    shader->Use();
+    shader->SetFloat("u_aerial_perspective_distance", aerial_perspective ? aerial_perspective->max_distance_ : 0.0f);
+    int cascade_count = cascades ? cascades->cascade_count_ : 0;
+    for (int c = 0; c < cascade_count; c++) {
+      shader->SetMat4("u_cascade_matrices[" + std::to_string(c) + "]",
+                      bias * cascades->view_projection_[c] * inverse_view);
+    }
+    if (cascades) {
+      shader->SetVec4("u_cascade_splits", cascades->split_depths_);
+    }
+    shader->SetInt("u_cascade_count", cascade_count);
+    shader->SetBool("u_use_irradiance_sh", irradiance_sh != nullptr);
+    if (irradiance_sh) {
+      for (int i = 0; i < 9; i++) {
+        shader->SetVec3("u_irradiance_sh[" + std::to_string(i) + "]", irradiance_sh->coefficients_[i]);
+      }
+      shader->SetMat3("u_world_from_view", glm::mat3(inverse_view));
+    }
+    shader->SetMat4("u_view", camera->GetViewMatrix());
+    shader->SetMat4("u_projection", camera->GetProjectionMatrix());
+    shader->SetIVec3("u_cluster_dims", glm::ivec3(cluster_builder->GetGridSize()));
+    shader->SetVec2("u_cluster_z_params", cluster_builder->GetSliceScaleBias());
+    shader->SetVec4("u_viewport", glm::vec4(viewport[0], viewport[1], viewport[2], viewport[3]));
+    shader->SetInt("u_global_light_count", static_cast<int>(cluster_builder->GetGlobalLightCount()));
+    shader->SetBool("u_instanced", false);
+    if (mask & kTextureArraysVariant) {
+      material_arrays_->Bind(shader);
+    }
+  };
+  // the array variant only needs the material index, others bind textures
+  auto ApplyMaterial = [&](const std::shared_ptr<Shader> &variant, CMesh &mesh, unsigned int sub_mesh,
+                           int material_index) {
+    if (material_index >= 0) {
+      variant->Use();
+      variant->SetInt("u_material_index", material_index);
+    } else {
+      mesh.ApplyMaterial(variant, sub_mesh);
+      stats.lit_material_binds_++;
+    }
+  };
+
+  // culled sub-meshes from COcclusionCullingPass (one indirect command each,
+  // GL 4.1 has no multi-draw-indirect), or frustum culled here
+  std::shared_ptr<SDrawList> draw_list;
+  if (render_system->HasAnyDataWithName("main_draw_list")) {
+    draw_list = std::any_cast<std::shared_ptr<SDrawList>>(render_system->GetAnyDataByName("main_draw_list"));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw_list->indirect_buffer_);
+  } else {
+    draw_items_.clear();
+    render_system->GetOrCreateMainScene()->CollectDrawItems(
+        CFrustum(camera->GetProjectionMatrix() * camera->GetViewMatrix()), draw_items_);
+  }
+  const auto &items = draw_list ? draw_list->items_ : draw_items_;
+
+  // pixels per world unit at distance 1, for the texture streaming requests
+  bool streaming = CSingleton<CTextureStreamer>()->GetStreamedCount() > 0;
+  glm::vec3 eye = camera->GetPosition();
+  float pixels_per_unit = 0.5f * viewport[3] * camera->GetProjectionMatrix()[1][1];
+
+  // group by variant, then mesh, so programs & vertex streams switch rarely
+  draw_order_.resize(items.size());
+  draw_masks_.resize(items.size());
+  draw_material_indices_.resize(items.size());
+  for (size_t i = 0; i < items.size(); i++) {
+    draw_order_[i] = static_cast<unsigned int>(i);
+    draw_material_indices_[i] = GetArrayMaterialIndex(*items[i].mesh_, items[i].sub_mesh_);
+    draw_masks_[i] = GetFeatureMask(*items[i].mesh_, items[i].sub_mesh_) |
+                     (draw_material_indices_[i] >= 0 ? kTextureArraysVariant : 0u);
+    if (streaming) {
+      RequestTextureLevels(*items[i].mesh_, items[i].sub_mesh_, items[i].world_bounds_, eye, pixels_per_unit);
+    }
+  }
+  std::sort(draw_order_.begin(), draw_order_.end(), [&](unsigned int a, unsigned int b) {
+    if (draw_masks_[a] != draw_masks_[b]) {
+      return draw_masks_[a] < draw_masks_[b];
+    }
+    return items[a].mesh_ < items[b].mesh_;
+  });
+
+  CMesh *bound_mesh = nullptr;
+  for (unsigned int i : draw_order_) {
+    const auto &item = items[i];
+    auto variant = variants_->GetVariant(draw_masks_[i]);
+    BindVariant(variant, draw_masks_[i]);
+    if (item.mesh_ != bound_mesh) {
+      item.mesh_->BindFullVertexStream();
+      bound_mesh = item.mesh_;
+    }
+    ApplyMaterial(variant, *item.mesh_, item.sub_mesh_, draw_material_indices_[i]);
+    variant->Use();
+    variant->SetMat4("u_model", item.model_);
+    if (draw_list) {
+      glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                             reinterpret_cast<const void *>(i * sizeof(SDrawElementsIndirectCommand)));
+    } else {
+      item.mesh_->DrawSubMesh(item.sub_mesh_);
+    }
+  }
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  // instanced objects, one draw per sub-mesh for all visible instances
+  stats.instanced_draw_calls_ = 0;
+  stats.instances_drawn_ = 0;
+  render_system->GetOrCreateMainScene()->CollectInstanceBatches(
+      CFrustum(camera->GetProjectionMatrix() * camera->GetViewMatrix()), instance_batches_);
+  for (auto &batch : instance_batches_) {
+    if (batch.transforms_.empty()) {
+      continue;
+    }
+    batch.mesh_->UploadInstances(batch.transforms_);
+    batch.mesh_->BindFullVertexStream();
+    for (unsigned int i = 0; i < batch.mesh_->meshes_.size() && streaming; i++) {
+      // the instances share the textures, the closest one decides
+      for (const auto &transform : batch.transforms_) {
+        RequestTextureLevels(*batch.mesh_, i, batch.mesh_->meshes_[i].bounds_.Transform(transform), eye,
+                             pixels_per_unit);
+      }
+    }
+    for (unsigned int i = 0; i < batch.mesh_->meshes_.size(); i++) {
+      int material_index = GetArrayMaterialIndex(*batch.mesh_, i);
+      uint32_t mask = GetFeatureMask(*batch.mesh_, i) | (material_index >= 0 ? kTextureArraysVariant : 0u);
+      auto variant = variants_->GetVariant(mask);
+      BindVariant(variant, mask);
+      ApplyMaterial(variant, *batch.mesh_, i, material_index);
+      variant->Use();
+      variant->SetBool("u_instanced", true);
+      batch.mesh_->DrawSubMeshInstanced(i, static_cast<unsigned int>(batch.transforms_.size()));
+      variant->SetBool("u_instanced", false);
+      stats.instanced_draw_calls_++;
+    }
+    stats.instances_drawn_ += static_cast<unsigned int>(batch.transforms_.size());
+  }
+  CSingleton<CGLStateCache>()->BindVertexArray(0);
+  stats.lit_shader_variants_ = static_cast<unsigned int>(variants_->GetVariants().size());
+
+  glDepthFunc(GL_LESS);
+  glDepthMask(GL_TRUE);
+  gpu_timer_.End();
+  stats.lit_pass_ms_ = gpu_timer_.GetElapsedMs();
+}
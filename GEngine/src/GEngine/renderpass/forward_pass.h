@@ -0,0 +1,52 @@
+#pragma once
+#include "GEngine/gpu_timer.h"
+#include "GEngine/material_texture_arrays.h"
+#include "GEngine/render_pass.h"
+#include "GEngine/render_scene.h"
+#include "GEngine/shader_variants.h"
+#include <string>
+#include <vector>
+
+namespace GEngine {
+// lit pass for the render objects of the main scene, shading only loops over
+// the lights binned by CLightCullingPass for the fragment's cluster, the sun
+// is shadowed by CCascadedShadowPass when registered. With a CDepthPass the
+// depth buffer is already final and the pass runs with GL_EQUAL
+class CForwardPass : public CRenderPass {
+public:
+  CForwardPass(const std::string &name, int order);
+  virtual ~CForwardPass();
+
+  virtual void PrepareShaders() override;
+  virtual void Init() override;
+  virtual void Tick() override;
+
+private:
+  // variant option on top of the material features
+  static constexpr uint32_t kTextureArraysVariant = 1u << 31;
+  static uint32_t GetFeatureMask(const CMesh &mesh, unsigned int sub_mesh);
+  // -1: bind the material's own textures
+  int GetArrayMaterialIndex(const CMesh &mesh, unsigned int sub_mesh) const;
+  // CTextureStreamer levels from the projected size of the bounds
+  static void RequestTextureLevels(const CMesh &mesh, unsigned int sub_mesh, const SAABB &world_bounds,
+                                   const glm::vec3 &eye, float pixels_per_unit);
+
+  // sponza_PBR permutations, one per material texture set
+  std::shared_ptr<CShaderVariants> variants_;
+  std::vector<Shader *> prepared_variants_;
+  std::vector<SDrawItem> draw_items_;
+  std::vector<unsigned int> draw_order_;
+  std::vector<uint32_t> draw_masks_;
+  std::vector<int> draw_material_indices_;
+  // shared as "material_texture_arrays", the depth pre-pass alpha tests the same layers
+  std::shared_ptr<CMaterialTextureArrays> material_arrays_;
+  bool use_material_arrays_ = false;
+  // bound when no CCascadedShadowPass is registered
+  std::shared_ptr<CTexture> dummy_shadow_map_;
+  // bound when no PrecomputedAtmospherePass is registered: no in-scattering,
+  // full transmittance
+  std::shared_ptr<CTexture> dummy_aerial_perspective_;
+  std::vector<SInstanceBatch> instance_batches_;
+  CGPUTimer gpu_timer_;
+};
+} // namespace GEngine
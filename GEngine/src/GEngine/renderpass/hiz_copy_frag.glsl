@@ -0,0 +1,10 @@
+#version 410
+out float FragDepth;
+
+uniform sampler2D u_depth;
+
+// level 0 of the Hi-Z pyramid is a copy of the scene depth
+void main()
+{
+    FragDepth = texelFetch(u_depth, ivec2(gl_FragCoord.xy), 0).r;
+}
@@ -0,0 +1,225 @@
+#include "GEngine/renderpass/hiz_pass.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/log.h"
+#include "GEngine/render_system.h"
+#include "GEngine/singleton.h"
+#include <algorithm>
+#include <cstring>
+
+GEngine::CHiZPass::CHiZPass(const std::string &name, int order)
+    : CRenderPass(name, order, ERenderPassType::Default) {}
+
+GEngine::CHiZPass::~CHiZPass() {
+  ReleaseTargets();
+  for (int i = 0; i < kReadbackCount; i++) {
+    if (fences_[i]) {
+      glDeleteSync(fences_[i]);
+    }
+  }
+  glDeleteBuffers(kReadbackCount, pbos_);
+  if (empty_VAO_ != 0) {
+    CSingleton<CGLStateCache>()->OnVertexArrayDeleted(empty_VAO_);
+    glDeleteVertexArrays(1, &empty_VAO_);
+  }
+}
+
+void GEngine::CHiZPass::Init() {
+  std::string v_path("../../GEngine/src/GEngine/renderpass/hiz_vert.glsl");
+  std::string copy_f_path("../../GEngine/src/GEngine/renderpass/hiz_copy_frag.glsl");
+  std::string reduce_f_path("../../GEngine/src/GEngine/renderpass/hiz_reduce_frag.glsl");
+  copy_shader_ = std::make_shared<GEngine::Shader>(v_path, copy_f_path);
+  shader_ = std::make_shared<GEngine::Shader>(v_path, reduce_f_path);
+
+  // the fullscreen triangle is generated from gl_VertexID, core profile still wants a VAO
+  glGenVertexArrays(1, &empty_VAO_);
+  glGenBuffers(kReadbackCount, pbos_);
+
+  culler_ = std::make_shared<COcclusionCuller>();
+  CSingleton<CRenderSystem>()->RegisterAnyDataWithName("hiz_culler", culler_);
+}
+
+void GEngine::CHiZPass::ReleaseTargets() {
+  if (depth_fbo_ != 0) {
+    CSingleton<CGLStateCache>()->OnFramebufferDeleted(depth_fbo_);
+    glDeleteFramebuffers(1, &depth_fbo_);
+    depth_fbo_ = 0;
+  }
+  if (!level_fbos_.empty()) {
+    for (GLuint fbo : level_fbos_) {
+      CSingleton<CGLStateCache>()->OnFramebufferDeleted(fbo);
+    }
+    glDeleteFramebuffers(static_cast<GLsizei>(level_fbos_.size()), level_fbos_.data());
+    level_fbos_.clear();
+  }
+  level_sizes_.clear();
+  depth_texture_.reset();
+  hiz_texture_.reset();
+}
+
+void GEngine::CHiZPass::Resize(int width, int height) {
+  ReleaseTargets();
+  width_ = width;
+  height_ = height;
+
+  // the default framebuffer depth can't be sampled, it is blitted here first
+  depth_texture_ = std::make_shared<CTexture>(CTexture::ETarget::kTexture2D);
+  depth_texture_->SetWidth(width);
+  depth_texture_->SetHeight(height);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, depth_texture_->id_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glGenFramebuffers(1, &depth_fbo_);
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, depth_fbo_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth_texture_->id_, 0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    GE_WARN("Hi-Z depth framebuffer is not complete");
+  }
+
+  // full mip chain of R32F, every level has its own framebuffer
+  int level_count = 1;
+  for (int size = std::max(width, height); size > 1; size >>= 1) {
+    level_count++;
+  }
+  hiz_texture_ = std::make_shared<CTexture>(CTexture::ETarget::kTexture2D);
+  hiz_texture_->SetWidth(width);
+  hiz_texture_->SetHeight(height);
+  hiz_texture_->has_mipmap_ = true;
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, hiz_texture_->id_);
+  readback_level_ = level_count - 1;
+  for (int level = 0; level < level_count; level++) {
+    glm::ivec2 size(std::max(width >> level, 1), std::max(height >> level, 1));
+    glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, size.x, size.y, 0, GL_RED, GL_FLOAT, nullptr);
+    level_sizes_.push_back(size);
+    if (std::max(size.x, size.y) <= readback_max_size_) {
+      readback_level_ = std::min(readback_level_, level);
+    }
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  level_fbos_.resize(level_count);
+  glGenFramebuffers(level_count, level_fbos_.data());
+  for (int level = 0; level < level_count; level++) {
+    CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, level_fbos_[level]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, hiz_texture_->id_, level);
+  }
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, 0);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, 0);
+
+  // pending readbacks refer to the old size
+  for (int i = 0; i < kReadbackCount; i++) {
+    if (fences_[i]) {
+      glDeleteSync(fences_[i]);
+      fences_[i] = nullptr;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos_[i]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, level_sizes_[readback_level_].x * level_sizes_[readback_level_].y * sizeof(float),
+                 nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  culler_->Reset();
+  CSingleton<CRenderSystem>()->texture_center_["hiz_pyramid"] = hiz_texture_;
+}
+
+void GEngine::CHiZPass::CollectReadback() {
+  // oldest first, never wait on the gpu
+  for (int n = 0; n < kReadbackCount; n++) {
+    int i = (readback_index_ + n) % kReadbackCount;
+    if (!fences_[i]) {
+      continue;
+    }
+    GLenum status = glClientWaitSync(fences_[i], 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      continue;
+    }
+    glDeleteSync(fences_[i]);
+    fences_[i] = nullptr;
+
+    glm::ivec2 size = readback_sizes_[i];
+    readback_data_.resize(static_cast<size_t>(size.x) * size.y);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos_[i]);
+    void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readback_data_.size() * sizeof(float), GL_MAP_READ_BIT);
+    if (data) {
+      std::memcpy(readback_data_.data(), data, readback_data_.size() * sizeof(float));
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      // resizing drops the pending readbacks, this one is of the current chain
+      culler_->SetDepth(readback_data_.data(), size.x, size.y, readback_level_, width_, height_,
+                        readback_view_projection_[i]);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+}
+
+void GEngine::CHiZPass::Tick() {
+  auto render_system = CSingleton<CRenderSystem>();
+  if (render_system->GetOrCreateMainUI()->occlusion_mode_ != 1) {
+    return;
+  }
+  std::array<GLint, 4> viewport = CSingleton<CGLStateCache>()->GetViewport();
+  if (viewport[2] <= 0 || viewport[3] <= 0) {
+    return;
+  }
+  if (viewport[2] != width_ || viewport[3] != height_) {
+    Resize(viewport[2], viewport[3]);
+  }
+  CollectReadback();
+
+  // 1. scene depth -> sampleable texture
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_DRAW_FRAMEBUFFER, depth_fbo_);
+  glBlitFramebuffer(viewport[0], viewport[1], viewport[0] + width_, viewport[1] + height_,
+                    0, 0, width_, height_, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+  bool depth_test = CSingleton<CGLStateCache>()->IsEnabled(GL_DEPTH_TEST);
+  CSingleton<CGLStateCache>()->Disable(GL_DEPTH_TEST);
+  glDepthMask(GL_FALSE);
+  CSingleton<CGLStateCache>()->BindVertexArray(empty_VAO_);
+
+  // 2. level 0 copy
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, level_fbos_[0]);
+  CSingleton<CGLStateCache>()->Viewport(0, 0, width_, height_);
+  copy_shader_->SetTexture("u_depth", depth_texture_);
+  copy_shader_->Use();
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+
+  // 3. max reduction, the source level is isolated with base/max level
+  shader_->SetTexture("u_hiz", hiz_texture_);
+  for (size_t level = 1; level < level_fbos_.size(); level++) {
+    CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, hiz_texture_->id_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(level - 1));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(level - 1));
+    CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, level_fbos_[level]);
+    CSingleton<CGLStateCache>()->Viewport(0, 0, level_sizes_[level].x, level_sizes_[level].y);
+    shader_->Use();
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+  }
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, hiz_texture_->id_);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(level_fbos_.size() - 1));
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, 0);
+
+  // 4. async readback of a small level, skipped while both slots are in flight
+  if (!fences_[readback_index_]) {
+    glm::ivec2 size = level_sizes_[readback_level_];
+    CSingleton<CGLStateCache>()->BindFramebuffer(GL_READ_FRAMEBUFFER, level_fbos_[readback_level_]);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos_[readback_index_]);
+    glReadPixels(0, 0, size.x, size.y, GL_RED, GL_FLOAT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fences_[readback_index_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    auto camera = render_system->GetOrCreateMainCamera();
+    readback_view_projection_[readback_index_] = camera->GetProjectionMatrix() * camera->GetViewMatrix();
+    readback_sizes_[readback_index_] = size;
+    readback_index_ = (readback_index_ + 1) % kReadbackCount;
+  }
+
+  CSingleton<CGLStateCache>()->BindVertexArray(0);
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, 0);
+  CSingleton<CGLStateCache>()->Viewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  glDepthMask(GL_TRUE);
+  CSingleton<CGLStateCache>()->SetEnabled(GL_DEPTH_TEST, depth_test);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "GEngine/occlusion_culler.h"
+#include "GEngine/render_pass.h"
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace GEngine {
+// builds a max-depth (Hi-Z) pyramid from the depth buffer at the end of the
+// frame and reads one small mip back with PBOs + fences. The readback feeds
+// the COcclusionCuller registered as "hiz_culler", so the next frame's
+// COcclusionCullingPass tests against last frame's depth, a frame or two late
+// but without ever stalling on the gpu.
+class CHiZPass : public CRenderPass {
+public:
+  CHiZPass(const std::string &name, int order);
+  virtual ~CHiZPass();
+
+  virtual void Init() override;
+  virtual void Tick() override;
+
+  // largest dimension of the mip level read back to the cpu
+  void SetReadbackSize(int max_size) { readback_max_size_ = max_size; }
+
+private:
+  void Resize(int width, int height);
+  void ReleaseTargets();
+  void CollectReadback();
+
+  static constexpr int kReadbackCount = 2;
+
+  std::shared_ptr<Shader> copy_shader_;
+  std::shared_ptr<CTexture> depth_texture_;
+  std::shared_ptr<CTexture> hiz_texture_;
+  unsigned int depth_fbo_ = 0;
+  std::vector<unsigned int> level_fbos_;
+  std::vector<glm::ivec2> level_sizes_;
+  unsigned int empty_VAO_ = 0;
+  int width_ = 0;
+  int height_ = 0;
+
+  // readback ring
+  int readback_max_size_ = 512;
+  int readback_level_ = 0;
+  unsigned int pbos_[kReadbackCount] = {0};
+  GLsync fences_[kReadbackCount] = {nullptr};
+  glm::mat4 readback_view_projection_[kReadbackCount];
+  glm::ivec2 readback_sizes_[kReadbackCount];
+  int readback_index_ = 0;
+  std::vector<float> readback_data_;
+
+  std::shared_ptr<COcclusionCuller> culler_;
+};
+} // namespace GEngine
@@ -0,0 +1,33 @@
+#version 410
+out float FragDepth;
+
+// base & max level of u_hiz are set to the source mip, so texelFetch level 0
+// reads the level above the one being rendered (no feedback loop)
+uniform sampler2D u_hiz;
+
+// max of the 2x2 texels below, odd sizes fold the extra row/column in
+void main()
+{
+    ivec2 last = textureSize(u_hiz, 0) - 1;
+    ivec2 coord = ivec2(gl_FragCoord.xy) * 2;
+    float d0 = texelFetch(u_hiz, min(coord, last), 0).r;
+    float d1 = texelFetch(u_hiz, min(coord + ivec2(1, 0), last), 0).r;
+    float d2 = texelFetch(u_hiz, min(coord + ivec2(0, 1), last), 0).r;
+    float d3 = texelFetch(u_hiz, min(coord + ivec2(1, 1), last), 0).r;
+    float d = max(max(d0, d1), max(d2, d3));
+    // odd source sizes: the last destination texel also covers the 3rd row/column
+    ivec2 size = last + 1;
+    if ((size.x & 1) == 1 && coord.x + 2 == last.x) {
+        d = max(d, max(texelFetch(u_hiz, ivec2(last.x, coord.y), 0).r,
+                       texelFetch(u_hiz, ivec2(last.x, min(coord.y + 1, last.y)), 0).r));
+    }
+    if ((size.y & 1) == 1 && coord.y + 2 == last.y) {
+        d = max(d, max(texelFetch(u_hiz, ivec2(coord.x, last.y), 0).r,
+                       texelFetch(u_hiz, ivec2(min(coord.x + 1, last.x), last.y), 0).r));
+    }
+    // both odd: the corner belongs to neither the extra column nor the extra row
+    if ((size.x & 1) == 1 && coord.x + 2 == last.x && (size.y & 1) == 1 && coord.y + 2 == last.y) {
+        d = max(d, texelFetch(u_hiz, last, 0).r);
+    }
+    FragDepth = d;
+}
@@ -0,0 +1,73 @@
+#version 410
+// split sum BRDF LUT (scale, bias) of the IBL specular term, NdotV in x and
+// roughness in y at the texel centers of a u_size^2 target
+// (CIBLBaker::IntegrateBRDF)
+out vec2 Color;
+
+uniform int u_size;
+uniform int u_sample_count;
+
+const float PI = 3.14159265359;
+
+// http://holger.dammertz.org/stuff/notes_HammersleyOnHemisphere.html
+float RadicalInverse_VdC(uint bits)
+{
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return float(bits) * 2.3283064365386963e-10; // / 0x100000000
+}
+
+vec2 Hammersley(uint i, uint N)
+{
+    return vec2(float(i) / float(N), RadicalInverse_VdC(i));
+}
+
+vec3 ImportanceSampleGGX(vec2 Xi, vec3 N, float roughness)
+{
+    float a = roughness * roughness;
+    float phi = 2.0 * PI * Xi.x;
+    float cosTheta = sqrt((1.0 - Xi.y) / (1.0 + (a * a - 1.0) * Xi.y));
+    float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+    vec3 H = vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, N));
+    vec3 bitangent = cross(N, tangent);
+    return normalize(tangent * H.x + bitangent * H.y + N * H.z);
+}
+
+// k = roughness^2 / 2 for IBL
+float GeometrySchlickGGX(float NdotV, float roughness)
+{
+    float k = roughness * roughness / 2.0;
+    return NdotV / (NdotV * (1.0 - k) + k);
+}
+
+void main()
+{
+    float NdotV = gl_FragCoord.x / float(u_size);
+    float roughness = gl_FragCoord.y / float(u_size);
+    vec3 V = vec3(sqrt(1.0 - NdotV * NdotV), 0.0, NdotV);
+    vec3 N = vec3(0.0, 0.0, 1.0);
+
+    uint sample_count = uint(u_sample_count);
+    float A = 0.0;
+    float B = 0.0;
+    for (uint i = 0u; i < sample_count; ++i) {
+        vec3 H = ImportanceSampleGGX(Hammersley(i, sample_count), N, roughness);
+        vec3 L = normalize(2.0 * dot(V, H) * H - V);
+        float NdotL = max(L.z, 0.0);
+        if (NdotL > 0.0) {
+            float NdotH = max(H.z, 0.0);
+            float VdotH = max(dot(V, H), 0.0);
+            float G = GeometrySchlickGGX(NdotV, roughness) * GeometrySchlickGGX(NdotL, roughness);
+            float G_Vis = G * VdotH / (NdotH * NdotV);
+            float Fc = pow(1.0 - VdotH, 5.0);
+            A += (1.0 - Fc) * G_Vis;
+            B += Fc * G_Vis;
+        }
+    }
+    Color = vec2(A, B) / float(sample_count);
+}
@@ -4,6 +4,11 @@ in vec3 WorldPos;
 
 uniform samplerCube cubemap_texture;
 uniform float roughness;
+uniform int sample_count;
+// filtered importance sampling (CIBLBaker::Prefilter): the source mip of a
+// sample from its pdf, source_size is the face size of level 0
+uniform bool filtered;
+uniform float source_size;
 
 const float PI = 3.14159265359;
 
@@ -67,7 +72,8 @@ void main()
     vec3 R = N;
     vec3 V = R;
 
-    const uint SAMPLE_COUNT = 4096u;
+    uint SAMPLE_COUNT = uint(sample_count);
+    float texelSolidAngle = 4.0 * PI / (6.0 * source_size * source_size);
     float totalWeight = 0.0;   
     vec3 prefilteredColor = vec3(0.0);     
     for(uint i = 0u; i < SAMPLE_COUNT; ++i)
@@ -79,7 +85,18 @@ void main()
         float NdotL = max(dot(N, L), 0.0);
         if(NdotL > 0.0)
         {
-            prefilteredColor += texture(cubemap_texture, L).rgb * NdotL;
+            if(filtered && roughness > 0.0)
+            {
+                // pdf of L with N = V: D(H) (N.H) / (4 (V.H)) = D(H) / 4
+                float pdf = DistributionGGX(N, H, roughness) / 4.0;
+                float sampleSolidAngle = 1.0 / (float(SAMPLE_COUNT) * pdf + 0.0001);
+                float lod = max(0.5 * log2(sampleSolidAngle / texelSolidAngle) + 1.0, 0.0);
+                prefilteredColor += textureLod(cubemap_texture, L, lod).rgb * NdotL;
+            }
+            else
+            {
+                prefilteredColor += texture(cubemap_texture, L).rgb * NdotL;
+            }
             totalWeight      += NdotL;
         }
     }
@@ -0,0 +1,68 @@
+#version 410
+// SH9 projection of a cubemap on the GPU, fragment x of a 9x1 target is
+// coefficient x (CSphericalHarmonics::ProjectCubemap). The faces are read on
+// a u_grid_size^2 grid, at the texel corners of a 2 * u_grid_size source the
+// bilinear fetch averages 2x2 texels
+out vec4 Color;
+
+uniform samplerCube cubemap_texture;
+uniform int u_grid_size;
+
+const float PI = 3.14159265359;
+
+vec3 CubemapDirection(int face, float sc, float tc)
+{
+    if (face == 0) return vec3(1.0, -tc, -sc);
+    if (face == 1) return vec3(-1.0, -tc, sc);
+    if (face == 2) return vec3(sc, 1.0, tc);
+    if (face == 3) return vec3(sc, -1.0, -tc);
+    if (face == 4) return vec3(sc, -tc, 1.0);
+    return vec3(-sc, -tc, -1.0);
+}
+
+float AreaElement(float x, float y)
+{
+    return atan(x * y, sqrt(x * x + y * y + 1.0));
+}
+
+float Polynomial(int index, vec3 d)
+{
+    if (index == 0) return 1.0;
+    if (index == 1) return d.y;
+    if (index == 2) return d.z;
+    if (index == 3) return d.x;
+    if (index == 4) return d.x * d.y;
+    if (index == 5) return d.y * d.z;
+    if (index == 6) return 3.0 * d.z * d.z - 1.0;
+    if (index == 7) return d.x * d.z;
+    return d.x * d.x - d.y * d.y;
+}
+
+// CSphericalHarmonics::GetCoefficientScale
+float CoefficientScale(int index)
+{
+    const float basis[9] = float[9](0.282095, 0.488603, 0.488603, 0.488603, 1.092548,
+                                    1.092548, 0.315392, 1.092548, 0.546274);
+    float band = index == 0 ? PI : (index < 4 ? 2.0 * PI / 3.0 : PI / 4.0);
+    return band * basis[index] * basis[index];
+}
+
+void main()
+{
+    int index = int(gl_FragCoord.x);
+    float cell = 2.0 / float(u_grid_size);
+    vec3 sum = vec3(0.0);
+    for (int face = 0; face < 6; face++) {
+        for (int y = 0; y < u_grid_size; y++) {
+            float y0 = -1.0 + float(y) * cell;
+            for (int x = 0; x < u_grid_size; x++) {
+                float x0 = -1.0 + float(x) * cell;
+                float solid_angle = AreaElement(x0, y0) - AreaElement(x0, y0 + cell) -
+                                    AreaElement(x0 + cell, y0) + AreaElement(x0 + cell, y0 + cell);
+                vec3 d = normalize(CubemapDirection(face, x0 + 0.5 * cell, y0 + 0.5 * cell));
+                sum += textureLod(cubemap_texture, d, 0.0).rgb * (Polynomial(index, d) * solid_angle);
+            }
+        }
+    }
+    Color = vec4(sum * CoefficientScale(index), 1.0);
+}
@@ -0,0 +1,41 @@
+#include "GEngine/renderpass/light_culling_pass.h"
+#include "GEngine/render_system.h"
+#include "GEngine/singleton.h"
+
+GEngine::CLightCullingPass::CLightCullingPass(const std::string &name, int order)
+    : CRenderPass(name, order) {}
+
+GEngine::CLightCullingPass::~CLightCullingPass() {}
+
+void GEngine::CLightCullingPass::Init() {
+  cluster_builder_ = std::make_shared<CLightClusterBuilder>(16, 9, 24);
+  light_data_buffer_ = std::make_shared<CTextureBuffer>(GL_RGBA32F);
+  cluster_grid_buffer_ = std::make_shared<CTextureBuffer>(GL_RG32UI);
+  light_index_buffer_ = std::make_shared<CTextureBuffer>(GL_R32UI);
+
+  auto render_system = CSingleton<CRenderSystem>();
+  render_system->texture_center_["cluster_light_data"] = light_data_buffer_->GetTexture();
+  render_system->texture_center_["cluster_grid"] = cluster_grid_buffer_->GetTexture();
+  render_system->texture_center_["cluster_light_indices"] = light_index_buffer_->GetTexture();
+  render_system->RegisterAnyDataWithName("light_cluster", cluster_builder_);
+}
+
+void GEngine::CLightCullingPass::Tick() {
+  auto camera = CSingleton<CRenderSystem>()->GetOrCreateMainCamera();
+  auto scene = CSingleton<CRenderSystem>()->GetOrCreateMainScene();
+  cluster_builder_->Build(scene->GetLights(), camera->GetViewMatrix(),
+                          camera->GetProjectionMatrix(), camera->GetNear(),
+                          camera->GetFar());
+
+  const auto &light_data = cluster_builder_->GetLightData();
+  const auto &cluster_grid = cluster_builder_->GetClusterGrid();
+  const auto &light_indices = cluster_builder_->GetLightIndices();
+  light_data_buffer_->Upload(light_data.data(), light_data.size() * sizeof(SClusterLight));
+  cluster_grid_buffer_->Upload(cluster_grid.data(), cluster_grid.size() * sizeof(glm::uvec2));
+  light_index_buffer_->Upload(light_indices.data(), light_indices.size() * sizeof(unsigned int));
+
+  auto &stats = CSingleton<CRenderSystem>()->GetRenderStats();
+  stats.light_cluster_build_ms_ = cluster_builder_->GetBuildTime();
+  stats.cluster_light_count_ = static_cast<unsigned int>(light_data.size());
+  stats.cluster_light_index_count_ = static_cast<unsigned int>(light_indices.size());
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "GEngine/light_cluster.h"
+#include "GEngine/render_pass.h"
+#include "GEngine/texture_buffer.h"
+#include <memory>
+#include <string>
+
+namespace GEngine {
+// bins the lights of the main scene into view space clusters every frame and
+// uploads the result as texture buffers for the lit passes:
+//   texture_center_["cluster_light_data"]    RGBA32F, 4 texels per light
+//   texture_center_["cluster_grid"]          RG32UI, (offset, count) per cluster
+//   texture_center_["cluster_light_indices"] R32UI
+class CLightCullingPass : public CRenderPass {
+public:
+  CLightCullingPass(const std::string &name, int order);
+  virtual ~CLightCullingPass();
+
+  virtual void Init() override;
+  virtual void Tick() override;
+
+  std::shared_ptr<CLightClusterBuilder> GetClusterBuilder() const { return cluster_builder_; }
+
+private:
+  std::shared_ptr<CLightClusterBuilder> cluster_builder_;
+  std::shared_ptr<CTextureBuffer> light_data_buffer_;
+  std::shared_ptr<CTextureBuffer> cluster_grid_buffer_;
+  std::shared_ptr<CTextureBuffer> light_index_buffer_;
+};
+} // namespace GEngine
@@ -0,0 +1,105 @@
+#include "GEngine/renderpass/occlusion_culling_pass.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/render_system.h"
+#include "GEngine/singleton.h"
+#include <algorithm>
+#include <chrono>
+
+GEngine::COcclusionCullingPass::COcclusionCullingPass(const std::string &name, int order)
+    : CRenderPass(name, order, ERenderPassType::Default) {}
+
+GEngine::COcclusionCullingPass::~COcclusionCullingPass() {
+  if (draw_list_ && draw_list_->indirect_buffer_ != 0) {
+    glDeleteBuffers(1, &draw_list_->indirect_buffer_);
+  }
+}
+
+void GEngine::COcclusionCullingPass::Init() {
+  draw_list_ = std::make_shared<SDrawList>();
+  glGenBuffers(1, &draw_list_->indirect_buffer_);
+  software_culler_ = std::make_shared<COcclusionCuller>();
+  CSingleton<CRenderSystem>()->RegisterAnyDataWithName("main_draw_list", draw_list_);
+}
+
+void GEngine::COcclusionCullingPass::RasterizeSoftwareOccluders(const glm::mat4 &view_projection, float aspect) {
+  int height = std::max(static_cast<int>(software_width_ / aspect), 1);
+  software_culler_->BeginOccluders(software_width_, height, view_projection);
+
+  // biggest on screen first: bounding radius over distance (w of the center)
+  std::vector<std::pair<float, const SDrawItem *>> occluders;
+  for (const auto &item : frustum_items_) {
+    if (item.alpha_tested_) {
+      continue;
+    }
+    glm::vec4 center = view_projection * glm::vec4(item.world_bounds_.GetCenter(), 1.0f);
+    float radius = glm::length(item.world_bounds_.GetExtent());
+    occluders.push_back({radius / std::max(center.w, 0.1f), &item});
+  }
+  std::sort(occluders.begin(), occluders.end(),
+            [](const auto &a, const auto &b) { return a.first > b.first; });
+
+  unsigned int triangles = 0;
+  for (const auto &[size, item] : occluders) {
+    const auto &entry = item->mesh_->meshes_[item->sub_mesh_];
+    if (triangles + entry.num_indices_ / 3 > software_triangle_budget_) {
+      continue;
+    }
+    software_culler_->RasterizeOccluder(item->mesh_->GetPositions(), item->mesh_->GetIndices(),
+                                        entry.base_index_, entry.num_indices_, entry.base_vertex_, item->model_);
+    triangles += entry.num_indices_ / 3;
+  }
+  software_culler_->EndOccluders();
+}
+
+void GEngine::COcclusionCullingPass::Tick() {
+  auto render_system = CSingleton<CRenderSystem>();
+  auto &stats = render_system->GetRenderStats();
+  auto start_time = std::chrono::high_resolution_clock::now();
+
+  auto camera = render_system->GetOrCreateMainCamera();
+  glm::mat4 view_projection = camera->GetProjectionMatrix() * camera->GetViewMatrix();
+  frustum_items_.clear();
+  render_system->GetOrCreateMainScene()->CollectDrawItems(CFrustum(view_projection), frustum_items_);
+
+  // pick the depth pyramid to test against, nullptr means frustum culling only
+  std::shared_ptr<COcclusionCuller> culler;
+  int mode = render_system->GetOrCreateMainUI()->occlusion_mode_;
+  if (mode == 1 && render_system->HasAnyDataWithName("hiz_culler")) {
+    auto hiz_culler = std::any_cast<std::shared_ptr<COcclusionCuller>>(render_system->GetAnyDataByName("hiz_culler"));
+    if (hiz_culler && hiz_culler->IsReady()) {
+      culler = hiz_culler;
+    }
+  } else if (mode == 2) {
+    std::array<GLint, 4> viewport = CSingleton<CGLStateCache>()->GetViewport();
+    float aspect = viewport[3] > 0 ? static_cast<float>(viewport[2]) / viewport[3] : 1.0f;
+    RasterizeSoftwareOccluders(view_projection, aspect);
+    culler = software_culler_;
+  }
+
+  draw_list_->items_.clear();
+  draw_list_->commands_.clear();
+  for (const auto &item : frustum_items_) {
+    if (culler && !culler->IsVisible(item.world_bounds_)) {
+      continue;
+    }
+    const auto &entry = item.mesh_->meshes_[item.sub_mesh_];
+    SDrawElementsIndirectCommand command;
+    command.count_ = entry.num_indices_;
+    command.instance_count_ = 1;
+    command.first_index_ = entry.base_index_;
+    command.base_vertex_ = static_cast<int>(entry.base_vertex_);
+    command.base_instance_ = 0;
+    draw_list_->items_.push_back(item);
+    draw_list_->commands_.push_back(command);
+  }
+
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw_list_->indirect_buffer_);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, draw_list_->commands_.size() * sizeof(SDrawElementsIndirectCommand),
+               draw_list_->commands_.data(), GL_STREAM_DRAW);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  auto end_time = std::chrono::high_resolution_clock::now();
+  stats.occlusion_tested_ = static_cast<unsigned int>(frustum_items_.size());
+  stats.occlusion_culled_ = static_cast<unsigned int>(frustum_items_.size() - draw_list_->items_.size());
+  stats.occlusion_cull_ms_ = std::chrono::duration<float, std::milli>(end_time - start_time).count();
+}
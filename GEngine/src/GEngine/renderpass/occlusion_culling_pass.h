@@ -0,0 +1,54 @@
+#pragma once
+#include "GEngine/occlusion_culler.h"
+#include "GEngine/render_pass.h"
+#include "GEngine/render_scene.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace GEngine {
+// layout of GL_DRAW_INDIRECT_BUFFER entries for glDrawElementsIndirect
+struct SDrawElementsIndirectCommand {
+  unsigned int count_;
+  unsigned int instance_count_;
+  unsigned int first_index_;
+  int base_vertex_;
+  unsigned int base_instance_; // must be 0 before GL 4.2
+};
+
+// the visible sub-meshes of the main camera, items_[i] is drawn by commands_[i]
+// at byte offset i * sizeof(SDrawElementsIndirectCommand) in indirect_buffer_.
+// Registered as "main_draw_list" and consumed by the depth & forward passes
+struct SDrawList {
+  std::vector<SDrawItem> items_;
+  std::vector<SDrawElementsIndirectCommand> commands_;
+  unsigned int indirect_buffer_ = 0;
+};
+
+// frustum + occlusion culling of the main scene, per sub-mesh bounds:
+//   occlusion_mode_ 0: frustum only
+//   occlusion_mode_ 1: Hi-Z, last frame's depth pyramid read back by CHiZPass
+//   occlusion_mode_ 2: software, the largest opaque sub-meshes are rasterized
+//                      into a small cpu depth buffer (no gpu involved)
+// must run before the depth pre-pass
+class COcclusionCullingPass : public CRenderPass {
+public:
+  COcclusionCullingPass(const std::string &name, int order);
+  virtual ~COcclusionCullingPass();
+
+  virtual void Init() override;
+  virtual void Tick() override;
+
+  void SetSoftwareResolution(int width) { software_width_ = width; }
+  void SetSoftwareTriangleBudget(unsigned int triangles) { software_triangle_budget_ = triangles; }
+
+private:
+  void RasterizeSoftwareOccluders(const glm::mat4 &view_projection, float aspect);
+
+  std::shared_ptr<SDrawList> draw_list_;
+  std::vector<SDrawItem> frustum_items_;
+  std::shared_ptr<COcclusionCuller> software_culler_;
+  int software_width_ = 256;
+  unsigned int software_triangle_budget_ = 50000;
+};
+} // namespace GEngine
@@ -18,6 +18,11 @@ uniform sampler3D scattering_texture;
 uniform sampler3D single_mie_scattering_texture;
 uniform sampler2D irradiance_texture;
 
+// lat/long sky radiance around the camera (PrecomputedAtmospherePass::UpdateSkyView)
+uniform bool u_use_sky_view_lut;
+uniform sampler2D sky_view_texture;
+uniform mat3 sky_view_frame;            // local frame of the camera, z up
+
 const float PI = 3.14159265;
 const float kLengthUnitInMeters = 1000.000000;
 const vec3 kSphereCenter = vec3(0.0, 0.0, 1000.0) / kLengthUnitInMeters;
@@ -86,6 +91,19 @@ void GetSphereShadowInOut(vec3 view_direction, vec3 sun_direction, out float d_i
   }
 }
 
+// longitude, then the zenith angle with the horizon at 0.5: v goes with the
+// square root of the angle to the horizon, the rows are densest at it
+vec2 SkyViewUv(vec3 view_direction) {
+    vec3 local = transpose(sky_view_frame) * view_direction;
+    float r = length(camera - earth_center);
+    float bottom_radius = length(earth_center);
+    float horizon = acos(-sqrt(max(r * r - bottom_radius * bottom_radius, 0.0)) / r);
+    float zenith = acos(clamp(local.z, -1.0, 1.0));
+    float v = zenith < horizon ? 0.5 * (1.0 - sqrt(1.0 - zenith / horizon))
+                               : 0.5 + 0.5 * sqrt((zenith - horizon) / (PI - horizon));
+    return vec2(fract(atan(local.y, local.x) / (2.0 * PI)), v);
+}
+
 void main() {
     vec3 view_direction = normalize(view_ray);
     float fragment_angular_size = length(dFdx(view_ray) + dFdy(view_ray)) / length(view_ray);
@@ -137,9 +155,19 @@ void main() {
     }
     float shadow_length = max(0.0, shadow_out - shadow_in) * lightshaft_fadein_hack;
     vec3 transmittance;
-    vec3 radiance = GetSkyRadiance(camera - earth_center, view_direction, shadow_length, sun_direction, transmittance);
-    if (dot(view_direction, sun_direction) > sun_size.y) {
-        radiance = radiance + transmittance * GetSolarRadiance();
+    vec3 radiance;
+    if (u_use_sky_view_lut) {
+        // no light shafts, the full lookup only runs on the sun disc for its transmittance
+        radiance = texture(sky_view_texture, SkyViewUv(view_direction)).rgb;
+        if (dot(view_direction, sun_direction) > sun_size.y) {
+            GetSkyRadiance(camera - earth_center, view_direction, 0.0, sun_direction, transmittance);
+            radiance = radiance + transmittance * GetSolarRadiance();
+        }
+    } else {
+        radiance = GetSkyRadiance(camera - earth_center, view_direction, shadow_length, sun_direction, transmittance);
+        if (dot(view_direction, sun_direction) > sun_size.y) {
+            radiance = radiance + transmittance * GetSolarRadiance();
+        }
     }
     radiance = mix(radiance, ground_radiance, ground_alpha);
     radiance = mix(radiance, sphere_radiance, sphere_alpha);
@@ -1,9 +1,15 @@
 #include "GEngine/renderpass/precomputed_atmosphere_pass.h"
+#include "GEngine/atmosphere_lut_cache.h"
 #include "GEngine/render_system.h"
 #include "GEngine/log.h"
 #include "GEngine/editor_ui.h"
+#include "GEngine/gl_state_cache.h"
+#include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <limits>
 #include <memory>
 #include <streambuf>
 
@@ -57,36 +63,6 @@ bool IsFramebufferRgbFormatSupported(bool half_precision) {
   return rgb_format_supported;
 }
 
-double Interpolate(const std::vector<double> &wavelengths,
-                   const std::vector<double> &wavelength_function,
-                   double wavelength) {
-  assert(wavelength_function.size() == wavelengths.size());
-  if (wavelength < wavelengths[0]) {
-    return wavelength_function[0];
-  }
-  for (unsigned int i = 0; i < wavelengths.size() - 1; ++i) {
-    if (wavelength < wavelengths[i + 1]) {
-      double u = (wavelength - wavelengths[i]) / (wavelengths[i + 1] - wavelengths[i]);
-      return wavelength_function[i] * (1.0 - u) + wavelength_function[i + 1] * u;
-    }
-  }
-  return wavelength_function[wavelength_function.size() - 1];
-}
-
-double CieColorMatchingFunctionTableValue(double wavelength, int column) {
-  if (wavelength <= GEngine::PrecomputedAtmosphereModel::kLambdaMin || wavelength >= GEngine::PrecomputedAtmosphereModel::kLambdaMax) {
-    return 0.0;
-  }
-  double u = (wavelength - GEngine::PrecomputedAtmosphereModel::kLambdaMin) / 5.0;
-  int row = static_cast<int>(std::floor(u));
-  assert(row >= 0 && row + 1 < 95);
-  assert(GEngine::CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[4 * row] <= wavelength &&
-         GEngine::CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[4 * (row + 1)] >= wavelength);
-  u -= row;
-  return GEngine::CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[4 * row + column] * (1.0 - u) +
-      GEngine::CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[4 * (row + 1) + column] * u;
-}
-
 void ComputeSpectralRadianceToLuminanceFactors(
     const std::vector<double>& wavelengths,
     const std::vector<double>& solar_irradiance,
@@ -94,19 +70,19 @@ void ComputeSpectralRadianceToLuminanceFactors(
   *k_r = 0.0;
   *k_g = 0.0;
   *k_b = 0.0;
-  double solar_r = Interpolate(wavelengths, solar_irradiance, GEngine::PrecomputedAtmosphereModel::kLambdaR);
-  double solar_g = Interpolate(wavelengths, solar_irradiance, GEngine::PrecomputedAtmosphereModel::kLambdaG);
-  double solar_b = Interpolate(wavelengths, solar_irradiance, GEngine::PrecomputedAtmosphereModel::kLambdaB);
+  double solar_r = GEngine::SAtmosphereParameters::Interpolate(wavelengths, solar_irradiance, GEngine::PrecomputedAtmosphereModel::kLambdaR);
+  double solar_g = GEngine::SAtmosphereParameters::Interpolate(wavelengths, solar_irradiance, GEngine::PrecomputedAtmosphereModel::kLambdaG);
+  double solar_b = GEngine::SAtmosphereParameters::Interpolate(wavelengths, solar_irradiance, GEngine::PrecomputedAtmosphereModel::kLambdaB);
   int dlambda = 1;
   for (int lambda = GEngine::PrecomputedAtmosphereModel::kLambdaMin; lambda < GEngine::PrecomputedAtmosphereModel::kLambdaMax; lambda += dlambda) {
-    double x_bar = CieColorMatchingFunctionTableValue(lambda, 1);
-    double y_bar = CieColorMatchingFunctionTableValue(lambda, 2);
-    double z_bar = CieColorMatchingFunctionTableValue(lambda, 3);
+    double x_bar = GEngine::SAtmosphereParameters::CieColorMatchingFunctionTableValue(lambda, 1);
+    double y_bar = GEngine::SAtmosphereParameters::CieColorMatchingFunctionTableValue(lambda, 2);
+    double z_bar = GEngine::SAtmosphereParameters::CieColorMatchingFunctionTableValue(lambda, 3);
     const double* xyz2srgb = GEngine::XYZ_TO_SRGB;
     double r_bar = xyz2srgb[0] * x_bar + xyz2srgb[1] * y_bar + xyz2srgb[2] * z_bar;
     double g_bar = xyz2srgb[3] * x_bar + xyz2srgb[4] * y_bar + xyz2srgb[5] * z_bar;
     double b_bar = xyz2srgb[6] * x_bar + xyz2srgb[7] * y_bar + xyz2srgb[8] * z_bar;
-    double irradiance = Interpolate(wavelengths, solar_irradiance, lambda);
+    double irradiance = GEngine::SAtmosphereParameters::Interpolate(wavelengths, solar_irradiance, lambda);
     *k_r += r_bar * irradiance / solar_r * pow(lambda / GEngine::PrecomputedAtmosphereModel::kLambdaR, lambda_power);
     *k_g += g_bar * irradiance / solar_g * pow(lambda / GEngine::PrecomputedAtmosphereModel::kLambdaG, lambda_power);
     *k_b += b_bar * irradiance / solar_b * pow(lambda / GEngine::PrecomputedAtmosphereModel::kLambdaB, lambda_power);
@@ -116,7 +92,39 @@ void ComputeSpectralRadianceToLuminanceFactors(
   *k_b *= GEngine::MAX_LUMINOUS_EFFICACY * dlambda;
 }
 
-void DrawQuad(const std::vector<bool>& enable_blend, GLuint quad_vao) {
+// draws / dispatches issued by the precomputation, reset by PrecomputedAtmosphereModel::BeginPrecompute
+unsigned int precompute_draw_calls = 0;
+unsigned int precompute_dispatches = 0;
+
+// the programs of one wavelength batch, built by the first precompute steps
+struct SPrecomputePrograms {
+  std::unique_ptr<GEngine::Program> direct_irradiance_;
+  std::unique_ptr<GEngine::Program> single_scattering_;
+  std::unique_ptr<GEngine::Program> scattering_density_;
+  std::unique_ptr<GEngine::Program> indirect_irradiance_;
+  std::unique_ptr<GEngine::Program> multiple_scattering_;
+};
+
+// textures on the first color attachments of fbo, the others detached (a
+// step may run frames after the previous one, it sets up all its state)
+void BindPrecomputeTargets(GLuint fbo, const std::vector<GLuint>& textures) {
+  const GLenum kDrawBuffers[4] = {
+    GL_COLOR_ATTACHMENT0,
+    GL_COLOR_ATTACHMENT1,
+    GL_COLOR_ATTACHMENT2,
+    GL_COLOR_ATTACHMENT3
+  };
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  for (size_t i = 0; i < 4; ++i) {
+    glFramebufferTexture(GL_FRAMEBUFFER, kDrawBuffers[i], i < textures.size() ? textures[i] : 0, 0);
+  }
+  glDrawBuffers(static_cast<GLsizei>(textures.size()), kDrawBuffers);
+}
+
+// one instance per layer of a 3D texture (see kLayeredVertexShader)
+void DrawQuad(const std::vector<bool>& enable_blend, GLuint quad_vao, GLsizei instance_count = 1) {
+  glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
+  glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ONE, GL_ONE);
   for (unsigned int i = 0; i < enable_blend.size(); ++i) {
     if (enable_blend[i]) {
       glEnablei(GL_BLEND, i);
@@ -124,7 +132,8 @@ void DrawQuad(const std::vector<bool>& enable_blend, GLuint quad_vao) {
   }
 
   glBindVertexArray(quad_vao);
-  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instance_count);
+  precompute_draw_calls++;
   
   auto err = glGetError();
   if(err!=GL_NO_ERROR) {
@@ -138,6 +147,63 @@ void DrawQuad(const std::vector<bool>& enable_blend, GLuint quad_vao) {
   }
 }
 
+// one invocation per texel, 8x8 groups on every layer (of the slice)
+void DispatchCompute(int width, int height, int depth) {
+  glDispatchCompute((width + 7) / 8, (height + 7) / 8, depth);
+  // the next step samples or loads what this one stored
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  precompute_dispatches++;
+}
+
+// the precompute header targets 4.1, compute shaders need 4.3
+std::string ComputeShaderSource(std::string header, const std::string& defines, const std::string& kernel) {
+  const std::string kVersion = "#version 410";
+  size_t version = header.find(kVersion);
+  if (version != std::string::npos) {
+    header.replace(version, kVersion.size(), "#version 430");
+    header.insert(header.find('\n', version) + 1, defines);
+  }
+  return header + kernel;
+}
+
+// the scene is y up, the atmosphere frame z up
+glm::mat3 AtmosphereFromSceneAxes() {
+  return glm::mat3(glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+}
+
+// (sc, tc, 1) of a cubemap face texel -> its direction, the GL cubemap face
+// selection inverted
+glm::mat3 SceneFromCubeFace(int face) {
+  static const glm::mat3 kFaces[6] = {
+      {{0.0f, 0.0f, -1.0f}, {0.0f, -1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}},
+      {{0.0f, 0.0f, 1.0f}, {0.0f, -1.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}},
+      {{1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 0.0f}},
+      {{1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, {0.0f, -1.0f, 0.0f}},
+      {{1.0f, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+      {{-1.0f, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, -1.0f}}};
+  return kFaces[face];
+}
+
+std::shared_ptr<GEngine::CTexture> NewSkyCaptureCubemap() {
+  auto cubemap = std::make_shared<GEngine::CTexture>(GEngine::CTexture::ETarget::kTextureCubeMap);
+  cubemap->SetWidth(GEngine::SSkyCapture::kSize);
+  cubemap->SetHeight(GEngine::SSkyCapture::kSize);
+  auto state_cache = GEngine::CSingleton<GEngine::CGLStateCache>();
+  state_cache->BindTexture(GL_TEXTURE_CUBE_MAP, cubemap->id_);
+  for (int face = 0; face < 6; face++) {
+    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB16F, GEngine::SSkyCapture::kSize,
+                 GEngine::SSkyCapture::kSize, 0, GL_RGB, GL_FLOAT, nullptr);
+  }
+  // the mips are generated once the 6 faces are rendered
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  state_cache->BindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  return cubemap;
+}
+
 /* helper funtion end */
 
 /* Shader definitions begin */
@@ -151,872 +217,45 @@ void main() {
   gl_Position = vec4(vertex, 0.0, 1.0);
 })";
 
+// the same quad for 3D textures, drawn with one instance per layer from
+// first_layer on
+const std::string kLayeredVertexShader = R"(
+#version 410
+layout(location = 0) in vec2 vertex;
+uniform int first_layer;
+flat out int instance;
+void main() {
+  gl_Position = vec4(vertex, 0.0, 1.0);
+  instance = first_layer + gl_InstanceID;
+})";
+
 // a basic geometry shader (only for 3D textures, to specify in which layer we
-// want to write):
+// want to write), the layer is the instance of kLayeredVertexShader:
 const std::string kGeometryShader = R"(
 #version 410
 layout(triangles) in;
 layout(triangle_strip, max_vertices = 3) out;
-uniform int layer;
+flat in int instance[];
+flat out int layer;
 void main() {
   gl_Position = gl_in[0].gl_Position;
-  gl_Layer = layer;
+  gl_Layer = instance[0];
+  layer = instance[0];
   EmitVertex();
   gl_Position = gl_in[1].gl_Position;
-  gl_Layer = layer;
+  gl_Layer = instance[0];
+  layer = instance[0];
   EmitVertex();
   gl_Position = gl_in[2].gl_Position;
-  gl_Layer = layer;
+  gl_Layer = instance[0];
+  layer = instance[0];
   EmitVertex();
   EndPrimitive();
 })";
 
-// fragment shader (definitions + functions), see https://ebruneton.github.io/precomputed_atmospheric_scattering/atmosphere/functions.glsl.html
-const std::string kFragmentShaderDefinitions = R"(
-#define Length float
-#define Wavelength float
-#define Angle float
-#define SolidAngle float
-#define Power float
-#define LuminousPower float
-#define Number float
-#define InverseLength float
-#define Area float
-#define Volume float
-#define NumberDensity float
-#define Irradiance float
-#define Radiance float
-#define SpectralPower float
-#define SpectralIrradiance float
-#define SpectralRadiance float
-#define SpectralRadianceDensity float
-#define ScatteringCoefficient float
-#define InverseSolidAngle float
-#define LuminousIntensity float
-#define Luminance float
-#define Illuminance float
-#define AbstractSpectrum vec3
-#define DimensionlessSpectrum vec3
-#define PowerSpectrum vec3
-#define IrradianceSpectrum vec3
-#define RadianceSpectrum vec3
-#define RadianceDensitySpectrum vec3
-#define ScatteringSpectrum vec3
-#define Position vec3
-#define Direction vec3
-#define Luminance3 vec3
-#define Illuminance3 vec3
-#define TransmittanceTexture sampler2D
-#define AbstractScatteringTexture sampler3D
-#define ReducedScatteringTexture sampler3D
-#define ScatteringTexture sampler3D
-#define ScatteringDensityTexture sampler3D
-#define IrradianceTexture sampler2D
-const Length m = 1.0;
-const Wavelength nm = 1.0;
-const Angle rad = 1.0;
-const SolidAngle sr = 1.0;
-const Power watt = 1.0;
-const LuminousPower lm = 1.0;
-const float PI = 3.14159265358979323846;
-const Length km = 1000.0 * m;
-const Area m2 = m * m;
-const Volume m3 = m * m * m;
-const Angle pi = PI * rad;
-const Angle deg = pi / 180.0;
-const Irradiance watt_per_square_meter = watt / m2;
-const Radiance watt_per_square_meter_per_sr = watt / (m2 * sr);
-const SpectralIrradiance watt_per_square_meter_per_nm = watt / (m2 * nm);
-const SpectralRadiance watt_per_square_meter_per_sr_per_nm = watt / (m2 * sr * nm);
-const SpectralRadianceDensity watt_per_cubic_meter_per_sr_per_nm = watt / (m3 * sr * nm);
-const LuminousIntensity cd = lm / sr;
-const LuminousIntensity kcd = 1000.0 * cd;
-const Luminance cd_per_square_meter = cd / m2;
-const Luminance kcd_per_square_meter = kcd / m2;
-
-struct DensityProfileLayer {
-  Length width;
-  Number exp_term;
-  InverseLength exp_scale;
-  InverseLength linear_term;
-  Number constant_term;
-};
-struct DensityProfile {
-  DensityProfileLayer layers[2];
-};
-struct AtmosphereParameters {
-  IrradianceSpectrum solar_irradiance;
-  Angle sun_angular_radius;
-  Length bottom_radius;
-  Length top_radius;
-  DensityProfile rayleigh_density;
-  ScatteringSpectrum rayleigh_scattering;
-  DensityProfile mie_density;
-  ScatteringSpectrum mie_scattering;
-  ScatteringSpectrum mie_extinction;
-  Number mie_phase_function_g;
-  DensityProfile absorption_density;
-  ScatteringSpectrum absorption_extinction;
-  DimensionlessSpectrum ground_albedo;
-  Number mu_s_min;
-};
-)";
-
-const std::string kFragmentShaderFunctions = R"(
-// utility functions
-Number ClampCosine(Number mu) {
-  return clamp(mu, Number(-1.0), Number(1.0));
-}
-Length ClampDistance(Length d) {
-  return max(d, 0.0 * m);
-}
-Length ClampRadius(IN(AtmosphereParameters) atmosphere, Length r) {
-  return clamp(r, atmosphere.bottom_radius, atmosphere.top_radius);
-}
-Length SafeSqrt(Area a) {
-  return sqrt(max(a, 0.0 * m2));
-}
-
-// Distance to the top atmosphere boundary along the view dir
-Length DistanceToTopAtmosphereBoundary(IN(AtmosphereParameters) atmosphere, Length r, Number mu) {
-  assert(r <= atmosphere.top_radius);
-  assert(mu >= -1.0 && mu <= 1.0);
-  Area discriminant = r * r * (mu * mu - 1.0) + atmosphere.top_radius * atmosphere.top_radius;
-  return ClampDistance(-r * mu + SafeSqrt(discriminant));
-}
-// Distance to the ground along the view dir
-Length DistanceToBottomAtmosphereBoundary(IN(AtmosphereParameters) atmosphere,
-    Length r, Number mu) {
-  assert(r >= atmosphere.bottom_radius);
-  assert(mu >= -1.0 && mu <= 1.0);
-  Area discriminant = r * r * (mu * mu - 1.0) + atmosphere.bottom_radius * atmosphere.bottom_radius;
-  return ClampDistance(-r * mu - SafeSqrt(discriminant));
-}
-// view dir intersections with the ground
-bool RayIntersectsGround(IN(AtmosphereParameters) atmosphere,
-    Length r, Number mu) {
-  assert(r >= atmosphere.bottom_radius);
-  assert(mu >= -1.0 && mu <= 1.0);
-  return mu < 0.0 && r * r * (mu * mu - 1.0) + atmosphere.bottom_radius * atmosphere.bottom_radius >= 0.0 * m2;
-}
-
-// compute the transmittance 
-Number GetLayerDensity(IN(DensityProfileLayer) layer, Length altitude) {
-  Number density = layer.exp_term * exp(layer.exp_scale * altitude) + layer.linear_term * altitude + layer.constant_term;
-  return clamp(density, Number(0.0), Number(1.0));
-}
-Number GetProfileDensity(IN(DensityProfile) profile, Length altitude) {
-  return altitude < profile.layers[0].width ? GetLayerDensity(profile.layers[0], altitude) : GetLayerDensity(profile.layers[1], altitude);
-}
-Length ComputeOpticalLengthToTopAtmosphereBoundary(IN(AtmosphereParameters) atmosphere, IN(DensityProfile) profile, Length r, Number mu) {
-  assert(r >= atmosphere.bottom_radius && r <= atmosphere.top_radius);
-  assert(mu >= -1.0 && mu <= 1.0);
-  const int SAMPLE_COUNT = 500;
-  Length dx = DistanceToTopAtmosphereBoundary(atmosphere, r, mu) / Number(SAMPLE_COUNT);
-  Length result = 0.0 * m;
-  for (int i = 0; i <= SAMPLE_COUNT; ++i) {
-    Length d_i = Number(i) * dx;
-    Length r_i = sqrt(d_i * d_i + 2.0 * r * mu * d_i + r * r);
-    Number y_i = GetProfileDensity(profile, r_i - atmosphere.bottom_radius);
-    Number weight_i = (i == 0 || i == SAMPLE_COUNT) ? 0.5 : 1.0;
-    result += y_i * weight_i * dx;
-  }
-  return result;
-}
-DimensionlessSpectrum ComputeTransmittanceToTopAtmosphereBoundary(IN(AtmosphereParameters) atmosphere, Length r, Number mu) {
-  assert(r >= atmosphere.bottom_radius && r <= atmosphere.top_radius);
-  assert(mu >= -1.0 && mu <= 1.0);
-  return exp(-(atmosphere.rayleigh_scattering * ComputeOpticalLengthToTopAtmosphereBoundary(atmosphere, atmosphere.rayleigh_density, r, mu)
-       + atmosphere.mie_extinction * ComputeOpticalLengthToTopAtmosphereBoundary(atmosphere, atmosphere.mie_density, r, mu)
-       + atmosphere.absorption_extinction * ComputeOpticalLengthToTopAtmosphereBoundary(atmosphere, atmosphere.absorption_density, r, mu)));
-}
-Number GetTextureCoordFromUnitRange(Number x, int texture_size) {
-  return 0.5 / Number(texture_size) + x * (1.0 - 1.0 / Number(texture_size));
-}
-Number GetUnitRangeFromTextureCoord(Number u, int texture_size) {
-  return (u - 0.5 / Number(texture_size)) / (1.0 - 1.0 / Number(texture_size));
-}
-vec2 GetTransmittanceTextureUvFromRMu(IN(AtmosphereParameters) atmosphere, Length r, Number mu) {
-  assert(r >= atmosphere.bottom_radius && r <= atmosphere.top_radius);
-  assert(mu >= -1.0 && mu <= 1.0);
-  Length H = sqrt(atmosphere.top_radius * atmosphere.top_radius - atmosphere.bottom_radius * atmosphere.bottom_radius);
-  Length rho = SafeSqrt(r * r - atmosphere.bottom_radius * atmosphere.bottom_radius);
-  Length d = DistanceToTopAtmosphereBoundary(atmosphere, r, mu);
-  Length d_min = atmosphere.top_radius - r;
-  Length d_max = rho + H;
-  Number x_mu = (d - d_min) / (d_max - d_min);
-  Number x_r = rho / H;
-  return vec2(GetTextureCoordFromUnitRange(x_mu, TRANSMITTANCE_TEXTURE_WIDTH), GetTextureCoordFromUnitRange(x_r, TRANSMITTANCE_TEXTURE_HEIGHT));
-}
-void GetRMuFromTransmittanceTextureUv(IN(AtmosphereParameters) atmosphere,
-    IN(vec2) uv, OUT(Length) r, OUT(Number) mu) {
-  assert(uv.x >= 0.0 && uv.x <= 1.0);
-  assert(uv.y >= 0.0 && uv.y <= 1.0);
-  Number x_mu = GetUnitRangeFromTextureCoord(uv.x, TRANSMITTANCE_TEXTURE_WIDTH);
-  Number x_r = GetUnitRangeFromTextureCoord(uv.y, TRANSMITTANCE_TEXTURE_HEIGHT);
-  Length H = sqrt(atmosphere.top_radius * atmosphere.top_radius - atmosphere.bottom_radius * atmosphere.bottom_radius);
-  Length rho = H * x_r;
-  r = sqrt(rho * rho + atmosphere.bottom_radius * atmosphere.bottom_radius);
-  Length d_min = atmosphere.top_radius - r;
-  Length d_max = rho + H;
-  Length d = d_min + x_mu * (d_max - d_min);
-  mu = d == 0.0 * m ? Number(1.0) : (H * H - rho * rho - d * d) / (2.0 * r * d);
-  mu = ClampCosine(mu);
-}
-DimensionlessSpectrum ComputeTransmittanceToTopAtmosphereBoundaryTexture(IN(AtmosphereParameters) atmosphere, IN(vec2) frag_coord) {
-  const vec2 TRANSMITTANCE_TEXTURE_SIZE = vec2(TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT);
-  Length r;
-  Number mu;
-  GetRMuFromTransmittanceTextureUv(atmosphere, frag_coord / TRANSMITTANCE_TEXTURE_SIZE, r, mu);
-  return ComputeTransmittanceToTopAtmosphereBoundary(atmosphere, r, mu);
-}
-DimensionlessSpectrum GetTransmittanceToTopAtmosphereBoundary(
-    IN(AtmosphereParameters) atmosphere,
-    IN(TransmittanceTexture) transmittance_texture,
-    Length r, Number mu) {
-  assert(r >= atmosphere.bottom_radius && r <= atmosphere.top_radius);
-  vec2 uv = GetTransmittanceTextureUvFromRMu(atmosphere, r, mu);
-  return DimensionlessSpectrum(texture(transmittance_texture, uv));
-}
-DimensionlessSpectrum GetTransmittance(
-    IN(AtmosphereParameters) atmosphere,
-    IN(TransmittanceTexture) transmittance_texture,
-    Length r, Number mu, Length d, bool ray_r_mu_intersects_ground) {
-  assert(r >= atmosphere.bottom_radius && r <= atmosphere.top_radius);
-  assert(mu >= -1.0 && mu <= 1.0);
-  assert(d >= 0.0 * m);
-  Length r_d = ClampRadius(atmosphere, sqrt(d * d + 2.0 * r * mu * d + r * r));
-  Number mu_d = ClampCosine((r * mu + d) / r_d);
-  if (ray_r_mu_intersects_ground) {
-    return min(
-        GetTransmittanceToTopAtmosphereBoundary(atmosphere, transmittance_texture, r_d, -mu_d) /
-        GetTransmittanceToTopAtmosphereBoundary(atmosphere, transmittance_texture, r, -mu),
-        DimensionlessSpectrum(1.0));
-  } else {
-    return min(
-        GetTransmittanceToTopAtmosphereBoundary(
-            atmosphere, transmittance_texture, r, mu) /
-        GetTransmittanceToTopAtmosphereBoundary(
-            atmosphere, transmittance_texture, r_d, mu_d),
-        DimensionlessSpectrum(1.0));
-  }
-}
-DimensionlessSpectrum GetTransmittanceToSun(IN(AtmosphereParameters) atmosphere,
-                                            IN(TransmittanceTexture) transmittance_texture,
-                                            Length r, Number mu_s) {
-  Number sin_theta_h = atmosphere.bottom_radius / r;
-  Number cos_theta_h = -sqrt(max(1.0 - sin_theta_h * sin_theta_h, 0.0));
-  return GetTransmittanceToTopAtmosphereBoundary(atmosphere, transmittance_texture, r, mu_s) *
-      smoothstep(-sin_theta_h * atmosphere.sun_angular_radius / rad,
-                  sin_theta_h * atmosphere.sun_angular_radius / rad,
-                  mu_s - cos_theta_h);
-}
-void ComputeSingleScatteringIntegrand(IN(AtmosphereParameters) atmosphere,
-                                      IN(TransmittanceTexture) transmittance_texture,
-                                      Length r, Number mu, Number mu_s, Number nu, Length d,
-                                      bool ray_r_mu_intersects_ground,
-                                      OUT(DimensionlessSpectrum) rayleigh, 
-                                      OUT(DimensionlessSpectrum) mie) {
-  Length r_d = ClampRadius(atmosphere, sqrt(d * d + 2.0 * r * mu * d + r * r));
-  Number mu_s_d = ClampCosine((r * mu_s + d * nu) / r_d);
-  DimensionlessSpectrum transmittance = GetTransmittance(atmosphere, transmittance_texture, r, mu, d, ray_r_mu_intersects_ground) *
-                                        GetTransmittanceToSun(atmosphere, transmittance_texture, r_d, mu_s_d);
-  rayleigh = transmittance * GetProfileDensity(atmosphere.rayleigh_density, r_d - atmosphere.bottom_radius);
-  mie = transmittance * GetProfileDensity(atmosphere.mie_density, r_d - atmosphere.bottom_radius);
-}
-Length DistanceToNearestAtmosphereBoundary(IN(AtmosphereParameters) atmosphere,
-                                           Length r, Number mu, bool ray_r_mu_intersects_ground) {
-  if (ray_r_mu_intersects_ground) {
-    return DistanceToBottomAtmosphereBoundary(atmosphere, r, mu);
-  } else {
-    return DistanceToTopAtmosphereBoundary(atmosphere, r, mu);
-  }
-}
-void ComputeSingleScattering(IN(AtmosphereParameters) atmosphere,
-                             IN(TransmittanceTexture) transmittance_texture,
-                             Length r, Number mu, Number mu_s, Number nu,
-                             bool ray_r_mu_intersects_ground,
-                             OUT(IrradianceSpectrum) rayleigh,
-                             OUT(IrradianceSpectrum) mie) {
-  assert(r >= atmosphere.bottom_radius && r <= atmosphere.top_radius);
-  assert(mu >= -1.0 && mu <= 1.0);
-  assert(mu_s >= -1.0 && mu_s <= 1.0);
-  assert(nu >= -1.0 && nu <= 1.0);
-  const int SAMPLE_COUNT = 50;
-  Length dx = DistanceToNearestAtmosphereBoundary(atmosphere, r, mu, ray_r_mu_intersects_ground) / Number(SAMPLE_COUNT);
-  DimensionlessSpectrum rayleigh_sum = DimensionlessSpectrum(0.0);
-  DimensionlessSpectrum mie_sum = DimensionlessSpectrum(0.0);
-  for (int i = 0; i <= SAMPLE_COUNT; ++i) {
-    Length d_i = Number(i) * dx;
-    DimensionlessSpectrum rayleigh_i;
-    DimensionlessSpectrum mie_i;
-    ComputeSingleScatteringIntegrand(atmosphere, transmittance_texture, r, mu, mu_s, nu, d_i, ray_r_mu_intersects_ground, rayleigh_i, mie_i);
-    Number weight_i = (i == 0 || i == SAMPLE_COUNT) ? 0.5 : 1.0;
-    rayleigh_sum += rayleigh_i * weight_i;
-    mie_sum += mie_i * weight_i;
-  }
-  rayleigh = rayleigh_sum * dx * atmosphere.solar_irradiance * atmosphere.rayleigh_scattering;
-  mie = mie_sum * dx * atmosphere.solar_irradiance * atmosphere.mie_scattering;
-}
-InverseSolidAngle RayleighPhaseFunction(Number nu) {
-  InverseSolidAngle k = 3.0 / (16.0 * PI * sr);
-  return k * (1.0 + nu * nu);
-}
-InverseSolidAngle MiePhaseFunction(Number g, Number nu) {
-  InverseSolidAngle k = 3.0 / (8.0 * PI * sr) * (1.0 - g * g) / (2.0 + g * g);
-  return k * (1.0 + nu * nu) / pow(1.0 + g * g - 2.0 * g * nu, 1.5);
-}
-vec4 GetScatteringTextureUvwzFromRMuMuSNu(IN(AtmosphereParameters) atmosphere,
-                                          Length r, Number mu, Number mu_s, Number nu,
-                                          bool ray_r_mu_intersects_ground) {
-  assert(r >= atmosphere.bottom_radius && r <= atmosphere.top_radius);
-  assert(mu >= -1.0 && mu <= 1.0);
-  assert(mu_s >= -1.0 && mu_s <= 1.0);
-  assert(nu >= -1.0 && nu <= 1.0);
-  Length H = sqrt(atmosphere.top_radius * atmosphere.top_radius - atmosphere.bottom_radius * atmosphere.bottom_radius);
-  Length rho = SafeSqrt(r * r - atmosphere.bottom_radius * atmosphere.bottom_radius);
-  Number u_r = GetTextureCoordFromUnitRange(rho / H, SCATTERING_TEXTURE_R_SIZE);
-  Length r_mu = r * mu;
-  Area discriminant = r_mu * r_mu - r * r + atmosphere.bottom_radius * atmosphere.bottom_radius;
-  Number u_mu;
-  if (ray_r_mu_intersects_ground) {
-    Length d = -r_mu - SafeSqrt(discriminant);
-    Length d_min = r - atmosphere.bottom_radius;
-    Length d_max = rho;
-    u_mu = 0.5 - 0.5 * GetTextureCoordFromUnitRange(d_max == d_min ? 0.0 : (d - d_min) / (d_max - d_min), SCATTERING_TEXTURE_MU_SIZE / 2);
-  } else {
-    Length d = -r_mu + SafeSqrt(discriminant + H * H);
-    Length d_min = atmosphere.top_radius - r;
-    Length d_max = rho + H;
-    u_mu = 0.5 + 0.5 * GetTextureCoordFromUnitRange((d - d_min) / (d_max - d_min), SCATTERING_TEXTURE_MU_SIZE / 2);
-  }
-  Length d = DistanceToTopAtmosphereBoundary(atmosphere, atmosphere.bottom_radius, mu_s);
-  Length d_min = atmosphere.top_radius - atmosphere.bottom_radius;
-  Length d_max = H;
-  Number a = (d - d_min) / (d_max - d_min);
-  Length D = DistanceToTopAtmosphereBoundary(atmosphere, atmosphere.bottom_radius, atmosphere.mu_s_min);
-  Number A = (D - d_min) / (d_max - d_min);
-  Number u_mu_s = GetTextureCoordFromUnitRange(max(1.0 - a / A, 0.0) / (1.0 + a), SCATTERING_TEXTURE_MU_S_SIZE);
-  Number u_nu = (nu + 1.0) / 2.0;
-  return vec4(u_nu, u_mu_s, u_mu, u_r);
-}
-void GetRMuMuSNuFromScatteringTextureUvwz(IN(AtmosphereParameters) atmosphere,
-                                          IN(vec4) uvwz,
-                                          OUT(Length) r,
-                                          OUT(Number) mu,
-                                          OUT(Number) mu_s,
-                                          OUT(Number) nu,
-                                          OUT(bool) ray_r_mu_intersects_ground) {
-  assert(uvwz.x >= 0.0 && uvwz.x <= 1.0);
-  assert(uvwz.y >= 0.0 && uvwz.y <= 1.0);
-  assert(uvwz.z >= 0.0 && uvwz.z <= 1.0);
-  assert(uvwz.w >= 0.0 && uvwz.w <= 1.0);
-  Length H = sqrt(atmosphere.top_radius * atmosphere.top_radius - atmosphere.bottom_radius * atmosphere.bottom_radius);
-  Length rho = H * GetUnitRangeFromTextureCoord(uvwz.w, SCATTERING_TEXTURE_R_SIZE);
-  r = sqrt(rho * rho + atmosphere.bottom_radius * atmosphere.bottom_radius);
-  if (uvwz.z < 0.5) {
-    // ray hit the ground
-    Length d_min = r - atmosphere.bottom_radius;
-    Length d_max = rho;
-    Length d = d_min + (d_max - d_min) * GetUnitRangeFromTextureCoord(1.0 - 2.0 * uvwz.z, SCATTERING_TEXTURE_MU_SIZE / 2);
-    mu = d == 0.0 * m ? Number(-1.0) : ClampCosine(-(rho * rho + d * d) / (2.0 * r * d));
-    ray_r_mu_intersects_ground = true;
-  } else {
-    // ray hit sky
-    Length d_min = atmosphere.top_radius - r;
-    Length d_max = rho + H;
-    Length d = d_min + (d_max - d_min) * GetUnitRangeFromTextureCoord(2.0 * uvwz.z - 1.0, SCATTERING_TEXTURE_MU_SIZE / 2);
-    mu = d == 0.0 * m ? Number(1.0) : ClampCosine((H * H - rho * rho - d * d) / (2.0 * r * d));
-    ray_r_mu_intersects_ground = false;
-  }
-  Number x_mu_s = GetUnitRangeFromTextureCoord(uvwz.y, SCATTERING_TEXTURE_MU_S_SIZE);
-  Length d_min = atmosphere.top_radius - atmosphere.bottom_radius;
-  Length d_max = H;
-  Length D = DistanceToTopAtmosphereBoundary(atmosphere, atmosphere.bottom_radius, atmosphere.mu_s_min);
-  Number A = (D - d_min) / (d_max - d_min);
-  Number a = (A - x_mu_s * A) / (1.0 + x_mu_s * A);
-  Length d = d_min + min(a, A) * (d_max - d_min);
-  mu_s = d == 0.0 * m ? Number(1.0) : ClampCosine((H * H - d * d) / (2.0 * atmosphere.bottom_radius * d));
-  nu = ClampCosine(uvwz.x * 2.0 - 1.0);
-}
-void GetRMuMuSNuFromScatteringTextureFragCoord(IN(AtmosphereParameters) atmosphere, IN(vec3) frag_coord,
-                                               OUT(Length) r, OUT(Number) mu, 
-                                               OUT(Number) mu_s, 
-                                               OUT(Number) nu,
-                                               OUT(bool) ray_r_mu_intersects_ground) {
-  const vec4 SCATTERING_TEXTURE_SIZE = vec4(SCATTERING_TEXTURE_NU_SIZE - 1, SCATTERING_TEXTURE_MU_S_SIZE,
-                                            SCATTERING_TEXTURE_MU_SIZE, SCATTERING_TEXTURE_R_SIZE);
-  Number frag_coord_nu = floor(frag_coord.x / Number(SCATTERING_TEXTURE_MU_S_SIZE));
-  Number frag_coord_mu_s = mod(frag_coord.x, Number(SCATTERING_TEXTURE_MU_S_SIZE));
-  vec4 uvwz = vec4(frag_coord_nu, frag_coord_mu_s, frag_coord.y, frag_coord.z) / SCATTERING_TEXTURE_SIZE;
-  GetRMuMuSNuFromScatteringTextureUvwz(atmosphere, uvwz, r, mu, mu_s, nu, ray_r_mu_intersects_ground);
-  nu = clamp(nu, mu * mu_s - sqrt((1.0 - mu * mu) * (1.0 - mu_s * mu_s)), mu * mu_s + sqrt((1.0 - mu * mu) * (1.0 - mu_s * mu_s)));
-}
-void ComputeSingleScatteringTexture(IN(AtmosphereParameters) atmosphere,
-                                    IN(TransmittanceTexture) transmittance_texture, IN(vec3) frag_coord,
-                                    OUT(IrradianceSpectrum) rayleigh, OUT(IrradianceSpectrum) mie) {
-  Length r;
-  Number mu;
-  Number mu_s;
-  Number nu;
-  bool ray_r_mu_intersects_ground;
-  GetRMuMuSNuFromScatteringTextureFragCoord(atmosphere, frag_coord,r, mu, mu_s, nu, ray_r_mu_intersects_ground);
-  ComputeSingleScattering(atmosphere, transmittance_texture, r, mu, mu_s, nu, ray_r_mu_intersects_ground, rayleigh, mie);
-}
-TEMPLATE(AbstractSpectrum)
-AbstractSpectrum GetScattering(
-    IN(AtmosphereParameters) atmosphere,
-    IN(AbstractScatteringTexture TEMPLATE_ARGUMENT(AbstractSpectrum))
-        scattering_texture,
-    Length r, Number mu, Number mu_s, Number nu,
-    bool ray_r_mu_intersects_ground) {
-  vec4 uvwz = GetScatteringTextureUvwzFromRMuMuSNu(
-      atmosphere, r, mu, mu_s, nu, ray_r_mu_intersects_ground);
-  Number tex_coord_x = uvwz.x * Number(SCATTERING_TEXTURE_NU_SIZE - 1);
-  Number tex_x = floor(tex_coord_x);
-  Number lerp = tex_coord_x - tex_x;
-  vec3 uvw0 = vec3((tex_x + uvwz.y) / Number(SCATTERING_TEXTURE_NU_SIZE),
-      uvwz.z, uvwz.w);
-  vec3 uvw1 = vec3((tex_x + 1.0 + uvwz.y) / Number(SCATTERING_TEXTURE_NU_SIZE),
-      uvwz.z, uvwz.w);
-  return AbstractSpectrum(texture(scattering_texture, uvw0) * (1.0 - lerp) +
-      texture(scattering_texture, uvw1) * lerp);
-}
-RadianceSpectrum GetScattering(
-    IN(AtmosphereParameters) atmosphere,
-    IN(ReducedScatteringTexture) single_rayleigh_scattering_texture,
-    IN(ReducedScatteringTexture) single_mie_scattering_texture,
-    IN(ScatteringTexture) multiple_scattering_texture,
-    Length r, Number mu, Number mu_s, Number nu,
-    bool ray_r_mu_intersects_ground,
-    int scattering_order) {
-  if (scattering_order == 1) {
-    IrradianceSpectrum rayleigh = GetScattering(
-        atmosphere, single_rayleigh_scattering_texture, r, mu, mu_s, nu,
-        ray_r_mu_intersects_ground);
-    IrradianceSpectrum mie = GetScattering(
-        atmosphere, single_mie_scattering_texture, r, mu, mu_s, nu,
-        ray_r_mu_intersects_ground);
-    return rayleigh * RayleighPhaseFunction(nu) +
-        mie * MiePhaseFunction(atmosphere.mie_phase_function_g, nu);
-  } else {
-    return GetScattering(
-        atmosphere, multiple_scattering_texture, r, mu, mu_s, nu,
-        ray_r_mu_intersects_ground);
-  }
-}
-IrradianceSpectrum GetIrradiance(
-    IN(AtmosphereParameters) atmosphere,
-    IN(IrradianceTexture) irradiance_texture,
-    Length r, Number mu_s);
-RadianceDensitySpectrum ComputeScatteringDensity(
-    IN(AtmosphereParameters) atmosphere,
-    IN(TransmittanceTexture) transmittance_texture,
-    IN(ReducedScatteringTexture) single_rayleigh_scattering_texture,
-    IN(ReducedScatteringTexture) single_mie_scattering_texture,
-    IN(ScatteringTexture) multiple_scattering_texture,
-    IN(IrradianceTexture) irradiance_texture,
-    Length r, Number mu, Number mu_s, Number nu, int scattering_order) {
-  assert(r >= atmosphere.bottom_radius && r <= atmosphere.top_radius);
-  assert(mu >= -1.0 && mu <= 1.0);
-  assert(mu_s >= -1.0 && mu_s <= 1.0);
-  assert(nu >= -1.0 && nu <= 1.0);
-  assert(scattering_order >= 2);
-  vec3 zenith_direction = vec3(0.0, 0.0, 1.0);
-  vec3 omega = vec3(sqrt(1.0 - mu * mu), 0.0, mu);
-  Number sun_dir_x = omega.x == 0.0 ? 0.0 : (nu - mu * mu_s) / omega.x;
-  Number sun_dir_y = sqrt(max(1.0 - sun_dir_x * sun_dir_x - mu_s * mu_s, 0.0));
-  vec3 omega_s = vec3(sun_dir_x, sun_dir_y, mu_s);
-  const int SAMPLE_COUNT = 16;
-  const Angle dphi = pi / Number(SAMPLE_COUNT);
-  const Angle dtheta = pi / Number(SAMPLE_COUNT);
-  RadianceDensitySpectrum rayleigh_mie =
-      RadianceDensitySpectrum(0.0 * watt_per_cubic_meter_per_sr_per_nm);
-  for (int l = 0; l < SAMPLE_COUNT; ++l) {
-    Angle theta = (Number(l) + 0.5) * dtheta;
-    Number cos_theta = cos(theta);
-    Number sin_theta = sin(theta);
-    bool ray_r_theta_intersects_ground =
-        RayIntersectsGround(atmosphere, r, cos_theta);
-    Length distance_to_ground = 0.0 * m;
-    DimensionlessSpectrum transmittance_to_ground = DimensionlessSpectrum(0.0);
-    DimensionlessSpectrum ground_albedo = DimensionlessSpectrum(0.0);
-    if (ray_r_theta_intersects_ground) {
-      distance_to_ground =
-          DistanceToBottomAtmosphereBoundary(atmosphere, r, cos_theta);
-      transmittance_to_ground =
-          GetTransmittance(atmosphere, transmittance_texture, r, cos_theta,
-              distance_to_ground, true /* ray_intersects_ground */);
-      ground_albedo = atmosphere.ground_albedo;
-    }
-    for (int m = 0; m < 2 * SAMPLE_COUNT; ++m) {
-      Angle phi = (Number(m) + 0.5) * dphi;
-      vec3 omega_i =
-          vec3(cos(phi) * sin_theta, sin(phi) * sin_theta, cos_theta);
-      SolidAngle domega_i = (dtheta / rad) * (dphi / rad) * sin(theta) * sr;
-      Number nu1 = dot(omega_s, omega_i);
-      RadianceSpectrum incident_radiance = GetScattering(atmosphere,
-          single_rayleigh_scattering_texture, single_mie_scattering_texture,
-          multiple_scattering_texture, r, omega_i.z, mu_s, nu1,
-          ray_r_theta_intersects_ground, scattering_order - 1);
-      vec3 ground_normal =
-          normalize(zenith_direction * r + omega_i * distance_to_ground);
-      IrradianceSpectrum ground_irradiance = GetIrradiance(
-          atmosphere, irradiance_texture, atmosphere.bottom_radius,
-          dot(ground_normal, omega_s));
-      incident_radiance += transmittance_to_ground *
-          ground_albedo * (1.0 / (PI * sr)) * ground_irradiance;
-      Number nu2 = dot(omega, omega_i);
-      Number rayleigh_density = GetProfileDensity(
-          atmosphere.rayleigh_density, r - atmosphere.bottom_radius);
-      Number mie_density = GetProfileDensity(
-          atmosphere.mie_density, r - atmosphere.bottom_radius);
-      rayleigh_mie += incident_radiance * (
-          atmosphere.rayleigh_scattering * rayleigh_density *
-              RayleighPhaseFunction(nu2) +
-          atmosphere.mie_scattering * mie_density *
-              MiePhaseFunction(atmosphere.mie_phase_function_g, nu2)) *
-          domega_i;
-    }
-  }
-  return rayleigh_mie;
-}
-RadianceSpectrum ComputeMultipleScattering(
-    IN(AtmosphereParameters) atmosphere,
-    IN(TransmittanceTexture) transmittance_texture,
-    IN(ScatteringDensityTexture) scattering_density_texture,
-    Length r, Number mu, Number mu_s, Number nu,
-    bool ray_r_mu_intersects_ground) {
-  assert(r >= atmosphere.bottom_radius && r <= atmosphere.top_radius);
-  assert(mu >= -1.0 && mu <= 1.0);
-  assert(mu_s >= -1.0 && mu_s <= 1.0);
-  assert(nu >= -1.0 && nu <= 1.0);
-  const int SAMPLE_COUNT = 50;
-  Length dx =
-      DistanceToNearestAtmosphereBoundary(
-          atmosphere, r, mu, ray_r_mu_intersects_ground) /
-              Number(SAMPLE_COUNT);
-  RadianceSpectrum rayleigh_mie_sum =
-      RadianceSpectrum(0.0 * watt_per_square_meter_per_sr_per_nm);
-  for (int i = 0; i <= SAMPLE_COUNT; ++i) {
-    Length d_i = Number(i) * dx;
-    Length r_i =
-        ClampRadius(atmosphere, sqrt(d_i * d_i + 2.0 * r * mu * d_i + r * r));
-    Number mu_i = ClampCosine((r * mu + d_i) / r_i);
-    Number mu_s_i = ClampCosine((r * mu_s + d_i * nu) / r_i);
-    RadianceSpectrum rayleigh_mie_i =
-        GetScattering(
-            atmosphere, scattering_density_texture, r_i, mu_i, mu_s_i, nu,
-            ray_r_mu_intersects_ground) *
-        GetTransmittance(
-            atmosphere, transmittance_texture, r, mu, d_i,
-            ray_r_mu_intersects_ground) *
-        dx;
-    Number weight_i = (i == 0 || i == SAMPLE_COUNT) ? 0.5 : 1.0;
-    rayleigh_mie_sum += rayleigh_mie_i * weight_i;
-  }
-  return rayleigh_mie_sum;
-}
-RadianceDensitySpectrum ComputeScatteringDensityTexture(
-    IN(AtmosphereParameters) atmosphere,
-    IN(TransmittanceTexture) transmittance_texture,
-    IN(ReducedScatteringTexture) single_rayleigh_scattering_texture,
-    IN(ReducedScatteringTexture) single_mie_scattering_texture,
-    IN(ScatteringTexture) multiple_scattering_texture,
-    IN(IrradianceTexture) irradiance_texture,
-    IN(vec3) frag_coord, int scattering_order) {
-  Length r;
-  Number mu;
-  Number mu_s;
-  Number nu;
-  bool ray_r_mu_intersects_ground;
-  GetRMuMuSNuFromScatteringTextureFragCoord(atmosphere, frag_coord,
-      r, mu, mu_s, nu, ray_r_mu_intersects_ground);
-  return ComputeScatteringDensity(atmosphere, transmittance_texture,
-      single_rayleigh_scattering_texture, single_mie_scattering_texture,
-      multiple_scattering_texture, irradiance_texture, r, mu, mu_s, nu,
-      scattering_order);
-}
-RadianceSpectrum ComputeMultipleScatteringTexture(
-    IN(AtmosphereParameters) atmosphere,
-    IN(TransmittanceTexture) transmittance_texture,
-    IN(ScatteringDensityTexture) scattering_density_texture,
-    IN(vec3) frag_coord, OUT(Number) nu) {
-  Length r;
-  Number mu;
-  Number mu_s;
-  bool ray_r_mu_intersects_ground;
-  GetRMuMuSNuFromScatteringTextureFragCoord(atmosphere, frag_coord,
-      r, mu, mu_s, nu, ray_r_mu_intersects_ground);
-  return ComputeMultipleScattering(atmosphere, transmittance_texture,
-      scattering_density_texture, r, mu, mu_s, nu,
-      ray_r_mu_intersects_ground);
-}
-IrradianceSpectrum ComputeDirectIrradiance(
-    IN(AtmosphereParameters) atmosphere,
-    IN(TransmittanceTexture) transmittance_texture,
-    Length r, Number mu_s) {
-  assert(r >= atmosphere.bottom_radius && r <= atmosphere.top_radius);
-  assert(mu_s >= -1.0 && mu_s <= 1.0);
-  Number alpha_s = atmosphere.sun_angular_radius / rad;
-  Number average_cosine_factor =
-    mu_s < -alpha_s ? 0.0 : (mu_s > alpha_s ? mu_s :
-        (mu_s + alpha_s) * (mu_s + alpha_s) / (4.0 * alpha_s));
-  return atmosphere.solar_irradiance *
-      GetTransmittanceToTopAtmosphereBoundary(
-          atmosphere, transmittance_texture, r, mu_s) * average_cosine_factor;
-}
-IrradianceSpectrum ComputeIndirectIrradiance(
-    IN(AtmosphereParameters) atmosphere,
-    IN(ReducedScatteringTexture) single_rayleigh_scattering_texture,
-    IN(ReducedScatteringTexture) single_mie_scattering_texture,
-    IN(ScatteringTexture) multiple_scattering_texture,
-    Length r, Number mu_s, int scattering_order) {
-  assert(r >= atmosphere.bottom_radius && r <= atmosphere.top_radius);
-  assert(mu_s >= -1.0 && mu_s <= 1.0);
-  assert(scattering_order >= 1);
-  const int SAMPLE_COUNT = 32;
-  const Angle dphi = pi / Number(SAMPLE_COUNT);
-  const Angle dtheta = pi / Number(SAMPLE_COUNT);
-  IrradianceSpectrum result =
-      IrradianceSpectrum(0.0 * watt_per_square_meter_per_nm);
-  vec3 omega_s = vec3(sqrt(1.0 - mu_s * mu_s), 0.0, mu_s);
-  for (int j = 0; j < SAMPLE_COUNT / 2; ++j) {
-    Angle theta = (Number(j) + 0.5) * dtheta;
-    for (int i = 0; i < 2 * SAMPLE_COUNT; ++i) {
-      Angle phi = (Number(i) + 0.5) * dphi;
-      vec3 omega =
-          vec3(cos(phi) * sin(theta), sin(phi) * sin(theta), cos(theta));
-      SolidAngle domega = (dtheta / rad) * (dphi / rad) * sin(theta) * sr;
-      Number nu = dot(omega, omega_s);
-      result += GetScattering(atmosphere, single_rayleigh_scattering_texture,
-          single_mie_scattering_texture, multiple_scattering_texture,
-          r, omega.z, mu_s, nu, false /* ray_r_theta_intersects_ground */,
-          scattering_order) *
-              omega.z * domega;
-    }
-  }
-  return result;
-}
-vec2 GetIrradianceTextureUvFromRMuS(IN(AtmosphereParameters) atmosphere,
-    Length r, Number mu_s) {
-  assert(r >= atmosphere.bottom_radius && r <= atmosphere.top_radius);
-  assert(mu_s >= -1.0 && mu_s <= 1.0);
-  Number x_r = (r - atmosphere.bottom_radius) /
-      (atmosphere.top_radius - atmosphere.bottom_radius);
-  Number x_mu_s = mu_s * 0.5 + 0.5;
-  return vec2(GetTextureCoordFromUnitRange(x_mu_s, IRRADIANCE_TEXTURE_WIDTH),
-              GetTextureCoordFromUnitRange(x_r, IRRADIANCE_TEXTURE_HEIGHT));
-}
-void GetRMuSFromIrradianceTextureUv(IN(AtmosphereParameters) atmosphere,
-    IN(vec2) uv, OUT(Length) r, OUT(Number) mu_s) {
-  assert(uv.x >= 0.0 && uv.x <= 1.0);
-  assert(uv.y >= 0.0 && uv.y <= 1.0);
-  Number x_mu_s = GetUnitRangeFromTextureCoord(uv.x, IRRADIANCE_TEXTURE_WIDTH);
-  Number x_r = GetUnitRangeFromTextureCoord(uv.y, IRRADIANCE_TEXTURE_HEIGHT);
-  r = atmosphere.bottom_radius +
-      x_r * (atmosphere.top_radius - atmosphere.bottom_radius);
-  mu_s = ClampCosine(2.0 * x_mu_s - 1.0);
-}
-const vec2 IRRADIANCE_TEXTURE_SIZE =
-    vec2(IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT);
-IrradianceSpectrum ComputeDirectIrradianceTexture(
-    IN(AtmosphereParameters) atmosphere,
-    IN(TransmittanceTexture) transmittance_texture,
-    IN(vec2) frag_coord) {
-  Length r;
-  Number mu_s;
-  GetRMuSFromIrradianceTextureUv(atmosphere, frag_coord / IRRADIANCE_TEXTURE_SIZE, r, mu_s);
-  return ComputeDirectIrradiance(atmosphere, transmittance_texture, r, mu_s);
-}
-IrradianceSpectrum ComputeIndirectIrradianceTexture(
-    IN(AtmosphereParameters) atmosphere,
-    IN(ReducedScatteringTexture) single_rayleigh_scattering_texture,
-    IN(ReducedScatteringTexture) single_mie_scattering_texture,
-    IN(ScatteringTexture) multiple_scattering_texture,
-    IN(vec2) frag_coord, int scattering_order) {
-  Length r;
-  Number mu_s;
-  GetRMuSFromIrradianceTextureUv(
-      atmosphere, frag_coord / IRRADIANCE_TEXTURE_SIZE, r, mu_s);
-  return ComputeIndirectIrradiance(atmosphere,
-      single_rayleigh_scattering_texture, single_mie_scattering_texture,
-      multiple_scattering_texture, r, mu_s, scattering_order);
-}
-IrradianceSpectrum GetIrradiance(
-    IN(AtmosphereParameters) atmosphere,
-    IN(IrradianceTexture) irradiance_texture,
-    Length r, Number mu_s) {
-  vec2 uv = GetIrradianceTextureUvFromRMuS(atmosphere, r, mu_s);
-  return IrradianceSpectrum(texture(irradiance_texture, uv));
-}
-#ifdef COMBINED_SCATTERING_TEXTURES
-vec3 GetExtrapolatedSingleMieScattering(
-    IN(AtmosphereParameters) atmosphere, IN(vec4) scattering) {
-  if (scattering.r <= 0.0) {
-    return vec3(0.0);
-  }
-  return scattering.rgb * scattering.a / scattering.r *
-	    (atmosphere.rayleigh_scattering.r / atmosphere.mie_scattering.r) *
-	    (atmosphere.mie_scattering / atmosphere.rayleigh_scattering);
-}
-#endif
-IrradianceSpectrum GetCombinedScattering(
-    IN(AtmosphereParameters) atmosphere,
-    IN(ReducedScatteringTexture) scattering_texture,
-    IN(ReducedScatteringTexture) single_mie_scattering_texture,
-    Length r, Number mu, Number mu_s, Number nu,
-    bool ray_r_mu_intersects_ground,
-    OUT(IrradianceSpectrum) single_mie_scattering) {
-  vec4 uvwz = GetScatteringTextureUvwzFromRMuMuSNu(
-      atmosphere, r, mu, mu_s, nu, ray_r_mu_intersects_ground);
-  Number tex_coord_x = uvwz.x * Number(SCATTERING_TEXTURE_NU_SIZE - 1);
-  Number tex_x = floor(tex_coord_x);
-  Number lerp = tex_coord_x - tex_x;
-  vec3 uvw0 = vec3((tex_x + uvwz.y) / Number(SCATTERING_TEXTURE_NU_SIZE),
-      uvwz.z, uvwz.w);
-  vec3 uvw1 = vec3((tex_x + 1.0 + uvwz.y) / Number(SCATTERING_TEXTURE_NU_SIZE),
-      uvwz.z, uvwz.w);
-#ifdef COMBINED_SCATTERING_TEXTURES
-  vec4 combined_scattering =
-      texture(scattering_texture, uvw0) * (1.0 - lerp) +
-      texture(scattering_texture, uvw1) * lerp;
-  IrradianceSpectrum scattering = IrradianceSpectrum(combined_scattering);
-  single_mie_scattering =
-      GetExtrapolatedSingleMieScattering(atmosphere, combined_scattering);
-#else
-  IrradianceSpectrum scattering = IrradianceSpectrum(
-      texture(scattering_texture, uvw0) * (1.0 - lerp) +
-      texture(scattering_texture, uvw1) * lerp);
-  single_mie_scattering = IrradianceSpectrum(
-      texture(single_mie_scattering_texture, uvw0) * (1.0 - lerp) +
-      texture(single_mie_scattering_texture, uvw1) * lerp);
-#endif
-  return scattering;
-}
-RadianceSpectrum GetSkyRadiance(
-    IN(AtmosphereParameters) atmosphere,
-    IN(TransmittanceTexture) transmittance_texture,
-    IN(ReducedScatteringTexture) scattering_texture,
-    IN(ReducedScatteringTexture) single_mie_scattering_texture,
-    Position camera, IN(Direction) view_ray, Length shadow_length,
-    IN(Direction) sun_direction, OUT(DimensionlessSpectrum) transmittance) {
-  Length r = length(camera);
-  Length rmu = dot(camera, view_ray);
-  Length distance_to_top_atmosphere_boundary = -rmu -
-      sqrt(rmu * rmu - r * r + atmosphere.top_radius * atmosphere.top_radius);
-  if (distance_to_top_atmosphere_boundary > 0.0 * m) {
-    camera = camera + view_ray * distance_to_top_atmosphere_boundary;
-    r = atmosphere.top_radius;
-    rmu += distance_to_top_atmosphere_boundary;
-  } else if (r > atmosphere.top_radius) {
-    transmittance = DimensionlessSpectrum(1.0);
-    return RadianceSpectrum(0.0 * watt_per_square_meter_per_sr_per_nm);
-  }
-  Number mu = rmu / r;
-  Number mu_s = dot(camera, sun_direction) / r;
-  Number nu = dot(view_ray, sun_direction);
-  bool ray_r_mu_intersects_ground = RayIntersectsGround(atmosphere, r, mu);
-  transmittance = ray_r_mu_intersects_ground ? DimensionlessSpectrum(0.0) :
-      GetTransmittanceToTopAtmosphereBoundary(
-          atmosphere, transmittance_texture, r, mu);
-  IrradianceSpectrum single_mie_scattering;
-  IrradianceSpectrum scattering;
-  if (shadow_length == 0.0 * m) {
-    scattering = GetCombinedScattering(
-        atmosphere, scattering_texture, single_mie_scattering_texture,
-        r, mu, mu_s, nu, ray_r_mu_intersects_ground,
-        single_mie_scattering);
-  } else {
-    Length d = shadow_length;
-    Length r_p =
-        ClampRadius(atmosphere, sqrt(d * d + 2.0 * r * mu * d + r * r));
-    Number mu_p = (r * mu + d) / r_p;
-    Number mu_s_p = (r * mu_s + d * nu) / r_p;
-    scattering = GetCombinedScattering(
-        atmosphere, scattering_texture, single_mie_scattering_texture,
-        r_p, mu_p, mu_s_p, nu, ray_r_mu_intersects_ground,
-        single_mie_scattering);
-    DimensionlessSpectrum shadow_transmittance =
-        GetTransmittance(atmosphere, transmittance_texture,
-            r, mu, shadow_length, ray_r_mu_intersects_ground);
-    scattering = scattering * shadow_transmittance;
-    single_mie_scattering = single_mie_scattering * shadow_transmittance;
-  }
-  return scattering * RayleighPhaseFunction(nu) + single_mie_scattering *
-      MiePhaseFunction(atmosphere.mie_phase_function_g, nu);
-}
-RadianceSpectrum GetSkyRadianceToPoint(
-    IN(AtmosphereParameters) atmosphere,
-    IN(TransmittanceTexture) transmittance_texture,
-    IN(ReducedScatteringTexture) scattering_texture,
-    IN(ReducedScatteringTexture) single_mie_scattering_texture,
-    Position camera, IN(Position) point, Length shadow_length,
-    IN(Direction) sun_direction, OUT(DimensionlessSpectrum) transmittance) {
-  Direction view_ray = normalize(point - camera);
-  Length r = length(camera);
-  Length rmu = dot(camera, view_ray);
-  Length distance_to_top_atmosphere_boundary = -rmu -
-      sqrt(rmu * rmu - r * r + atmosphere.top_radius * atmosphere.top_radius);
-  if (distance_to_top_atmosphere_boundary > 0.0 * m) {
-    camera = camera + view_ray * distance_to_top_atmosphere_boundary;
-    r = atmosphere.top_radius;
-    rmu += distance_to_top_atmosphere_boundary;
-  }
-  Number mu = rmu / r;
-  Number mu_s = dot(camera, sun_direction) / r;
-  Number nu = dot(view_ray, sun_direction);
-  Length d = length(point - camera);
-  bool ray_r_mu_intersects_ground = RayIntersectsGround(atmosphere, r, mu);
-  transmittance = GetTransmittance(atmosphere, transmittance_texture,
-      r, mu, d, ray_r_mu_intersects_ground);
-  IrradianceSpectrum single_mie_scattering;
-  IrradianceSpectrum scattering = GetCombinedScattering(
-      atmosphere, scattering_texture, single_mie_scattering_texture,
-      r, mu, mu_s, nu, ray_r_mu_intersects_ground,
-      single_mie_scattering);
-  d = max(d - shadow_length, 0.0 * m);
-  Length r_p = ClampRadius(atmosphere, sqrt(d * d + 2.0 * r * mu * d + r * r));
-  Number mu_p = (r * mu + d) / r_p;
-  Number mu_s_p = (r * mu_s + d * nu) / r_p;
-  IrradianceSpectrum single_mie_scattering_p;
-  IrradianceSpectrum scattering_p = GetCombinedScattering(
-      atmosphere, scattering_texture, single_mie_scattering_texture,
-      r_p, mu_p, mu_s_p, nu, ray_r_mu_intersects_ground,
-      single_mie_scattering_p);
-  DimensionlessSpectrum shadow_transmittance = transmittance;
-  if (shadow_length > 0.0 * m) {
-    shadow_transmittance = GetTransmittance(atmosphere, transmittance_texture,
-        r, mu, d, ray_r_mu_intersects_ground);
-  }
-  scattering = scattering - shadow_transmittance * scattering_p;
-  single_mie_scattering =
-      single_mie_scattering - shadow_transmittance * single_mie_scattering_p;
-#ifdef COMBINED_SCATTERING_TEXTURES
-  single_mie_scattering = GetExtrapolatedSingleMieScattering(
-      atmosphere, vec4(scattering, single_mie_scattering.r));
-#endif
-  single_mie_scattering = single_mie_scattering *
-      smoothstep(Number(0.0), Number(0.01), mu_s);
-  return scattering * RayleighPhaseFunction(nu) + single_mie_scattering *
-      MiePhaseFunction(atmosphere.mie_phase_function_g, nu);
-}
-IrradianceSpectrum GetSunAndSkyIrradiance(
-    IN(AtmosphereParameters) atmosphere,
-    IN(TransmittanceTexture) transmittance_texture,
-    IN(IrradianceTexture) irradiance_texture,
-    IN(Position) point, IN(Direction) normal, IN(Direction) sun_direction,
-    OUT(IrradianceSpectrum) sky_irradiance) {
-  Length r = length(point);
-  Number mu_s = dot(point, sun_direction) / r;
-  sky_irradiance = GetIrradiance(atmosphere, irradiance_texture, r, mu_s) *
-      (1.0 + dot(normal, point) / r) * 0.5;
-  return atmosphere.solar_irradiance *
-      GetTransmittanceToSun(
-          atmosphere, transmittance_texture, r, mu_s) *
-      max(dot(normal, sun_direction), 0.0);
-}
-)";
+// fragment shader (definitions + functions) live in atmosphere_definitions.glsl
+// and atmosphere_functions.glsl, glsl_header_factory_ #includes them
+const std::string kShaderDirectory = "../../GEngine/src/GEngine/renderpass";
 
 const char kDemoVertexShader[] = R"(
 #version 410
@@ -1036,8 +275,8 @@ void main() {
 /* precompute textures shaders begin */
 
 /**
- * Note that these shaders must be concatenated with kFragmentShaderDefinitions and kFragmentShaderFunctions,
- * as well as with a definition of the ATMOSPHERE constant
+ * Note that these shaders must be appended to the output of glsl_header_factory_ (atmosphere_definitions.glsl,
+ * the ATMOSPHERE constant and atmosphere_functions.glsl)
  */
 const std::string kComputeTransmittanceShader = R"(
 layout(location = 0) out vec3 transmittance;
@@ -1061,7 +300,7 @@ layout(location = 2) out vec4 scattering;
 layout(location = 3) out vec3 single_mie_scattering;
 uniform mat3 luminance_from_radiance;
 uniform sampler2D transmittance_texture;
-uniform int layer;
+flat in int layer;
 void main() {
   ComputeSingleScatteringTexture(ATMOSPHERE, transmittance_texture, vec3(gl_FragCoord.xy, layer + 0.5), delta_rayleigh, delta_mie);
   scattering = vec4(luminance_from_radiance * delta_rayleigh.rgb, (luminance_from_radiance * delta_mie).r);
@@ -1076,7 +315,7 @@ uniform sampler3D single_mie_scattering_texture;
 uniform sampler3D multiple_scattering_texture;
 uniform sampler2D irradiance_texture;
 uniform int scattering_order;
-uniform int layer;
+flat in int layer;
 void main() {
   scattering_density = ComputeScatteringDensityTexture(
       ATMOSPHERE, transmittance_texture,
@@ -1109,7 +348,7 @@ layout(location = 1) out vec4 scattering;
 uniform mat3 luminance_from_radiance;
 uniform sampler2D transmittance_texture;
 uniform sampler3D scattering_density_texture;
-uniform int layer;
+flat in int layer;
 void main() {
   float nu;
   delta_multiple_scattering = ComputeMultipleScatteringTexture(
@@ -1120,6 +359,151 @@ void main() {
 })";
 
 
+/**
+ * GL 4.3 kernels of the shaders above, one invocation per texel of the layers
+ * from first_layer on, blending is an imageLoad + imageStore of the texel the
+ * invocation owns.
+ * Appended to the glsl_header_factory_ output with #version 430 and
+ * LUT_FORMAT, the image format of the 3D textures (rgba, images have no rgb).
+ */
+const std::string kComputeTransmittanceKernel = R"(
+layout(local_size_x = 8, local_size_y = 8) in;
+layout(rgba32f) uniform writeonly image2D transmittance_image;
+void main() {
+  ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+  if (any(greaterThanEqual(texel, imageSize(transmittance_image)))) {
+    return;
+  }
+  imageStore(transmittance_image, texel,
+             vec4(ComputeTransmittanceToTopAtmosphereBoundaryTexture(ATMOSPHERE, vec2(texel) + 0.5), 0.0));
+})";
+
+const std::string kComputeDirectIrradianceKernel = R"(
+layout(local_size_x = 8, local_size_y = 8) in;
+layout(rgba32f) uniform writeonly image2D delta_irradiance_image;
+layout(rgba32f) uniform writeonly image2D irradiance_image;
+uniform sampler2D transmittance_texture;
+uniform bool blend;
+void main() {
+  ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+  if (any(greaterThanEqual(texel, imageSize(delta_irradiance_image)))) {
+    return;
+  }
+  imageStore(delta_irradiance_image, texel,
+             vec4(ComputeDirectIrradianceTexture(ATMOSPHERE, transmittance_texture, vec2(texel) + 0.5), 0.0));
+  if (!blend) {
+    imageStore(irradiance_image, texel, vec4(0.0));
+  }
+})";
+
+const std::string kComputeSingleScatteringKernel = R"(
+layout(local_size_x = 8, local_size_y = 8) in;
+layout(LUT_FORMAT) uniform writeonly image3D delta_rayleigh_image;
+layout(LUT_FORMAT) uniform writeonly image3D delta_mie_image;
+layout(LUT_FORMAT) uniform image3D scattering_image;
+#ifndef COMBINED_SCATTERING_TEXTURES
+layout(LUT_FORMAT) uniform image3D single_mie_scattering_image;
+#endif
+uniform mat3 luminance_from_radiance;
+uniform sampler2D transmittance_texture;
+uniform bool blend;
+uniform int first_layer;
+void main() {
+  ivec3 texel = ivec3(gl_GlobalInvocationID) + ivec3(0, 0, first_layer);
+  if (any(greaterThanEqual(texel, imageSize(scattering_image)))) {
+    return;
+  }
+  vec3 delta_rayleigh;
+  vec3 delta_mie;
+  ComputeSingleScatteringTexture(ATMOSPHERE, transmittance_texture, vec3(texel) + 0.5, delta_rayleigh, delta_mie);
+  imageStore(delta_rayleigh_image, texel, vec4(delta_rayleigh, 0.0));
+  imageStore(delta_mie_image, texel, vec4(delta_mie, 0.0));
+  vec4 scattering = vec4(luminance_from_radiance * delta_rayleigh, (luminance_from_radiance * delta_mie).r);
+  if (blend) {
+    scattering += imageLoad(scattering_image, texel);
+  }
+  imageStore(scattering_image, texel, scattering);
+#ifndef COMBINED_SCATTERING_TEXTURES
+  vec4 single_mie_scattering = vec4(luminance_from_radiance * delta_mie, 0.0);
+  if (blend) {
+    single_mie_scattering += imageLoad(single_mie_scattering_image, texel);
+  }
+  imageStore(single_mie_scattering_image, texel, single_mie_scattering);
+#endif
+})";
+
+const std::string kComputeScatteringDensityKernel = R"(
+layout(local_size_x = 8, local_size_y = 8) in;
+layout(LUT_FORMAT) uniform writeonly image3D scattering_density_image;
+uniform sampler2D transmittance_texture;
+uniform sampler3D single_rayleigh_scattering_texture;
+uniform sampler3D single_mie_scattering_texture;
+uniform sampler3D multiple_scattering_texture;
+uniform sampler2D irradiance_texture;
+uniform int scattering_order;
+uniform int first_layer;
+void main() {
+  ivec3 texel = ivec3(gl_GlobalInvocationID) + ivec3(0, 0, first_layer);
+  if (any(greaterThanEqual(texel, imageSize(scattering_density_image)))) {
+    return;
+  }
+  vec3 scattering_density = ComputeScatteringDensityTexture(
+      ATMOSPHERE, transmittance_texture,
+      single_rayleigh_scattering_texture,
+      single_mie_scattering_texture,
+      multiple_scattering_texture,
+      irradiance_texture,
+      vec3(texel) + 0.5,
+      scattering_order);
+  imageStore(scattering_density_image, texel, vec4(scattering_density, 0.0));
+})";
+
+const std::string kComputeIndirectIrradianceKernel = R"(
+layout(local_size_x = 8, local_size_y = 8) in;
+layout(rgba32f) uniform writeonly image2D delta_irradiance_image;
+layout(rgba32f) uniform image2D irradiance_image;
+uniform mat3 luminance_from_radiance;
+uniform sampler3D single_rayleigh_scattering_texture;
+uniform sampler3D single_mie_scattering_texture;
+uniform sampler3D multiple_scattering_texture;
+uniform int scattering_order;
+void main() {
+  ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+  if (any(greaterThanEqual(texel, imageSize(irradiance_image)))) {
+    return;
+  }
+  vec3 delta_irradiance = ComputeIndirectIrradianceTexture(ATMOSPHERE, single_rayleigh_scattering_texture,
+                                                           single_mie_scattering_texture, multiple_scattering_texture,
+                                                           vec2(texel) + 0.5, scattering_order);
+  imageStore(delta_irradiance_image, texel, vec4(delta_irradiance, 0.0));
+  imageStore(irradiance_image, texel,
+             imageLoad(irradiance_image, texel) + vec4(luminance_from_radiance * delta_irradiance, 0.0));
+})";
+
+const std::string kComputeMultipleScatteringKernel = R"(
+layout(local_size_x = 8, local_size_y = 8) in;
+layout(LUT_FORMAT) uniform writeonly image3D delta_multiple_scattering_image;
+layout(LUT_FORMAT) uniform image3D scattering_image;
+uniform mat3 luminance_from_radiance;
+uniform sampler2D transmittance_texture;
+uniform sampler3D scattering_density_texture;
+uniform int first_layer;
+void main() {
+  ivec3 texel = ivec3(gl_GlobalInvocationID) + ivec3(0, 0, first_layer);
+  if (any(greaterThanEqual(texel, imageSize(scattering_image)))) {
+    return;
+  }
+  float nu;
+  vec3 delta_multiple_scattering = ComputeMultipleScatteringTexture(
+      ATMOSPHERE, transmittance_texture,
+      scattering_density_texture,
+      vec3(texel) + 0.5, nu);
+  imageStore(delta_multiple_scattering_image, texel, vec4(delta_multiple_scattering, 0.0));
+  imageStore(scattering_image, texel,
+             imageLoad(scattering_image, texel) +
+                 vec4(luminance_from_radiance * delta_multiple_scattering / RayleighPhaseFunction(nu), 0.0));
+})";
+
 /* precompute textures shaders end */
 
 /* kAtmosphereShader which exposed our API beign */
@@ -1188,80 +572,124 @@ const std::string kAtmosphereShader = R"(
 
 /* kAtmosphereShader which exposed our API end */
 
+// one froxel per fragment of the layered quad, appended to the model's
+// kAtmosphereShader source (see SAerialPerspective)
+const std::string kAerialPerspectiveShader = R"(
+#ifdef USE_LUMINANCE
+#define GetSkyRadianceToPoint GetSkyLuminanceToPoint
+#endif
+layout(location = 0) out vec4 aerial_perspective;
+uniform mat4 view_from_clip;
+// view space -> atmosphere frame (z up, length unit, from the earth center)
+uniform mat4 atmosphere_from_view;
+uniform vec3 sun_direction;
+uniform float max_distance;
+uniform float exposure;
+flat in int layer;
+void main() {
+  vec2 size = vec2(AERIAL_PERSPECTIVE_SIZE);
+  vec4 clip_ray = view_from_clip * vec4(gl_FragCoord.xy / size * 2.0 - 1.0, 1.0, 1.0);
+  vec3 view_ray = clip_ray.xyz / clip_ray.w;
+  float slice = (float(layer) + 0.5) / float(AERIAL_PERSPECTIVE_SIZE);
+  float view_depth = max_distance * slice * slice;
+  vec3 camera = atmosphere_from_view[3].xyz;
+  vec3 point = (atmosphere_from_view * vec4(view_ray * (view_depth / -view_ray.z), 1.0)).xyz;
+  vec3 transmittance;
+  vec3 in_scatter = GetSkyRadianceToPoint(camera, point, 0.0, sun_direction, transmittance);
+  aerial_perspective = vec4(in_scatter * exposure, dot(transmittance, vec3(1.0 / 3.0)));
+})";
+
+// one texel of the sky-view LUT per fragment, appended to the model's
+// kAtmosphereShader source. The inverse of SkyViewUv in
+// precomputed_atmosphere_frag.glsl
+const std::string kSkyViewShader = R"(
+#ifdef USE_LUMINANCE
+#define GetSkyRadiance GetSkyLuminance
+#endif
+layout(location = 0) out vec4 sky_view;
+uniform vec3 camera; // from the earth center
+uniform mat3 sky_view_frame;
+uniform vec3 sun_direction;
+void main() {
+  vec2 uv = gl_FragCoord.xy / vec2(SKY_VIEW_WIDTH, SKY_VIEW_HEIGHT);
+  float r = length(camera);
+  float horizon = acos(-sqrt(max(r * r - ATMOSPHERE.bottom_radius * ATMOSPHERE.bottom_radius, 0.0)) / r);
+  float zenith = uv.y < 0.5 ? horizon * (1.0 - (1.0 - 2.0 * uv.y) * (1.0 - 2.0 * uv.y))
+                            : horizon + (2.0 * uv.y - 1.0) * (2.0 * uv.y - 1.0) * (PI - horizon);
+  float azimuth = 2.0 * PI * uv.x;
+  vec3 view_direction = sky_view_frame * vec3(cos(azimuth) * sin(zenith), sin(azimuth) * sin(zenith), cos(zenith));
+  vec3 transmittance;
+  sky_view = vec4(GetSkyRadiance(camera, view_direction, 0.0, sun_direction, transmittance), 1.0);
+})";
+
+// one face of the SSkyCapture cubemap, appended to the model's
+// kAtmosphereShader source. The sky without the sun disc (the sun is a
+// light), the lit ground below the horizon
+const std::string kSkyCaptureShader = R"(
+#ifdef USE_LUMINANCE
+#define GetSkyRadiance GetSkyLuminance
+#define GetSkyRadianceToPoint GetSkyLuminanceToPoint
+#define GetSunAndSkyIrradiance GetSunAndSkyIlluminance
+#endif
+layout(location = 0) out vec4 sky_capture;
+uniform mat3 atmosphere_from_face; // (sc, tc, 1) -> direction
+uniform vec3 camera; // from the earth center
+uniform vec3 sun_direction;
+uniform float exposure;
+void main() {
+  vec2 face_uv = gl_FragCoord.xy / vec2(SKY_CAPTURE_SIZE) * 2.0 - 1.0;
+  vec3 view_direction = normalize(atmosphere_from_face * vec3(face_uv, 1.0));
+  vec3 transmittance;
+  vec3 radiance = GetSkyRadiance(camera, view_direction, 0.0, sun_direction, transmittance);
+  float r = length(camera);
+  float mu = dot(camera, view_direction) / r;
+  float discriminant = r * r * (mu * mu - 1.0) + ATMOSPHERE.bottom_radius * ATMOSPHERE.bottom_radius;
+  if (mu < 0.0 && discriminant >= 0.0) {
+    vec3 point = camera + view_direction * (-r * mu - sqrt(discriminant));
+    vec3 sky_irradiance;
+    vec3 sun_irradiance = GetSunAndSkyIrradiance(point, normalize(point), sun_direction, sky_irradiance);
+    vec3 ground = ATMOSPHERE.ground_albedo * (1.0 / PI) * (sun_irradiance + sky_irradiance);
+    radiance = GetSkyRadianceToPoint(camera, point, 0.0, sun_direction, transmittance) + ground * transmittance;
+  }
+  sky_capture = vec4(radiance * exposure, 1.0);
+})";
+
 } // namespace atmosphere
 
 GEngine::PrecomputedAtmospherePass::PrecomputedAtmospherePass(const std::string &name, int order)
     : CRenderPass(name, order) {
 }
 
-GEngine::PrecomputedAtmospherePass::~PrecomputedAtmospherePass() {}
+GEngine::PrecomputedAtmospherePass::~PrecomputedAtmospherePass() {
+  if (aerial_perspective_fbo_) {
+    glDeleteFramebuffers(1, &aerial_perspective_fbo_);
+  }
+  if (sky_view_fbo_) {
+    glDeleteFramebuffers(1, &sky_view_fbo_);
+  }
+  if (sky_capture_fbo_) {
+    glDeleteFramebuffers(1, &sky_capture_fbo_);
+  }
+}
+
+GEngine::SAtmosphereParameters GEngine::PrecomputedAtmospherePass::MakeParameters() const {
+  SAtmosphereParameters parameters =
+      SAtmosphereParameters::Earth(use_ozone_, use_constant_solar_spectrum_, use_half_precision_,
+                                   use_luminance_ == PRECOMPUTED ? 15 : 3, use_combined_textures_);
+  parameters.mie_phase_function_g_ = mie_phase_function_g_;
+  std::fill(parameters.ground_albedo_.begin(), parameters.ground_albedo_.end(), ground_albedo_);
+  return parameters;
+}
 
 void GEngine::PrecomputedAtmospherePass::Init() {
-  constexpr int kLambdaMin = 360;
-  constexpr int kLambdaMax = 830;
-  constexpr double kSolarIrradiance[48] = {
-      1.11776, 1.14259, 1.01249, 1.14716, 1.72765, 1.73054, 1.6887,  1.61253,
-      1.91198, 2.03474, 2.02042, 2.02212, 1.93377, 1.95809, 1.91686, 1.8298,
-      1.8685,  1.8931,  1.85149, 1.8504,  1.8341,  1.8345,  1.8147,  1.78158,
-      1.7533,  1.6965,  1.68194, 1.64654, 1.6048,  1.52143, 1.55622, 1.5113,
-      1.474,   1.4482,  1.41018, 1.36775, 1.34188, 1.31429, 1.28303, 1.26758,
-      1.2367,  1.2082,  1.18737, 1.14683, 1.12362, 1.1058,  1.07124, 1.04992};
-  constexpr double kOzoneCrossSection[48] = {
-      1.18e-27,  2.182e-28, 2.818e-28, 6.636e-28, 1.527e-27, 2.763e-27,
-      5.52e-27,  8.451e-27, 1.582e-26, 2.316e-26, 3.669e-26, 4.924e-26,
-      7.752e-26, 9.016e-26, 1.48e-25,  1.602e-25, 2.139e-25, 2.755e-25,
-      3.091e-25, 3.5e-25,   4.266e-25, 4.672e-25, 4.398e-25, 4.701e-25,
-      5.019e-25, 4.305e-25, 3.74e-25,  3.215e-25, 2.662e-25, 2.238e-25,
-      1.852e-25, 1.473e-25, 1.209e-25, 9.423e-26, 7.455e-26, 6.566e-26,
-      5.105e-26, 4.15e-26,  4.228e-26, 3.237e-26, 2.451e-26, 2.801e-26,
-      2.534e-26, 1.624e-26, 1.465e-26, 2.078e-26, 1.383e-26, 7.105e-27};
-  constexpr double kDobsonUnit = 2.687e20;
-  constexpr double kMaxOzoneNumberDensity = 300.0 * kDobsonUnit / 15000.0;
-  constexpr double kConstantSolarIrradiance = 1.5;
-  constexpr double kBottomRadius = 6360000.0;
-  constexpr double kTopRadius = 6420000.0;
-  constexpr double kRayleigh = 1.24062e-6;
-  constexpr double kRayleighScaleHeight = 8000.0;
-  constexpr double kMieScaleHeight = 1200.0;
-  constexpr double kMieAngstromAlpha = 0.0;
-  constexpr double kMieAngstromBeta = 5.328e-3;
-  constexpr double kMieSingleScatteringAlbedo = 0.9;
-  constexpr double kMiePhaseFunctionG = 0.8;
-  constexpr double kGroundAlbedo = 0.1;
-  const double max_sun_zenith_angle =
-      (use_half_precision_ ? 102.0 : 120.0) / 180.0 * kPi;
-
-  // set up layers
-  DensityProfileLayer rayleigh_layer(0.0, 1.0, -1.0 / kRayleighScaleHeight, 0.0, 0.0);
-  DensityProfileLayer mie_layer(0.0, 1.0, -1.0 / kMieScaleHeight, 0.0, 0.0);
-  std::vector<DensityProfileLayer> ozone_density;
-  ozone_density.push_back(DensityProfileLayer(25000.0, 0.0, 0.0, 1.0 / 15000.0, -2.0 / 3.0));
-  ozone_density.push_back(DensityProfileLayer(0.0, 0.0, 0.0, -1.0 / 15000.0, 8.0 / 3.0));
-
-  // scattering parameters of wavelength from 360nm to 830nm
-  std::vector<double> wavelengths;
-  std::vector<double> solar_irradiance;
-  std::vector<double> rayleigh_scattering;
-  std::vector<double> mie_scattering;
-  std::vector<double> mie_extinction;
-  std::vector<double> absorption_extinction;
-  std::vector<double> ground_albedo;
-  for (int l = kLambdaMin; l <= kLambdaMax; l += 10) {
-    double lambda = static_cast<double>(l) * 1e-3; // micro-meters
-    double mie = kMieAngstromBeta / kMieScaleHeight * pow(lambda, -kMieAngstromAlpha);
-    wavelengths.push_back(l);
-    if (use_constant_solar_spectrum_) {
-      solar_irradiance.push_back(kConstantSolarIrradiance);
-    } else {
-      solar_irradiance.push_back(kSolarIrradiance[(l - kLambdaMin) / 10]);
-    }
-    rayleigh_scattering.push_back(kRayleigh * pow(lambda, -4));
-    mie_scattering.push_back(mie * kMieSingleScatteringAlbedo);
-    mie_extinction.push_back(mie);
-    absorption_extinction.push_back(use_ozone_ ? kMaxOzoneNumberDensity * kOzoneCrossSection[(l - kLambdaMin) / 10] : 0.0);
-    ground_albedo.push_back(kGroundAlbedo);
-  }
-  
+  auto ui = CSingleton<CRenderSystem>()->GetOrCreateMainUI();
+  use_ozone_ = ui->atmosphere_ozone_;
+  mie_phase_function_g_ = ui->atmosphere_mie_g_;
+  ground_albedo_ = ui->atmosphere_ground_albedo_;
+  SAtmosphereParameters parameters = MakeParameters();
+  const std::vector<double> &wavelengths = parameters.wavelengths_;
+  const std::vector<double> &solar_irradiance = parameters.solar_irradiance_;
+
   // full_screen_quad_vao_ for pass
   glGenVertexArrays(1, &full_screen_quad_vao_);
   glBindVertexArray(full_screen_quad_vao_);
@@ -1282,13 +710,7 @@ void GEngine::PrecomputedAtmospherePass::Init() {
 
   // precompute the transmittance, scattering and irradiance textures,
   // impletation of Algorithm 4.1 of the original paper
-  model_.reset(new PrecomputedAtmosphereModel(
-      wavelengths, solar_irradiance, kSunAngularRadius, kBottomRadius,
-      kTopRadius, {rayleigh_layer}, rayleigh_scattering, {mie_layer},
-      mie_scattering, mie_extinction, kMiePhaseFunctionG, ozone_density,
-      absorption_extinction, ground_albedo, max_sun_zenith_angle,
-      kLengthUnitInMeters, use_luminance_ == PRECOMPUTED ? 15 : 3,
-      use_combined_textures_, use_half_precision_));
+  model_.reset(new PrecomputedAtmosphereModel(parameters, ui->atmosphere_compute_precompute_));
   model_->Init();
 
   // create shader for demo scene
@@ -1319,7 +741,7 @@ void GEngine::PrecomputedAtmospherePass::Init() {
   }
 
   glUniform3f(glGetUniformLocation(program_->GetShaderID(), "white_point"), white_point_r, white_point_g, white_point_b);
-  glUniform3f(glGetUniformLocation(program_->GetShaderID(), "earth_center"), 0.0, 0.0, -kBottomRadius / kLengthUnitInMeters);
+  glUniform3f(glGetUniformLocation(program_->GetShaderID(), "earth_center"), 0.0, 0.0, -parameters.bottom_radius_ / kLengthUnitInMeters);
   glUniform2f(glGetUniformLocation(program_->GetShaderID(), "sun_size"), tan(kSunAngularRadius), cos(kSunAngularRadius));
 
   auto viewport_width = static_cast<float>(GEngine::WINDOW_CONFIG::VIEWPORT_WIDTH);
@@ -1339,15 +761,109 @@ void GEngine::PrecomputedAtmospherePass::Init() {
     0.0, 0.0, 1.0, 1.0
   };
   glUniformMatrix4fv(glGetUniformLocation(program_->GetShaderID(), "view_from_clip"), 1, true, view_from_clip);
+  // the model sets its bindings with raw GL calls
+  CSingleton<CGLStateCache>()->Invalidate();
+
+  // froxels for the lit passes, rebuilt every Tick
+  auto state_cache = CSingleton<CGLStateCache>();
+  aerial_perspective_ = std::make_shared<SAerialPerspective>();
+  aerial_perspective_->volume_ = std::make_shared<CTexture>(CTexture::ETarget::kTexture3D);
+  state_cache->BindTexture(GL_TEXTURE_3D, aerial_perspective_->volume_->id_);
+  glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, SAerialPerspective::kSize, SAerialPerspective::kSize,
+               SAerialPerspective::kSize, 0, GL_RGBA, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  state_cache->BindTexture(GL_TEXTURE_3D, 0);
+  glGenFramebuffers(1, &aerial_perspective_fbo_);
+  state_cache->BindFramebuffer(GL_FRAMEBUFFER, aerial_perspective_fbo_);
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, aerial_perspective_->volume_->id_, 0);
+  state_cache->BindFramebuffer(GL_FRAMEBUFFER, 0);
+  CSingleton<CRenderSystem>()->texture_center_["aerial_perspective"] = aerial_perspective_->volume_;
+  CSingleton<CRenderSystem>()->RegisterAnyDataWithName("aerial_perspective", aerial_perspective_);
+
+  sky_view_texture_ = std::make_shared<CTexture>(CTexture::ETarget::kTexture2D);
+  state_cache->BindTexture(GL_TEXTURE_2D, sky_view_texture_->id_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, kSkyViewWidth, kSkyViewHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  // longitude wraps around
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  state_cache->BindTexture(GL_TEXTURE_2D, 0);
+  glGenFramebuffers(1, &sky_view_fbo_);
+  state_cache->BindFramebuffer(GL_FRAMEBUFFER, sky_view_fbo_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sky_view_texture_->id_, 0);
+  state_cache->BindFramebuffer(GL_FRAMEBUFFER, 0);
+  CSingleton<CRenderSystem>()->texture_center_["sky_view"] = sky_view_texture_;
+
+  sky_capture_ = std::make_shared<SSkyCapture>();
+  sky_capture_->cubemap_ = NewSkyCaptureCubemap();
+  sky_capture_back_ = NewSkyCaptureCubemap();
+  glGenFramebuffers(1, &sky_capture_fbo_);
+  CSingleton<CRenderSystem>()->texture_center_["sky_capture"] = sky_capture_->cubemap_;
+  CSingleton<CRenderSystem>()->RegisterAnyDataWithName("sky_capture", sky_capture_);
+}
+
+void GEngine::PrecomputedAtmospherePass::OnModelChanged() {
+  aerial_perspective_program_.reset();
+  sky_view_program_.reset();
+  sky_view_valid_ = false;
+  sky_capture_program_.reset();
+  sky_capture_dirty_ = true;
 }
 
 void GEngine::PrecomputedAtmospherePass::Tick() {
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, 0);
   
   glClearColor(0.2f, 0.3f, 0.4f, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  glUseProgram(program_->GetShaderID());
+  // the precompute steps set the LUT sizes with glViewport, the sky below draws full screen
+  std::array<GLint, 4> viewport = CSingleton<CGLStateCache>()->GetViewport();
+  auto ui = CSingleton<CRenderSystem>()->GetOrCreateMainUI();
+  if (ui->atmosphere_precompute_requested_) {
+    ui->atmosphere_precompute_requested_ = false;
+    // precompute again on the selected path, the LUT cache would hide its time
+    SAtmosphereParameters parameters = model_->GetParameters();
+    model_.reset();
+    model_.reset(new PrecomputedAtmosphereModel(parameters, ui->atmosphere_compute_precompute_));
+    model_->Init(4, false /* use_cache */);
+    OnModelChanged();
+  }
+
+  // parameters changing while a precomputation runs (animated weather) are
+  // picked up by the next one, once it swapped in
+  if (!pending_model_ && (ui->atmosphere_ozone_ != use_ozone_ || ui->atmosphere_mie_g_ != mie_phase_function_g_ ||
+                          ui->atmosphere_ground_albedo_ != ground_albedo_)) {
+    use_ozone_ = ui->atmosphere_ozone_;
+    mie_phase_function_g_ = ui->atmosphere_mie_g_;
+    ground_albedo_ = ui->atmosphere_ground_albedo_;
+    pending_model_.reset(new PrecomputedAtmosphereModel(MakeParameters(), ui->atmosphere_compute_precompute_));
+    pending_model_->BeginPrecompute();
+    pending_frames_ = 0;
+  }
+  if (pending_model_) {
+    pending_frames_++;
+    if (pending_model_->AdvancePrecompute(static_cast<unsigned int>(ui->atmosphere_layers_per_frame_))) {
+      // all the LUTs change in the same frame
+      model_ = std::move(pending_model_);
+      OnModelChanged();
+      GE_INFO("Atmosphere LUTs re-precomputed over {0} frames ({1} layers per frame)", pending_frames_,
+              ui->atmosphere_layers_per_frame_);
+    }
+  }
+  ui->atmosphere_precompute_progress_ = pending_model_ ? pending_model_->GetPrecomputeProgress() : 1.0f;
+  CSingleton<CGLStateCache>()->Viewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+  CSingleton<CGLStateCache>()->UseProgram(program_->GetShaderID());
+  // the precompute steps (and the other passes) use these units too
+  model_->SetProgramUniforms(program_->GetShaderID(), 0, 1, 2, 3);
+  // single mie scattering is phased here, with the g the LUTs were precomputed for
+  glUniform1f(glGetUniformLocation(program_->GetShaderID(), "mie_phase_function_g"),
+              static_cast<float>(model_->GetParameters().mie_phase_function_g_));
 
   view_distance_meters_ = CSingleton<CRenderSystem>()->GetOrCreateMainUI()->distance_ * CSingleton<CRenderSystem>()->GetOrCreateMainUI()->distance_factor_;
   view_zenith_angle_radians_ = CSingleton<CRenderSystem>()->GetOrCreateMainUI()->view_angle_[0];
@@ -1379,40 +895,218 @@ void GEngine::PrecomputedAtmospherePass::Tick() {
   glUniform3f(glGetUniformLocation(program_->GetShaderID(), "camera"), model_from_view[3], model_from_view[7], model_from_view[11]);
   glUniform1f(glGetUniformLocation(program_->GetShaderID(), "exposure"), use_luminance_ != NONE ? exposure_ * 1e-5 : exposure_);
   glUniformMatrix4fv(glGetUniformLocation(program_->GetShaderID(), "model_from_view"), 1, true, model_from_view);
-  glUniform3f(glGetUniformLocation(program_->GetShaderID(), "sun_direction"),
-      cos(sun_azimuth_angle_radians_) * sin(sun_zenith_angle_radians_),
-      sin(sun_azimuth_angle_radians_) * sin(sun_zenith_angle_radians_),
-      cos(sun_zenith_angle_radians_));
-  
-  glBindVertexArray(full_screen_quad_vao_);
+  glm::vec3 sun_direction(cos(sun_azimuth_angle_radians_) * sin(sun_zenith_angle_radians_),
+                          sin(sun_azimuth_angle_radians_) * sin(sun_zenith_angle_radians_),
+                          cos(sun_zenith_angle_radians_));
+  glUniform3f(glGetUniformLocation(program_->GetShaderID(), "sun_direction"), sun_direction.x, sun_direction.y,
+              sun_direction.z);
+
+  bool use_sky_view = ui->atmosphere_sky_view_lut_ && ui->display_content_ == 0;
+  if (use_sky_view) {
+    glm::vec3 camera(model_from_view[3], model_from_view[7], model_from_view[11]);
+    glm::vec3 earth_center(0.0f, 0.0f, static_cast<float>(-model_->GetParameters().bottom_radius_ / kLengthUnitInMeters));
+    UpdateSkyView(camera - earth_center, sun_direction);
+    CSingleton<CGLStateCache>()->UseProgram(program_->GetShaderID());
+    CSingleton<CGLStateCache>()->BindTextureUnit(kSkyViewTextureUnit, GL_TEXTURE_2D, sky_view_texture_->id_);
+    glUniform1i(glGetUniformLocation(program_->GetShaderID(), "sky_view_texture"), kSkyViewTextureUnit);
+    glUniformMatrix3fv(glGetUniformLocation(program_->GetShaderID(), "sky_view_frame"), 1, false,
+                       glm::value_ptr(sky_view_frame_));
+  }
+  glUniform1i(glGetUniformLocation(program_->GetShaderID(), "u_use_sky_view_lut"), use_sky_view);
+
+  CSingleton<CGLStateCache>()->BindVertexArray(full_screen_quad_vao_);
   glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-  glBindVertexArray(0);
+  CSingleton<CGLStateCache>()->BindVertexArray(0);
+
+  UpdateAerialPerspective(sun_direction);
+  UpdateSkyCapture(sun_direction);
+}
+
+void GEngine::PrecomputedAtmospherePass::UpdateSkyView(const glm::vec3 &camera, const glm::vec3 &sun_direction) {
+  if (sky_view_valid_ && camera == sky_view_camera_ && sun_direction == sky_view_sun_direction_) {
+    return;
+  }
+  if (!sky_view_program_) {
+    std::string fragment_shader = model_->GetShaderSource() +
+                                  (use_luminance_ != NONE ? "#define USE_LUMINANCE\n" : "") +
+                                  "const int SKY_VIEW_WIDTH = " + std::to_string(kSkyViewWidth) + ";\n" +
+                                  "const int SKY_VIEW_HEIGHT = " + std::to_string(kSkyViewHeight) + ";\n" +
+                                  atmosphere::kSkyViewShader;
+    sky_view_program_.reset(new Program(atmosphere::kVertexShader, fragment_shader));
+  }
+  sky_view_valid_ = true;
+  sky_view_camera_ = camera;
+  sky_view_sun_direction_ = sun_direction;
+  // any tangent works as long as the sky pass uses the same frame
+  glm::vec3 up = glm::normalize(camera);
+  glm::vec3 tangent = glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), up);
+  tangent = glm::length(tangent) > 1e-4f ? glm::normalize(tangent) : glm::vec3(1.0f, 0.0f, 0.0f);
+  sky_view_frame_ = glm::mat3(tangent, glm::cross(up, tangent), up);
+
+  auto state_cache = CSingleton<CGLStateCache>();
+  std::array<GLint, 4> viewport = state_cache->GetViewport();
+  state_cache->BindFramebuffer(GL_FRAMEBUFFER, sky_view_fbo_);
+  state_cache->Viewport(0, 0, kSkyViewWidth, kSkyViewHeight);
+  state_cache->Disable(GL_BLEND);
+  const Program &program = *sky_view_program_;
+  program.Use();
+  model_->SetProgramUniforms(program.GetProgram(), 0, 1, 2, 3);
+  program.BindVec3("camera", camera);
+  program.BindMat3("sky_view_frame", sky_view_frame_);
+  program.BindVec3("sun_direction", sun_direction);
+  state_cache->BindVertexArray(full_screen_quad_vao_);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  state_cache->BindVertexArray(0);
+  state_cache->BindFramebuffer(GL_FRAMEBUFFER, 0);
+  state_cache->Viewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  CSingleton<CRenderSystem>()->GetRenderStats().sky_view_lut_updates_++;
+}
+
+void GEngine::PrecomputedAtmospherePass::UpdateSkyCapture(const glm::vec3 &sun_direction) {
+  auto render_system = CSingleton<CRenderSystem>();
+  auto ui = render_system->GetOrCreateMainUI();
+  float exposure = static_cast<float>(use_luminance_ != NONE ? exposure_ * 1e-5 : exposure_);
+  if (sun_direction != sky_capture_sun_direction_ || exposure != sky_capture_exposure_) {
+    sky_capture_dirty_ = true;
+  }
+  // a change during a capture starts the next one
+  if (sky_capture_face_ < 0) {
+    if (!sky_capture_dirty_ || !ui->atmosphere_sky_capture_) {
+      return;
+    }
+    sky_capture_dirty_ = false;
+    sky_capture_sun_direction_ = sun_direction;
+    sky_capture_exposure_ = exposure;
+    sky_capture_face_ = 0;
+    if (sky_capture_back_.use_count() > 1) {
+      sky_capture_back_ = NewSkyCaptureCubemap();
+    }
+  }
+  if (!sky_capture_program_) {
+    std::string fragment_shader = model_->GetShaderSource() +
+                                  (use_luminance_ != NONE ? "#define USE_LUMINANCE\n" : "") +
+                                  "const int SKY_CAPTURE_SIZE = " + std::to_string(SSkyCapture::kSize) + ";\n" +
+                                  atmosphere::kSkyCaptureShader;
+    sky_capture_program_.reset(new Program(atmosphere::kVertexShader, fragment_shader));
+  }
+
+  auto state_cache = CSingleton<CGLStateCache>();
+  std::array<GLint, 4> viewport = state_cache->GetViewport();
+  state_cache->BindFramebuffer(GL_FRAMEBUFFER, sky_capture_fbo_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + sky_capture_face_,
+                         sky_capture_back_->id_, 0);
+  state_cache->Viewport(0, 0, SSkyCapture::kSize, SSkyCapture::kSize);
+  state_cache->Disable(GL_BLEND);
+  const Program &program = *sky_capture_program_;
+  program.Use();
+  model_->SetProgramUniforms(program.GetProgram(), 0, 1, 2, 3);
+  double origin_radius = model_->GetParameters().bottom_radius_ + kSceneAltitudeInMeters;
+  program.BindMat3("atmosphere_from_face", AtmosphereFromSceneAxes() * SceneFromCubeFace(sky_capture_face_));
+  program.BindVec3("camera", glm::vec3(0.0f, 0.0f, static_cast<float>(origin_radius / kLengthUnitInMeters)));
+  program.BindVec3("sun_direction", sky_capture_sun_direction_);
+  program.BindFloat("exposure", sky_capture_exposure_);
+  state_cache->BindVertexArray(full_screen_quad_vao_);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  state_cache->BindVertexArray(0);
+  state_cache->BindFramebuffer(GL_FRAMEBUFFER, 0);
+  state_cache->Viewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+  if (++sky_capture_face_ == 6) {
+    sky_capture_face_ = -1;
+    // the prefilter of CIBLPass picks source mips by sample density
+    state_cache->BindTexture(GL_TEXTURE_CUBE_MAP, sky_capture_back_->id_);
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    state_cache->BindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    std::swap(sky_capture_->cubemap_, sky_capture_back_);
+    sky_capture_->version_++;
+    render_system->texture_center_["sky_capture"] = sky_capture_->cubemap_;
+  }
+}
+
+void GEngine::PrecomputedAtmospherePass::UpdateAerialPerspective(const glm::vec3 &sun_direction) {
+  auto render_system = CSingleton<CRenderSystem>();
+  auto ui = render_system->GetOrCreateMainUI();
+  if (!ui->aerial_perspective_) {
+    aerial_perspective_->max_distance_ = 0.0f;
+    return;
+  }
+  if (!aerial_perspective_program_) {
+    std::string fragment_shader = model_->GetShaderSource() +
+                                  (use_luminance_ != NONE ? "#define USE_LUMINANCE\n" : "") +
+                                  "const int AERIAL_PERSPECTIVE_SIZE = " +
+                                  std::to_string(SAerialPerspective::kSize) + ";\n" +
+                                  atmosphere::kAerialPerspectiveShader;
+    aerial_perspective_program_.reset(
+        new Program(atmosphere::kLayeredVertexShader, atmosphere::kGeometryShader, fragment_shader));
+  }
+
+  // scene (y up, scene units) -> atmosphere frame (z up, kLengthUnitInMeters, from the earth center)
+  double origin_radius = model_->GetParameters().bottom_radius_ + kSceneAltitudeInMeters;
+  glm::mat4 atmosphere_from_world =
+      glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, static_cast<float>(origin_radius / kLengthUnitInMeters))) *
+      glm::scale(glm::mat4(1.0f), glm::vec3(static_cast<float>(ui->scene_meters_per_unit_ / kLengthUnitInMeters))) *
+      glm::mat4(AtmosphereFromSceneAxes());
+  auto camera = render_system->GetOrCreateMainCamera();
+  float max_distance = ui->aerial_perspective_distance_;
+
+  auto state_cache = CSingleton<CGLStateCache>();
+  std::array<GLint, 4> viewport = state_cache->GetViewport();
+  state_cache->BindFramebuffer(GL_FRAMEBUFFER, aerial_perspective_fbo_);
+  state_cache->Viewport(0, 0, SAerialPerspective::kSize, SAerialPerspective::kSize);
+  state_cache->Disable(GL_BLEND);
+  const Program &program = *aerial_perspective_program_;
+  program.Use();
+  model_->SetProgramUniforms(program.GetProgram(), 0, 1, 2, 3);
+  program.BindMat4("view_from_clip", glm::inverse(camera->GetProjectionMatrix()));
+  program.BindMat4("atmosphere_from_view", atmosphere_from_world * glm::inverse(camera->GetViewMatrix()));
+  program.BindVec3("sun_direction", sun_direction);
+  program.BindFloat("max_distance", max_distance);
+  program.BindFloat("exposure", static_cast<float>(use_luminance_ != NONE ? exposure_ * 1e-5 : exposure_));
+  program.BindInt("first_layer", 0);
+  state_cache->BindVertexArray(full_screen_quad_vao_);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, SAerialPerspective::kSize);
+  state_cache->BindVertexArray(0);
+  state_cache->BindFramebuffer(GL_FRAMEBUFFER, 0);
+  state_cache->Viewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  aerial_perspective_->max_distance_ = max_distance;
 }
 
 // The constructor of the PrecomputedAtmosphereModel class allocates the
 // precomputed textures, but does not initialize them.
-GEngine::PrecomputedAtmosphereModel::PrecomputedAtmosphereModel(
-    const std::vector<double> &wavelengths,
-    const std::vector<double> &solar_irradiance, double sun_angular_radius,
-    double bottom_radius, double top_radius,
-    const std::vector<DensityProfileLayer> &rayleigh_density,
-    const std::vector<double> &rayleigh_scattering,
-    const std::vector<DensityProfileLayer> &mie_density,
-    const std::vector<double> &mie_scattering,
-    const std::vector<double> &mie_extinction, double mie_phase_function_g,
-    const std::vector<DensityProfileLayer> &absorption_density,
-    const std::vector<double> &absorption_extinction,
-    const std::vector<double> &ground_albedo, double max_sun_zenith_angle,
-    double length_unit_in_meters, unsigned int num_precomputed_wavelengths,
-    bool combine_scattering_textures, bool half_precision)
-    : num_precomputed_wavelengths_(num_precomputed_wavelengths),
-      half_precision_(half_precision),
-      rgb_format_supported_(IsFramebufferRgbFormatSupported(half_precision)) {
+GEngine::PrecomputedAtmosphereModel::PrecomputedAtmosphereModel(const SAtmosphereParameters &parameters,
+                                                                bool allow_compute_shaders)
+    : parameters_(parameters),
+      num_precomputed_wavelengths_(parameters.num_precomputed_wavelengths_),
+      half_precision_(parameters.half_precision_),
+      use_compute_shaders_(allow_compute_shaders && GLAD_GL_VERSION_4_3),
+      // images have no rgb formats, the compute path stores rgba textures
+      rgb_format_supported_(!use_compute_shaders_ && IsFramebufferRgbFormatSupported(parameters.half_precision_)),
+      parameters_hash_(parameters.Hash(rgb_format_supported_)) {
+  const auto &wavelengths = parameters.wavelengths_;
+  const auto &solar_irradiance = parameters.solar_irradiance_;
+  double sun_angular_radius = parameters.sun_angular_radius_;
+  double bottom_radius = parameters.bottom_radius_;
+  double top_radius = parameters.top_radius_;
+  const auto &rayleigh_density = parameters.rayleigh_density_;
+  const auto &rayleigh_scattering = parameters.rayleigh_scattering_;
+  const auto &mie_density = parameters.mie_density_;
+  const auto &mie_scattering = parameters.mie_scattering_;
+  const auto &mie_extinction = parameters.mie_extinction_;
+  double mie_phase_function_g = parameters.mie_phase_function_g_;
+  const auto &absorption_density = parameters.absorption_density_;
+  const auto &absorption_extinction = parameters.absorption_extinction_;
+  const auto &ground_albedo = parameters.ground_albedo_;
+  double max_sun_zenith_angle = parameters.max_sun_zenith_angle_;
+  double length_unit_in_meters = parameters.length_unit_in_meters_;
+  unsigned int num_precomputed_wavelengths = parameters.num_precomputed_wavelengths_;
+  bool combine_scattering_textures = parameters.combine_scattering_textures_;
+  bool half_precision = parameters.half_precision_;
+
   // prepare shader datas
   auto to_string = [&wavelengths](const std::vector<double> &v, const vec3 &lambdas, double scale) {
-    double r = Interpolate(wavelengths, v, lambdas[0]) * scale;
-    double g = Interpolate(wavelengths, v, lambdas[1]) * scale;
-    double b = Interpolate(wavelengths, v, lambdas[2]) * scale;
+    double r = SAtmosphereParameters::Interpolate(wavelengths, v, lambdas[0]) * scale;
+    double g = SAtmosphereParameters::Interpolate(wavelengths, v, lambdas[1]) * scale;
+    double b = SAtmosphereParameters::Interpolate(wavelengths, v, lambdas[2]) * scale;
     return "vec3(" + std::to_string(r) + "," + std::to_string(g) + "," + std::to_string(b) + ")";
   };
   auto density_layer =
@@ -1450,7 +1144,7 @@ GEngine::PrecomputedAtmosphereModel::PrecomputedAtmosphereModel(
                                             &sun_k_r, &sun_k_g, &sun_k_b);
 
   glsl_header_factory_ = [=](const vec3& lambdas) {
-    return
+    std::string header =
       "#version 410\n"
       "#define IN(x) const in x\n"
       "#define OUT(x) out x\n"
@@ -1475,7 +1169,7 @@ GEngine::PrecomputedAtmosphereModel::PrecomputedAtmosphereModel(
           std::to_string(IRRADIANCE_TEXTURE_HEIGHT) + ";\n" +
       (combine_scattering_textures ?
           "#define COMBINED_SCATTERING_TEXTURES\n" : "") +
-      atmosphere::kFragmentShaderDefinitions +
+      "#include \"atmosphere_definitions.glsl\"\n" +
       "const AtmosphereParameters ATMOSPHERE = AtmosphereParameters(\n" +
           to_string(solar_irradiance, lambdas, 1.0) + ",\n" +
           std::to_string(sun_angular_radius) + ",\n" +
@@ -1499,7 +1193,8 @@ GEngine::PrecomputedAtmosphereModel::PrecomputedAtmosphereModel(
           std::to_string(sun_k_r) + "," +
           std::to_string(sun_k_g) + "," +
           std::to_string(sun_k_b) + ");\n" +
-      atmosphere::kFragmentShaderFunctions;
+      "#include \"atmosphere_functions.glsl\"\n";
+    return CShaderPreprocessor::ProcessSource(header, atmosphere::kShaderDirectory, "<atmosphere header>").source_;
   };
 
   // Allocate the precomputed textures, but don't precompute them yet.
@@ -1515,11 +1210,11 @@ GEngine::PrecomputedAtmosphereModel::PrecomputedAtmosphereModel(
   irradiance_texture_ = NewTexture2d(IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT);
 
     // Create and compile the shader providing our API.
-  std::string shader =
+  atmosphere_shader_source_ =
       glsl_header_factory_({kLambdaR, kLambdaG, kLambdaB}) +
       (precompute_illuminance ? "" : "#define RADIANCE_API_ENABLED\n") +
       atmosphere::kAtmosphereShader;
-  const char* source = shader.c_str();
+  const char* source = atmosphere_shader_source_.c_str();
   atmosphere_shader_ = glCreateShader(GL_FRAGMENT_SHADER);
   glShaderSource(atmosphere_shader_, 1, &source, NULL);
   glCompileShader(atmosphere_shader_);
@@ -1548,105 +1243,174 @@ GEngine::PrecomputedAtmosphereModel::PrecomputedAtmosphereModel(
   glBindVertexArray(0);
 }
 
-GEngine::PrecomputedAtmosphereModel::~PrecomputedAtmosphereModel() {}
+GEngine::PrecomputedAtmosphereModel::~PrecomputedAtmosphereModel() {
+  ReleasePrecomputeResources();
+  glDeleteVertexArrays(1, &full_screen_quad_vao_);
+  glDeleteBuffers(1, &full_screen_quad_vbo_);
+  if (optional_single_mie_scattering_texture_ != 0) {
+    glDeleteTextures(1, &optional_single_mie_scattering_texture_);
+  }
+  glDeleteTextures(1, &irradiance_texture_);
+  glDeleteTextures(1, &scattering_texture_);
+  glDeleteTextures(1, &transmittance_texture_);
+  glDeleteShader(atmosphere_shader_);
+  CSingleton<CGLStateCache>()->Invalidate();
+}
 
-void GEngine::PrecomputedAtmosphereModel::Init(unsigned int num_scattering_orders) {
-  GLuint delta_irradiance_texture = NewTexture2d(IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT);
-  GLuint delta_rayleigh_scattering_texture = NewTexture3d(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH,
-                                                          rgb_format_supported_ ? GL_RGB : GL_RGBA, half_precision_);
-  GLuint delta_mie_scattering_texture = NewTexture3d(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH,
-                                                     rgb_format_supported_ ? GL_RGB : GL_RGBA, half_precision_);
-  GLuint delta_scattering_density_texture = NewTexture3d(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH,
-                                                         rgb_format_supported_ ? GL_RGB : GL_RGBA, half_precision_);
+void GEngine::PrecomputedAtmosphereModel::Init(unsigned int num_scattering_orders, bool use_cache) {
+  auto start = std::chrono::steady_clock::now();
+  auto elapsed_ms = [&start]() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  };
+  // the precompute below binds directly
+  CSingleton<CGLStateCache>()->Invalidate();
+  uint64_t key = CAtmosphereLUTCache::Hash(parameters_hash_, num_scattering_orders);
+  std::vector<CAtmosphereLUTCache::STexture> textures = {{GL_TEXTURE_2D, transmittance_texture_},
+                                                         {GL_TEXTURE_3D, scattering_texture_},
+                                                         {GL_TEXTURE_2D, irradiance_texture_}};
+  if (optional_single_mie_scattering_texture_ != 0) {
+    textures.push_back({GL_TEXTURE_3D, optional_single_mie_scattering_texture_});
+  }
+  if (use_cache && CSingleton<CAtmosphereLUTCache>()->Load(key, textures)) {
+    GE_INFO("Atmosphere LUTs loaded from cache in {0:.1f} ms", elapsed_ms());
+    return;
+  }
 
-  GLuint delta_multiple_scattering_texture = delta_rayleigh_scattering_texture;
+  // every step in one go, only the program builds split the slices
+  BeginPrecompute(num_scattering_orders);
+  while (!AdvancePrecompute(std::numeric_limits<unsigned int>::max())) {
+  }
+  assert(glGetError() == 0);
 
-  GLuint fbo;
-  glGenFramebuffers(1, &fbo);
-  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  // the gpu finished before the timer stops, the time of the step not of its submission
+  glFinish();
+  double precompute_ms = elapsed_ms();
+  if (use_cache) {
+    CSingleton<CAtmosphereLUTCache>()->Store(key, textures);
+  }
+  CSingleton<CRenderSystem>()->GetRenderStats().atmosphere_precompute_ms_ = static_cast<float>(precompute_ms);
+  GE_INFO("Atmosphere LUTs precomputed in {0:.1f} ms ({1}: {2} draw calls, {3} dispatches)", precompute_ms,
+          use_compute_shaders_ ? "compute shaders" : "fragment shaders", precompute_draw_calls,
+          precompute_dispatches);
+}
 
-  if (num_precomputed_wavelengths_ <= 3) {
-    vec3 lambdas{kLambdaR, kLambdaG, kLambdaB};
-    mat3 luminance_from_radiance{1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
-    Precompute(fbo, delta_irradiance_texture, delta_rayleigh_scattering_texture,
-        delta_mie_scattering_texture, delta_scattering_density_texture,
-        delta_multiple_scattering_texture, lambdas, luminance_from_radiance,
-        false /* blend */, num_scattering_orders);
-  } else {
-    constexpr double kLambdaMin = 360.0;
-    constexpr double kLambdaMax = 830.0;
-    int num_iterations = (num_precomputed_wavelengths_ + 2) / 3;
-    double dlambda = (kLambdaMax - kLambdaMin) / (3 * num_iterations);
-    for (int i = 0; i < num_iterations; ++i) {
-      vec3 lambdas{
-        kLambdaMin + (3 * i + 0.5) * dlambda,
-        kLambdaMin + (3 * i + 1.5) * dlambda,
-        kLambdaMin + (3 * i + 2.5) * dlambda
-      };
-      auto coeff = [dlambda](double lambda, int component) {
-        // Note that we don't include MAX_LUMINOUS_EFFICACY here, to avoid
-        // artefacts due to too large values when using half precision on GPU.
-        // We add this term back in kAtmosphereShader, via
-        // SKY_SPECTRAL_RADIANCE_TO_LUMINANCE (see also the comments in the
-        // Model constructor).
-        double x = CieColorMatchingFunctionTableValue(lambda, 1);
-        double y = CieColorMatchingFunctionTableValue(lambda, 2);
-        double z = CieColorMatchingFunctionTableValue(lambda, 3);
-        return static_cast<float>((
-            XYZ_TO_SRGB[component * 3] * x +
-            XYZ_TO_SRGB[component * 3 + 1] * y +
-            XYZ_TO_SRGB[component * 3 + 2] * z) * dlambda);
-      };
-      mat3 luminance_from_radiance{
-        coeff(lambdas[0], 0), coeff(lambdas[1], 0), coeff(lambdas[2], 0),
-        coeff(lambdas[0], 1), coeff(lambdas[1], 1), coeff(lambdas[2], 1),
-        coeff(lambdas[0], 2), coeff(lambdas[1], 2), coeff(lambdas[2], 2)
-      };
-      Precompute(fbo, delta_irradiance_texture,
-          delta_rayleigh_scattering_texture, delta_mie_scattering_texture,
-          delta_scattering_density_texture, delta_multiple_scattering_texture,
-          lambdas, luminance_from_radiance, i > 0 /* blend */,
-          num_scattering_orders);
-    }
-    std::string header = glsl_header_factory_({kLambdaR, kLambdaG, kLambdaB});
-    Program compute_transmittance(atmosphere::kVertexShader, header + atmosphere::kComputeTransmittanceShader);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, transmittance_texture_, 0);
-    glDrawBuffer(GL_COLOR_ATTACHMENT0);
-    glViewport(0, 0, TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT);
-    compute_transmittance.Use();
-    DrawQuad({}, full_screen_quad_vao_);
+void GEngine::PrecomputedAtmosphereModel::BeginPrecompute(unsigned int num_scattering_orders) {
+  ReleasePrecomputeResources();
+  // rgba when compute shaders store them, images have no rgb formats
+  GLenum delta_format = rgb_format_supported_ ? GL_RGB : GL_RGBA;
+  delta_irradiance_texture_ = NewTexture2d(IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT);
+  delta_rayleigh_scattering_texture_ = NewTexture3d(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT,
+                                                    SCATTERING_TEXTURE_DEPTH, delta_format, half_precision_);
+  delta_mie_scattering_texture_ = NewTexture3d(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT,
+                                               SCATTERING_TEXTURE_DEPTH, delta_format, half_precision_);
+  delta_scattering_density_texture_ = NewTexture3d(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT,
+                                                   SCATTERING_TEXTURE_DEPTH, delta_format, half_precision_);
+  glGenFramebuffers(1, &precompute_fbo_);
+  CSingleton<CGLStateCache>()->Invalidate();
+
+  precompute_draw_calls = 0;
+  precompute_dispatches = 0;
+  std::vector<SAtmosphereParameters::SWavelengthBatch> batches = parameters_.GetWavelengthBatches();
+  for (size_t i = 0; i < batches.size(); ++i) {
+    AddPrecomputeSteps(batches[i].lambdas_, batches[i].luminance_from_radiance_, i > 0 /* blend */,
+                       num_scattering_orders);
+  }
+  if (batches.size() > 1) {
+    // the batches left the transmittance of the last wavelengths
+    AddTransmittanceSteps(std::make_shared<const std::string>(glsl_header_factory_({kLambdaR, kLambdaG, kLambdaB})));
+  }
+  for (const auto &step : precompute_steps_) {
+    precompute_layer_count_ += step.layers_;
   }
+}
 
-  // Delete the temporary resources allocated at the begining of this method.
-  glUseProgram(0);
+bool GEngine::PrecomputedAtmosphereModel::AdvancePrecompute(unsigned int budget) {
+  if (precompute_steps_.empty()) {
+    return true;
+  }
+  const unsigned int frame_budget = budget;
+  while (budget > 0 && precompute_step_ < precompute_steps_.size()) {
+    const SPrecomputeStep &step = precompute_steps_[precompute_step_];
+    if (step.builds_program_ && budget < frame_budget) {
+      // not after other work, the build gets a slice of its own
+      break;
+    }
+    unsigned int layer_count = std::min(budget, step.layers_ - precompute_layer_);
+    step.run_(precompute_layer_, layer_count);
+    precompute_layer_ += layer_count;
+    precompute_layers_done_ += layer_count;
+    budget = step.builds_program_ ? 0 : budget - layer_count;
+    if (precompute_layer_ == step.layers_) {
+      precompute_step_++;
+      precompute_layer_ = 0;
+    }
+  }
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  glDeleteFramebuffers(1, &fbo);
-  glDeleteTextures(1, &delta_scattering_density_texture);
-  glDeleteTextures(1, &delta_mie_scattering_texture);
-  glDeleteTextures(1, &delta_rayleigh_scattering_texture);
-  glDeleteTextures(1, &delta_irradiance_texture);
-  assert(glGetError() == 0);
+  // the steps bind directly
+  CSingleton<CGLStateCache>()->Invalidate();
+  if (precompute_step_ < precompute_steps_.size()) {
+    return false;
+  }
+
+  if (use_compute_shaders_) {
+    // glGetTexImage in CAtmosphereLUTCache::Store and the passes sampling the LUTs
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+  }
+  auto &stats = CSingleton<CRenderSystem>()->GetRenderStats();
+  stats.atmosphere_precompute_draw_calls_ = precompute_draw_calls;
+  stats.atmosphere_precompute_dispatches_ = precompute_dispatches;
+  stats.atmosphere_compute_precompute_ = use_compute_shaders_;
+  ReleasePrecomputeResources();
+  return true;
+}
+
+float GEngine::PrecomputedAtmosphereModel::GetPrecomputeProgress() const {
+  if (precompute_layer_count_ == 0) {
+    return 1.0f;
+  }
+  return static_cast<float>(precompute_layers_done_) / precompute_layer_count_;
+}
+
+void GEngine::PrecomputedAtmosphereModel::ReleasePrecomputeResources() {
+  // the programs go with the steps
+  precompute_steps_.clear();
+  precompute_step_ = 0;
+  precompute_layer_ = 0;
+  precompute_layer_count_ = 0;
+  precompute_layers_done_ = 0;
+  if (precompute_fbo_ == 0) {
+    return;
+  }
+  glDeleteFramebuffers(1, &precompute_fbo_);
+  glDeleteTextures(1, &delta_scattering_density_texture_);
+  glDeleteTextures(1, &delta_mie_scattering_texture_);
+  glDeleteTextures(1, &delta_rayleigh_scattering_texture_);
+  glDeleteTextures(1, &delta_irradiance_texture_);
+  precompute_fbo_ = 0;
+  delta_irradiance_texture_ = 0;
+  delta_rayleigh_scattering_texture_ = 0;
+  delta_mie_scattering_texture_ = 0;
+  delta_scattering_density_texture_ = 0;
+  CSingleton<CGLStateCache>()->Invalidate();
 }
 
 void GEngine::PrecomputedAtmosphereModel::SetProgramUniforms(
     GLuint program, GLuint transmittance_texture_unit,
     GLuint scattering_texture_unit, GLuint irradiance_texture_unit,
     GLuint single_mie_scattering_texture_unit) const {
-  glActiveTexture(GL_TEXTURE0 + transmittance_texture_unit);
-  glBindTexture(GL_TEXTURE_2D, transmittance_texture_);
+  auto state_cache = CSingleton<CGLStateCache>();
+  state_cache->BindTextureUnit(transmittance_texture_unit, GL_TEXTURE_2D, transmittance_texture_);
   glUniform1i(glGetUniformLocation(program, "transmittance_texture"), transmittance_texture_unit);
 
-  glActiveTexture(GL_TEXTURE0 + scattering_texture_unit);
-  glBindTexture(GL_TEXTURE_3D, scattering_texture_);
+  state_cache->BindTextureUnit(scattering_texture_unit, GL_TEXTURE_3D, scattering_texture_);
   glUniform1i(glGetUniformLocation(program, "scattering_texture"), scattering_texture_unit);
 
-  glActiveTexture(GL_TEXTURE0 + irradiance_texture_unit);
-  glBindTexture(GL_TEXTURE_2D, irradiance_texture_);
+  state_cache->BindTextureUnit(irradiance_texture_unit, GL_TEXTURE_2D, irradiance_texture_);
   glUniform1i(glGetUniformLocation(program, "irradiance_texture"), irradiance_texture_unit);
 
   if (optional_single_mie_scattering_texture_ != 0) {
-    glActiveTexture(GL_TEXTURE0 + single_mie_scattering_texture_unit);
-    glBindTexture(GL_TEXTURE_3D, optional_single_mie_scattering_texture_);
+    state_cache->BindTextureUnit(single_mie_scattering_texture_unit, GL_TEXTURE_3D,
+                                 optional_single_mie_scattering_texture_);
     glUniform1i(glGetUniformLocation(program, "single_mie_scattering_texture"), single_mie_scattering_texture_unit);
   }
 }
@@ -1660,10 +1424,10 @@ void GEngine::PrecomputedAtmosphereModel::ConvertSpectrumToLinearSrgb(
   double z = 0.0;
   const int dlambda = 1;
   for (int lambda = kLambdaMin; lambda < kLambdaMax; lambda += dlambda) {
-    double value = Interpolate(wavelengths, spectrum, lambda);
-    x += CieColorMatchingFunctionTableValue(lambda, 1) * value;
-    y += CieColorMatchingFunctionTableValue(lambda, 2) * value;
-    z += CieColorMatchingFunctionTableValue(lambda, 3) * value;
+    double value = SAtmosphereParameters::Interpolate(wavelengths, spectrum, lambda);
+    x += SAtmosphereParameters::CieColorMatchingFunctionTableValue(lambda, 1) * value;
+    y += SAtmosphereParameters::CieColorMatchingFunctionTableValue(lambda, 2) * value;
+    z += SAtmosphereParameters::CieColorMatchingFunctionTableValue(lambda, 3) * value;
   }
   *r = MAX_LUMINOUS_EFFICACY *
       (XYZ_TO_SRGB[0] * x + XYZ_TO_SRGB[1] * y + XYZ_TO_SRGB[2] * z) * dlambda;
@@ -1673,134 +1437,248 @@ void GEngine::PrecomputedAtmosphereModel::ConvertSpectrumToLinearSrgb(
       (XYZ_TO_SRGB[6] * x + XYZ_TO_SRGB[7] * y + XYZ_TO_SRGB[8] * z) * dlambda;
 }
 
-void GEngine::PrecomputedAtmosphereModel::Precompute(
-    GLuint fbo,
-    GLuint delta_irradiance_texture,
-    GLuint delta_rayleigh_scattering_texture,
-    GLuint delta_mie_scattering_texture,
-    GLuint delta_scattering_density_texture,
-    GLuint delta_multiple_scattering_texture,
+
+void GEngine::PrecomputedAtmosphereModel::AddTransmittanceSteps(const std::shared_ptr<const std::string> &header) {
+  auto program = std::make_shared<std::unique_ptr<Program>>();
+  precompute_steps_.push_back({1, [this, header, program](unsigned int, unsigned int) {
+    if (use_compute_shaders_) {
+      program->reset(new Program(ComputeShaderSource(*header, "", atmosphere::kComputeTransmittanceKernel)));
+    } else {
+      program->reset(new Program(atmosphere::kVertexShader, *header + atmosphere::kComputeTransmittanceShader));
+    }
+  }, true});
+  // Compute the transmittance, and store it in transmittance_texture_.
+  precompute_steps_.push_back({1, [this, program](unsigned int, unsigned int) {
+    (*program)->Use();
+    if (use_compute_shaders_) {
+      (*program)->BindImage("transmittance_image", transmittance_texture_, 0, GL_RGBA32F);
+      DispatchCompute(TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT, 1);
+    } else {
+      BindPrecomputeTargets(precompute_fbo_, {transmittance_texture_});
+      glViewport(0, 0, TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT);
+      DrawQuad({}, full_screen_quad_vao_);
+    }
+  }});
+}
+
+void GEngine::PrecomputedAtmosphereModel::AddPrecomputeSteps(
     const vec3& lambdas,
     const mat3& luminance_from_radiance,
     bool blend,
     unsigned int num_scattering_orders) {
+  if (use_compute_shaders_) {
+    AddComputePrecomputeSteps(lambdas, luminance_from_radiance, blend, num_scattering_orders);
+    return;
+  }
   // The precomputations require specific GLSL programs, for each precomputation
-  // step. We create and compile them here (they are automatically destroyed
-  // when this method returns, via the Program destructor).
-  std::string header = glsl_header_factory_(lambdas);
-//  std::cout << atmosphere::kVertexShader << '\n';
-//  std::cout << header << '\n';
-  Program compute_transmittance(atmosphere::kVertexShader, header + atmosphere::kComputeTransmittanceShader);
-  Program compute_direct_irradiance(atmosphere::kVertexShader, header + atmosphere::kComputeDirectIrradianceShader);
-  Program compute_single_scattering(atmosphere::kVertexShader, atmosphere::kGeometryShader, header + atmosphere::kComputeSingleScatteringShader);
-  Program compute_scattering_density(atmosphere::kVertexShader, atmosphere::kGeometryShader, header + atmosphere::kComputeScatteringDensityShader);
-  Program compute_indirect_irradiance(atmosphere::kVertexShader, header + atmosphere::kComputeIndirectIrradianceShader);
-  Program compute_multiple_scattering(atmosphere::kVertexShader, atmosphere::kGeometryShader, header + atmosphere::kComputeMultipleScatteringShader);
-
-  const GLuint kDrawBuffers[4] = {
-    GL_COLOR_ATTACHMENT0,
-    GL_COLOR_ATTACHMENT1,
-    GL_COLOR_ATTACHMENT2,
-    GL_COLOR_ATTACHMENT3
+  // step. The first steps create and compile them (they are destroyed with the
+  // steps, via the Program destructor).
+  auto header = std::make_shared<const std::string>(glsl_header_factory_(lambdas));
+  auto programs = std::make_shared<SPrecomputePrograms>();
+  auto add_program = [this, header, programs](std::unique_ptr<Program> &program, const std::string &vertex_shader,
+                                              const std::string &geometry_shader, const std::string &fragment_shader) {
+    precompute_steps_.push_back({1, [header, programs, &program, vertex_shader, geometry_shader,
+                                     fragment_shader](unsigned int, unsigned int) {
+      program.reset(new Program(vertex_shader, geometry_shader, *header + fragment_shader));
+    }, true});
   };
-  glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
-  glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ONE, GL_ONE);
-
-  // Compute the transmittance, and store it in transmittance_texture_.
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, transmittance_texture_, 0);
-  glDrawBuffer(GL_COLOR_ATTACHMENT0);
-  glViewport(0, 0, TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT);
-  compute_transmittance.Use();
-  DrawQuad({}, full_screen_quad_vao_);
+  const std::string kNoGeometryShader = "";
+  AddTransmittanceSteps(header);
+  add_program(programs->direct_irradiance_, atmosphere::kVertexShader, kNoGeometryShader,
+              atmosphere::kComputeDirectIrradianceShader);
+  add_program(programs->single_scattering_, atmosphere::kLayeredVertexShader, atmosphere::kGeometryShader,
+              atmosphere::kComputeSingleScatteringShader);
+  if (num_scattering_orders >= 2) {
+    add_program(programs->scattering_density_, atmosphere::kLayeredVertexShader, atmosphere::kGeometryShader,
+                atmosphere::kComputeScatteringDensityShader);
+    add_program(programs->indirect_irradiance_, atmosphere::kVertexShader, kNoGeometryShader,
+                atmosphere::kComputeIndirectIrradianceShader);
+    add_program(programs->multiple_scattering_, atmosphere::kLayeredVertexShader, atmosphere::kGeometryShader,
+                atmosphere::kComputeMultipleScatteringShader);
+  }
 
   // Compute the direct irradiance, store it in delta_irradiance_texture and,
   // depending on 'blend', either initialize irradiance_texture_ with zeros or
   // leave it unchanged (we don't want the direct irradiance in
   // irradiance_texture_, but only the irradiance from the sky).
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, delta_irradiance_texture, 0);
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, irradiance_texture_, 0);
-  glDrawBuffers(2, kDrawBuffers);
-  glViewport(0, 0, IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT);
-  compute_direct_irradiance.Use();
-  compute_direct_irradiance.BindTexture2d("transmittance_texture", transmittance_texture_, 0);
-  DrawQuad({false, blend}, full_screen_quad_vao_);
+  precompute_steps_.push_back({1, [this, programs, blend](unsigned int, unsigned int) {
+    const Program &program = *programs->direct_irradiance_;
+    BindPrecomputeTargets(precompute_fbo_, {delta_irradiance_texture_, irradiance_texture_});
+    glViewport(0, 0, IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT);
+    program.Use();
+    program.BindTexture2d("transmittance_texture", transmittance_texture_, 0);
+    DrawQuad({false, blend}, full_screen_quad_vao_);
+  }});
 
   // Compute the rayleigh and mie single scattering, store them in
   // delta_rayleigh_scattering_texture and delta_mie_scattering_texture, and
   // either store them or accumulate them in scattering_texture_ and
   // optional_single_mie_scattering_texture_.
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, delta_rayleigh_scattering_texture, 0);
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, delta_mie_scattering_texture, 0);
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, scattering_texture_, 0);
-  if (optional_single_mie_scattering_texture_ != 0) {
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, optional_single_mie_scattering_texture_, 0);
-    glDrawBuffers(4, kDrawBuffers);
-  } else {
-    glDrawBuffers(3, kDrawBuffers);
-  }
-  glViewport(0, 0, SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT);
-  compute_single_scattering.Use();
-  compute_single_scattering.BindMat3("luminance_from_radiance", luminance_from_radiance);
-  compute_single_scattering.BindTexture2d("transmittance_texture", transmittance_texture_, 0);
-  for (unsigned int layer = 0; layer < SCATTERING_TEXTURE_DEPTH; ++layer) {
-    compute_single_scattering.BindInt("layer", layer);
-    DrawQuad({false, false, blend, blend}, full_screen_quad_vao_);
-  }
+  precompute_steps_.push_back({SCATTERING_TEXTURE_DEPTH, [this, programs, luminance_from_radiance, blend](
+                                                             unsigned int first_layer, unsigned int layer_count) {
+    const Program &program = *programs->single_scattering_;
+    std::vector<GLuint> targets = {delta_rayleigh_scattering_texture_, delta_mie_scattering_texture_,
+                                   scattering_texture_};
+    if (optional_single_mie_scattering_texture_ != 0) {
+      targets.push_back(optional_single_mie_scattering_texture_);
+    }
+    BindPrecomputeTargets(precompute_fbo_, targets);
+    glViewport(0, 0, SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT);
+    program.Use();
+    program.BindMat3("luminance_from_radiance", luminance_from_radiance);
+    program.BindTexture2d("transmittance_texture", transmittance_texture_, 0);
+    program.BindInt("first_layer", first_layer);
+    DrawQuad({false, false, blend, blend}, full_screen_quad_vao_, layer_count);
+  }});
 
   // Compute the 2nd, 3rd and 4th order of scattering, in sequence.
+  // delta_multiple_scattering_texture is delta_rayleigh_scattering_texture_.
   for (unsigned int scattering_order = 2; scattering_order <= num_scattering_orders; ++scattering_order) {
-  // for (unsigned int scattering_order = 2; scattering_order <= num_scattering_orders; ++scattering_order) {
     // Compute the scattering density, and store it in
     // delta_scattering_density_texture.
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, delta_scattering_density_texture, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, 0, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, 0, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, 0, 0);
-    glDrawBuffer(GL_COLOR_ATTACHMENT0);
-    glViewport(0, 0, SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT);
-    compute_scattering_density.Use();
-    compute_scattering_density.BindTexture2d("transmittance_texture", transmittance_texture_, 0);
-    compute_scattering_density.BindTexture3d("single_rayleigh_scattering_texture", delta_rayleigh_scattering_texture, 1);
-    compute_scattering_density.BindTexture3d("single_mie_scattering_texture", delta_mie_scattering_texture, 2);
-    compute_scattering_density.BindTexture3d("multiple_scattering_texture", delta_multiple_scattering_texture, 3);
-    compute_scattering_density.BindTexture2d("irradiance_texture", delta_irradiance_texture, 4);
-    compute_scattering_density.BindInt("scattering_order", scattering_order);
-    for (unsigned int layer = 0; layer < SCATTERING_TEXTURE_DEPTH; ++layer) {
-      compute_scattering_density.BindInt("layer", layer);
-      DrawQuad({}, full_screen_quad_vao_);
-    }
+    precompute_steps_.push_back({SCATTERING_TEXTURE_DEPTH, [this, programs, scattering_order](
+                                                               unsigned int first_layer, unsigned int layer_count) {
+      const Program &program = *programs->scattering_density_;
+      BindPrecomputeTargets(precompute_fbo_, {delta_scattering_density_texture_});
+      glViewport(0, 0, SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT);
+      program.Use();
+      program.BindTexture2d("transmittance_texture", transmittance_texture_, 0);
+      program.BindTexture3d("single_rayleigh_scattering_texture", delta_rayleigh_scattering_texture_, 1);
+      program.BindTexture3d("single_mie_scattering_texture", delta_mie_scattering_texture_, 2);
+      program.BindTexture3d("multiple_scattering_texture", delta_rayleigh_scattering_texture_, 3);
+      program.BindTexture2d("irradiance_texture", delta_irradiance_texture_, 4);
+      program.BindInt("scattering_order", scattering_order);
+      program.BindInt("first_layer", first_layer);
+      DrawQuad({}, full_screen_quad_vao_, layer_count);
+    }});
 
     // Compute the indirect irradiance, store it in delta_irradiance_texture and
     // accumulate it in irradiance_texture_.
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, delta_irradiance_texture, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, irradiance_texture_, 0);
-    glDrawBuffers(2, kDrawBuffers);
-    glViewport(0, 0, IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT);
-    compute_indirect_irradiance.Use();
-    compute_indirect_irradiance.BindMat3("luminance_from_radiance", luminance_from_radiance);
-    compute_indirect_irradiance.BindTexture3d("single_rayleigh_scattering_texture", delta_rayleigh_scattering_texture, 0);
-    compute_indirect_irradiance.BindTexture3d("single_mie_scattering_texture", delta_mie_scattering_texture, 1);
-    compute_indirect_irradiance.BindTexture3d("multiple_scattering_texture", delta_multiple_scattering_texture, 2);
-    compute_indirect_irradiance.BindInt("scattering_order", scattering_order - 1);
-    DrawQuad({false, true}, full_screen_quad_vao_);
+    precompute_steps_.push_back({1, [this, programs, luminance_from_radiance, scattering_order](unsigned int,
+                                                                                                unsigned int) {
+      const Program &program = *programs->indirect_irradiance_;
+      BindPrecomputeTargets(precompute_fbo_, {delta_irradiance_texture_, irradiance_texture_});
+      glViewport(0, 0, IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT);
+      program.Use();
+      program.BindMat3("luminance_from_radiance", luminance_from_radiance);
+      program.BindTexture3d("single_rayleigh_scattering_texture", delta_rayleigh_scattering_texture_, 0);
+      program.BindTexture3d("single_mie_scattering_texture", delta_mie_scattering_texture_, 1);
+      program.BindTexture3d("multiple_scattering_texture", delta_rayleigh_scattering_texture_, 2);
+      program.BindInt("scattering_order", scattering_order - 1);
+      DrawQuad({false, true}, full_screen_quad_vao_);
+    }});
 
     // Compute the multiple scattering, store it in
     // delta_multiple_scattering_texture, and accumulate it in
     // scattering_texture_.
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, delta_multiple_scattering_texture, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, scattering_texture_, 0);
-    glDrawBuffers(2, kDrawBuffers);
-    glViewport(0, 0, SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT);
-    compute_multiple_scattering.Use();
-    compute_multiple_scattering.BindMat3("luminance_from_radiance", luminance_from_radiance);
-    compute_multiple_scattering.BindTexture2d("transmittance_texture", transmittance_texture_, 0);
-    compute_multiple_scattering.BindTexture3d("scattering_density_texture", delta_scattering_density_texture, 1);
-    for (unsigned int layer = 0; layer < SCATTERING_TEXTURE_DEPTH; ++layer) {
-      compute_multiple_scattering.BindInt("layer", layer);
-      DrawQuad({false, true}, full_screen_quad_vao_);
+    precompute_steps_.push_back({SCATTERING_TEXTURE_DEPTH, [this, programs, luminance_from_radiance](
+                                                               unsigned int first_layer, unsigned int layer_count) {
+      const Program &program = *programs->multiple_scattering_;
+      BindPrecomputeTargets(precompute_fbo_, {delta_rayleigh_scattering_texture_, scattering_texture_});
+      glViewport(0, 0, SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT);
+      program.Use();
+      program.BindMat3("luminance_from_radiance", luminance_from_radiance);
+      program.BindTexture2d("transmittance_texture", transmittance_texture_, 0);
+      program.BindTexture3d("scattering_density_texture", delta_scattering_density_texture_, 1);
+      program.BindInt("first_layer", first_layer);
+      DrawQuad({false, true}, full_screen_quad_vao_, layer_count);
+    }});
+  }
+}
+
+void GEngine::PrecomputedAtmosphereModel::AddComputePrecomputeSteps(
+    const vec3& lambdas,
+    const mat3& luminance_from_radiance,
+    bool blend,
+    unsigned int num_scattering_orders) {
+  // the same steps as AddPrecomputeSteps, one dispatch per slice instead of one draw
+  auto header = std::make_shared<const std::string>(glsl_header_factory_(lambdas));
+  auto programs = std::make_shared<SPrecomputePrograms>();
+  GLenum lut_format = half_precision_ ? GL_RGBA16F : GL_RGBA32F;
+  std::string defines = std::string("#define LUT_FORMAT ") + (half_precision_ ? "rgba16f" : "rgba32f") + "\n";
+  auto add_program = [this, header, programs, defines](std::unique_ptr<Program> &program, const std::string &kernel) {
+    precompute_steps_.push_back({1, [header, programs, defines, &program, kernel](unsigned int, unsigned int) {
+      program.reset(new Program(ComputeShaderSource(*header, defines, kernel)));
+    }, true});
+  };
+  AddTransmittanceSteps(header);
+  add_program(programs->direct_irradiance_, atmosphere::kComputeDirectIrradianceKernel);
+  add_program(programs->single_scattering_, atmosphere::kComputeSingleScatteringKernel);
+  if (num_scattering_orders >= 2) {
+    add_program(programs->scattering_density_, atmosphere::kComputeScatteringDensityKernel);
+    add_program(programs->indirect_irradiance_, atmosphere::kComputeIndirectIrradianceKernel);
+    add_program(programs->multiple_scattering_, atmosphere::kComputeMultipleScatteringKernel);
+  }
+
+  precompute_steps_.push_back({1, [this, programs, blend](unsigned int, unsigned int) {
+    const Program &program = *programs->direct_irradiance_;
+    program.Use();
+    program.BindImage("delta_irradiance_image", delta_irradiance_texture_, 0, GL_RGBA32F);
+    program.BindImage("irradiance_image", irradiance_texture_, 1, GL_RGBA32F);
+    program.BindTexture2d("transmittance_texture", transmittance_texture_, 0);
+    program.BindInt("blend", blend);
+    DispatchCompute(IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT, 1);
+  }});
+
+  precompute_steps_.push_back({SCATTERING_TEXTURE_DEPTH, [this, programs, luminance_from_radiance, blend,
+                                                          lut_format](unsigned int first_layer,
+                                                                      unsigned int layer_count) {
+    const Program &program = *programs->single_scattering_;
+    program.Use();
+    program.BindImage("delta_rayleigh_image", delta_rayleigh_scattering_texture_, 0, lut_format);
+    program.BindImage("delta_mie_image", delta_mie_scattering_texture_, 1, lut_format);
+    program.BindImage("scattering_image", scattering_texture_, 2, lut_format);
+    if (optional_single_mie_scattering_texture_ != 0) {
+      program.BindImage("single_mie_scattering_image", optional_single_mie_scattering_texture_, 3, lut_format);
     }
+    program.BindMat3("luminance_from_radiance", luminance_from_radiance);
+    program.BindTexture2d("transmittance_texture", transmittance_texture_, 0);
+    program.BindInt("blend", blend);
+    program.BindInt("first_layer", first_layer);
+    DispatchCompute(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, layer_count);
+  }});
+
+  for (unsigned int scattering_order = 2; scattering_order <= num_scattering_orders; ++scattering_order) {
+    precompute_steps_.push_back({SCATTERING_TEXTURE_DEPTH, [this, programs, scattering_order, lut_format](
+                                                               unsigned int first_layer, unsigned int layer_count) {
+      const Program &program = *programs->scattering_density_;
+      program.Use();
+      program.BindImage("scattering_density_image", delta_scattering_density_texture_, 0, lut_format);
+      program.BindTexture2d("transmittance_texture", transmittance_texture_, 0);
+      program.BindTexture3d("single_rayleigh_scattering_texture", delta_rayleigh_scattering_texture_, 1);
+      program.BindTexture3d("single_mie_scattering_texture", delta_mie_scattering_texture_, 2);
+      program.BindTexture3d("multiple_scattering_texture", delta_rayleigh_scattering_texture_, 3);
+      program.BindTexture2d("irradiance_texture", delta_irradiance_texture_, 4);
+      program.BindInt("scattering_order", scattering_order);
+      program.BindInt("first_layer", first_layer);
+      DispatchCompute(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, layer_count);
+    }});
+
+    precompute_steps_.push_back({1, [this, programs, luminance_from_radiance, scattering_order](unsigned int,
+                                                                                                unsigned int) {
+      const Program &program = *programs->indirect_irradiance_;
+      program.Use();
+      program.BindImage("delta_irradiance_image", delta_irradiance_texture_, 0, GL_RGBA32F);
+      program.BindImage("irradiance_image", irradiance_texture_, 1, GL_RGBA32F);
+      program.BindMat3("luminance_from_radiance", luminance_from_radiance);
+      program.BindTexture3d("single_rayleigh_scattering_texture", delta_rayleigh_scattering_texture_, 0);
+      program.BindTexture3d("single_mie_scattering_texture", delta_mie_scattering_texture_, 1);
+      program.BindTexture3d("multiple_scattering_texture", delta_rayleigh_scattering_texture_, 2);
+      program.BindInt("scattering_order", scattering_order - 1);
+      DispatchCompute(IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT, 1);
+    }});
+
+    precompute_steps_.push_back({SCATTERING_TEXTURE_DEPTH, [this, programs, luminance_from_radiance, lut_format](
+                                                               unsigned int first_layer, unsigned int layer_count) {
+      const Program &program = *programs->multiple_scattering_;
+      program.Use();
+      program.BindImage("delta_multiple_scattering_image", delta_rayleigh_scattering_texture_, 0, lut_format);
+      program.BindImage("scattering_image", scattering_texture_, 1, lut_format);
+      program.BindMat3("luminance_from_radiance", luminance_from_radiance);
+      program.BindTexture2d("transmittance_texture", transmittance_texture_, 0);
+      program.BindTexture3d("scattering_density_texture", delta_scattering_density_texture_, 1);
+      program.BindInt("first_layer", first_layer);
+      DispatchCompute(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT, layer_count);
+    }});
   }
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, 0, 0);
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, 0, 0);
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, 0, 0);
 }
@@ -1,7 +1,9 @@
-#pragma Once
+#pragma once
 
+#include "GEngine/atmosphere_parameters.h"
 #include "GEngine/render_pass.h"
 #include "GEngine/shader.h"
+#include "GEngine/texture.h"
 
 #include <string>
 #define GLFW_INCLUDE_NONE
@@ -9,145 +11,6 @@
 
 namespace GEngine {
 
-constexpr int TRANSMITTANCE_TEXTURE_WIDTH = 256;
-constexpr int TRANSMITTANCE_TEXTURE_HEIGHT = 64;
-
-constexpr int SCATTERING_TEXTURE_R_SIZE = 32;
-constexpr int SCATTERING_TEXTURE_MU_SIZE = 128;
-constexpr int SCATTERING_TEXTURE_MU_S_SIZE = 32;
-constexpr int SCATTERING_TEXTURE_NU_SIZE = 8;
-
-constexpr int SCATTERING_TEXTURE_WIDTH = SCATTERING_TEXTURE_NU_SIZE * SCATTERING_TEXTURE_MU_S_SIZE;
-constexpr int SCATTERING_TEXTURE_HEIGHT = SCATTERING_TEXTURE_MU_SIZE;
-constexpr int SCATTERING_TEXTURE_DEPTH = SCATTERING_TEXTURE_R_SIZE;
-
-constexpr int IRRADIANCE_TEXTURE_WIDTH = 64;
-constexpr int IRRADIANCE_TEXTURE_HEIGHT = 16;
-
-constexpr double MAX_LUMINOUS_EFFICACY = 683.0;
-
-constexpr double CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[380] = {
-  360, 0.000129900000, 0.000003917000, 0.000606100000,
-  365, 0.000232100000, 0.000006965000, 0.001086000000,
-  370, 0.000414900000, 0.000012390000, 0.001946000000,
-  375, 0.000741600000, 0.000022020000, 0.003486000000,
-  380, 0.001368000000, 0.000039000000, 0.006450001000,
-  385, 0.002236000000, 0.000064000000, 0.010549990000,
-  390, 0.004243000000, 0.000120000000, 0.020050010000,
-  395, 0.007650000000, 0.000217000000, 0.036210000000,
-  400, 0.014310000000, 0.000396000000, 0.067850010000,
-  405, 0.023190000000, 0.000640000000, 0.110200000000,
-  410, 0.043510000000, 0.001210000000, 0.207400000000,
-  415, 0.077630000000, 0.002180000000, 0.371300000000,
-  420, 0.134380000000, 0.004000000000, 0.645600000000,
-  425, 0.214770000000, 0.007300000000, 1.039050100000,
-  430, 0.283900000000, 0.011600000000, 1.385600000000,
-  435, 0.328500000000, 0.016840000000, 1.622960000000,
-  440, 0.348280000000, 0.023000000000, 1.747060000000,
-  445, 0.348060000000, 0.029800000000, 1.782600000000,
-  450, 0.336200000000, 0.038000000000, 1.772110000000,
-  455, 0.318700000000, 0.048000000000, 1.744100000000,
-  460, 0.290800000000, 0.060000000000, 1.669200000000,
-  465, 0.251100000000, 0.073900000000, 1.528100000000,
-  470, 0.195360000000, 0.090980000000, 1.287640000000,
-  475, 0.142100000000, 0.112600000000, 1.041900000000,
-  480, 0.095640000000, 0.139020000000, 0.812950100000,
-  485, 0.057950010000, 0.169300000000, 0.616200000000,
-  490, 0.032010000000, 0.208020000000, 0.465180000000,
-  495, 0.014700000000, 0.258600000000, 0.353300000000,
-  500, 0.004900000000, 0.323000000000, 0.272000000000,
-  505, 0.002400000000, 0.407300000000, 0.212300000000,
-  510, 0.009300000000, 0.503000000000, 0.158200000000,
-  515, 0.029100000000, 0.608200000000, 0.111700000000,
-  520, 0.063270000000, 0.710000000000, 0.078249990000,
-  525, 0.109600000000, 0.793200000000, 0.057250010000,
-  530, 0.165500000000, 0.862000000000, 0.042160000000,
-  535, 0.225749900000, 0.914850100000, 0.029840000000,
-  540, 0.290400000000, 0.954000000000, 0.020300000000,
-  545, 0.359700000000, 0.980300000000, 0.013400000000,
-  550, 0.433449900000, 0.994950100000, 0.008749999000,
-  555, 0.512050100000, 1.000000000000, 0.005749999000,
-  560, 0.594500000000, 0.995000000000, 0.003900000000,
-  565, 0.678400000000, 0.978600000000, 0.002749999000,
-  570, 0.762100000000, 0.952000000000, 0.002100000000,
-  575, 0.842500000000, 0.915400000000, 0.001800000000,
-  580, 0.916300000000, 0.870000000000, 0.001650001000,
-  585, 0.978600000000, 0.816300000000, 0.001400000000,
-  590, 1.026300000000, 0.757000000000, 0.001100000000,
-  595, 1.056700000000, 0.694900000000, 0.001000000000,
-  600, 1.062200000000, 0.631000000000, 0.000800000000,
-  605, 1.045600000000, 0.566800000000, 0.000600000000,
-  610, 1.002600000000, 0.503000000000, 0.000340000000,
-  615, 0.938400000000, 0.441200000000, 0.000240000000,
-  620, 0.854449900000, 0.381000000000, 0.000190000000,
-  625, 0.751400000000, 0.321000000000, 0.000100000000,
-  630, 0.642400000000, 0.265000000000, 0.000049999990,
-  635, 0.541900000000, 0.217000000000, 0.000030000000,
-  640, 0.447900000000, 0.175000000000, 0.000020000000,
-  645, 0.360800000000, 0.138200000000, 0.000010000000,
-  650, 0.283500000000, 0.107000000000, 0.000000000000,
-  655, 0.218700000000, 0.081600000000, 0.000000000000,
-  660, 0.164900000000, 0.061000000000, 0.000000000000,
-  665, 0.121200000000, 0.044580000000, 0.000000000000,
-  670, 0.087400000000, 0.032000000000, 0.000000000000,
-  675, 0.063600000000, 0.023200000000, 0.000000000000,
-  680, 0.046770000000, 0.017000000000, 0.000000000000,
-  685, 0.032900000000, 0.011920000000, 0.000000000000,
-  690, 0.022700000000, 0.008210000000, 0.000000000000,
-  695, 0.015840000000, 0.005723000000, 0.000000000000,
-  700, 0.011359160000, 0.004102000000, 0.000000000000,
-  705, 0.008110916000, 0.002929000000, 0.000000000000,
-  710, 0.005790346000, 0.002091000000, 0.000000000000,
-  715, 0.004109457000, 0.001484000000, 0.000000000000,
-  720, 0.002899327000, 0.001047000000, 0.000000000000,
-  725, 0.002049190000, 0.000740000000, 0.000000000000,
-  730, 0.001439971000, 0.000520000000, 0.000000000000,
-  735, 0.000999949300, 0.000361100000, 0.000000000000,
-  740, 0.000690078600, 0.000249200000, 0.000000000000,
-  745, 0.000476021300, 0.000171900000, 0.000000000000,
-  750, 0.000332301100, 0.000120000000, 0.000000000000,
-  755, 0.000234826100, 0.000084800000, 0.000000000000,
-  760, 0.000166150500, 0.000060000000, 0.000000000000,
-  765, 0.000117413000, 0.000042400000, 0.000000000000,
-  770, 0.000083075270, 0.000030000000, 0.000000000000,
-  775, 0.000058706520, 0.000021200000, 0.000000000000,
-  780, 0.000041509940, 0.000014990000, 0.000000000000,
-  785, 0.000029353260, 0.000010600000, 0.000000000000,
-  790, 0.000020673830, 0.000007465700, 0.000000000000,
-  795, 0.000014559770, 0.000005257800, 0.000000000000,
-  800, 0.000010253980, 0.000003702900, 0.000000000000,
-  805, 0.000007221456, 0.000002607800, 0.000000000000,
-  810, 0.000005085868, 0.000001836600, 0.000000000000,
-  815, 0.000003581652, 0.000001293400, 0.000000000000,
-  820, 0.000002522525, 0.000000910930, 0.000000000000,
-  825, 0.000001776509, 0.000000641530, 0.000000000000,
-  830, 0.000001251141, 0.000000451810, 0.000000000000,
-};
-
-constexpr double XYZ_TO_SRGB[9] = {
-  +3.2406, -1.5372, -0.4986,
-  -0.9689, +1.8758, +0.0415,
-  +0.0557, -0.2040, +1.0570
-};
-
-/**
- * @brief DensityProfileLayer
- * 
- */
-class DensityProfileLayer {
- public:
-  DensityProfileLayer() : DensityProfileLayer(0.0, 0.0, 0.0, 0.0, 0.0) {}
-  DensityProfileLayer(double width, double exp_term, double exp_scale, double linear_term, double constant_term)
-      : width(width), exp_term(exp_term), exp_scale(exp_scale), linear_term(linear_term), constant_term(constant_term) {
-  }
-
-  double width;
-  double exp_term;
-  double exp_scale;
-  double linear_term;
-  double constant_term;
-};
-
 /**
  * @brief PrecomputedAtmosphereModel
  * 
@@ -155,33 +18,34 @@ class DensityProfileLayer {
 class PrecomputedAtmosphereModel {
   public:
 
-  PrecomputedAtmosphereModel(
-    const std::vector<double>& wavelengths,
-    const std::vector<double>& solar_irradiance,
-    double sun_angular_radius,
-    double bottom_radius,
-    double top_radius,
-    const std::vector<DensityProfileLayer>& rayleigh_density,
-    const std::vector<double>& rayleigh_scattering,
-    const std::vector<DensityProfileLayer>& mie_density,
-    const std::vector<double>& mie_scattering,
-    const std::vector<double>& mie_extinction,
-    double mie_phase_function_g,
-    const std::vector<DensityProfileLayer>& absorption_density,
-    const std::vector<double>& absorption_extinction,
-    const std::vector<double>& ground_albedo,
-    double max_sun_zenith_angle,
-    double length_unit_in_meters,
-    unsigned int num_precomputed_wavelengths,
-    bool combine_scattering_textures,
-    bool half_precision);
+  // the precomputation runs compute shaders when the context is GL 4.3+ and
+  // allow_compute_shaders, fragment shaders (one layered draw per step) otherwise
+  explicit PrecomputedAtmosphereModel(const SAtmosphereParameters &parameters, bool allow_compute_shaders = true);
 
     ~PrecomputedAtmosphereModel();
 
-    // default multi-scattering order is 4
-    void Init(unsigned int num_scattering_orders = 4);
+    // default multi-scattering order is 4, loads the textures from the
+    // CAtmosphereLUTCache when the same parameters were precomputed before
+    // (use_cache false always precomputes, e.g. to time it)
+    void Init(unsigned int num_scattering_orders = 4, bool use_cache = true);
+
+    // time-sliced precomputation, for parameter changes at runtime: Begin then
+    // AdvancePrecompute once per frame until it returns true, the textures are
+    // only complete then (precompute into a second model and swap). budget is
+    // in scattering texture layers, a 2D texture counts as 1. A program build
+    // ends the frame's slice: it only starts a slice and takes all its budget
+    void BeginPrecompute(unsigned int num_scattering_orders = 4);
+    bool AdvancePrecompute(unsigned int budget);
+    bool IsPrecomputing() const { return !precompute_steps_.empty(); }
+    // 0 to 1
+    float GetPrecomputeProgress() const;
 
     GLuint shader() const { return atmosphere_shader_; }
+    // the source of shader(), to build programs around the atmosphere API
+    // without linking the shader object
+    const std::string &GetShaderSource() const { return atmosphere_shader_source_; }
+    const SAtmosphereParameters &GetParameters() const { return parameters_; }
+    bool UsesComputeShaders() const { return use_compute_shaders_; }
 
     void SetProgramUniforms(
         GLuint program, GLuint transmittance_texture_unit,
@@ -192,12 +56,12 @@ class PrecomputedAtmosphereModel {
                                             const std::vector<double> &spectrum, double *r,
                                             double *g, double *b);
 
-    static constexpr int kLambdaMin = 360;
-    static constexpr int kLambdaMax = 830;
+    static constexpr int kLambdaMin = SAtmosphereParameters::kLambdaMin;
+    static constexpr int kLambdaMax = SAtmosphereParameters::kLambdaMax;
 
-    static constexpr double kLambdaR = 680.0;
-    static constexpr double kLambdaG = 550.0;
-    static constexpr double kLambdaB = 440.0;
+    static constexpr double kLambdaR = SAtmosphereParameters::kLambdaR;
+    static constexpr double kLambdaG = SAtmosphereParameters::kLambdaG;
+    static constexpr double kLambdaB = SAtmosphereParameters::kLambdaB;
 
     GLuint transmittance_texture_;
     GLuint scattering_texture_;
@@ -208,23 +72,72 @@ class PrecomputedAtmosphereModel {
     typedef std::array<double, 3> vec3;
     typedef std::array<float, 9> mat3;
 
-    void Precompute(GLuint fbo, GLuint delta_irradiance_texture,
-                    GLuint delta_rayleigh_scattering_texture,
-                    GLuint delta_mie_scattering_texture,
-                    GLuint delta_scattering_density_texture,
-                    GLuint delta_multiple_scattering_texture,
-                    const vec3 &lambdas, const mat3 &luminance_from_radiance,
-                    bool blend, unsigned int num_scattering_orders);
-
+    // one precompute step, a 3D one runs in slices of its layers
+    struct SPrecomputeStep {
+      unsigned int layers_;
+      std::function<void(unsigned int first_layer, unsigned int layer_count)> run_;
+      // compiles & links a program, about as slow as a whole slice of layers
+      bool builds_program_ = false;
+    };
+
+    void AddTransmittanceSteps(const std::shared_ptr<const std::string> &header);
+    void AddPrecomputeSteps(const vec3 &lambdas, const mat3 &luminance_from_radiance,
+                            bool blend, unsigned int num_scattering_orders);
+    void AddComputePrecomputeSteps(const vec3 &lambdas, const mat3 &luminance_from_radiance,
+                                   bool blend, unsigned int num_scattering_orders);
+    void ReleasePrecomputeResources();
+
+    SAtmosphereParameters parameters_;
     unsigned int num_precomputed_wavelengths_;
     bool half_precision_;
+    bool use_compute_shaders_;
     bool rgb_format_supported_;
+    // the LUT cache key with the scattering orders
+    uint64_t parameters_hash_;
 
     std::function<std::string(const vec3 &)> glsl_header_factory_;
 
+    std::string atmosphere_shader_source_;
     GLuint atmosphere_shader_;
     GLuint full_screen_quad_vao_;
     GLuint full_screen_quad_vbo_;
+
+    // the pending precomputation, its steps own the programs
+    std::vector<SPrecomputeStep> precompute_steps_;
+    size_t precompute_step_ = 0;
+    unsigned int precompute_layer_ = 0;
+    unsigned int precompute_layer_count_ = 0;
+    unsigned int precompute_layers_done_ = 0;
+    GLuint precompute_fbo_ = 0;
+    GLuint delta_irradiance_texture_ = 0;
+    // also the delta multiple scattering texture
+    GLuint delta_rayleigh_scattering_texture_ = 0;
+    GLuint delta_mie_scattering_texture_ = 0;
+    GLuint delta_scattering_density_texture_ = 0;
+};
+
+// aerial perspective of the main camera: froxels (screen uv, view depth) of
+// the exposed in-scattering in rgb and the mean transmittance in a, between
+// the eye and the froxel. Registered as "aerial_perspective", lit passes
+// apply it as color * a + rgb with one fetch
+struct SAerialPerspective {
+  static constexpr int kSize = 32;
+  // view depth of the last slice, slices are spaced quadratically: the
+  // texture z of a view depth d is sqrt(d / max_distance_). 0: disabled
+  float max_distance_ = 0.0f;
+  std::shared_ptr<CTexture> volume_; // RGBA16F GL_TEXTURE_3D, kSize^3
+};
+
+// the sky around the scene origin (y up, exposed radiance without the sun
+// disc) for image based lighting, registered as "sky_capture". The pass
+// renders one face per frame into a back cubemap and swaps it in complete,
+// a cubemap still referenced elsewhere (CIBLPass filtering it) is never
+// rendered into again
+struct SSkyCapture {
+  static constexpr int kSize = 64;
+  std::shared_ptr<CTexture> cubemap_; // RGB16F GL_TEXTURE_CUBE_MAP, kSize^2 with mips
+  // bumped with every complete capture, 0: none yet
+  unsigned int version_ = 0;
 };
 
 /**
@@ -248,10 +161,30 @@ private:
     PRECOMPUTED
   };
 
+  // Earth with the physical parameters below
+  SAtmosphereParameters MakeParameters() const;
+  // the programs below embed the ATMOSPHERE constants of model_
+  void OnModelChanged();
+  // rebuilds the froxels of aerial_perspective_ for the main camera
+  void UpdateAerialPerspective(const glm::vec3 &sun_direction);
+  // rebuilds the sky-view LUT when the camera (from the earth center) or the
+  // sun moved since the last one
+  void UpdateSkyView(const glm::vec3 &camera, const glm::vec3 &sun_direction);
+  // renders the next face of sky_capture_, a capture starts when the sun,
+  // the exposure or the model changed since the last one
+  void UpdateSkyCapture(const glm::vec3 &sun_direction);
+
   constexpr static double kPi = 3.1415926;
   constexpr static double kSunAngularRadius = 0.00935 / 2.0;
   constexpr static double kSunSolidAngle = kPi * kSunAngularRadius * kSunAngularRadius;
   constexpr static double kLengthUnitInMeters = 1000.0;
+  // the altitude of the scene origin, the scene is y up
+  constexpr static double kSceneAltitudeInMeters = 100.0;
+  // sky radiance around the camera: longitude in x, the zenith angle in y
+  // with half of the rows on each side of the horizon, denser near it
+  constexpr static int kSkyViewWidth = 200;
+  constexpr static int kSkyViewHeight = 100;
+  constexpr static GLuint kSkyViewTextureUnit = 4;
 
   bool use_constant_solar_spectrum_ = false;
   bool use_ozone_ = true;
@@ -259,6 +192,9 @@ private:
   bool use_half_precision_ = false;
   Luminance use_luminance_ = Luminance::NONE;
   bool do_white_balance_ = false;
+  // weather, a change re-precomputes the LUTs over several frames
+  float mie_phase_function_g_ = 0.8f;
+  float ground_albedo_ = 0.1f;
 
   double view_distance_meters_ = 9000.0f;
   double view_zenith_angle_radians_ = 1.47f;
@@ -273,6 +209,33 @@ private:
   GLuint irradiance_texture_;
 
   std::unique_ptr<PrecomputedAtmosphereModel> model_;
+  // precomputing the LUTs of the new parameters while model_ is drawn, swapped
+  // in once complete
+  std::unique_ptr<PrecomputedAtmosphereModel> pending_model_;
+  unsigned int pending_frames_ = 0;
+
+  std::shared_ptr<SAerialPerspective> aerial_perspective_;
+  GLuint aerial_perspective_fbo_ = 0;
+  // compiled with the ATMOSPHERE constants of model_, reset with it
+  std::unique_ptr<Program> aerial_perspective_program_;
+  // RGBA32F, the radiance of GetSkyRadiance without the sun disc
+  std::shared_ptr<CTexture> sky_view_texture_;
+  GLuint sky_view_fbo_ = 0;
+  std::unique_ptr<Program> sky_view_program_;
+  bool sky_view_valid_ = false;
+  glm::vec3 sky_view_camera_ = glm::vec3(0.0f);
+  glm::vec3 sky_view_sun_direction_ = glm::vec3(0.0f);
+  // local frame of the camera, the up axis last
+  glm::mat3 sky_view_frame_ = glm::mat3(1.0f);
+  std::shared_ptr<SSkyCapture> sky_capture_;
+  std::shared_ptr<CTexture> sky_capture_back_;
+  GLuint sky_capture_fbo_ = 0;
+  std::unique_ptr<Program> sky_capture_program_;
+  // the face rendered next, -1: idle
+  int sky_capture_face_ = -1;
+  bool sky_capture_dirty_ = true;
+  glm::vec3 sky_capture_sun_direction_ = glm::vec3(0.0f);
+  float sky_capture_exposure_ = 0.0f;
   GLuint vertex_shader_;
   GLuint fragment_shader_;
   std::shared_ptr<Shader> program_;
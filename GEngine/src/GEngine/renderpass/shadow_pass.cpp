@@ -0,0 +1,282 @@
+#include "GEngine/renderpass/shadow_pass.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/log.h"
+#include "GEngine/render_system.h"
+#include "GEngine/singleton.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+GEngine::CCascadedShadowPass::CCascadedShadowPass(const std::string &name, int order)
+    : CRenderPass(name, order, ERenderPassType::ShadowMap) {}
+
+GEngine::CCascadedShadowPass::~CCascadedShadowPass() {
+  if (fbo_ != 0) {
+    CSingleton<CGLStateCache>()->OnFramebufferDeleted(fbo_);
+    glDeleteFramebuffers(1, &fbo_);
+  }
+}
+
+void GEngine::CCascadedShadowPass::SetCascadeCount(int count) {
+  if (cascades_) {
+    GE_WARN("Cascade count must be set before {0} is initialized", GetName());
+    return;
+  }
+  cascade_count_ = std::clamp(count, 1, SShadowCascades::kMaxCascades);
+}
+
+void GEngine::CCascadedShadowPass::SetCascadeUpdateInterval(int cascade, int frames) {
+  if (cascade < 0 || cascade >= SShadowCascades::kMaxCascades) {
+    GE_ERROR("Invalid shadow cascade index: {0}", cascade);
+    return;
+  }
+  update_intervals_[cascade] = std::max(frames, 1);
+}
+
+void GEngine::CCascadedShadowPass::Init() {
+  std::string v_path("../../GEngine/src/GEngine/renderpass/depth_only_vert.glsl");
+  std::string f_path("../../GEngine/src/GEngine/renderpass/depth_only_frag.glsl");
+  shader_ = std::make_shared<GEngine::Shader>(v_path, f_path);
+  std::string alpha_v_path("../../GEngine/src/GEngine/renderpass/depth_alpha_vert.glsl");
+  std::string alpha_f_path("../../GEngine/src/GEngine/renderpass/depth_alpha_frag.glsl");
+  alpha_shader_ = std::make_shared<GEngine::Shader>(alpha_v_path, alpha_f_path);
+
+  cascades_ = std::make_shared<SShadowCascades>();
+  auto shadow_map = std::make_shared<CTexture>(CTexture::ETarget::kTexture2DArray);
+  shadow_map->SetWidth(resolution_);
+  shadow_map->SetHeight(resolution_);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D_ARRAY, shadow_map->id_);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, resolution_, resolution_,
+               cascade_count_, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  // hardware pcf with sampler2DArrayShadow
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  cascades_->shadow_map_ = shadow_map;
+
+  glGenFramebuffers(1, &fbo_);
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, fbo_);
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadow_map->id_, 0, 0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    GE_WARN("Shadow map framebuffer is not complete");
+  }
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  CSingleton<CRenderSystem>()->texture_center_["shadow_cascades"] = shadow_map;
+  CSingleton<CRenderSystem>()->RegisterAnyDataWithName("shadow_cascades", cascades_);
+}
+
+void GEngine::CCascadedShadowPass::Tick() {
+  auto render_system = CSingleton<CRenderSystem>();
+  auto scene = render_system->GetOrCreateMainScene();
+  auto &stats = render_system->GetRenderStats();
+  stats.shadow_cascades_updated_ = 0;
+  stats.shadow_draw_calls_ = 0;
+
+  std::shared_ptr<CLight> sun;
+  for (const auto &light : scene->GetLights()) {
+    if (light->type_ == CLight::LightType::Directional && light->cast_shadow_) {
+      sun = light;
+      break;
+    }
+  }
+  if (!sun) {
+    cascades_->cascade_count_ = 0;
+    return;
+  }
+
+  glm::vec3 light_direction = glm::normalize(sun->direction_);
+  // a moving sun invalidates every cascade
+  bool force_update = light_direction != last_light_direction_;
+  last_light_direction_ = light_direction;
+
+  auto camera = render_system->GetOrCreateMainCamera();
+  glm::mat4 view = camera->GetViewMatrix();
+  glm::mat4 projection = camera->GetProjectionMatrix();
+  std::array<float, SShadowCascades::kMaxCascades + 1> splits;
+  ComputeSplits(camera->GetNear(), std::min(camera->GetFar(), shadow_distance_), splits);
+  SAABB scene_bounds = scene->GetBounds();
+
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, fbo_);
+  CSingleton<CGLStateCache>()->Viewport(0, 0, resolution_, resolution_);
+  CSingleton<CGLStateCache>()->Enable(GL_DEPTH_TEST);
+  glDepthFunc(GL_LESS);
+  glDepthMask(GL_TRUE);
+  CSingleton<CGLStateCache>()->Enable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(2.0f, 4.0f);
+
+  cascades_->cascade_count_ = cascade_count_;
+  for (int c = 0; c < cascade_count_; c++) {
+    bool due = force_update || last_update_frame_[c] < 0 ||
+               frame_index_ - last_update_frame_[c] >= update_intervals_[c];
+    if (!due) {
+      continue;
+    }
+    // a skipped cascade keeps the matrix & split of its shadow map layer
+    cascades_->view_projection_[c] = ComputeCascadeMatrix(view, projection, splits[c], splits[c + 1],
+                                                          light_direction, scene_bounds);
+    cascades_->split_depths_[c] = splits[c + 1];
+    RenderCascade(c);
+    last_update_frame_[c] = frame_index_;
+    stats.shadow_cascades_updated_++;
+  }
+
+  CSingleton<CGLStateCache>()->Disable(GL_POLYGON_OFFSET_FILL);
+  CSingleton<CGLStateCache>()->BindVertexArray(0);
+  CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, 0);
+  render_system->GetOrCreateWindow()->SetViewport();
+  frame_index_++;
+}
+
+void GEngine::CCascadedShadowPass::ComputeSplits(
+    float near, float far, std::array<float, SShadowCascades::kMaxCascades + 1> &splits) const {
+  // practical split scheme: blend of logarithmic and uniform splits
+  splits[0] = near;
+  for (int i = 1; i <= cascade_count_; i++) {
+    float ratio = static_cast<float>(i) / cascade_count_;
+    float log_split = near * std::pow(far / near, ratio);
+    float uniform_split = near + (far - near) * ratio;
+    splits[i] = split_lambda_ * log_split + (1.0f - split_lambda_) * uniform_split;
+  }
+}
+
+glm::mat4 GEngine::CCascadedShadowPass::ComputeCascadeMatrix(
+    const glm::mat4 &view, const glm::mat4 &projection, float split_near, float split_far,
+    const glm::vec3 &light_direction, const SAABB &scene_bounds) const {
+  // corners of the camera frustum slice in world space
+  glm::mat4 inverse_view = glm::inverse(view);
+  float tan_half_x = 1.0f / projection[0][0];
+  float tan_half_y = 1.0f / projection[1][1];
+  glm::vec3 corners[8];
+  int corner_index = 0;
+  for (float depth : {split_near, split_far}) {
+    for (float sx : {-1.0f, 1.0f}) {
+      for (float sy : {-1.0f, 1.0f}) {
+        glm::vec4 view_corner(sx * depth * tan_half_x, sy * depth * tan_half_y, -depth, 1.0f);
+        corners[corner_index++] = glm::vec3(inverse_view * view_corner);
+      }
+    }
+  }
+
+  // bounding sphere keeps the cascade size constant under camera rotation
+  glm::vec3 center(0.0f);
+  for (const auto &corner : corners) {
+    center += corner;
+  }
+  center /= 8.0f;
+  float radius = 0.0f;
+  for (const auto &corner : corners) {
+    radius = std::max(radius, glm::length(corner - center));
+  }
+  radius = std::ceil(radius * 16.0f) / 16.0f;
+
+  glm::vec3 up = std::abs(light_direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+  glm::mat4 light_view = glm::lookAt(center, center + light_direction, up);
+
+  // pull the near plane back so every caster of the scene is kept
+  float z_near = -radius;
+  float z_far = radius;
+  if (scene_bounds.IsValid()) {
+    SAABB light_space_bounds = scene_bounds.Transform(light_view);
+    z_near = std::min(z_near, -light_space_bounds.max_.z);
+    z_far = std::max(z_far, -light_space_bounds.min_.z);
+  }
+  glm::mat4 light_projection = glm::ortho(-radius, radius, -radius, radius, z_near, z_far);
+
+  // snap to shadow map texels to avoid shimmering when the camera moves
+  glm::vec4 origin = light_projection * light_view * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+  float half_resolution = resolution_ * 0.5f;
+  glm::vec2 origin_texel = glm::vec2(origin) * half_resolution;
+  glm::vec2 offset = (glm::round(origin_texel) - origin_texel) / half_resolution;
+  light_projection[3][0] += offset.x;
+  light_projection[3][1] += offset.y;
+
+  return light_projection * light_view;
+}
+
+void GEngine::CCascadedShadowPass::RenderCascade(int cascade) {
+  const glm::mat4 &view_projection = cascades_->view_projection_[cascade];
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cascades_->shadow_map_->id_, 0, cascade);
+  glClear(GL_DEPTH_BUFFER_BIT);
+
+  draw_items_.clear();
+  CSingleton<CRenderSystem>()->GetOrCreateMainScene()->CollectDrawItems(CFrustum(view_projection), draw_items_);
+  // group by mesh so the vertex stream is bound once per mesh
+  std::sort(draw_items_.begin(), draw_items_.end(), [](const SDrawItem &a, const SDrawItem &b) {
+    return a.alpha_tested_ != b.alpha_tested_ ? b.alpha_tested_ : a.mesh_ < b.mesh_;
+  });
+
+  auto &stats = CSingleton<CRenderSystem>()->GetRenderStats();
+  CMesh *bound_mesh = nullptr;
+  shader_->Use();
+  shader_->SetMat4("u_view", glm::mat4(1.0f));
+  shader_->SetMat4("u_projection", view_projection);
+  for (const auto &item : draw_items_) {
+    if (item.alpha_tested_) {
+      break;
+    }
+    if (item.mesh_ != bound_mesh) {
+      item.mesh_->BindPositionOnly();
+      bound_mesh = item.mesh_;
+    }
+    shader_->SetMat4("u_model", item.model_);
+    item.mesh_->DrawSubMesh(item.sub_mesh_);
+    stats.shadow_draw_calls_++;
+  }
+
+  // alpha tested casters need texcoords, use the full vertex stream
+  bound_mesh = nullptr;
+  alpha_shader_->Use();
+  alpha_shader_->SetMat4("u_view", glm::mat4(1.0f));
+  alpha_shader_->SetMat4("u_projection", view_projection);
+  for (const auto &item : draw_items_) {
+    if (!item.alpha_tested_) {
+      continue;
+    }
+    if (item.mesh_ != bound_mesh) {
+      item.mesh_->BindFullVertexStream();
+      bound_mesh = item.mesh_;
+    }
+    auto material = item.mesh_->GetSubMeshMaterial(item.sub_mesh_);
+    alpha_shader_->SetBool("has_base_color_texture", material->basecolor_texture_ != nullptr);
+    alpha_shader_->SetTexture("texture_base_color", material->basecolor_texture_);
+    alpha_shader_->SetMat4("u_model", item.model_);
+    item.mesh_->DrawSubMesh(item.sub_mesh_);
+    stats.shadow_draw_calls_++;
+  }
+
+  // instanced casters
+  CSingleton<CRenderSystem>()->GetOrCreateMainScene()->CollectInstanceBatches(CFrustum(view_projection), instance_batches_);
+  for (int alpha_pass = 0; alpha_pass < 2; alpha_pass++) {
+    auto &shader = alpha_pass == 0 ? shader_ : alpha_shader_;
+    shader->Use();
+    shader->SetBool("u_instanced", true);
+    for (auto &batch : instance_batches_) {
+      if (batch.transforms_.empty()) {
+        continue;
+      }
+      batch.mesh_->UploadInstances(batch.transforms_);
+      alpha_pass == 0 ? batch.mesh_->BindPositionOnly() : batch.mesh_->BindFullVertexStream();
+      for (unsigned int i = 0; i < batch.mesh_->meshes_.size(); i++) {
+        if (batch.mesh_->IsAlphaTested(i) != (alpha_pass == 1)) {
+          continue;
+        }
+        if (alpha_pass == 1) {
+          auto material = batch.mesh_->GetSubMeshMaterial(i);
+          shader->SetBool("has_base_color_texture", material->basecolor_texture_ != nullptr);
+          shader->SetTexture("texture_base_color", material->basecolor_texture_);
+        }
+        batch.mesh_->DrawSubMeshInstanced(i, static_cast<unsigned int>(batch.transforms_.size()));
+        stats.shadow_draw_calls_++;
+      }
+    }
+    shader->Use();
+    shader->SetBool("u_instanced", false);
+  }
+}
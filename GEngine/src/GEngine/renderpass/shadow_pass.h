@@ -0,0 +1,66 @@
+#pragma once
+#include "GEngine/light.h"
+#include "GEngine/render_pass.h"
+#include "GEngine/render_scene.h"
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace GEngine {
+// cascade data read by the lit passes, registered as "shadow_cascades"
+struct SShadowCascades {
+  static constexpr int kMaxCascades = 4;
+  int cascade_count_ = 0;
+  // world -> light clip space, as used when the cascade was last rendered
+  std::array<glm::mat4, kMaxCascades> view_projection_;
+  // far view depth of each cascade, also as of its last render
+  glm::vec4 split_depths_ = glm::vec4(0.0f);
+  std::shared_ptr<CTexture> shadow_map_; // depth GL_TEXTURE_2D_ARRAY
+};
+
+// cascaded shadow maps for the first shadow casting directional light of the
+// main scene: practical split scheme, texel snapped cascades, per cascade
+// culling and position-only depth draws. Far cascades can be refreshed less
+// often, see SetCascadeUpdateInterval()
+class CCascadedShadowPass : public CRenderPass {
+public:
+  CCascadedShadowPass(const std::string &name, int order);
+  virtual ~CCascadedShadowPass();
+
+  virtual void Init() override;
+  virtual void Tick() override;
+
+  void SetCascadeCount(int count);
+  void SetResolution(int resolution) { resolution_ = resolution; }
+  // 0: uniform splits, 1: logarithmic splits
+  void SetSplitLambda(float lambda) { split_lambda_ = lambda; }
+  void SetShadowDistance(float distance) { shadow_distance_ = distance; }
+  // render cascade every `frames` frames (1: every frame)
+  void SetCascadeUpdateInterval(int cascade, int frames);
+
+  std::shared_ptr<SShadowCascades> GetCascades() const { return cascades_; }
+
+private:
+  void ComputeSplits(float near, float far, std::array<float, SShadowCascades::kMaxCascades + 1> &splits) const;
+  glm::mat4 ComputeCascadeMatrix(const glm::mat4 &view, const glm::mat4 &projection,
+                                 float split_near, float split_far,
+                                 const glm::vec3 &light_direction, const SAABB &scene_bounds) const;
+  void RenderCascade(int cascade);
+
+  int cascade_count_ = 4;
+  int resolution_ = 2048;
+  float split_lambda_ = 0.75f;
+  float shadow_distance_ = 120.0f;
+  std::array<int, SShadowCascades::kMaxCascades> update_intervals_ = {1, 1, 2, 4};
+  std::array<int, SShadowCascades::kMaxCascades> last_update_frame_ = {-1, -1, -1, -1};
+  int frame_index_ = 0;
+  glm::vec3 last_light_direction_ = glm::vec3(0.0f);
+
+  std::shared_ptr<SShadowCascades> cascades_;
+  std::shared_ptr<Shader> alpha_shader_;
+  unsigned int fbo_ = 0;
+  std::vector<SDrawItem> draw_items_;
+  std::vector<SInstanceBatch> instance_batches_;
+};
+} // namespace GEngine
@@ -1,9 +1,13 @@
 #include "GEngine/renderpass/skybox_pass.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/ibl_cache.h"
+#include "GEngine/job_system.h"
 #include "GEngine/log.h"
 #include "GEngine/render_pass.h"
 #include "GEngine/shader.h"
 #include "GEngine/singleton.h"
 #include "GEngine/texture.h"
+#include "GEngine/texture_upload_queue.h"
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include <iostream>
@@ -16,9 +20,15 @@ GEngine::CSkyboxPass::CSkyboxPass(const std::string &name, int order)
 
 GEngine::CSkyboxPass::~CSkyboxPass() {}
 
+void GEngine::CSkyboxPass::PrepareShaders() {
+  std::string v_path("../../GEngine/src/GEngine/renderpass/skybox_shader_vert.glsl");
+  std::string f_path("../../GEngine/src/GEngine/renderpass/skybox_shader_frag.glsl");
+  shader_ = std::make_shared<GEngine::Shader>(v_path, f_path);
+}
+
 void GEngine::CSkyboxPass::Init() {
   glfwMakeContextCurrent(CSingleton<CRenderSystem>()->GetOrCreateWindow()->GetGLFWwindow());
-  glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+  CSingleton<CGLStateCache>()->Enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
   std::vector<std::string> faces{
       "../../assets/textures/skybox_outdoor/right.png",
       "../../assets/textures/skybox_outdoor/left.png",
@@ -34,10 +44,6 @@ void GEngine::CSkyboxPass::Init() {
   //     "../../assets/textures/skybox_indoor/front.png",
   //     "../../assets/textures/skybox_indoor/back.png"};
 
-  std::string v_path("../../GEngine/src/GEngine/renderpass/skybox_shader_vert.glsl");
-  std::string f_path("../../GEngine/src/GEngine/renderpass/skybox_shader_frag.glsl");
-  shader_ = std::make_shared<GEngine::Shader>(v_path, f_path);
-
   auto skybox_texture = std::make_shared<GEngine::CTexture>(GEngine::CTexture::ETarget::kTextureCubeMap);
   skybox_texture->SetMinFilter(GEngine::CTexture::EMinFilter::kLinearMipmapLinear);
   skybox_texture->SetMagFilter(GEngine::CTexture::EMagFilter::kLinear);
@@ -53,10 +59,10 @@ void GEngine::CSkyboxPass::Init() {
 }
 
 void GEngine::CSkyboxPass::Tick() {
-   glBindFramebuffer(GL_FRAMEBUFFER, 0);
+   CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, 0);
    glClearColor(0.2, 0.3, 0.4, 1.0);
    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-   glEnable(GL_DEPTH_TEST);
+   CSingleton<CGLStateCache>()->Enable(GL_DEPTH_TEST);
    glDepthFunc(GL_LEQUAL);
    // todo
    shader_->Use();
@@ -67,7 +73,7 @@ void GEngine::CSkyboxPass::Tick() {
    shader_->SetMat4("projection", projection);
    CSingleton<CRenderSystem>()->RenderCube();
    glDepthFunc(GL_LESS); 
-   glBindFramebuffer(GL_FRAMEBUFFER, 0);
+   CSingleton<CGLStateCache>()->BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void GEngine::CSkyboxPass::LoadCubemapFromFiles(const std::vector<std::string>& paths, std::shared_ptr<GEngine::CTexture> texture) {
@@ -76,34 +82,81 @@ void GEngine::CSkyboxPass::LoadCubemapFromFiles(const std::vector<std::string>&
     return;
   }
 
-  glBindTexture(GL_TEXTURE_CUBE_MAP, texture->id_);
+  // the faces are decoded (and hashed for the CIBLCache key) in parallel
+  struct SFace {
+    int width = 0, height = 0, components_number = 0;
+    std::vector<uint8_t> pixels;
+    uint64_t hash = 0;
+  };
+  std::vector<SFace> faces(6);
+  CSingleton<CJobSystem>()->ParallelFor(6, 1, [&](unsigned int begin, unsigned int end) {
+    for (unsigned int i = begin; i < end; i++) {
+      unsigned char *data = stbi_load(paths[i].c_str(), &faces[i].width, &faces[i].height, &faces[i].components_number, 0);
+      if (data) {
+        faces[i].pixels.assign(data, data + static_cast<size_t>(faces[i].width) * faces[i].height * faces[i].components_number);
+        faces[i].hash = CIBLCache::HashFace(faces[i].width, faces[i].height, faces[i].components_number,
+                                            faces[i].pixels.data());
+      }
+      stbi_image_free(data);
+    }
+  });
 
-  int width, height, components_number;
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_CUBE_MAP, texture->id_);
+  // mipmaps are generated once every face landed, until then level 0 only
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+  std::array<uint64_t, 6> face_hashes;
+  bool complete = true;
   for (int i = 0; i < 6; i++) {
-    unsigned char *data = stbi_load(paths[i].c_str(), &width, &height, &components_number, 0);
-    if (components_number == 1)
+    face_hashes[i] = faces[i].hash;
+    complete = complete && !faces[i].pixels.empty();
+  }
+  if (complete) {
+    CSingleton<CRenderSystem>()->RegisterAnyDataWithName("skybox_hash", CIBLCache::HashSkybox(face_hashes));
+  }
+
+  // counts the enqueued faces, a face that failed to load never calls back
+  auto remaining_faces = std::make_shared<int>(0);
+  GLuint id = texture->id_;
+  for (int i = 0; i < 6; i++) {
+    if (faces[i].components_number == 1)
       texture->internal_format_ = texture->external_format_ = CTexture::EPixelFormat::kRed;
-    else if (components_number == 3)
+    else if (faces[i].components_number == 3)
       texture->internal_format_ = texture->external_format_ = CTexture::EPixelFormat::kRGB;
-    else if (components_number == 4)
+    else if (faces[i].components_number == 4)
       texture->internal_format_ = texture->external_format_ = CTexture::EPixelFormat::kRGBA;
-    if (data) {
-      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, static_cast<GLint>(texture->internal_format_), width, height, 0, static_cast<GLenum>(texture->external_format_), GL_UNSIGNED_BYTE, data);
-      stbi_image_free(data);
-    } else {
+    if (faces[i].pixels.empty()) {
       GE_ERROR("Cubemap texture failed to load at path: {0}", paths[i]);
-      stbi_image_free(data);
+      continue;
     }
+    // storage only, the pixels go through the upload queue
+    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, static_cast<GLint>(texture->internal_format_), faces[i].width,
+                 faces[i].height, 0, static_cast<GLenum>(texture->external_format_), GL_UNSIGNED_BYTE, nullptr);
+    CTextureUploadQueue::SRequest request;
+    request.texture_ = id;
+    request.target_ = GL_TEXTURE_CUBE_MAP;
+    request.image_target_ = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
+    request.width_ = faces[i].width;
+    request.height_ = faces[i].height;
+    request.format_ = static_cast<GLenum>(texture->external_format_);
+    request.pixels_ = std::move(faces[i].pixels);
+    request.on_uploaded_ = [remaining_faces, id]() {
+      if (--*remaining_faces > 0) {
+        return;
+      }
+      CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_CUBE_MAP, id);
+      glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+      glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    };
+    ++*remaining_faces;
+    CSingleton<CTextureUploadQueue>()->Enqueue(std::move(request));
   }
-  texture->SetWidth(width);
-  texture->SetHeight(height);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-  glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+  texture->SetWidth(faces[0].width);
+  texture->SetHeight(faces[0].height);
 
-  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_CUBE_MAP, 0);
 }
@@ -11,6 +11,7 @@ public:
 
   void LoadCubemapFromFiles(const std::vector<std::string>& paths, std::shared_ptr<GEngine::CTexture> texture);
 
+  virtual void PrepareShaders() override;
   virtual void Init() override;
   virtual void Tick() override;
 private:
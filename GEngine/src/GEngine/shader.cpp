@@ -1,83 +1,37 @@
 #include "shader.h"
+#include "gl_state_cache.h"
 #include "log.h"
+#include "shader_hot_reload.h"
+#include "singleton.h"
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
+#include <algorithm>
+
+std::vector<const GEngine::Shader *> GEngine::Shader::pending_programs_;
+bool GEngine::Shader::parallel_compile_ = false;
 
 GEngine::Shader::Shader() {}
 
+GEngine::Shader::~Shader() {
+  if (!stage_files_.empty()) {
+    CSingleton<CShaderHotReload>()->Unregister(this);
+  }
+  pending_programs_.erase(std::remove(pending_programs_.begin(), pending_programs_.end(), this),
+                          pending_programs_.end());
+}
+
 GEngine::Shader::Shader(const std::string &vert_shader_path,
                           const std::string &frag_shader_path,
                           const std::string &geom_shader_path) {
   // TODO:
   // tessellation_evaluation_shader, tessellation_control_shader, compute_shader_path
   // compute shader
-  std::string vert_code;
-  std::string frag_code;
-  std::string geom_code;
-  std::ifstream vert_shader_file;
-  std::ifstream frag_shader_file;
-  std::ifstream geom_shader_file;
-  // ensure ifstream objects can throw exceptions:
-  vert_shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  frag_shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  geom_shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  try {
-    vert_shader_file.open(vert_shader_path);
-    frag_shader_file.open(frag_shader_path);
-    std::stringstream vert_shader_stream;
-    std::stringstream frag_shader_stream;
-    vert_shader_stream << vert_shader_file.rdbuf();
-    frag_shader_stream << frag_shader_file.rdbuf();
-    vert_shader_file.close();
-    frag_shader_file.close();
-    vert_code = vert_shader_stream.str();
-    frag_code = frag_shader_stream.str();
-    if (!geom_shader_path.empty()) {
-      geom_shader_file.open(geom_shader_path);
-      std::stringstream geom_shader_stream;
-      geom_shader_stream << geom_shader_file.rdbuf();
-      geom_shader_file.close();
-      geom_code = geom_shader_stream.str();
-    }
-  } catch (std::ifstream::failure &e) {
-    GE_ERROR("ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: {}", e.what());
-  }
-  // 2. compile shaders
-  unsigned int vertex, fragment;
-  const char* vert_c_str = vert_code.c_str();
-  const char* frag_c_str = frag_code.c_str();
-  // vertex shader
-  vertex = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertex, 1, &vert_c_str, NULL);
-  glCompileShader(vertex);
-  CheckCompileErrors(vertex, "VERTEX");
-  // fragment Shader
-  fragment = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragment, 1, &frag_c_str, NULL);
-  glCompileShader(fragment);
-  CheckCompileErrors(fragment, "FRAGMENT");
-  // if geometry shader is given, compile geometry shader
-  unsigned int geometry;
+  std::vector<SShaderStageFile> stages = {{GL_VERTEX_SHADER, vert_shader_path},
+                                          {GL_FRAGMENT_SHADER, frag_shader_path}};
   if (!geom_shader_path.empty()) {
-    const char * geom_c_str = geom_code.c_str();
-    geometry = glCreateShader(GL_GEOMETRY_SHADER);
-    glShaderSource(geometry, 1, &geom_c_str, NULL);
-    glCompileShader(geometry);
-    CheckCompileErrors(geometry, "GEOMETRY");
+    stages.push_back({GL_GEOMETRY_SHADER, geom_shader_path});
   }
-  // shader Program
-  shader_program_ID_ = glCreateProgram();
-  glAttachShader(shader_program_ID_, vertex);
-  glAttachShader(shader_program_ID_, fragment);
-  if (!geom_shader_path.empty())
-    glAttachShader(shader_program_ID_, geometry);
-  glLinkProgram(shader_program_ID_);
-  CheckCompileErrors(shader_program_ID_, "PROGRAM");
-  // delete the shaders as they're linked into our program now and no longer necessary
-  glDeleteShader(vertex);
-  glDeleteShader(fragment);
-  if (!geom_shader_path.empty())
-    glDeleteShader(geometry);
+  LoadFromFiles(stages, {});
 }
 
 std::shared_ptr<GEngine::Shader>
@@ -90,40 +44,12 @@ GEngine::Shader::CreateProgramFromSource(const std::string &vertex_shader_source
     GE_ERROR("vertex or fragment sahder not completed");
   }
 
-  unsigned int vertex, fragment, geometry;
-  const char* vert_c_str = vertex_shader_source.c_str();
-  const char* frag_c_str = fragment_shader_source.c_str();
-  // vertex shader
-  vertex = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertex, 1, &vert_c_str, NULL);
-  glCompileShader(vertex);
-  CheckCompileErrors(vertex, "VERTEX");
-  // fragment Shader
-  fragment = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragment, 1, &frag_c_str, NULL);
-  glCompileShader(fragment);
-  CheckCompileErrors(fragment, "FRAGMENT");
-  // if geometry shader is given, compile geometry shader
+  std::vector<CProgramCache::SStageSource> stages = {{GL_VERTEX_SHADER, &vertex_shader_source},
+                                                     {GL_FRAGMENT_SHADER, &fragment_shader_source}};
   if (!geometry_shader_source.empty()) {
-    const char * geom_c_str = geometry_shader_source.c_str();
-    geometry = glCreateShader(GL_GEOMETRY_SHADER);
-    glShaderSource(geometry, 1, &geom_c_str, NULL);
-    glCompileShader(geometry);
-    CheckCompileErrors(geometry, "GEOMETRY");
+    stages.push_back({GL_GEOMETRY_SHADER, &geometry_shader_source});
   }
-  // shader Program
-  program->shader_program_ID_ = glCreateProgram();
-  glAttachShader(program->shader_program_ID_, vertex);
-  glAttachShader(program->shader_program_ID_, fragment);
-  if (!geometry_shader_source.empty())
-    glAttachShader(program->shader_program_ID_, geometry);
-  glLinkProgram(program->shader_program_ID_);
-  CheckCompileErrors(program->shader_program_ID_, "PROGRAM");
-  // delete the shaders as they're linked into our program now and no longer necessary
-  glDeleteShader(vertex);
-  glDeleteShader(fragment);
-  if (!geometry_shader_source.empty())
-    glDeleteShader(geometry);
+  program->Submit(stages);
   return program;
 }
 
@@ -135,173 +61,354 @@ GEngine::Shader::CreateProgramFromFile(const std::string &vertex_shader_path,
   return program;
 }
 
+std::shared_ptr<GEngine::Shader>
+GEngine::Shader::CreateProgramFromFiles(const std::vector<SShaderStageFile> &stages,
+                                        const std::vector<std::string> &defines) {
+  auto program = std::make_shared<Shader>();
+  program->LoadFromFiles(stages, defines);
+  return program;
+}
+
 std::shared_ptr<GEngine::Shader>
 GEngine::Shader::CreateAtmosphereProgram(const std::string &vertex_shader_path,
                                          const std::string &fragment_shader_path,
                                          const std::string &atmosphere_shader_path) {
-  auto program = std::make_shared<Shader>();
+  return CreateProgramFromFiles({{GL_VERTEX_SHADER, vertex_shader_path},
+                                 {GL_FRAGMENT_SHADER, fragment_shader_path},
+                                 {GL_FRAGMENT_SHADER, atmosphere_shader_path}});
+}
 
-  std::string vert_code;
-  std::string frag_code;
-  std::string frag2_code;
-  std::ifstream vert_shader_file;
-  std::ifstream frag_shader_file;
-  std::ifstream frag2_shader_file;
-  // ensure ifstream objects can throw exceptions:
-  vert_shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  frag_shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  frag2_shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  try {
-    vert_shader_file.open(vertex_shader_path);
-    frag_shader_file.open(fragment_shader_path);
-    frag2_shader_file.open(atmosphere_shader_path);
-    std::stringstream vert_shader_stream;
-    std::stringstream frag_shader_stream;
-    std::stringstream frag2_shader_stream;
-    vert_shader_stream << vert_shader_file.rdbuf();
-    frag_shader_stream << frag_shader_file.rdbuf();
-    frag2_shader_stream << frag2_shader_file.rdbuf();
-    vert_shader_file.close();
-    frag_shader_file.close();
-    frag2_shader_file.close();
-    vert_code = vert_shader_stream.str();
-    frag_code = frag_shader_stream.str();
-    frag2_code = frag2_shader_stream.str();
-  } catch (std::ifstream::failure &e) {
-    GE_ERROR("ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: {}", e.what());
+void GEngine::Shader::LoadFromFiles(const std::vector<SShaderStageFile> &stages,
+                                    const std::vector<std::string> &defines) {
+  stage_files_ = stages;
+  sources_.clear();
+  std::vector<std::string> files;
+  for (const auto &stage : stages) {
+    auto source = CShaderPreprocessor::ProcessFile(stage.path_);
+    CShaderPreprocessor::InjectDefines(source, defines);
+    for (const auto &file : source.files_) {
+      if (std::find(files.begin(), files.end(), file) == files.end()) {
+        files.push_back(file);
+      }
+    }
+    sources_.push_back(std::move(source));
   }
+  CSingleton<CShaderHotReload>()->Register(this, stages, defines, files);
+  Submit(GetStageSources(sources_));
+}
 
-  unsigned int vertex, fragment, fragment2;
-
-  const char* vert_c_str = vert_code.c_str();
-  const char* frag_c_str = frag_code.c_str();
-  const char* frag2_c_str = frag2_code.c_str();
-
-  vertex = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertex, 1, &vert_c_str, NULL);
-  glCompileShader(vertex);
-  CheckCompileErrors(vertex, "VERTEX");
-  // fragment Shader
-  fragment = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragment, 1, &frag_c_str, NULL);
-  glCompileShader(fragment);
-  CheckCompileErrors(fragment, "FRAGMENT");
-  // fragment2 Shader
-  fragment2 = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragment2, 1, &frag2_c_str, NULL);
-  glCompileShader(fragment2);
-  CheckCompileErrors(fragment2, "FRAGMENT");
-
-  program->shader_program_ID_ = glCreateProgram();
-  glAttachShader(program->shader_program_ID_, vertex);
-  glAttachShader(program->shader_program_ID_, fragment);
-  glAttachShader(program->shader_program_ID_, fragment2);
-
-  glLinkProgram(program->shader_program_ID_);
-  CheckCompileErrors(program->shader_program_ID_, "PROGRAM");
-
-  glDeleteShader(vertex);
-  glDeleteShader(fragment);
-  glDeleteShader(fragment2);
+std::vector<GEngine::CProgramCache::SStageSource>
+GEngine::Shader::GetStageSources(const std::vector<SPreprocessedShader> &sources) const {
+  std::vector<CProgramCache::SStageSource> stages;
+  for (size_t i = 0; i < sources.size() && i < stage_files_.size(); i++) {
+    stages.push_back({stage_files_[i].stage_, &sources[i].source_});
+  }
+  return stages;
+}
 
+unsigned int GEngine::Shader::BuildProgram(const std::vector<CProgramCache::SStageSource> &stages) {
+  std::vector<unsigned int> shaders;
+  uint64_t cache_key = 0;
+  bool from_cache = false;
+  unsigned int program = SubmitProgram(stages, shaders, cache_key, from_cache);
+  if (!from_cache) {
+    FinishProgram(program, shaders, cache_key);
+  }
+  return program;
+}
+
+unsigned int GEngine::Shader::SubmitProgram(const std::vector<CProgramCache::SStageSource> &stages,
+                                            std::vector<unsigned int> &shaders, uint64_t &cache_key,
+                                            bool &from_cache) {
+  auto cache = CSingleton<CProgramCache>();
+  from_cache = false;
+  cache_key = 0;
+  if (cache->IsAvailable()) {
+    cache_key = cache->ComputeKey(stages);
+    unsigned int cached_program = glCreateProgram();
+    if (cache->Load(cache_key, cached_program)) {
+      from_cache = true;
+      return cached_program;
+    }
+    glDeleteProgram(cached_program);
+  }
+
+  // no status query in here, the driver may compile & link on its own threads
+  unsigned int program = glCreateProgram();
+  shaders.clear();
+  for (const auto &stage : stages) {
+    const char *source = stage.source_->c_str();
+    unsigned int shader = glCreateShader(stage.stage_);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    glAttachShader(program, shader);
+    shaders.push_back(shader);
+  }
+  if (cache->IsAvailable()) {
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+  glLinkProgram(program);
   return program;
 }
 
+bool GEngine::Shader::FinishProgram(unsigned int program, std::vector<unsigned int> &shaders, uint64_t cache_key,
+                                    const std::vector<SPreprocessedShader> *sources) {
+  GLint link_status = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+  if (link_status != GL_TRUE) {
+    // compile logs first, they usually explain the link error
+    for (size_t i = 0; i < shaders.size(); i++) {
+      GLint type = 0;
+      glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type);
+      CheckCompileErrors(shaders[i],
+                         type == GL_VERTEX_SHADER     ? "VERTEX"
+                         : type == GL_GEOMETRY_SHADER ? "GEOMETRY"
+                                                      : "FRAGMENT",
+                         sources && i < sources->size() ? &(*sources)[i] : nullptr);
+    }
+    CheckCompileErrors(program, "PROGRAM");
+  }
+  // delete the shaders as they're linked into our program now and no longer necessary
+  for (unsigned int shader : shaders) {
+    glDetachShader(program, shader);
+    glDeleteShader(shader);
+  }
+  shaders.clear();
+  if (link_status == GL_TRUE && CSingleton<CProgramCache>()->IsAvailable()) {
+    CSingleton<CProgramCache>()->Store(cache_key, program);
+  }
+  return link_status == GL_TRUE;
+}
+
+void GEngine::Shader::Submit(const std::vector<CProgramCache::SStageSource> &stages) {
+  bool from_cache = false;
+  shader_program_ID_ = SubmitProgram(stages, pending_shaders_, pending_cache_key_, from_cache);
+  if (!from_cache) {
+    pending_ = true;
+    pending_programs_.push_back(this);
+  }
+}
+
+void GEngine::Shader::Resolve() const {
+  if (!pending_) {
+    return;
+  }
+  pending_ = false;
+  FinishProgram(shader_program_ID_, pending_shaders_, pending_cache_key_, &sources_);
+  pending_programs_.erase(std::remove(pending_programs_.begin(), pending_programs_.end(), this),
+                          pending_programs_.end());
+}
+
+void GEngine::Shader::Reload(std::vector<SPreprocessedShader> sources) {
+  Resolve();
+  if (reload_program_ != 0) {
+    // superseded by a newer save
+    for (unsigned int shader : reload_shaders_) {
+      glDeleteShader(shader);
+    }
+    glDeleteProgram(reload_program_);
+    reload_program_ = 0;
+  }
+  reload_sources_ = std::move(sources);
+  bool from_cache = false;
+  reload_program_ = SubmitProgram(GetStageSources(reload_sources_), reload_shaders_, reload_cache_key_, from_cache);
+  if (from_cache) {
+    // an earlier version of the files, nothing to compile
+    SwapProgram(reload_program_);
+  }
+}
+
+bool GEngine::Shader::PollReload(bool &succeeded) {
+  succeeded = false;
+  if (reload_program_ == 0) {
+    succeeded = true;
+    return true;
+  }
+  if (parallel_compile_) {
+    GLint completed = GL_FALSE;
+    glGetProgramiv(reload_program_, kCompletionStatus, &completed);
+    if (completed != GL_TRUE) {
+      return false;
+    }
+  }
+  succeeded = FinishProgram(reload_program_, reload_shaders_, reload_cache_key_, &reload_sources_);
+  if (succeeded) {
+    SwapProgram(reload_program_);
+    GE_INFO("Reloaded shader {0}", stage_files_.empty() ? std::string() : stage_files_.back().path_);
+  } else {
+    GE_WARN("Keeping the previous program of {0}", stage_files_.empty() ? std::string() : stage_files_.back().path_);
+    glDeleteProgram(reload_program_);
+    reload_program_ = 0;
+    reload_sources_.clear();
+  }
+  return true;
+}
+
+void GEngine::Shader::SwapProgram(unsigned int program) {
+  CSingleton<CGLStateCache>()->OnProgramDeleted(shader_program_ID_);
+  glDeleteProgram(shader_program_ID_);
+  shader_program_ID_ = program;
+  sources_ = std::move(reload_sources_);
+  reload_sources_.clear();
+  reload_program_ = 0;
+  // sampler units are per program
+  CSingleton<CGLStateCache>()->UseProgram(shader_program_ID_);
+  for (auto &[name, item] : bound_textures_) {
+    std::get<2>(item) = glGetUniformLocation(shader_program_ID_, name.c_str());
+    glUniform1i(std::get<2>(item), std::get<0>(item));
+  }
+  CSingleton<CGLStateCache>()->UseProgram(0);
+}
+
+void GEngine::Shader::InitParallelCompile() {
+  bool khr = glfwExtensionSupported("GL_KHR_parallel_shader_compile");
+  bool arb = !khr && glfwExtensionSupported("GL_ARB_parallel_shader_compile");
+  if (!khr && !arb) {
+    GE_INFO("Parallel shader compile not supported, programs finish on first use");
+    return;
+  }
+  // glad is generated without extensions, fetch the entry point directly
+  using PFNMaxShaderCompilerThreads = void (*)(GLuint);
+  auto max_threads = reinterpret_cast<PFNMaxShaderCompilerThreads>(
+      glfwGetProcAddress(khr ? "glMaxShaderCompilerThreadsKHR" : "glMaxShaderCompilerThreadsARB"));
+  if (max_threads) {
+    max_threads(0xFFFFFFFFu); // implementation-chosen thread count
+  }
+  parallel_compile_ = true;
+  GE_INFO("Parallel shader compile enabled ({0})", khr ? "KHR" : "ARB");
+}
+
+void GEngine::Shader::PollPendingPrograms() {
+  if (!parallel_compile_) {
+    return;
+  }
+  // Resolve() removes from the list, iterate over a copy
+  auto pending = pending_programs_;
+  for (const Shader *shader : pending) {
+    GLint completed = GL_FALSE;
+    glGetProgramiv(shader->shader_program_ID_, kCompletionStatus, &completed);
+    if (completed == GL_TRUE) {
+      shader->Resolve();
+    }
+  }
+}
+
+void GEngine::Shader::FinishPendingPrograms() {
+  auto pending = pending_programs_;
+  for (const Shader *shader : pending) {
+    shader->Resolve();
+  }
+}
+
 void GEngine::Shader::Use() const {
-  glUseProgram(shader_program_ID_);
+  Resolve();
+  CSingleton<CGLStateCache>()->UseProgram(shader_program_ID_);
   ActiveBoundTextures();
 }
 
 void GEngine::Shader::SetBool(const std::string &name, bool value) const {
-  glUniform1i(glGetUniformLocation(shader_program_ID_, name.c_str()), (int)value);
+  glUniform1i(GetUniformLocation(name), (int)value);
 }
 
 void GEngine::Shader::SetInt(const std::string &name, int value) const {
-  glUniform1i(glGetUniformLocation(shader_program_ID_, name.c_str()), value);
+  glUniform1i(GetUniformLocation(name), value);
 }
 
 void GEngine::Shader::SetFloat(const std::string &name, float value) const {
-  glUniform1f(glGetUniformLocation(shader_program_ID_, name.c_str()), value);
+  glUniform1f(GetUniformLocation(name), value);
 }
 
 void GEngine::Shader::SetVec2(const std::string &name,
                               const glm::vec2 &value) const {
-  glUniform2fv(glGetUniformLocation(shader_program_ID_, name.c_str()), 1, &value[0]);
+  glUniform2fv(GetUniformLocation(name), 1, &value[0]);
 }
 void GEngine::Shader::SetVec2(const std::string &name, float x, float y) const {
-  glUniform2f(glGetUniformLocation(shader_program_ID_, name.c_str()), x, y);
+  glUniform2f(GetUniformLocation(name), x, y);
 }
 
 void GEngine::Shader::SetVec3(const std::string &name,
                               const glm::vec3 &value) const {
-  glUniform3fv(glGetUniformLocation(shader_program_ID_, name.c_str()), 1, &value[0]);
+  glUniform3fv(GetUniformLocation(name), 1, &value[0]);
 }
 void GEngine::Shader::SetVec3(const std::string &name, float x, float y,
                               float z) const {
-  glUniform3f(glGetUniformLocation(shader_program_ID_, name.c_str()), x, y, z);
+  glUniform3f(GetUniformLocation(name), x, y, z);
 }
 
 void GEngine::Shader::SetVec4(const std::string &name,
                               const glm::vec4 &value) const {
-  glUniform4fv(glGetUniformLocation(shader_program_ID_, name.c_str()), 1, &value[0]);
+  glUniform4fv(GetUniformLocation(name), 1, &value[0]);
 }
 void GEngine::Shader::SetVec4(const std::string &name, float x, float y,
                               float z, float w) const {
-  glUniform4f(glGetUniformLocation(shader_program_ID_, name.c_str()), x, y, z, w);
+  glUniform4f(GetUniformLocation(name), x, y, z, w);
+}
+
+void GEngine::Shader::SetIVec3(const std::string &name,
+                               const glm::ivec3 &value) const {
+  glUniform3iv(GetUniformLocation(name), 1, &value[0]);
 }
 
 void GEngine::Shader::SetMat2(const std::string &name,
                               const glm::mat2 &mat) const {
-  glUniformMatrix2fv(glGetUniformLocation(shader_program_ID_, name.c_str()), 1, GL_FALSE,
+  glUniformMatrix2fv(GetUniformLocation(name), 1, GL_FALSE,
                      &mat[0][0]);
 }
 
 void GEngine::Shader::SetMat3(const std::string &name,
                               const glm::mat3 &mat) const {
-  glUniformMatrix3fv(glGetUniformLocation(shader_program_ID_, name.c_str()), 1, GL_FALSE,
+  glUniformMatrix3fv(GetUniformLocation(name), 1, GL_FALSE,
                      &mat[0][0]);
 }
 
 void GEngine::Shader::SetMat4(const std::string &name,
                               const glm::mat4 &mat) const {
-  glUniformMatrix4fv(glGetUniformLocation(shader_program_ID_, name.c_str()), 1, GL_FALSE,
+  glUniformMatrix4fv(GetUniformLocation(name), 1, GL_FALSE,
                      &mat[0][0]);
 }
 
 void GEngine::Shader::SetTexture(const std::string &name, const std::shared_ptr<GEngine::CTexture> texture) {
-  glUseProgram(shader_program_ID_);
+  Resolve();
+  CSingleton<CGLStateCache>()->UseProgram(shader_program_ID_);
   if (bound_textures_.find(name) != bound_textures_.end()) {
     // [name] already exists, overwrite with new texture
     auto &item = bound_textures_[name];
     std::get<1>(item) = texture;
-    glActiveTexture(GL_TEXTURE0 + std::get<0>(item));
-    glBindTexture(static_cast<GLuint>(texture->GetTarget()), texture->id_);
+    CSingleton<CGLStateCache>()->BindTextureUnit(std::get<0>(item), static_cast<GLenum>(texture->GetTarget()),
+                                                 texture->id_);
   } else {
     // register a new texture
     int binding_slot_index = bound_textures_num_;
-    glActiveTexture(GL_TEXTURE0 + binding_slot_index);
-    auto uniform_location = glGetUniformLocation(shader_program_ID_, name.c_str());
+    auto uniform_location = GetUniformLocation(name);
     glUniform1i(uniform_location, binding_slot_index);
-    glBindTexture(static_cast<GLenum>(texture->GetTarget()), texture->id_);
+    CSingleton<CGLStateCache>()->BindTextureUnit(binding_slot_index, static_cast<GLenum>(texture->GetTarget()),
+                                                 texture->id_);
     bound_textures_[name] = std::make_tuple(binding_slot_index, texture, uniform_location);
     bound_textures_num_++;
   }
 }
 
 unsigned int GEngine::Shader::GetShaderID() const {
+  Resolve();
   return shader_program_ID_;
 }
 
-void GEngine::Shader::CheckCompileErrors(GLuint shader, std::string type) {
+GLint GEngine::Shader::GetUniformLocation(const std::string &name) const {
+  Resolve();
+  return glGetUniformLocation(shader_program_ID_, name.c_str());
+}
+
+void GEngine::Shader::CheckCompileErrors(GLuint shader, std::string type, const SPreprocessedShader *source) {
   GLint success;
   GLchar infoLog[1024];
   if (type != "PROGRAM") {
     glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (!success) {
       glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+      // point at the file & line of the include, not the pasted source
       GE_ERROR("ERROR::SHADER_COMPILATION_ERROR of type: {0} \n{1}"
                "-------------------------------------------------------",
-               type, infoLog);
+               type, source ? CShaderPreprocessor::MapErrorLog(infoLog, *source) : std::string(infoLog));
     }
   } else {
     glGetProgramiv(shader, GL_LINK_STATUS, &success);
@@ -315,9 +422,10 @@ void GEngine::Shader::CheckCompileErrors(GLuint shader, std::string type) {
 }
 
 void GEngine::Shader::ActiveBoundTextures() const {
-  for (const auto item : bound_textures_) {
-    glActiveTexture(GL_TEXTURE0 + std::get<0>(item.second));
+  // units already holding the texture are skipped by the state cache
+  for (const auto &item : bound_textures_) {
     const auto &texture = std::get<1>(item.second);
-    glBindTexture(static_cast<GLenum>(texture->GetTarget()), texture->id_);
+    CSingleton<CGLStateCache>()->BindTextureUnit(std::get<0>(item.second), static_cast<GLenum>(texture->GetTarget()),
+                                                 texture->id_);
   }
 }
@@ -1,9 +1,14 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/program_cache.h"
+#include "GEngine/shader_preprocessor.h"
+#include "GEngine/singleton.h"
 #include "GEngine/texture.h"
 #include <vector>
 #include <tuple>
@@ -15,6 +20,7 @@ namespace GEngine {
 class Shader {
 public:
   Shader();
+  ~Shader();
   Shader(const std::string& vertex_shader_path,
           const std::string& fragment_shader_path,
           const std::string& geometry_shader_path = "");
@@ -28,6 +34,12 @@ public:
                         const std::string &fragment_shader_path,
                         const std::string &geometry_shader_path = "");
 
+  // stages are preprocessed (#include) and watched by CShaderHotReload,
+  // defines go right after #version
+  static std::shared_ptr<Shader>
+  CreateProgramFromFiles(const std::vector<SShaderStageFile> &stages,
+                         const std::vector<std::string> &defines = {});
+
   static std::shared_ptr<Shader>
   CreateAtmosphereProgram(const std::string &vertex_shader_path,
                           const std::string &fragment_shader_path,
@@ -42,6 +54,7 @@ public:
   void SetVec3(const std::string &name, const glm::vec3 &value) const;
   void SetVec3(const std::string &name, float x, float y, float z) const;
   void SetVec4(const std::string &name, const glm::vec4 &value) const;
+  void SetIVec3(const std::string &name, const glm::ivec3 &value) const;
   void SetVec4(const std::string &name, float x, float y, float z, float w) const;
   void SetMat2(const std::string &name, const glm::mat2 &mat) const;
   void SetMat3(const std::string &name, const glm::mat3 &mat) const;
@@ -49,10 +62,61 @@ public:
   void SetTexture(const std::string &name, const std::shared_ptr<GEngine::CTexture> texture);
 
   unsigned int GetShaderID() const;
+
+  // compile & link the stages, or restore the program from CProgramCache
+  static unsigned int BuildProgram(const std::vector<CProgramCache::SStageSource> &stages);
+
+  // Shader objects only submit their program, compile & link status are
+  // queried when the program is first used (Use, SetX, GetShaderID...). With
+  // KHR_parallel_shader_compile the driver builds them on its own threads and
+  // PollPendingPrograms() picks up the finished ones without blocking.
+  // FinishPendingPrograms() blocks on the rest, CApp calls it before the first frame.
+  static void InitParallelCompile();
+  static void PollPendingPrograms();
+  static void FinishPendingPrograms();
+  static size_t GetPendingProgramCount() { return pending_programs_.size(); }
+  bool IsPending() const { return pending_; }
+
+  // hot reload: build the new sources next to the running program, then
+  // PollReload() swaps them once finished (true when done, succeeded is false
+  // if the build failed and the old program is kept). Sampler units carry
+  // over, other uniforms must be set again
+  void Reload(std::vector<SPreprocessedShader> sources);
+  bool PollReload(bool &succeeded);
+
 private:
-  static void CheckCompileErrors(GLuint shader, std::string type);
+  static constexpr GLenum kCompletionStatus = 0x91B1; // GL_COMPLETION_STATUS_KHR
+
+  static void CheckCompileErrors(GLuint shader, std::string type, const SPreprocessedShader *source = nullptr);
+  static unsigned int SubmitProgram(const std::vector<CProgramCache::SStageSource> &stages,
+                                    std::vector<unsigned int> &shaders, uint64_t &cache_key, bool &from_cache);
+  // false if the link failed, the logs are mapped through sources if given
+  static bool FinishProgram(unsigned int program, std::vector<unsigned int> &shaders, uint64_t cache_key,
+                            const std::vector<SPreprocessedShader> *sources = nullptr);
+  void Submit(const std::vector<CProgramCache::SStageSource> &stages);
+  void LoadFromFiles(const std::vector<SShaderStageFile> &stages, const std::vector<std::string> &defines);
+  std::vector<CProgramCache::SStageSource> GetStageSources(const std::vector<SPreprocessedShader> &sources) const;
+  void SwapProgram(unsigned int program);
+  void Resolve() const;
+  GLint GetUniformLocation(const std::string &name) const;
   void ActiveBoundTextures() const;
 
+  // in-flight build, finished by Resolve()
+  mutable std::vector<unsigned int> pending_shaders_;
+  mutable uint64_t pending_cache_key_ = 0;
+  mutable bool pending_ = false;
+  static std::vector<const Shader *> pending_programs_;
+  static bool parallel_compile_;
+
+  // files the program was loaded from, empty for in-memory sources
+  std::vector<SShaderStageFile> stage_files_;
+  std::vector<SPreprocessedShader> sources_;
+  // hot reload build in flight
+  unsigned int reload_program_ = 0;
+  std::vector<unsigned int> reload_shaders_;
+  uint64_t reload_cache_key_ = 0;
+  std::vector<SPreprocessedShader> reload_sources_;
+
   unsigned int shader_program_ID_ = 0;
   // number of textures bound to specific shader instance
   int bound_textures_num_ = 0; 
@@ -70,99 +134,78 @@ class Program {
   Program(const std::string& vertex_shader_source,
           const std::string& geometry_shader_source,
           const std::string& fragment_shader_source) {
-    program_ = glCreateProgram();
-
-    const char* source;
-    source = vertex_shader_source.c_str();
-    GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex_shader, 1, &source, NULL);
-    glCompileShader(vertex_shader);
-    CheckShader(vertex_shader);
-    glAttachShader(program_, vertex_shader);
-
-    GLuint geometry_shader = 0;
+    std::vector<CProgramCache::SStageSource> stages = {{GL_VERTEX_SHADER, &vertex_shader_source}};
     if (!geometry_shader_source.empty()) {
-      source = geometry_shader_source.c_str();
-      geometry_shader = glCreateShader(GL_GEOMETRY_SHADER);
-      glShaderSource(geometry_shader, 1, &source, NULL);
-      glCompileShader(geometry_shader);
-      CheckShader(geometry_shader);
-      glAttachShader(program_, geometry_shader);
+      stages.push_back({GL_GEOMETRY_SHADER, &geometry_shader_source});
     }
-
-    source = fragment_shader_source.c_str();
-    GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment_shader, 1, &source, NULL);
-    glCompileShader(fragment_shader);
-    CheckShader(fragment_shader);
-    glAttachShader(program_, fragment_shader);
-
-    glLinkProgram(program_);
+    stages.push_back({GL_FRAGMENT_SHADER, &fragment_shader_source});
+    program_ = Shader::BuildProgram(stages);
     CheckProgram(program_);
+  }
 
-    glDetachShader(program_, vertex_shader);
-    glDeleteShader(vertex_shader);
-    if (!geometry_shader_source.empty()) {
-      glDetachShader(program_, geometry_shader);
-      glDeleteShader(geometry_shader);
-    }
-    glDetachShader(program_, fragment_shader);
-    glDeleteShader(fragment_shader);
+  // a compute program (GL 4.3 contexts only)
+  explicit Program(const std::string& compute_shader_source) {
+    program_ = Shader::BuildProgram({{GL_COMPUTE_SHADER, &compute_shader_source}});
+    CheckProgram(program_);
   }
 
   ~Program() {
+    CSingleton<CGLStateCache>()->OnProgramDeleted(program_);
     glDeleteProgram(program_);
   }
 
   void Use() const {
-    glUseProgram(program_);
+    CSingleton<CGLStateCache>()->UseProgram(program_);
   }
 
+  GLuint GetProgram() const { return program_; }
+
   void BindMat3(const std::string& uniform_name,
       const std::array<float, 9>& value) const {
     glUniformMatrix3fv(glGetUniformLocation(program_, uniform_name.c_str()),
         1, true /* transpose */, value.data());
   }
 
+  void BindMat3(const std::string& uniform_name, const glm::mat3& value) const {
+    glUniformMatrix3fv(glGetUniformLocation(program_, uniform_name.c_str()), 1, false, glm::value_ptr(value));
+  }
+
+  void BindMat4(const std::string& uniform_name, const glm::mat4& value) const {
+    glUniformMatrix4fv(glGetUniformLocation(program_, uniform_name.c_str()), 1, false, glm::value_ptr(value));
+  }
+
+  void BindVec3(const std::string& uniform_name, const glm::vec3& value) const {
+    glUniform3fv(glGetUniformLocation(program_, uniform_name.c_str()), 1, glm::value_ptr(value));
+  }
+
+  void BindFloat(const std::string& uniform_name, float value) const {
+    glUniform1f(glGetUniformLocation(program_, uniform_name.c_str()), value);
+  }
+
   void BindInt(const std::string& uniform_name, int value) const {
     glUniform1i(glGetUniformLocation(program_, uniform_name.c_str()), value);
   }
 
   void BindTexture2d(const std::string& sampler_uniform_name, GLuint texture,
       GLuint texture_unit) const {
-    glActiveTexture(GL_TEXTURE0 + texture_unit);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    CSingleton<CGLStateCache>()->BindTextureUnit(texture_unit, GL_TEXTURE_2D, texture);
     BindInt(sampler_uniform_name, texture_unit);
   }
 
   void BindTexture3d(const std::string& sampler_uniform_name, GLuint texture,
       GLuint texture_unit) const {
-    glActiveTexture(GL_TEXTURE0 + texture_unit);
-    glBindTexture(GL_TEXTURE_3D, texture);
+    CSingleton<CGLStateCache>()->BindTextureUnit(texture_unit, GL_TEXTURE_3D, texture);
     BindInt(sampler_uniform_name, texture_unit);
   }
 
- private:
-  static void CheckShader(GLuint shader) {
-    GLint compile_status;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
-    if (compile_status == GL_FALSE) {
-      PrintShaderLog(shader);
-    }
-    assert(compile_status == GL_TRUE);
-  }
-
-  static void PrintShaderLog(GLuint shader) {
-    GLint log_length;
-    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_length);
-    if (log_length > 0) {
-      std::unique_ptr<char[]> log_data(new char[log_length]);
-      glGetShaderInfoLog(shader, log_length, &log_length, log_data.get());
-      std::cerr << "compile log = "
-                << std::string(log_data.get(), log_length) << std::endl;
-    }
+  // all layers of level 0, read & write
+  void BindImage(const std::string& image_uniform_name, GLuint texture,
+      GLuint image_unit, GLenum format) const {
+    glBindImageTexture(image_unit, texture, 0, GL_TRUE /* layered */, 0, GL_READ_WRITE, format);
+    BindInt(image_uniform_name, image_unit);
   }
 
+ private:
   static void CheckProgram(GLuint program) {
     GLint link_status;
     glGetProgramiv(program, GL_LINK_STATUS, &link_status);
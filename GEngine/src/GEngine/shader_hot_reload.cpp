@@ -0,0 +1,271 @@
+#include "GEngine/shader_hot_reload.h"
+#include "GEngine/log.h"
+#include "GEngine/shader.h"
+#include <algorithm>
+#include <chrono>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+bool GEngine::CShaderHotReload::shut_down_ = false;
+
+GEngine::CShaderHotReload::CShaderHotReload() {}
+
+GEngine::CShaderHotReload::~CShaderHotReload() {
+  Stop();
+  // shaders owned by other singletons may outlive this one
+  shut_down_ = true;
+}
+
+void GEngine::CShaderHotReload::Start() {
+  if (running_) {
+    return;
+  }
+#ifdef __linux__
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd_ < 0) {
+    GE_WARN("inotify_init1 failed, shader hot reload disabled");
+    return;
+  }
+#endif
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &[file, shaders] : dependents_) {
+      WatchDirectory(std::filesystem::path(file).parent_path().string());
+    }
+  }
+  running_ = true;
+  watcher_ = std::thread(&CShaderHotReload::WatchLoop, this);
+  GE_INFO("Shader hot reload watching {0} files", GetWatchedFileCount());
+}
+
+void GEngine::CShaderHotReload::Stop() {
+  if (!running_) {
+    return;
+  }
+  running_ = false;
+  watcher_.join();
+#ifdef __linux__
+  close(inotify_fd_);
+  inotify_fd_ = -1;
+#endif
+  watch_descriptors_.clear();
+  write_times_.clear();
+}
+
+void GEngine::CShaderHotReload::Register(Shader *shader, const std::vector<SShaderStageFile> &stages,
+                                         const std::vector<std::string> &defines,
+                                         const std::vector<std::string> &files) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &recipe = recipes_[shader];
+  recipe.id_ = next_id_++;
+  recipe.stages_ = stages;
+  recipe.defines_ = defines;
+  SetDependencies(shader, recipe, files);
+}
+
+void GEngine::CShaderHotReload::Unregister(Shader *shader) {
+  if (shut_down_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = recipes_.find(shader);
+  if (it == recipes_.end()) {
+    return;
+  }
+  SetDependencies(shader, it->second, {});
+  recipes_.erase(it);
+  ready_.erase(shader);
+  reloading_.erase(std::remove(reloading_.begin(), reloading_.end(), shader), reloading_.end());
+}
+
+void GEngine::CShaderHotReload::SetDependencies(Shader *shader, SProgramRecipe &recipe,
+                                                const std::vector<std::string> &files) {
+  for (const auto &file : recipe.files_) {
+    auto it = dependents_.find(file);
+    if (it != dependents_.end()) {
+      it->second.erase(shader);
+      if (it->second.empty()) {
+        dependents_.erase(it);
+      }
+    }
+  }
+  recipe.files_ = files;
+  for (const auto &file : files) {
+    dependents_[file].insert(shader);
+    if (running_) {
+      WatchDirectory(std::filesystem::path(file).parent_path().string());
+    }
+  }
+}
+
+void GEngine::CShaderHotReload::WatchDirectory(const std::string &directory) {
+#ifdef __linux__
+  for (const auto &[descriptor, watched] : watch_descriptors_) {
+    if (watched == directory) {
+      return;
+    }
+  }
+  // editors either rewrite the file or rename a temporary over it
+  int descriptor = inotify_add_watch(inotify_fd_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+  if (descriptor < 0) {
+    GE_WARN("Failed to watch shader directory {0}", directory);
+    return;
+  }
+  watch_descriptors_[descriptor] = directory;
+#endif
+}
+
+size_t GEngine::CShaderHotReload::GetWatchedFileCount() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return dependents_.size();
+}
+
+void GEngine::CShaderHotReload::WatchLoop() {
+  while (running_) {
+    auto changed = WaitForChanges();
+    if (changed.empty()) {
+      continue;
+    }
+    // a save is often several writes, let them settle
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    auto more = WaitForChanges();
+    changed.insert(more.begin(), more.end());
+    RebuildAffected(changed);
+  }
+}
+
+std::set<std::string> GEngine::CShaderHotReload::WaitForChanges() {
+  std::set<std::string> changed;
+#ifdef __linux__
+  pollfd descriptor = {inotify_fd_, POLLIN, 0};
+  if (poll(&descriptor, 1, 100) <= 0) {
+    return changed;
+  }
+  alignas(inotify_event) char buffer[4096];
+  ssize_t length;
+  while ((length = read(inotify_fd_, buffer, sizeof(buffer))) > 0) {
+    for (char *ptr = buffer; ptr < buffer + length;) {
+      auto *event = reinterpret_cast<inotify_event *>(ptr);
+      if (event->len > 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = watch_descriptors_.find(event->wd);
+        if (it != watch_descriptors_.end()) {
+          changed.insert(CShaderPreprocessor::NormalizePath(it->second + "/" + event->name));
+        }
+      }
+      ptr += sizeof(inotify_event) + event->len;
+    }
+  }
+#else
+  // no inotify (macOS), compare modification times a few times per second
+  std::this_thread::sleep_for(std::chrono::milliseconds(250));
+  std::vector<std::string> files;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &[file, shaders] : dependents_) {
+      files.push_back(file);
+    }
+  }
+  for (const auto &file : files) {
+    std::error_code error;
+    auto time = std::filesystem::last_write_time(file, error);
+    if (error) {
+      continue;
+    }
+    auto it = write_times_.find(file);
+    if (it == write_times_.end()) {
+      write_times_[file] = time;
+    } else if (it->second != time) {
+      it->second = time;
+      changed.insert(file);
+    }
+  }
+#endif
+  return changed;
+}
+
+void GEngine::CShaderHotReload::RebuildAffected(const std::set<std::string> &changed) {
+  std::vector<std::pair<Shader *, SProgramRecipe>> affected;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::set<Shader *> shaders;
+    for (const auto &file : changed) {
+      auto it = dependents_.find(file);
+      if (it != dependents_.end()) {
+        shaders.insert(it->second.begin(), it->second.end());
+      }
+    }
+    for (Shader *shader : shaders) {
+      affected.push_back({shader, recipes_[shader]});
+    }
+  }
+  if (affected.empty()) {
+    return;
+  }
+  GE_INFO("Shader hot reload: {0} file(s) changed, rebuilding {1} program(s)", changed.size(), affected.size());
+
+  // file io & include expansion stay on this thread, only the GL calls
+  // are left for Tick()
+  for (auto &[shader, recipe] : affected) {
+    SReloadRequest request;
+    request.id_ = recipe.id_;
+    bool ok = true;
+    for (const auto &stage : recipe.stages_) {
+      auto source = CShaderPreprocessor::ProcessFile(stage.path_);
+      CShaderPreprocessor::InjectDefines(source, recipe.defines_);
+      ok = ok && source.ok_;
+      for (const auto &file : source.files_) {
+        if (std::find(request.files_.begin(), request.files_.end(), file) == request.files_.end()) {
+          request.files_.push_back(file);
+        }
+      }
+      request.sources_.push_back(std::move(source));
+    }
+    if (!ok) {
+      GE_WARN("Shader hot reload: keeping the previous program of {0}", recipe.stages_.front().path_);
+      failed_reload_count_++;
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = recipes_.find(shader);
+    if (it != recipes_.end() && it->second.id_ == request.id_) {
+      ready_[shader] = std::move(request);
+    }
+  }
+}
+
+void GEngine::CShaderHotReload::Tick() {
+  std::map<Shader *, SReloadRequest> ready;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ready.swap(ready_);
+    for (auto &[shader, request] : ready) {
+      // includes may have been added or removed
+      SetDependencies(shader, recipes_[shader], request.files_);
+    }
+  }
+  for (auto &[shader, request] : ready) {
+    shader->Reload(std::move(request.sources_));
+    if (std::find(reloading_.begin(), reloading_.end(), shader) == reloading_.end()) {
+      reloading_.push_back(shader);
+    }
+  }
+
+  // swap the programs the driver has finished
+  for (size_t i = 0; i < reloading_.size();) {
+    bool succeeded = false;
+    if (!reloading_[i]->PollReload(succeeded)) {
+      i++;
+      continue;
+    }
+    if (succeeded) {
+      reload_count_++;
+    } else {
+      failed_reload_count_++;
+    }
+    reloading_.erase(reloading_.begin() + i);
+  }
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "GEngine/shader_preprocessor.h"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace GEngine {
+class Shader;
+
+// be sure to call CShaderHotReload method with CSingleton<CShaderHotReload>()->func();
+// watches the files of every Shader loaded from disk (includes too) and
+// rebuilds the programs depending on a changed file. A watcher thread (inotify
+// on linux, mtime polling elsewhere) re-reads and preprocesses the sources,
+// Tick() submits them at the start of a frame and swaps each program once the
+// driver finished it, a program that fails to build keeps the previous one.
+class CShaderHotReload {
+public:
+  CShaderHotReload();
+  ~CShaderHotReload();
+
+  void Start();
+  void Stop();
+  bool IsRunning() const { return running_; }
+
+  // called by Shader, files are the stage files plus their includes
+  void Register(Shader *shader, const std::vector<SShaderStageFile> &stages, const std::vector<std::string> &defines,
+                const std::vector<std::string> &files);
+  void Unregister(Shader *shader);
+
+  // main thread, between two frames
+  void Tick();
+
+  size_t GetWatchedFileCount();
+  unsigned int GetReloadCount() const { return reload_count_; }
+  unsigned int GetFailedReloadCount() const { return failed_reload_count_; }
+  size_t GetReloadingCount() const { return reloading_.size(); }
+
+private:
+  struct SProgramRecipe {
+    uint64_t id_ = 0;
+    std::vector<SShaderStageFile> stages_;
+    std::vector<std::string> defines_;
+    std::vector<std::string> files_;
+  };
+  struct SReloadRequest {
+    uint64_t id_ = 0;
+    std::vector<SPreprocessedShader> sources_;
+    std::vector<std::string> files_;
+  };
+
+  void WatchLoop();
+  std::set<std::string> WaitForChanges();
+  void RebuildAffected(const std::set<std::string> &changed);
+  // mutex_ held
+  void SetDependencies(Shader *shader, SProgramRecipe &recipe, const std::vector<std::string> &files);
+  void WatchDirectory(const std::string &directory);
+
+  // file -> programs, the dependency graph
+  std::map<std::string, std::set<Shader *>> dependents_;
+  std::map<Shader *, SProgramRecipe> recipes_;
+  // preprocessed by the watcher, waiting for Tick()
+  std::map<Shader *, SReloadRequest> ready_;
+  std::vector<Shader *> reloading_;
+  uint64_t next_id_ = 1;
+  std::mutex mutex_;
+
+  std::thread watcher_;
+  std::atomic<bool> running_ = false;
+  int inotify_fd_ = -1;
+  std::map<int, std::string> watch_descriptors_;
+  std::map<std::string, std::filesystem::file_time_type> write_times_;
+
+  unsigned int reload_count_ = 0;
+  std::atomic<unsigned int> failed_reload_count_ = 0;
+  static bool shut_down_;
+};
+} // namespace GEngine
@@ -0,0 +1,167 @@
+#include "GEngine/shader_preprocessor.h"
+#include "GEngine/log.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <regex>
+#include <set>
+#include <sstream>
+
+namespace {
+constexpr int kMaxIncludeDepth = 32;
+
+bool ReadFile(const std::string &path, std::string &content) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  std::stringstream stream;
+  stream << file.rdbuf();
+  content = stream.str();
+  return true;
+}
+
+// `#include "a.glsl"` -> a.glsl, false if the line is not an include
+bool ParseInclude(const std::string &line, std::string &name, bool &malformed) {
+  size_t pos = line.find_first_not_of(" \t");
+  if (pos == std::string::npos || line.compare(pos, 8, "#include") != 0) {
+    return false;
+  }
+  size_t open = line.find_first_of("\"<", pos + 8);
+  size_t close = open == std::string::npos ? std::string::npos
+                                           : line.find(line[open] == '"' ? '"' : '>', open + 1);
+  malformed = close == std::string::npos;
+  if (!malformed) {
+    name = line.substr(open + 1, close - open - 1);
+  }
+  return true;
+}
+
+bool IsPragmaOnce(const std::string &line) {
+  size_t pos = line.find_first_not_of(" \t");
+  return pos != std::string::npos && line.compare(pos, 7, "#pragma") == 0 &&
+         line.find("once", pos + 7) != std::string::npos;
+}
+
+void Expand(const std::string &text, int file_index, const std::filesystem::path &directory,
+            GEngine::SPreprocessedShader &out, std::set<std::string> &included, int depth) {
+  std::istringstream stream(text);
+  std::string line;
+  int line_number = 0;
+  while (std::getline(stream, line)) {
+    line_number++;
+    std::string name;
+    bool malformed = false;
+    if (IsPragmaOnce(line)) {
+      // implied for every file, keep the line count
+      line.clear();
+    } else if (ParseInclude(line, name, malformed)) {
+      line.clear();
+      if (malformed) {
+        GE_ERROR("{0}:{1}: malformed #include", out.files_[file_index], line_number);
+        out.ok_ = false;
+      } else if (depth >= kMaxIncludeDepth) {
+        GE_ERROR("{0}:{1}: #include nested too deeply", out.files_[file_index], line_number);
+        out.ok_ = false;
+      } else {
+        std::string resolved = GEngine::CShaderPreprocessor::NormalizePath((directory / name).string());
+        if (included.insert(resolved).second) {
+          std::string content;
+          if (!ReadFile(resolved, content)) {
+            GE_ERROR("{0}:{1}: cannot open include \"{2}\"", out.files_[file_index], line_number, name);
+            out.ok_ = false;
+          } else {
+            out.files_.push_back(resolved);
+            Expand(content, static_cast<int>(out.files_.size()) - 1,
+                   std::filesystem::path(resolved).parent_path(), out, included, depth + 1);
+            continue;
+          }
+        }
+      }
+    }
+    out.source_ += line;
+    out.source_ += '\n';
+    out.lines_.push_back({file_index, line_number});
+  }
+}
+} // namespace
+
+std::string GEngine::CShaderPreprocessor::NormalizePath(const std::string &path) {
+  std::error_code error;
+  auto canonical = std::filesystem::weakly_canonical(path, error);
+  if (error) {
+    return std::filesystem::path(path).lexically_normal().string();
+  }
+  return canonical.string();
+}
+
+GEngine::SPreprocessedShader GEngine::CShaderPreprocessor::ProcessFile(const std::string &path) {
+  SPreprocessedShader result;
+  std::string content;
+  if (!ReadFile(path, content)) {
+    GE_ERROR("ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: {0}", path);
+    result.files_.push_back(NormalizePath(path));
+    result.ok_ = false;
+    return result;
+  }
+  std::string root = NormalizePath(path);
+  result.files_.push_back(root);
+  std::set<std::string> included = {root};
+  Expand(content, 0, std::filesystem::path(root).parent_path(), result, included, 0);
+  return result;
+}
+
+GEngine::SPreprocessedShader GEngine::CShaderPreprocessor::ProcessSource(const std::string &source,
+                                                                         const std::string &directory,
+                                                                         const std::string &name) {
+  SPreprocessedShader result;
+  result.files_.push_back(name);
+  std::set<std::string> included;
+  Expand(source, 0, std::filesystem::path(directory), result, included, 0);
+  return result;
+}
+
+void GEngine::CShaderPreprocessor::InjectDefines(SPreprocessedShader &shader, const std::vector<std::string> &defines) {
+  if (defines.empty()) {
+    return;
+  }
+  std::string block;
+  for (const auto &define : defines) {
+    block += "#define " + define + "\n";
+  }
+  // #version has to stay the first statement
+  size_t insert_at = 0;
+  size_t insert_line = 0;
+  size_t version = shader.source_.find("#version");
+  if (version != std::string::npos) {
+    size_t line_end = shader.source_.find('\n', version);
+    insert_at = line_end == std::string::npos ? shader.source_.size() : line_end + 1;
+    insert_line = std::count(shader.source_.begin(), shader.source_.begin() + insert_at, '\n');
+  }
+  shader.source_.insert(insert_at, block);
+  shader.lines_.insert(shader.lines_.begin() + std::min(insert_line, shader.lines_.size()), defines.size(),
+                       std::make_pair(-1, 0));
+}
+
+std::string GEngine::CShaderPreprocessor::MapErrorLog(const std::string &log, const SPreprocessedShader &shader) {
+  // every stage is a single source string, drivers print it as
+  // "0:123(4): error" (mesa), "ERROR: 0:123:" (apple, amd) or "0(123) :" (nvidia)
+  static const std::regex kLocation(R"((^|[^\d.])0(?::|\()(\d+)\)?)");
+  std::string result;
+  auto begin = std::sregex_iterator(log.begin(), log.end(), kLocation);
+  size_t last = 0;
+  for (auto it = begin; it != std::sregex_iterator(); ++it) {
+    const auto &match = *it;
+    size_t line = std::stoul(match[2].str());
+    result += log.substr(last, match.position(0) - last) + match[1].str();
+    if (line >= 1 && line <= shader.lines_.size()) {
+      auto [file, file_line] = shader.lines_[line - 1];
+      result += file < 0 ? "<generated>" : shader.files_[file] + ":" + std::to_string(file_line);
+    } else {
+      result += match.str(0).substr(match[1].length());
+    }
+    last = match.position(0) + match.length(0);
+  }
+  result += log.substr(last);
+  return result;
+}
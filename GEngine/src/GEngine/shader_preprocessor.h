@@ -0,0 +1,39 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace GEngine {
+struct SShaderStageFile {
+  GLenum stage_;
+  std::string path_;
+};
+
+// one stage after #include expansion, lines_[i] tells where line i + 1 of
+// source_ came from ({index into files_, line}, file -1 for generated lines)
+struct SPreprocessedShader {
+  std::string source_;
+  std::vector<std::string> files_; // [0] is the root, then every include
+  std::vector<std::pair<int, int>> lines_;
+  bool ok_ = true;
+};
+
+// resolves #include "file" relative to the including file. Each file is
+// pasted once per stage (as if it had #pragma once), so shared GLSL can be
+// included from several headers. Compile logs are mapped back through the
+// line table, "0:123" becomes "../../shaders/brdf.glsl:17".
+class CShaderPreprocessor {
+public:
+  static SPreprocessedShader ProcessFile(const std::string &path);
+  // in-memory source, includes are searched in directory
+  static SPreprocessedShader ProcessSource(const std::string &source, const std::string &directory,
+                                           const std::string &name = "<source>");
+
+  // #define lines right after #version, marked as generated in the line table
+  static void InjectDefines(SPreprocessedShader &shader, const std::vector<std::string> &defines);
+  static std::string MapErrorLog(const std::string &log, const SPreprocessedShader &shader);
+
+  static std::string NormalizePath(const std::string &path);
+};
+} // namespace GEngine
@@ -0,0 +1,36 @@
+#include "GEngine/shader_variants.h"
+#include "GEngine/log.h"
+#include "GEngine/material.h"
+
+GEngine::CShaderVariants::CShaderVariants(const std::string &vertex_shader_path,
+                                          const std::string &fragment_shader_path)
+    : vertex_shader_path_(vertex_shader_path),
+      fragment_shader_path_(fragment_shader_path),
+      feature_defines_(MaterialFeatureDefines()) {}
+
+GEngine::CShaderVariants::~CShaderVariants() {}
+
+std::vector<std::pair<uint32_t, std::string>> GEngine::CShaderVariants::MaterialFeatureDefines() {
+  return {{kMaterialFeatureBaseColorTexture, "HAS_BASE_COLOR_TEXTURE"},
+          {kMaterialFeatureNormalTexture, "HAS_NORMAL_TEXTURE"},
+          {kMaterialFeatureMetallicRoughnessTexture, "HAS_METALLIC_ROUGHNESS_TEXTURE"},
+          {kMaterialFeatureAOTexture, "HAS_AO_TEXTURE"},
+          {kMaterialFeatureAlphaTest, "ALPHA_TEST"}};
+}
+
+std::shared_ptr<GEngine::Shader> GEngine::CShaderVariants::GetVariant(uint32_t feature_mask) {
+  auto it = variants_.find(feature_mask);
+  if (it != variants_.end()) {
+    return it->second;
+  }
+  std::vector<std::string> defines;
+  for (const auto &[bit, define] : feature_defines_) {
+    if (feature_mask & bit) {
+      defines.push_back(define);
+    }
+  }
+  auto variant = Shader::CreateProgramFromFiles(
+      {{GL_VERTEX_SHADER, vertex_shader_path_}, {GL_FRAGMENT_SHADER, fragment_shader_path_}}, defines);
+  variants_[feature_mask] = variant;
+  return variant;
+}
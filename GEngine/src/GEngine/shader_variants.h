@@ -0,0 +1,33 @@
+#pragma once
+#include "GEngine/shader.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace GEngine {
+// #define permutations of one vertex/fragment pair. Every bit of the feature
+// mask maps to a define, e.g. kMaterialFeatureNormalTexture -> HAS_NORMAL_TEXTURE,
+// inserted right after the #version line. Variants are compiled on first
+// request and kept, the program binary cache covers them as the defines are
+// part of the source, CShaderHotReload rebuilds every variant of a changed file.
+class CShaderVariants {
+public:
+  CShaderVariants(const std::string &vertex_shader_path, const std::string &fragment_shader_path);
+  ~CShaderVariants();
+
+  // defines of the material features (EMaterialFeature)
+  static std::vector<std::pair<uint32_t, std::string>> MaterialFeatureDefines();
+
+  void SetFeatureDefines(const std::vector<std::pair<uint32_t, std::string>> &defines) { feature_defines_ = defines; }
+  std::shared_ptr<Shader> GetVariant(uint32_t feature_mask);
+  const std::map<uint32_t, std::shared_ptr<Shader>> &GetVariants() const { return variants_; }
+
+private:
+  std::string vertex_shader_path_;
+  std::string fragment_shader_path_;
+  std::vector<std::pair<uint32_t, std::string>> feature_defines_;
+  std::map<uint32_t, std::shared_ptr<Shader>> variants_;
+};
+} // namespace GEngine
@@ -0,0 +1,93 @@
+#include "GEngine/spherical_harmonics.h"
+#include "GEngine/job_system.h"
+#include "GEngine/singleton.h"
+#include <cmath>
+#include <mutex>
+
+namespace {
+constexpr float kPi = 3.14159265358979f;
+// Y_lm = basis constant * polynomial
+constexpr float kBasis[9] = {0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f,
+                             1.092548f, 0.315392f, 1.092548f, 0.546274f};
+// the cosine lobe convolution of band l
+constexpr float kBand[9] = {kPi,        2.0f * kPi / 3.0f, 2.0f * kPi / 3.0f, 2.0f * kPi / 3.0f, kPi / 4.0f,
+                            kPi / 4.0f, kPi / 4.0f,        kPi / 4.0f,        kPi / 4.0f};
+
+// solid angle of the face region from (0, 0) to (x, y)
+float AreaElement(float x, float y) {
+  return std::atan2(x * y, std::sqrt(x * x + y * y + 1.0f));
+}
+} // namespace
+
+float GEngine::CSphericalHarmonics::GetCoefficientScale(int index) {
+  return kBand[index] * kBasis[index] * kBasis[index];
+}
+
+std::array<float, 9> GEngine::CSphericalHarmonics::EvaluatePolynomials(const glm::vec3 &d) {
+  return {1.0f,        d.y,         d.z,
+          d.x,         d.x * d.y,   d.y * d.z,
+          3.0f * d.z * d.z - 1.0f, d.x * d.z, d.x * d.x - d.y * d.y};
+}
+
+glm::vec3 GEngine::CSphericalHarmonics::CubemapDirection(int face, float sc, float tc) {
+  switch (face) {
+  case 0: return glm::vec3(1.0f, -tc, -sc);
+  case 1: return glm::vec3(-1.0f, -tc, sc);
+  case 2: return glm::vec3(sc, 1.0f, tc);
+  case 3: return glm::vec3(sc, -1.0f, -tc);
+  case 4: return glm::vec3(sc, -tc, 1.0f);
+  default: return glm::vec3(-sc, -tc, -1.0f);
+  }
+}
+
+float GEngine::CSphericalHarmonics::TexelSolidAngle(int x, int y, int size) {
+  float texel = 2.0f / static_cast<float>(size);
+  float x0 = -1.0f + x * texel;
+  float y0 = -1.0f + y * texel;
+  float x1 = x0 + texel;
+  float y1 = y0 + texel;
+  return AreaElement(x0, y0) - AreaElement(x0, y1) - AreaElement(x1, y0) + AreaElement(x1, y1);
+}
+
+GEngine::SIrradianceSH GEngine::CSphericalHarmonics::ProjectCubemap(const std::array<const float *, 6> &faces,
+                                                                      int size, int channels) {
+  std::array<glm::dvec3, 9> sums{};
+  std::mutex mutex;
+  unsigned int rows = static_cast<unsigned int>(6 * size);
+  CSingleton<CJobSystem>()->ParallelFor(rows, 16, [&](unsigned int begin, unsigned int end) {
+    std::array<glm::dvec3, 9> local{};
+    for (unsigned int row = begin; row < end; row++) {
+      int face = static_cast<int>(row) / size;
+      int y = static_cast<int>(row) % size;
+      const float *texels = faces[face] + static_cast<size_t>(y) * size * channels;
+      float tc = -1.0f + (y + 0.5f) * 2.0f / size;
+      for (int x = 0; x < size; x++, texels += channels) {
+        float sc = -1.0f + (x + 0.5f) * 2.0f / size;
+        glm::vec3 direction = glm::normalize(CubemapDirection(face, sc, tc));
+        glm::dvec3 radiance = glm::dvec3(texels[0], texels[1], texels[2]) * double(TexelSolidAngle(x, y, size));
+        std::array<float, 9> polynomials = EvaluatePolynomials(direction);
+        for (int i = 0; i < 9; i++) {
+          local[i] += radiance * double(polynomials[i]);
+        }
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int i = 0; i < 9; i++) {
+      sums[i] += local[i];
+    }
+  });
+  SIrradianceSH sh;
+  for (int i = 0; i < 9; i++) {
+    sh.coefficients_[i] = glm::vec3(sums[i]) * GetCoefficientScale(i);
+  }
+  return sh;
+}
+
+glm::vec3 GEngine::CSphericalHarmonics::EvaluateIrradiance(const SIrradianceSH &sh, const glm::vec3 &normal) {
+  std::array<float, 9> polynomials = EvaluatePolynomials(normal);
+  glm::vec3 irradiance(0.0f);
+  for (int i = 0; i < 9; i++) {
+    irradiance += sh.coefficients_[i] * polynomials[i];
+  }
+  return irradiance;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <array>
+
+namespace GEngine {
+// irradiance of an environment as 9 SH coefficients (bands 0-2, Ramamoorthi &
+// Hanrahan 2001), premultiplied by the cosine lobe convolution and the basis
+// constants: E(n) = c0 + c1 y + c2 z + c3 x + c4 xy + c5 yz + c6 (3z^2 - 1)
+//                 + c7 xz + c8 (x^2 - y^2)
+// like EvaluateIrradianceSH in shaders/irradiance_sh.glsl. Registered as
+// "irradiance_sh" by CIBLPass
+struct SIrradianceSH {
+  std::array<glm::vec3, 9> coefficients_{};
+};
+
+class CSphericalHarmonics {
+public:
+  // the convolution and basis constant of coefficient i, times the sum of
+  // radiance * polynomial i * solid angle
+  static float GetCoefficientScale(int index);
+  // the polynomials of E(n) above
+  static std::array<float, 9> EvaluatePolynomials(const glm::vec3 &direction);
+
+  // faces in the GL order (+x, -x, +y, -y, +z, -z), size^2 texels each with
+  // the rows from tc = -1 like glGetTexImage, channels floats per texel (rgb
+  // first). The rows are spread over the CJobSystem workers
+  static SIrradianceSH ProjectCubemap(const std::array<const float *, 6> &faces, int size, int channels);
+  static glm::vec3 EvaluateIrradiance(const SIrradianceSH &sh, const glm::vec3 &normal);
+
+  // the direction of (sc, tc) in [-1, 1]^2 on a face, not normalized
+  static glm::vec3 CubemapDirection(int face, float sc, float tc);
+  // solid angle of texel (x, y) of a size^2 face
+  static float TexelSolidAngle(int x, int y, int size);
+};
+} // namespace GEngine
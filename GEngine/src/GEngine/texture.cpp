@@ -1,5 +1,11 @@
 #include "GEngine/texture.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/singleton.h"
 #include "GEngine/log.h"
+#include "GEngine/mip_generator.h"
+#include "GEngine/texture_cooker.h"
+#include "GEngine/texture_upload_queue.h"
+#include <algorithm>
 #include <stb/stb_image.h>
 
 GEngine::CSampler::CSampler() {}
@@ -25,10 +31,30 @@ GEngine::CTexture::CTexture(ETarget target) : target_(target), owner_(true) {
   glGenTextures(1, &id_);
 }
 
-GEngine::CTexture::CTexture(std::string &path, ETarget target, bool need_flip, std::shared_ptr<CSampler> sampler) {
+GEngine::CTexture::CTexture(std::string &path, ETarget target, bool need_flip, std::shared_ptr<CSampler> sampler,
+                            ETextureUsage usage) {
   target_ = target;
   owner_ = true;
-  stbi_set_flip_vertically_on_load(need_flip);
+  ApplySampler(sampler);
+  switch (target) {
+  case ETarget::kTexture2D: {
+    glGenTextures(1, &id_);
+    Upload(DecodeImage(path, usage, need_flip), 0);
+  } break;
+  default:
+    GE_ERROR("Cannot create texture (target not supported) from path: {0}", path);
+    break;
+  }
+}
+
+GEngine::CTexture::CTexture(SDecodedImage image, std::shared_ptr<CSampler> sampler, int first_level)
+    : target_(ETarget::kTexture2D), owner_(true) {
+  ApplySampler(sampler);
+  glGenTextures(1, &id_);
+  Upload(std::move(image), first_level);
+}
+
+void GEngine::CTexture::ApplySampler(const std::shared_ptr<CSampler> &sampler) {
   if(sampler) {
     SetSWrapMode(sampler->GetSWrapMode());
     SetRWrapMode(sampler->GetRWrapMode());
@@ -36,41 +62,165 @@ GEngine::CTexture::CTexture(std::string &path, ETarget target, bool need_flip, s
     SetMinFilter(sampler->GetMinFilter());
     SetMagFilter(sampler->GetMagFilter());
   }
-  switch (target) {
-  case ETarget::kTexture2D: {
-    glGenTextures(1, &id_);
-    int components_number = 0;
-    unsigned char *data = stbi_load(path.c_str(), &width_, &height_, &components_number, 0);
-    if (data) {
-      if (components_number == 1)
-        internal_format_ = external_format_ = EPixelFormat::kRed;
-        
-      else if (components_number == 3)
-        internal_format_ = external_format_ = EPixelFormat::kRGB;
-      else if (components_number == 4)
-        internal_format_  = external_format_ = EPixelFormat::kRGBA;
-
-      glBindTexture(GL_TEXTURE_2D, id_);
-      glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(internal_format_),
-                   width_, height_, 0, static_cast<GLenum>(external_format_),
-                   GL_UNSIGNED_BYTE, data);
-      has_mipmap_ = true;
-      glGenerateMipmap(GL_TEXTURE_2D);
-      SetMinFilter(EMinFilter::kLinearMipmapLinear);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, static_cast<GLint>(s_wrap_mode_));
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, static_cast<GLint>(s_wrap_mode_));
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, static_cast<GLint>(min_filter_));
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, static_cast<GLint>(mag_filter_));
-      stbi_image_free(data);
-    } else {
-      GE_ERROR("Texture failed to load at path: {0}", path);
-      stbi_image_free(data);
+}
+
+GEngine::SDecodedImage GEngine::CTexture::DecodeImage(const std::string &path, ETextureUsage usage, bool need_flip) {
+  SDecodedImage image;
+  image.path_ = path;
+  image.usage_ = usage;
+  // flipped textures are never cooked
+  if (!need_flip && CTextureCooker::IsCookedUpToDate(path) &&
+      CDDSFile::Read(CTextureCooker::GetCookedPath(path), image.compressed_image_)) {
+    image.compressed_ = true;
+    image.width_ = image.compressed_image_.width_;
+    image.height_ = image.compressed_image_.height_;
+    image.ok_ = true;
+    return image;
+  }
+  return DecodeSource(path, usage, need_flip);
+}
+
+GEngine::SDecodedImage GEngine::CTexture::DecodeSource(const std::string &path, ETextureUsage usage, bool need_flip) {
+  SDecodedImage image;
+  image.path_ = path;
+  image.usage_ = usage;
+  stbi_set_flip_vertically_on_load_thread(need_flip);
+  int components_number = 0;
+  unsigned char *data = stbi_load(path.c_str(), &image.width_, &image.height_, &components_number, 0);
+  if (!data) {
+    GE_ERROR("Texture failed to load at path: {0}", path);
+    return image;
+  }
+  image.channels_ = components_number;
+  std::vector<uint8_t> pixels;
+  if (components_number == 2) {
+    // grey + alpha, no GL_RG upload path
+    image.channels_ = 4;
+    pixels.resize(static_cast<size_t>(image.width_) * image.height_ * 4);
+    for (size_t i = 0; i < static_cast<size_t>(image.width_) * image.height_; i++) {
+      pixels[i * 4 + 0] = pixels[i * 4 + 1] = pixels[i * 4 + 2] = data[i * 2];
+      pixels[i * 4 + 3] = data[i * 2 + 1];
     }
-  } break;
-  default:
-    GE_ERROR("Cannot create texture (target not supported) from path: {0}", path);
+  }
+  CMipGenerator::SOptions options;
+  options.usage_ = usage;
+  image.levels_ = CMipGenerator::Generate(pixels.empty() ? data : pixels.data(), image.width_, image.height_,
+                                          image.channels_, options);
+  stbi_image_free(data);
+  image.ok_ = true;
+  return image;
+}
+
+void GEngine::CTexture::Upload(SDecodedImage &&image, int first_level) {
+  if (!image.ok_) {
+    return;
+  }
+  if (image.compressed_) {
+    if (UploadCompressed(image.compressed_image_, first_level)) {
+      return;
+    }
+    // e.g. BC7 on macOS, decode the source here
+    GE_WARN("{0} is {1}, not supported by this context, loading the source image", image.path_,
+            CBlockCompressor::GetFormatName(image.compressed_image_.format_));
+    Upload(DecodeSource(image.path_, image.usage_, false), first_level);
+    return;
+  }
+  width_ = image.width_;
+  height_ = image.height_;
+  if (image.channels_ == 1)
+    internal_format_ = external_format_ = EPixelFormat::kRed;
+  else if (image.channels_ == 3)
+    internal_format_ = external_format_ = EPixelFormat::kRGB;
+  else if (image.channels_ == 4)
+    internal_format_  = external_format_ = EPixelFormat::kRGBA;
+
+  mip_levels_ = static_cast<int>(image.levels_.size());
+  first_level = std::min(first_level, mip_levels_ - 1);
+  int base_level = UploadLevels(image.levels_, first_level, static_cast<GLenum>(external_format_), false);
+  SetTextureParameters(base_level);
+}
+
+bool GEngine::CTexture::UploadCompressed(SCompressedImage &image, int first_level) {
+  if (!CBlockCompressor::IsSupportedByContext(image.format_)) {
+    return false;
+  }
+  width_ = image.width_;
+  height_ = image.height_;
+  compressed_format_ = CBlockCompressor::GetGLFormat(image.format_);
+  mip_levels_ = static_cast<int>(image.levels_.size());
+  first_level = std::min(first_level, mip_levels_ - 1);
+  // the channels the blocks hold, only BC3 & BC7 carry alpha (CMaterial::IsAlphaTested)
+  switch (image.format_) {
+  case ECompressedFormat::kBC1:
+    internal_format_ = external_format_ = EPixelFormat::kRGB;
+    break;
+  case ECompressedFormat::kBC4:
+    internal_format_ = external_format_ = EPixelFormat::kRed;
+    break;
+  case ECompressedFormat::kBC5:
+    internal_format_ = external_format_ = EPixelFormat::kRG;
+    break;
+  case ECompressedFormat::kBC3:
+  case ECompressedFormat::kBC7:
+    internal_format_ = external_format_ = EPixelFormat::kRGBA;
     break;
   }
+  int base_level = UploadLevels(image.levels_, first_level, compressed_format_, true);
+  SetTextureParameters(base_level);
+  return true;
+}
+
+int GEngine::CTexture::UploadLevels(std::vector<std::vector<uint8_t>> &levels, int first_level, GLenum format,
+                                    bool compressed) {
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, id_);
+  // rows of 1 & 3 channel levels are not 4 byte aligned
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  int base_level = mip_levels_ - 1;
+  for (int level = mip_levels_ - 1; level >= first_level; level--) {
+    int width = std::max(1, width_ >> level);
+    int height = std::max(1, height_ >> level);
+    bool immediate = std::max(width, height) <= kImmediateSize;
+    // the queued levels only get their storage here
+    const void *pixels = immediate ? levels[level].data() : nullptr;
+    if (compressed) {
+      glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0,
+                             static_cast<GLsizei>(levels[level].size()), pixels);
+    } else {
+      glTexImage2D(GL_TEXTURE_2D, level, static_cast<GLint>(internal_format_), width, height, 0, format,
+                   GL_UNSIGNED_BYTE, pixels);
+    }
+    if (immediate) {
+      base_level = level;
+      continue;
+    }
+    CTextureUploadQueue::SRequest request;
+    request.texture_ = id_;
+    request.level_ = level;
+    request.width_ = width;
+    request.height_ = height;
+    request.format_ = format;
+    request.compressed_ = compressed;
+    request.pixels_ = std::move(levels[level]);
+    request.on_uploaded_ = [this, level]() {
+      CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, id_);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+    };
+    CSingleton<CTextureUploadQueue>()->Enqueue(std::move(request));
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  return base_level;
+}
+
+void GEngine::CTexture::SetTextureParameters(int base_level) {
+  // levels below the base level are not uploaded (yet)
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base_level);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mip_levels_ - 1);
+  has_mipmap_ = mip_levels_ > 1;
+  SetMinFilter(has_mipmap_ ? EMinFilter::kLinearMipmapLinear : EMinFilter::kLinear);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, static_cast<GLint>(s_wrap_mode_));
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, static_cast<GLint>(t_wrap_mode_));
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, static_cast<GLint>(min_filter_));
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, static_cast<GLint>(mag_filter_));
 }
 
 GEngine::CTexture::CTexture(ETarget target, unsigned int id, int height, int width)
@@ -78,6 +228,8 @@ GEngine::CTexture::CTexture(ETarget target, unsigned int id, int height, int wid
 
 GEngine::CTexture::~CTexture() {
   if(owner_) {
+    CSingleton<CTextureUploadQueue>()->Cancel(id_);
+    CSingleton<CGLStateCache>()->OnTextureDeleted(id_);
     glDeleteTextures(1, &id_);
   }
 }
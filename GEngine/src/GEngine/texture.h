@@ -2,6 +2,9 @@
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include <glad/glad.h>
+#include "GEngine/texture_compression.h"
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace GEngine {
@@ -56,13 +59,29 @@ private:
   EWrapMode r_wrap_mode_ = EWrapMode::kClampToEdge;
 };
 
+// an image file decoded off the GL thread (CJobSystem workers), either the
+// cooked .dds or the source with its cpu generated mip chain (CMipGenerator)
+struct SDecodedImage {
+  std::string path_;
+  ETextureUsage usage_ = ETextureUsage::kColor;
+  bool ok_ = false;
+  int width_ = 0;
+  int height_ = 0;
+  int channels_ = 0; // 1, 3 or 4
+  std::vector<std::vector<uint8_t>> levels_;
+  bool compressed_ = false;
+  SCompressedImage compressed_image_;
+};
+
 // class CTexture : puhlic std::enable_shared_fron_this<CTexture>{
 class CTexture {
 public:
   enum class ETarget : GLenum {
     kTexture2D      = GL_TEXTURE_2D,
     kTexture3D      = GL_TEXTURE_3D,
+    kTexture2DArray = GL_TEXTURE_2D_ARRAY,
     kTextureCubeMap = GL_TEXTURE_CUBE_MAP,
+    kTextureBuffer  = GL_TEXTURE_BUFFER,
     // cubemap faces
     kTextureCubeMapPositiveX = GL_TEXTURE_CUBE_MAP_POSITIVE_X,
     kTextureCubeMapNegativeX = GL_TEXTURE_CUBE_MAP_NEGATIVE_X,
@@ -74,6 +93,7 @@ public:
 
   enum class EPixelFormat : GLenum {
     kRed  = GL_RED,
+    kRG   = GL_RG,
     kRGB  = GL_RGB,
     kRGBA = GL_RGBA,
   };
@@ -82,12 +102,24 @@ public:
   using EMagFilter = CSampler::EMagFilter;
   using EMinFilter = CSampler::EMinFilter;
 
+  static constexpr int kImmediateSize = 128;
+
   CTexture(ETarget target);
-  CTexture(std::string& path, ETarget target = ETarget::kTexture2D, bool need_flip = false, std::shared_ptr<CSampler> sampler = nullptr);
+  CTexture(std::string& path, ETarget target = ETarget::kTexture2D, bool need_flip = false, std::shared_ptr<CSampler> sampler = nullptr,
+           ETextureUsage usage = ETextureUsage::kColor);
+  // GL thread, no glGenerateMipmap. Levels up to kImmediateSize are uploaded
+  // at once, the bigger ones go through CTextureUploadQueue (coarse to fine,
+  // the base level drops as they land). Levels below first_level are left
+  // to CTextureStreamer
+  CTexture(SDecodedImage image, std::shared_ptr<CSampler> sampler = nullptr, int first_level = 0);
   CTexture(ETarget target, unsigned int id, int height, int width);
   ~CTexture();
 
   static CTexture CreateTextureFromFile();
+  // thread safe, no GL calls. usage selects the mip filtering
+  static SDecodedImage DecodeImage(const std::string &path, ETextureUsage usage, bool need_flip = false);
+  // the image file itself, ignores a cooked .dds
+  static SDecodedImage DecodeSource(const std::string &path, ETextureUsage usage, bool need_flip);
 
   ETarget GetTarget() const { return target_; }
 
@@ -112,8 +144,19 @@ public:
   EPixelFormat internal_format_ = EPixelFormat::kRGB; 
   EPixelFormat external_format_ = EPixelFormat::kRGB;
   bool has_mipmap_ = false;
+  // GL_COMPRESSED_* when loaded from a cooked .dds, 0 otherwise
+  GLenum compressed_format_ = 0;
+  int mip_levels_ = 1;
 
 private:
+  void ApplySampler(const std::shared_ptr<CSampler> &sampler);
+  void Upload(SDecodedImage &&image, int first_level);
+  // false if the context can't sample the format
+  bool UploadCompressed(SCompressedImage &image, int first_level);
+  // base level of the coarsest queued level
+  int UploadLevels(std::vector<std::vector<uint8_t>> &levels, int first_level, GLenum format, bool compressed);
+  void SetTextureParameters(int base_level);
+
   ETarget target_;
   bool owner_;
 
@@ -0,0 +1,34 @@
+#include "GEngine/texture_buffer.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/singleton.h"
+#include <algorithm>
+
+GEngine::CTextureBuffer::CTextureBuffer(GLenum internal_format)
+    : internal_format_(internal_format) {
+  glGenBuffers(1, &buffer_);
+  texture_ = std::make_shared<CTexture>(CTexture::ETarget::kTextureBuffer);
+}
+
+GEngine::CTextureBuffer::~CTextureBuffer() {
+  glDeleteBuffers(1, &buffer_);
+}
+
+void GEngine::CTextureBuffer::Upload(const void *data, size_t bytes) {
+  // an empty buffer texture is invalid to sample, keep at least a few bytes
+  size_t required = std::max(bytes, static_cast<size_t>(16));
+  glBindBuffer(GL_TEXTURE_BUFFER, buffer_);
+  if (required > capacity_) {
+    capacity_ = std::max(required, capacity_ * 2);
+    glBufferData(GL_TEXTURE_BUFFER, capacity_, nullptr, GL_STREAM_DRAW);
+    CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_BUFFER, texture_->id_);
+    glTexBuffer(GL_TEXTURE_BUFFER, internal_format_, buffer_);
+    CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_BUFFER, 0);
+  } else {
+    glBufferData(GL_TEXTURE_BUFFER, capacity_, nullptr, GL_STREAM_DRAW);
+  }
+  if (bytes > 0) {
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+  }
+  size_ = bytes;
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
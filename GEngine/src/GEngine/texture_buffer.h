@@ -0,0 +1,31 @@
+#pragma once
+#include "GEngine/texture.h"
+#include <memory>
+
+namespace GEngine {
+// a buffer object exposed to shaders as samplerBuffer / usamplerBuffer,
+// used to feed per-frame cpu data (e.g. clustered lights) on GL 4.1 where
+// shader storage buffers are not available
+class CTextureBuffer {
+public:
+  // internal_format: GL_RGBA32F, GL_RG32UI, GL_R32UI...
+  CTextureBuffer(GLenum internal_format);
+  ~CTextureBuffer();
+  CTextureBuffer(const CTextureBuffer &) = delete;
+  CTextureBuffer &operator=(const CTextureBuffer &) = delete;
+
+  // replace the whole content, the old storage is orphaned so the upload
+  // never waits for the gpu
+  void Upload(const void *data, size_t bytes);
+
+  std::shared_ptr<CTexture> GetTexture() const { return texture_; }
+  size_t GetSize() const { return size_; }
+
+private:
+  GLenum internal_format_;
+  unsigned int buffer_ = 0;
+  size_t capacity_ = 0;
+  size_t size_ = 0;
+  std::shared_ptr<CTexture> texture_;
+};
+} // namespace GEngine
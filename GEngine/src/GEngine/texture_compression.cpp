@@ -0,0 +1,471 @@
+#include "GEngine/texture_compression.h"
+#include "GEngine/job_system.h"
+#include "GEngine/log.h"
+#include "GEngine/singleton.h"
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <glm/glm.hpp>
+
+namespace {
+// not part of the core profile headers
+constexpr GLenum kCompressedRGBS3TCDXT1 = 0x83F0;
+constexpr GLenum kCompressedRGBAS3TCDXT5 = 0x83F3;
+
+// principal axis of the texels by power iteration, (1, 1, 1...) for flat blocks
+template <typename TVec, typename TMat>
+TVec PrincipalAxis(const TVec *points, int count, TVec &mean) {
+  mean = TVec(0.0f);
+  for (int i = 0; i < count; i++) {
+    mean += points[i];
+  }
+  mean /= static_cast<float>(count);
+  TMat covariance(0.0f);
+  for (int i = 0; i < count; i++) {
+    TVec d = points[i] - mean;
+    covariance += glm::outerProduct(d, d);
+  }
+  TVec axis(1.0f);
+  for (int iteration = 0; iteration < 8; iteration++) {
+    TVec next = covariance * axis;
+    float length = glm::length(next);
+    if (length < 1e-6f) {
+      return glm::normalize(TVec(1.0f));
+    }
+    axis = next / length;
+  }
+  return axis;
+}
+
+// endpoints of the texels projected on the principal axis
+template <typename TVec, typename TMat>
+void RangeFit(const TVec *points, int count, TVec &low, TVec &high) {
+  TVec mean;
+  TVec axis = PrincipalAxis<TVec, TMat>(points, count, mean);
+  float t_min = 0.0f;
+  float t_max = 0.0f;
+  for (int i = 0; i < count; i++) {
+    float t = glm::dot(points[i] - mean, axis);
+    t_min = std::min(t_min, t);
+    t_max = std::max(t_max, t);
+  }
+  low = glm::clamp(mean + axis * t_min, TVec(0.0f), TVec(255.0f));
+  high = glm::clamp(mean + axis * t_max, TVec(0.0f), TVec(255.0f));
+}
+
+uint16_t PackRGB565(const glm::vec3 &color) {
+  auto r = static_cast<uint16_t>(std::lround(color.r * 31.0f / 255.0f));
+  auto g = static_cast<uint16_t>(std::lround(color.g * 63.0f / 255.0f));
+  auto b = static_cast<uint16_t>(std::lround(color.b * 31.0f / 255.0f));
+  return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+glm::vec3 UnpackRGB565(uint16_t color) {
+  int r = (color >> 11) & 31;
+  int g = (color >> 5) & 63;
+  int b = color & 31;
+  return glm::vec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+float DistanceSquared(const glm::vec3 &a, const glm::vec3 &b) {
+  glm::vec3 d = a - b;
+  return glm::dot(d, d);
+}
+
+// little endian bit stream of a 128 bit block, lowest bit first
+class CBitWriter {
+public:
+  explicit CBitWriter(uint8_t *block) : block_(block) { std::memset(block_, 0, 16); }
+  void Write(uint32_t value, int bits) {
+    for (int i = 0; i < bits; i++, position_++) {
+      block_[position_ >> 3] |= static_cast<uint8_t>(((value >> i) & 1u) << (position_ & 7));
+    }
+  }
+
+private:
+  uint8_t *block_;
+  int position_ = 0;
+};
+
+// dds layout, https://learn.microsoft.com/en-us/windows/win32/direct3ddds/dds-header
+struct SDDSPixelFormat {
+  uint32_t size_ = 32;
+  uint32_t flags_ = 0x4; // DDPF_FOURCC
+  uint32_t four_cc_ = 0;
+  uint32_t rgb_bit_count_ = 0;
+  uint32_t masks_[4] = {0, 0, 0, 0};
+};
+struct SDDSHeader {
+  uint32_t size_ = 124;
+  uint32_t flags_ = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // caps, h, w, pixel format, mips, linear size
+  uint32_t height_ = 0;
+  uint32_t width_ = 0;
+  uint32_t linear_size_ = 0;
+  uint32_t depth_ = 0;
+  uint32_t mip_count_ = 0;
+  uint32_t reserved1_[11] = {};
+  SDDSPixelFormat pixel_format_;
+  uint32_t caps_ = 0x1000 | 0x400000 | 0x8; // texture, mipmap, complex
+  uint32_t caps2_ = 0;
+  uint32_t caps3_ = 0;
+  uint32_t caps4_ = 0;
+  uint32_t reserved2_ = 0;
+};
+struct SDDSHeaderDX10 {
+  uint32_t dxgi_format_ = 0;
+  uint32_t resource_dimension_ = 3; // texture 2D
+  uint32_t misc_flag_ = 0;
+  uint32_t array_size_ = 1;
+  uint32_t misc_flags2_ = 0;
+};
+static_assert(sizeof(SDDSHeader) == 124, "dds header is 124 bytes");
+
+constexpr uint32_t FourCC(char a, char b, char c, char d) {
+  return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) | (static_cast<uint32_t>(c) << 16) |
+         (static_cast<uint32_t>(d) << 24);
+}
+
+// dxgi formats of the DX10 header
+constexpr uint32_t kDXGIBC1 = 71;
+constexpr uint32_t kDXGIBC3 = 77;
+constexpr uint32_t kDXGIBC4 = 80;
+constexpr uint32_t kDXGIBC5 = 83;
+constexpr uint32_t kDXGIBC7 = 98;
+} // namespace
+
+size_t GEngine::CBlockCompressor::GetBlockBytes(ECompressedFormat format) {
+  return format == ECompressedFormat::kBC1 || format == ECompressedFormat::kBC4 ? 8 : 16;
+}
+
+size_t GEngine::CBlockCompressor::GetLevelBytes(ECompressedFormat format, int width, int height) {
+  return static_cast<size_t>((width + 3) / 4) * static_cast<size_t>((height + 3) / 4) * GetBlockBytes(format);
+}
+
+GLenum GEngine::CBlockCompressor::GetGLFormat(ECompressedFormat format) {
+  switch (format) {
+  case ECompressedFormat::kBC1:
+    return kCompressedRGBS3TCDXT1;
+  case ECompressedFormat::kBC3:
+    return kCompressedRGBAS3TCDXT5;
+  case ECompressedFormat::kBC4:
+    return GL_COMPRESSED_RED_RGTC1;
+  case ECompressedFormat::kBC5:
+    return GL_COMPRESSED_RG_RGTC2;
+  case ECompressedFormat::kBC7:
+    return GL_COMPRESSED_RGBA_BPTC_UNORM;
+  }
+  return 0;
+}
+
+const char *GEngine::CBlockCompressor::GetFormatName(ECompressedFormat format) {
+  switch (format) {
+  case ECompressedFormat::kBC1:
+    return "BC1";
+  case ECompressedFormat::kBC3:
+    return "BC3";
+  case ECompressedFormat::kBC4:
+    return "BC4";
+  case ECompressedFormat::kBC5:
+    return "BC5";
+  case ECompressedFormat::kBC7:
+    return "BC7";
+  }
+  return "unknown";
+}
+
+bool GEngine::CBlockCompressor::IsSupportedByContext(ECompressedFormat format) {
+  switch (format) {
+  case ECompressedFormat::kBC1:
+  case ECompressedFormat::kBC3:
+    return glfwExtensionSupported("GL_EXT_texture_compression_s3tc");
+  case ECompressedFormat::kBC7:
+    // not on macOS
+    return glfwExtensionSupported("GL_ARB_texture_compression_bptc");
+  default:
+    return true;
+  }
+}
+
+void GEngine::CBlockCompressor::EncodeBlock(ECompressedFormat format, const uint8_t *rgba, uint8_t *block) {
+  switch (format) {
+  case ECompressedFormat::kBC1:
+    EncodeBC1(rgba, block);
+    break;
+  case ECompressedFormat::kBC3:
+    EncodeBC4(rgba, 3, block);
+    EncodeBC1(rgba, block + 8);
+    break;
+  case ECompressedFormat::kBC4:
+    EncodeBC4(rgba, 0, block);
+    break;
+  case ECompressedFormat::kBC5:
+    EncodeBC4(rgba, 0, block);
+    EncodeBC4(rgba, 1, block + 8);
+    break;
+  case ECompressedFormat::kBC7:
+    EncodeBC7Mode6(rgba, block);
+    break;
+  }
+}
+
+void GEngine::CBlockCompressor::EncodeBC1(const uint8_t *rgba, uint8_t *block) {
+  glm::vec3 texels[16];
+  for (int i = 0; i < 16; i++) {
+    texels[i] = glm::vec3(rgba[i * 4 + 0], rgba[i * 4 + 1], rgba[i * 4 + 2]);
+  }
+  glm::vec3 low, high;
+  RangeFit<glm::vec3, glm::mat3>(texels, 16, low, high);
+  uint16_t color0 = PackRGB565(high);
+  uint16_t color1 = PackRGB565(low);
+  // color0 > color1 selects the 4 color mode (no punch-through alpha)
+  if (color0 < color1) {
+    std::swap(color0, color1);
+  }
+  uint32_t indices = 0;
+  if (color0 != color1) {
+    glm::vec3 palette[4];
+    palette[0] = UnpackRGB565(color0);
+    palette[1] = UnpackRGB565(color1);
+    palette[2] = (palette[0] * 2.0f + palette[1]) / 3.0f;
+    palette[3] = (palette[0] + palette[1] * 2.0f) / 3.0f;
+    for (int i = 0; i < 16; i++) {
+      uint32_t best = 0;
+      float best_error = DistanceSquared(texels[i], palette[0]);
+      for (uint32_t p = 1; p < 4; p++) {
+        float error = DistanceSquared(texels[i], palette[p]);
+        if (error < best_error) {
+          best_error = error;
+          best = p;
+        }
+      }
+      indices |= best << (i * 2);
+    }
+  }
+  block[0] = static_cast<uint8_t>(color0 & 0xFF);
+  block[1] = static_cast<uint8_t>(color0 >> 8);
+  block[2] = static_cast<uint8_t>(color1 & 0xFF);
+  block[3] = static_cast<uint8_t>(color1 >> 8);
+  for (int i = 0; i < 4; i++) {
+    block[4 + i] = static_cast<uint8_t>((indices >> (i * 8)) & 0xFF);
+  }
+}
+
+void GEngine::CBlockCompressor::EncodeBC4(const uint8_t *rgba, int channel, uint8_t *block) {
+  int low = 255;
+  int high = 0;
+  for (int i = 0; i < 16; i++) {
+    low = std::min<int>(low, rgba[i * 4 + channel]);
+    high = std::max<int>(high, rgba[i * 4 + channel]);
+  }
+  // high > low selects the 8 value mode
+  uint64_t indices = 0;
+  if (high != low) {
+    int palette[8] = {high, low};
+    for (int p = 2; p < 8; p++) {
+      palette[p] = ((8 - p) * high + (p - 1) * low) / 7;
+    }
+    for (int i = 0; i < 16; i++) {
+      int value = rgba[i * 4 + channel];
+      uint64_t best = 0;
+      int best_error = std::abs(value - palette[0]);
+      for (int p = 1; p < 8; p++) {
+        int error = std::abs(value - palette[p]);
+        if (error < best_error) {
+          best_error = error;
+          best = static_cast<uint64_t>(p);
+        }
+      }
+      indices |= best << (i * 3);
+    }
+  }
+  block[0] = static_cast<uint8_t>(high);
+  block[1] = static_cast<uint8_t>(low);
+  for (int i = 0; i < 6; i++) {
+    block[2 + i] = static_cast<uint8_t>((indices >> (i * 8)) & 0xFF);
+  }
+}
+
+void GEngine::CBlockCompressor::EncodeBC7Mode6(const uint8_t *rgba, uint8_t *block) {
+  static const int kWeights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+  glm::vec4 texels[16];
+  for (int i = 0; i < 16; i++) {
+    texels[i] = glm::vec4(rgba[i * 4 + 0], rgba[i * 4 + 1], rgba[i * 4 + 2], rgba[i * 4 + 3]);
+  }
+  glm::vec4 ends[2];
+  RangeFit<glm::vec4, glm::mat4>(texels, 16, ends[0], ends[1]);
+
+  // 7 bits per channel plus one shared p-bit per endpoint
+  glm::ivec4 quantized[2];
+  int p_bits[2];
+  glm::ivec4 endpoints[2];
+  for (int e = 0; e < 2; e++) {
+    float best_error = -1.0f;
+    for (int p = 0; p < 2; p++) {
+      glm::ivec4 q = glm::clamp(glm::ivec4(glm::round((ends[e] - static_cast<float>(p)) * 0.5f)), 0, 127);
+      glm::ivec4 value = (q << 1) | p;
+      glm::vec4 d = glm::vec4(value) - ends[e];
+      float error = glm::dot(d, d);
+      if (best_error < 0.0f || error < best_error) {
+        best_error = error;
+        quantized[e] = q;
+        p_bits[e] = p;
+        endpoints[e] = value;
+      }
+    }
+  }
+
+  int indices[16];
+  for (int i = 0; i < 16; i++) {
+    float best_error = -1.0f;
+    for (int w = 0; w < 16; w++) {
+      glm::ivec4 value = ((64 - kWeights[w]) * endpoints[0] + kWeights[w] * endpoints[1] + 32) >> 6;
+      glm::vec4 d = glm::vec4(value) - texels[i];
+      float error = glm::dot(d, d);
+      if (best_error < 0.0f || error < best_error) {
+        best_error = error;
+        indices[i] = w;
+      }
+    }
+  }
+  // the msb of the first index is implicit 0
+  if (indices[0] >= 8) {
+    std::swap(quantized[0], quantized[1]);
+    std::swap(p_bits[0], p_bits[1]);
+    for (int &index : indices) {
+      index = 15 - index;
+    }
+  }
+
+  CBitWriter writer(block);
+  writer.Write(1u << 6, 7); // mode 6
+  for (int channel = 0; channel < 4; channel++) {
+    writer.Write(static_cast<uint32_t>(quantized[0][channel]), 7);
+    writer.Write(static_cast<uint32_t>(quantized[1][channel]), 7);
+  }
+  writer.Write(static_cast<uint32_t>(p_bits[0]), 1);
+  writer.Write(static_cast<uint32_t>(p_bits[1]), 1);
+  writer.Write(static_cast<uint32_t>(indices[0]), 3);
+  for (int i = 1; i < 16; i++) {
+    writer.Write(static_cast<uint32_t>(indices[i]), 4);
+  }
+}
+
+std::vector<uint8_t> GEngine::CBlockCompressor::CompressImage(ECompressedFormat format, const uint8_t *rgba,
+                                                              int width, int height) {
+  int blocks_x = (width + 3) / 4;
+  int blocks_y = (height + 3) / 4;
+  size_t block_bytes = GetBlockBytes(format);
+  std::vector<uint8_t> blocks(static_cast<size_t>(blocks_x) * blocks_y * block_bytes);
+  CSingleton<CJobSystem>()->ParallelFor(
+      static_cast<unsigned int>(blocks_y), 4, [&](unsigned int begin, unsigned int end) {
+        uint8_t texels[64];
+        for (unsigned int by = begin; by < end; by++) {
+          for (int bx = 0; bx < blocks_x; bx++) {
+            for (int i = 0; i < 16; i++) {
+              int x = std::min(bx * 4 + (i & 3), width - 1);
+              int y = std::min(static_cast<int>(by) * 4 + (i >> 2), height - 1);
+              std::memcpy(texels + i * 4, rgba + (static_cast<size_t>(y) * width + x) * 4, 4);
+            }
+            EncodeBlock(format, texels, blocks.data() + (static_cast<size_t>(by) * blocks_x + bx) * block_bytes);
+          }
+        }
+      });
+  return blocks;
+}
+
+bool GEngine::CDDSFile::Write(const std::string &path, const SCompressedImage &image) {
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    GE_ERROR("Cannot write dds file: {0}", path);
+    return false;
+  }
+  SDDSHeader header;
+  header.width_ = static_cast<uint32_t>(image.width_);
+  header.height_ = static_cast<uint32_t>(image.height_);
+  header.mip_count_ = static_cast<uint32_t>(image.levels_.size());
+  header.linear_size_ = image.levels_.empty() ? 0 : static_cast<uint32_t>(image.levels_[0].size());
+  switch (image.format_) {
+  case ECompressedFormat::kBC1:
+    header.pixel_format_.four_cc_ = FourCC('D', 'X', 'T', '1');
+    break;
+  case ECompressedFormat::kBC3:
+    header.pixel_format_.four_cc_ = FourCC('D', 'X', 'T', '5');
+    break;
+  case ECompressedFormat::kBC4:
+    header.pixel_format_.four_cc_ = FourCC('A', 'T', 'I', '1');
+    break;
+  case ECompressedFormat::kBC5:
+    header.pixel_format_.four_cc_ = FourCC('A', 'T', 'I', '2');
+    break;
+  case ECompressedFormat::kBC7:
+    header.pixel_format_.four_cc_ = FourCC('D', 'X', '1', '0');
+    break;
+  }
+  file.write("DDS ", 4);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  if (image.format_ == ECompressedFormat::kBC7) {
+    SDDSHeaderDX10 dx10;
+    dx10.dxgi_format_ = kDXGIBC7;
+    file.write(reinterpret_cast<const char *>(&dx10), sizeof(dx10));
+  }
+  for (const auto &level : image.levels_) {
+    file.write(reinterpret_cast<const char *>(level.data()), static_cast<std::streamsize>(level.size()));
+  }
+  return static_cast<bool>(file);
+}
+
+bool GEngine::CDDSFile::Read(const std::string &path, SCompressedImage &image) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  char magic[4];
+  SDDSHeader header;
+  file.read(magic, 4);
+  file.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!file || std::memcmp(magic, "DDS ", 4) != 0 || header.size_ != 124 || !(header.pixel_format_.flags_ & 0x4)) {
+    GE_ERROR("Not a block compressed dds file: {0}", path);
+    return false;
+  }
+  uint32_t four_cc = header.pixel_format_.four_cc_;
+  uint32_t dxgi_format = 0;
+  if (four_cc == FourCC('D', 'X', '1', '0')) {
+    SDDSHeaderDX10 dx10;
+    file.read(reinterpret_cast<char *>(&dx10), sizeof(dx10));
+    dxgi_format = dx10.dxgi_format_;
+  }
+  if (four_cc == FourCC('D', 'X', 'T', '1') || dxgi_format == kDXGIBC1) {
+    image.format_ = ECompressedFormat::kBC1;
+  } else if (four_cc == FourCC('D', 'X', 'T', '5') || dxgi_format == kDXGIBC3) {
+    image.format_ = ECompressedFormat::kBC3;
+  } else if (four_cc == FourCC('A', 'T', 'I', '1') || four_cc == FourCC('B', 'C', '4', 'U') ||
+             dxgi_format == kDXGIBC4) {
+    image.format_ = ECompressedFormat::kBC4;
+  } else if (four_cc == FourCC('A', 'T', 'I', '2') || four_cc == FourCC('B', 'C', '5', 'U') ||
+             dxgi_format == kDXGIBC5) {
+    image.format_ = ECompressedFormat::kBC5;
+  } else if (dxgi_format == kDXGIBC7) {
+    image.format_ = ECompressedFormat::kBC7;
+  } else {
+    GE_ERROR("Unsupported dds format in {0}", path);
+    return false;
+  }
+  image.width_ = static_cast<int>(header.width_);
+  image.height_ = static_cast<int>(header.height_);
+  int level_count = (header.flags_ & 0x20000) ? std::max(1u, header.mip_count_) : 1;
+  image.levels_.resize(level_count);
+  for (int level = 0; level < level_count; level++) {
+    int width = std::max(1, image.width_ >> level);
+    int height = std::max(1, image.height_ >> level);
+    image.levels_[level].resize(CBlockCompressor::GetLevelBytes(image.format_, width, height));
+    file.read(reinterpret_cast<char *>(image.levels_[level].data()),
+              static_cast<std::streamsize>(image.levels_[level].size()));
+  }
+  if (!file) {
+    GE_ERROR("Truncated dds file: {0}", path);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace GEngine {
+// block compressed formats, 4x4 texels per block
+enum class ECompressedFormat {
+  kBC1, // rgb, 8 bytes
+  kBC3, // rgb + alpha, 16 bytes
+  kBC4, // r, 8 bytes
+  kBC5, // rg, 16 bytes
+  kBC7, // rgba (mode 6 only), 16 bytes, needs GL_ARB_texture_compression_bptc
+};
+
+// what a texture is sampled as, picks the format & the mip filter
+enum class ETextureUsage {
+  kColor,         // base color / diffuse, BC1 or BC3 with alpha (BC7 if asked)
+  kNormal,        // tangent space xy, z is rebuilt in the shader, BC5
+  kSingleChannel, // ao / roughness / opacity, BC4
+  kData,          // packed channels (glTF metallic-roughness), BC1
+};
+
+// a full mip chain of one block compressed 2D texture
+struct SCompressedImage {
+  ECompressedFormat format_ = ECompressedFormat::kBC1;
+  int width_ = 0;
+  int height_ = 0;
+  std::vector<std::vector<uint8_t>> levels_;
+};
+
+// cpu BCn encoders (range fit along the principal axis), images are
+// encoded block row by block row on the CJobSystem workers
+class CBlockCompressor {
+public:
+  static size_t GetBlockBytes(ECompressedFormat format);
+  static size_t GetLevelBytes(ECompressedFormat format, int width, int height);
+  static GLenum GetGLFormat(ECompressedFormat format);
+  static const char *GetFormatName(ECompressedFormat format);
+  // BC1/3 need GL_EXT_texture_compression_s3tc, BC7 bptc, BC4/5 are core
+  static bool IsSupportedByContext(ECompressedFormat format);
+
+  // rgba: 16 texels, row major
+  static void EncodeBlock(ECompressedFormat format, const uint8_t *rgba, uint8_t *block);
+  // rgba8 image, texels past the border repeat the last row / column
+  static std::vector<uint8_t> CompressImage(ECompressedFormat format, const uint8_t *rgba, int width, int height);
+
+private:
+  static void EncodeBC1(const uint8_t *rgba, uint8_t *block);
+  // one channel (offset in the texel) of 16 texels into an 8 byte block
+  static void EncodeBC4(const uint8_t *rgba, int channel, uint8_t *block);
+  static void EncodeBC7Mode6(const uint8_t *rgba, uint8_t *block);
+};
+
+// .dds container, legacy FourCC for BC1/3/4/5 and the DX10 header for BC7
+class CDDSFile {
+public:
+  static bool Write(const std::string &path, const SCompressedImage &image);
+  static bool Read(const std::string &path, SCompressedImage &image);
+};
+} // namespace GEngine
@@ -0,0 +1,85 @@
+#include "GEngine/texture_cooker.h"
+#include "GEngine/log.h"
+#include "GEngine/mip_generator.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <stb/stb_image.h>
+
+std::string GEngine::CTextureCooker::GetCookedPath(const std::string &source_path) {
+  return std::filesystem::path(source_path).replace_extension(".dds").string();
+}
+
+bool GEngine::CTextureCooker::IsCookedUpToDate(const std::string &source_path) {
+  std::error_code error;
+  auto cooked_time = std::filesystem::last_write_time(GetCookedPath(source_path), error);
+  if (error) {
+    return false;
+  }
+  auto source_time = std::filesystem::last_write_time(source_path, error);
+  // a cooked file without its source is fine
+  return error || cooked_time >= source_time;
+}
+
+GEngine::ECompressedFormat GEngine::CTextureCooker::ChooseFormat(ETextureUsage usage, bool has_alpha,
+                                                                 bool color_bc7) {
+  switch (usage) {
+  case ETextureUsage::kColor:
+    if (color_bc7) {
+      return ECompressedFormat::kBC7;
+    }
+    return has_alpha ? ECompressedFormat::kBC3 : ECompressedFormat::kBC1;
+  case ETextureUsage::kNormal:
+    return ECompressedFormat::kBC5;
+  case ETextureUsage::kSingleChannel:
+    return ECompressedFormat::kBC4;
+  case ETextureUsage::kData:
+    return ECompressedFormat::kBC1;
+  }
+  return ECompressedFormat::kBC1;
+}
+
+bool GEngine::CTextureCooker::Cook(const std::string &source_path, ETextureUsage usage, const SOptions &options) {
+  if (!options.force_ && IsCookedUpToDate(source_path)) {
+    return true;
+  }
+  auto start_time = std::chrono::high_resolution_clock::now();
+  int width = 0;
+  int height = 0;
+  int components = 0;
+  // same orientation as CTexture
+  stbi_set_flip_vertically_on_load_thread(false);
+  unsigned char *data = stbi_load(source_path.c_str(), &width, &height, &components, 4);
+  if (!data) {
+    GE_ERROR("Cannot cook texture, failed to load {0}", source_path);
+    return false;
+  }
+  bool has_alpha = false;
+  for (size_t i = 3; i < static_cast<size_t>(width) * height * 4 && !has_alpha; i += 4) {
+    has_alpha = data[i] < 255;
+  }
+  CMipGenerator::SOptions mip_options;
+  mip_options.filter_ = options.mip_filter_;
+  mip_options.usage_ = usage;
+  auto levels = CMipGenerator::Generate(data, width, height, 4, mip_options);
+  stbi_image_free(data);
+
+  SCompressedImage image;
+  image.format_ = ChooseFormat(usage, has_alpha, options.color_bc7_);
+  image.width_ = width;
+  image.height_ = height;
+  for (size_t level = 0; level < levels.size(); level++) {
+    image.levels_.push_back(CBlockCompressor::CompressImage(image.format_, levels[level].data(),
+                                                            std::max(1, width >> level), std::max(1, height >> level)));
+  }
+
+  std::string cooked_path = GetCookedPath(source_path);
+  if (!CDDSFile::Write(cooked_path, image)) {
+    return false;
+  }
+  auto end_time = std::chrono::high_resolution_clock::now();
+  GE_INFO("Cooked {0} ({1}x{2}, {3}, {4} mips) in {5:.1f} ms", cooked_path, width, height,
+          CBlockCompressor::GetFormatName(image.format_), image.levels_.size(),
+          std::chrono::duration<float, std::milli>(end_time - start_time).count());
+  return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "GEngine/mip_generator.h"
+#include "GEngine/texture_compression.h"
+#include <string>
+
+namespace GEngine {
+// offline conversion of source images (png, jpg, tga...) to block compressed
+// .dds files with a full mip chain, the format follows the usage. CTexture
+// picks up "<source>.dds" when it is newer than the source image.
+class CTextureCooker {
+public:
+  struct SOptions {
+    // BC7 instead of BC1/BC3 for color, GL 4.1 on macOS can't sample it
+    bool color_bc7_ = false;
+    // cook even when the .dds is up to date
+    bool force_ = false;
+    EMipFilter mip_filter_ = EMipFilter::kKaiser;
+  };
+
+  static std::string GetCookedPath(const std::string &source_path);
+  static bool IsCookedUpToDate(const std::string &source_path);
+  static ECompressedFormat ChooseFormat(ETextureUsage usage, bool has_alpha, bool color_bc7);
+
+  // false if the source can't be read or the .dds can't be written
+  static bool Cook(const std::string &source_path, ETextureUsage usage, const SOptions &options);
+};
+} // namespace GEngine
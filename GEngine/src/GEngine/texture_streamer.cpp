@@ -0,0 +1,208 @@
+#include "GEngine/texture_streamer.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/material.h"
+#include "GEngine/singleton.h"
+#include "GEngine/texture_upload_queue.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+const std::vector<uint8_t> &GEngine::CTextureStreamer::GetLevelData(const SEntry &entry, int level) const {
+  return entry.image_.compressed_ ? entry.image_.compressed_image_.levels_[level] : entry.image_.levels_[level];
+}
+
+std::shared_ptr<GEngine::CTexture> GEngine::CTextureStreamer::CreateStreamedTexture(SDecodedImage &&image,
+                                                                                   std::shared_ptr<CSampler> sampler) {
+  SEntry entry;
+  entry.level_count_ = static_cast<int>(image.compressed_ ? image.compressed_image_.levels_.size()
+                                                          : image.levels_.size());
+  while (entry.initial_level_ < entry.level_count_ - 1 &&
+         std::max(image.width_, image.height_) >> entry.initial_level_ > kInitialSize) {
+    entry.initial_level_++;
+  }
+  // the texture only gets copies of the resident levels
+  SDecodedImage resident;
+  resident.path_ = image.path_;
+  resident.usage_ = image.usage_;
+  resident.ok_ = image.ok_;
+  resident.width_ = image.width_;
+  resident.height_ = image.height_;
+  resident.channels_ = image.channels_;
+  resident.compressed_ = image.compressed_;
+  resident.compressed_image_.format_ = image.compressed_image_.format_;
+  resident.compressed_image_.width_ = image.compressed_image_.width_;
+  resident.compressed_image_.height_ = image.compressed_image_.height_;
+  auto &source_levels = image.compressed_ ? image.compressed_image_.levels_ : image.levels_;
+  auto &resident_levels = image.compressed_ ? resident.compressed_image_.levels_ : resident.levels_;
+  resident_levels.resize(source_levels.size());
+  std::copy(source_levels.begin() + entry.initial_level_, source_levels.end(),
+            resident_levels.begin() + entry.initial_level_);
+  auto texture = std::make_shared<CTexture>(std::move(resident), sampler, entry.initial_level_);
+  entry.texture_ = texture;
+  entry.resident_level_ = entry.requested_level_ = entry.wanted_level_ = entry.initial_level_;
+  entry.last_used_frame_ = frame_;
+  entry.image_ = std::move(image);
+  for (int level = entry.initial_level_; level < entry.level_count_; level++) {
+    resident_bytes_ += GetLevelData(entry, level).size();
+  }
+  entries_[texture.get()] = std::move(entry);
+  return texture;
+}
+
+int GEngine::CTextureStreamer::ComputeLevel(int texture_size, float screen_pixels) {
+  if (screen_pixels <= 1.0f) {
+    return std::numeric_limits<int>::max();
+  }
+  return std::max(0, static_cast<int>(std::floor(std::log2(texture_size / screen_pixels))));
+}
+
+void GEngine::CTextureStreamer::RequestLevel(const CTexture *texture, int level) {
+  auto it = entries_.find(texture);
+  if (it == entries_.end()) {
+    return;
+  }
+  it->second.requested_level_ = std::min(it->second.requested_level_, std::max(0, level));
+  it->second.last_used_frame_ = frame_;
+}
+
+void GEngine::CTextureStreamer::RequestScreenSize(const CTexture *texture, float screen_pixels) {
+  if (texture != nullptr) {
+    RequestLevel(texture, ComputeLevel(std::max(texture->GetWidth(), texture->GetHeight()), screen_pixels));
+  }
+}
+
+void GEngine::CTextureStreamer::RequestMaterial(const CMaterial &material, float screen_pixels) {
+  const CTexture *textures[] = {material.diffuse_texture_.get(),   material.normal_texture_.get(),
+                                material.alpha_texture_.get(),     material.basecolor_texture_.get(),
+                                material.roughness_texture_.get(), material.metallic_texture_.get(),
+                                material.ao_texture_.get(),        material.emissive_texture_.get(),
+                                material.unknown_texture_.get()};
+  for (const CTexture *texture : textures) {
+    RequestScreenSize(texture, screen_pixels);
+  }
+}
+
+void GEngine::CTextureStreamer::DefineLevel(const SEntry &entry, CTexture &texture, int level, bool empty) {
+  int width = empty ? 0 : std::max(1, entry.image_.width_ >> level);
+  int height = empty ? 0 : std::max(1, entry.image_.height_ >> level);
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, texture.id_);
+  if (entry.image_.compressed_) {
+    GLsizei bytes = empty ? 0 : static_cast<GLsizei>(GetLevelData(entry, level).size());
+    glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.compressed_format_, width, height, 0, bytes, nullptr);
+  } else {
+    glTexImage2D(GL_TEXTURE_2D, level, static_cast<GLint>(texture.internal_format_), width, height, 0,
+                 static_cast<GLenum>(texture.external_format_), GL_UNSIGNED_BYTE, nullptr);
+  }
+}
+
+bool GEngine::CTextureStreamer::EvictOne(uint64_t frame, const SEntry *keep) {
+  // least recently used first, textures finer than their draws need count as unused
+  SEntry *victim = nullptr;
+  for (auto &[key, entry] : entries_) {
+    if (&entry == keep || entry.uploading_level_ >= 0 || entry.resident_level_ >= entry.initial_level_) {
+      continue;
+    }
+    bool unused = entry.last_used_frame_ < frame || entry.resident_level_ < entry.wanted_level_;
+    if (unused && (!victim || entry.last_used_frame_ < victim->last_used_frame_ ||
+                   (entry.last_used_frame_ == victim->last_used_frame_ &&
+                    entry.resident_level_ < victim->resident_level_))) {
+      victim = &entry;
+    }
+  }
+  auto texture = victim ? victim->texture_.lock() : nullptr;
+  if (!texture) {
+    return false;
+  }
+  int level = victim->resident_level_++;
+  CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, texture->id_);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, victim->resident_level_);
+  // a 0x0 image releases the level storage
+  DefineLevel(*victim, *texture, level, true);
+  resident_bytes_ -= GetLevelData(*victim, level).size();
+  evicted_levels_++;
+  return true;
+}
+
+void GEngine::CTextureStreamer::Tick() {
+  if (entries_.empty()) {
+    return;
+  }
+  // requests of the frame just drawn
+  uint64_t frame = frame_++;
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    SEntry &entry = it->second;
+    if (entry.texture_.expired()) {
+      for (int level = entry.resident_level_; level < entry.level_count_; level++) {
+        resident_bytes_ -= GetLevelData(entry, level).size();
+      }
+      if (entry.uploading_level_ >= 0) {
+        resident_bytes_ -= GetLevelData(entry, entry.uploading_level_).size();
+      }
+      it = entries_.erase(it);
+      continue;
+    }
+    entry.wanted_level_ = std::min(entry.requested_level_, entry.initial_level_);
+    entry.requested_level_ = entry.initial_level_;
+    ++it;
+  }
+  // e.g. the budget was lowered
+  while (resident_bytes_ > budget_bytes_ && EvictOne(frame, nullptr)) {
+  }
+
+  candidates_.clear();
+  for (auto &[key, entry] : entries_) {
+    if (entry.uploading_level_ < 0 && entry.wanted_level_ < entry.resident_level_) {
+      candidates_.push_back(&entry);
+    }
+  }
+  if (candidates_.empty()) {
+    return;
+  }
+  // the most recently drawn, most blurry textures first
+  std::sort(candidates_.begin(), candidates_.end(), [](const SEntry *a, const SEntry *b) {
+    if (a->last_used_frame_ != b->last_used_frame_) {
+      return a->last_used_frame_ > b->last_used_frame_;
+    }
+    return a->resident_level_ - a->wanted_level_ > b->resident_level_ - b->wanted_level_;
+  });
+
+  auto upload_queue = CSingleton<CTextureUploadQueue>();
+  for (SEntry *entry : candidates_) {
+    // keep about two frames of uploads queued, the rest waits for next Tick
+    if (upload_queue->GetPendingBytes() > 2 * upload_queue->GetBytesPerFrame()) {
+      break;
+    }
+    auto texture = entry->texture_.lock();
+    int level = entry->resident_level_ - 1;
+    size_t bytes = GetLevelData(*entry, level).size();
+    while (resident_bytes_ + bytes > budget_bytes_ && EvictOne(entry->last_used_frame_, entry)) {
+    }
+    if (resident_bytes_ + bytes > budget_bytes_) {
+      break;
+    }
+    DefineLevel(*entry, *texture, level, false);
+    entry->uploading_level_ = level;
+    resident_bytes_ += bytes;
+
+    CTextureUploadQueue::SRequest request;
+    request.texture_ = texture->id_;
+    request.level_ = level;
+    request.width_ = std::max(1, entry->image_.width_ >> level);
+    request.height_ = std::max(1, entry->image_.height_ >> level);
+    request.compressed_ = entry->image_.compressed_;
+    request.format_ = request.compressed_ ? texture->compressed_format_ : static_cast<GLenum>(texture->external_format_);
+    // the entry outlives the request, CTexture cancels its uploads when deleted
+    request.data_ = GetLevelData(*entry, level).data();
+    request.bytes_ = bytes;
+    GLuint id = texture->id_;
+    request.on_uploaded_ = [this, entry, level, id]() {
+      // complete, sampled from the next draw on
+      entry->resident_level_ = level;
+      entry->uploading_level_ = -1;
+      CSingleton<CGLStateCache>()->BindTexture(GL_TEXTURE_2D, id);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+      uploaded_levels_++;
+    };
+    upload_queue->Enqueue(std::move(request));
+  }
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "GEngine/texture.h"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace GEngine {
+class CMaterial;
+
+// mip streaming of material textures. A streamed texture starts with its
+// small levels (<= kInitialSize) resident and keeps the full decoded chain on
+// the cpu; draws request levels from their screen size, Tick() queues one
+// finer level at a time on CTextureUploadQueue and evicts the finest levels
+// of the least recently used textures when the budget is exceeded.
+// Opt-in: enable before the meshes are loaded.
+class CTextureStreamer {
+public:
+  static constexpr int kInitialSize = 128;
+
+  void SetEnabled(bool enabled) { enabled_ = enabled; }
+  bool IsEnabled() const { return enabled_; }
+  void SetBudget(size_t bytes) { budget_bytes_ = bytes; }
+  size_t GetBudget() const { return budget_bytes_; }
+
+  // GL thread, the texture is created at its coarse levels
+  std::shared_ptr<CTexture> CreateStreamedTexture(SDecodedImage &&image, std::shared_ptr<CSampler> sampler = nullptr);
+  bool IsStreamed(const CTexture *texture) const { return entries_.count(texture) != 0; }
+
+  // the finest level a surface covering screen_pixels (texels along its
+  // longest axis) needs from a texture of texture_size
+  static int ComputeLevel(int texture_size, float screen_pixels);
+  void RequestLevel(const CTexture *texture, int level);
+  void RequestScreenSize(const CTexture *texture, float screen_pixels);
+  void RequestMaterial(const CMaterial &material, float screen_pixels);
+
+  // GL thread, once per frame before the passes
+  void Tick();
+
+  size_t GetStreamedCount() const { return entries_.size(); }
+  size_t GetResidentBytes() const { return resident_bytes_; }
+  unsigned int GetUploadedLevels() const { return uploaded_levels_; }
+  unsigned int GetEvictedLevels() const { return evicted_levels_; }
+
+private:
+  struct SEntry {
+    std::weak_ptr<CTexture> texture_;
+    SDecodedImage image_;
+    int level_count_ = 0;
+    // coarsest level never evicted
+    int initial_level_ = 0;
+    // finest complete level, the texture's GL_TEXTURE_BASE_LEVEL
+    int resident_level_ = 0;
+    // level queued for upload, -1 when idle
+    int uploading_level_ = -1;
+    int requested_level_ = 0;
+    int wanted_level_ = 0;
+    uint64_t last_used_frame_ = 0;
+  };
+
+  const std::vector<uint8_t> &GetLevelData(const SEntry &entry, int level) const;
+  // define the level storage with undefined contents, PBO unbound
+  void DefineLevel(const SEntry &entry, CTexture &texture, int level, bool empty);
+  // frees the finest level of the least recently used texture used before
+  // frame, false if there is nothing to evict
+  bool EvictOne(uint64_t frame, const SEntry *keep);
+
+  bool enabled_ = false;
+  size_t budget_bytes_ = 256u << 20;
+  std::unordered_map<const CTexture *, SEntry> entries_;
+  std::vector<SEntry *> candidates_;
+  uint64_t frame_ = 1;
+  size_t resident_bytes_ = 0;
+  unsigned int uploaded_levels_ = 0;
+  unsigned int evicted_levels_ = 0;
+};
+} // namespace GEngine
@@ -0,0 +1,139 @@
+#include "GEngine/texture_upload_queue.h"
+#include "GEngine/gl_state_cache.h"
+#include "GEngine/singleton.h"
+#include <algorithm>
+
+const uint8_t *GEngine::CTextureUploadQueue::GetData(const SRequest &request) {
+  return request.data_ ? request.data_ : request.pixels_.data();
+}
+
+int GEngine::CTextureUploadQueue::GetUnitCount(const SRequest &request) {
+  int rows_per_unit = GetRowsPerUnit(request);
+  return (request.height_ + rows_per_unit - 1) / rows_per_unit;
+}
+
+void GEngine::CTextureUploadQueue::Issue(const SRequest &request, int first_row, int row_count, size_t bytes,
+                                         const void *pixels) {
+  CSingleton<CGLStateCache>()->BindTexture(request.target_, request.texture_);
+  if (request.compressed_) {
+    glCompressedTexSubImage2D(request.image_target_, request.level_, 0, first_row, request.width_, row_count,
+                              request.format_, static_cast<GLsizei>(bytes), pixels);
+  } else {
+    glTexSubImage2D(request.image_target_, request.level_, 0, first_row, request.width_, row_count,
+                    request.format_, GL_UNSIGNED_BYTE, pixels);
+  }
+}
+
+void GEngine::CTextureUploadQueue::Enqueue(SRequest &&request) {
+  if (!request.data_) {
+    request.bytes_ = request.pixels_.size();
+  }
+  pending_bytes_ += request.bytes_;
+  pending_.push_back({std::move(request), 0});
+}
+
+void GEngine::CTextureUploadQueue::Cancel(GLuint texture) {
+  for (auto it = pending_.begin(); it != pending_.end();) {
+    if (it->request_.texture_ != texture) {
+      ++it;
+      continue;
+    }
+    size_t unit_bytes = it->request_.bytes_ / GetUnitCount(it->request_);
+    pending_bytes_ -= it->request_.bytes_ - it->uploaded_rows_ / GetRowsPerUnit(it->request_) * unit_bytes;
+    it = pending_.erase(it);
+  }
+}
+
+bool GEngine::CTextureUploadQueue::IsPending(GLuint texture) const {
+  return std::any_of(pending_.begin(), pending_.end(),
+                     [texture](const SPending &pending) { return pending.request_.texture_ == texture; });
+}
+
+void GEngine::CTextureUploadQueue::SetBytesPerFrame(size_t bytes) {
+  bytes_per_frame_ = std::max<size_t>(bytes, 1u << 20);
+  // the ring is sized by the cap, re-created on the next Tick
+  if (ring_ && ring_->GetSlotBytes() != bytes_per_frame_) {
+    ring_.reset();
+  }
+}
+
+void GEngine::CTextureUploadQueue::Flush() {
+  if (pending_.empty()) {
+    return;
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  while (!pending_.empty()) {
+    SPending pending = std::move(pending_.front());
+    pending_.pop_front();
+    const SRequest &request = pending.request_;
+    size_t unit_bytes = request.bytes_ / GetUnitCount(request);
+    size_t done = pending.uploaded_rows_ / GetRowsPerUnit(request) * unit_bytes;
+    Issue(request, pending.uploaded_rows_, request.height_ - pending.uploaded_rows_, request.bytes_ - done,
+          GetData(request) + done);
+    if (request.on_uploaded_) {
+      request.on_uploaded_();
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  pending_bytes_ = 0;
+}
+
+void GEngine::CTextureUploadQueue::Tick() {
+  uploaded_bytes_ = 0;
+  if (pending_.empty()) {
+    return;
+  }
+  if (!ring_) {
+    ring_ = std::make_unique<CPixelUnpackRing>(bytes_per_frame_);
+  }
+  // the gpu still reads the next slot, try again next frame
+  if (!ring_->Map()) {
+    return;
+  }
+  strips_.clear();
+  for (auto &pending : pending_) {
+    const SRequest &request = pending.request_;
+    int rows_per_unit = GetRowsPerUnit(request);
+    size_t unit_bytes = request.bytes_ / GetUnitCount(request);
+    int first_unit = pending.uploaded_rows_ / rows_per_unit;
+    // Stage() aligns to 16 bytes
+    size_t free_bytes = ring_->GetSlotBytes() - std::min(ring_->GetSlotBytes(), ring_->GetStagedBytes() + 15);
+    int units = static_cast<int>(std::min<size_t>(GetUnitCount(request) - first_unit, free_bytes / unit_bytes));
+    size_t offset = 0;
+    if (units == 0 || !ring_->Stage(GetData(request) + first_unit * unit_bytes, units * unit_bytes, offset)) {
+      break;
+    }
+    int row_count = std::min(request.height_ - pending.uploaded_rows_, units * rows_per_unit);
+    strips_.push_back({&pending, pending.uploaded_rows_, row_count, offset, units * unit_bytes});
+    pending.uploaded_rows_ += row_count;
+    pending_bytes_ -= units * unit_bytes;
+    if (pending.uploaded_rows_ < request.height_) {
+      // the slot is full, keep the strips in order
+      break;
+    }
+  }
+  uploaded_bytes_ = ring_->GetStagedBytes();
+
+  ring_->Unmap();
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  size_t completed_count = 0;
+  completed_.clear();
+  for (const auto &strip : strips_) {
+    const SRequest &request = strip.pending_->request_;
+    Issue(request, strip.first_row_, strip.row_count_, strip.bytes_, reinterpret_cast<const void *>(strip.offset_));
+    if (strip.pending_->uploaded_rows_ >= request.height_) {
+      completed_.push_back(request.on_uploaded_);
+      completed_count++;
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  ring_->Submit();
+  // strips are staged front to back, only the front ones complete
+  pending_.erase(pending_.begin(), pending_.begin() + completed_count);
+  for (const auto &on_uploaded : completed_) {
+    if (on_uploaded) {
+      on_uploaded();
+    }
+  }
+}
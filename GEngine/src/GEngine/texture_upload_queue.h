@@ -0,0 +1,82 @@
+#pragma once
+#include "GEngine/pixel_unpack_ring.h"
+#include <glad/glad.h>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace GEngine {
+// texture uploads spread over frames: every Tick() copies up to the per-frame
+// byte cap into a fenced CPixelUnpackRing slot and issues glTex(Compressed)SubImage2D
+// from the buffer offsets, big images go in row strips. The level storage must be
+// defined (glTexImage2D with nullptr) before Enqueue, its contents are undefined
+// until on_uploaded_ runs.
+class CTextureUploadQueue {
+public:
+  struct SRequest {
+    GLuint texture_ = 0;
+    GLenum target_ = GL_TEXTURE_2D;
+    // GL_TEXTURE_2D or a cubemap face
+    GLenum image_target_ = GL_TEXTURE_2D;
+    int level_ = 0;
+    int width_ = 0;
+    int height_ = 0;
+    // GL_RED/GL_RGB/GL_RGBA of unsigned bytes, or the GL_COMPRESSED_* format
+    GLenum format_ = GL_RGBA;
+    bool compressed_ = false;
+    // tightly packed rows (block rows when compressed), owned by the request,
+    // or data_ when the caller keeps the pixels alive until uploaded/cancelled
+    std::vector<uint8_t> pixels_;
+    const uint8_t *data_ = nullptr;
+    size_t bytes_ = 0;
+    // GL thread, after the last strip was issued
+    std::function<void()> on_uploaded_;
+  };
+
+  void Enqueue(SRequest &&request);
+  // drops the requests of a texture about to be deleted
+  void Cancel(GLuint texture);
+  bool IsPending(GLuint texture) const;
+  // uploads everything now from client memory, for passes that read the
+  // textures at init
+  void Flush();
+
+  void SetBytesPerFrame(size_t bytes);
+  size_t GetBytesPerFrame() const { return bytes_per_frame_; }
+
+  // GL thread, once per frame
+  void Tick();
+
+  size_t GetPendingCount() const { return pending_.size(); }
+  size_t GetPendingBytes() const { return pending_bytes_; }
+  size_t GetUploadedBytes() const { return uploaded_bytes_; }
+
+private:
+  struct SPending {
+    SRequest request_;
+    int uploaded_rows_ = 0;
+  };
+  struct SStrip {
+    SPending *pending_;
+    int first_row_;
+    int row_count_;
+    size_t offset_;
+    size_t bytes_;
+  };
+
+  static const uint8_t *GetData(const SRequest &request);
+  static int GetRowsPerUnit(const SRequest &request) { return request.compressed_ ? 4 : 1; }
+  static int GetUnitCount(const SRequest &request);
+  static void Issue(const SRequest &request, int first_row, int row_count, size_t bytes, const void *pixels);
+
+  std::deque<SPending> pending_;
+  std::unique_ptr<CPixelUnpackRing> ring_;
+  std::vector<SStrip> strips_;
+  std::vector<std::function<void()>> completed_;
+  size_t bytes_per_frame_ = 8u << 20;
+  size_t pending_bytes_ = 0;
+  size_t uploaded_bytes_ = 0;
+};
+} // namespace GEngine
@@ -11,8 +11,18 @@ int main() {
   // CSingleton<CRenderSystem>()->RegisterRenderPass(std::make_shared<CIBLPass>("ibl_pass", 2));
   CSingleton<CRenderSystem>()->RegisterRenderPass(std::make_shared<PrecomputedAtmospherePass>("PrecomputedAtmospherePass", 1));
 
+  // CSingleton<CRenderSystem>()->RegisterRenderPass(std::make_shared<CCascadedShadowPass>("shadow_pass", 2));
+  // CSingleton<CRenderSystem>()->RegisterRenderPass(std::make_shared<COcclusionCullingPass>("occlusion_culling_pass", 3));
+  // CSingleton<CRenderSystem>()->RegisterRenderPass(std::make_shared<CDepthPass>("depth_pass", 4));
+  // CSingleton<CRenderSystem>()->RegisterRenderPass(std::make_shared<CLightCullingPass>("light_culling_pass", 5));
+  // CSingleton<CRenderSystem>()->RegisterRenderPass(std::make_shared<CForwardPass>("forward_pass", 6));
+  // CSingleton<CRenderSystem>()->RegisterRenderPass(std::make_shared<CHiZPass>("hiz_pass", 7));
+
+  // stream material texture mips, before the objects are loaded
+  // CSingleton<CTextureStreamer>()->SetEnabled(true);
   // CSingleton<CRenderSystem>()->AddLight(Omilight1);
   // CSingleton<CRenderSystem>()->RegisterRenderObject(Object);
+  // CSingleton<CRenderSystem>()->RegisterInstancedObject(Prop, PropTransforms);
   
   CSingleton<CApp>()->Init();
   CSingleton<CApp>()->RunMainLoop();
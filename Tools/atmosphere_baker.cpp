@@ -0,0 +1,167 @@
+// offline atmosphere LUT baker, runs the CPU reference of the precomputation
+// and writes a CAtmosphereLUTCache file the engine loads instead of
+// precomputing on the GPU, or diffs the reference against a cache file the GPU
+// wrote:
+//   AtmosphereBaker [--orders 4] [--luminance] [--combined] [--half] [--no-ozone]
+//                   [--constant-solar] [--rgba] [--out ../../cache/atmosphere] [--diff gpu.lut]
+// --rgba matches drivers without RGB float render targets (the key hashes it)
+#include "GEngine/atmosphere_lut_cache.h"
+#include "GEngine/atmosphere_reference.h"
+#include "GEngine/job_system.h"
+#include "GEngine/log.h"
+#include "GEngine/singleton.h"
+#include <glm/gtc/packing.hpp>
+#include <chrono>
+#include <cstring>
+
+using namespace GEngine;
+
+static CAtmosphereLUTCache::SImage ToCacheImage(const CAtmosphereReference::SImage &image, GLenum target,
+                                                bool rgba, bool half) {
+  CAtmosphereLUTCache::SImage result;
+  result.target_ = target;
+  result.internal_format_ = rgba ? (half ? GL_RGBA16F : GL_RGBA32F) : (half ? GL_RGB16F : GL_RGB32F);
+  result.width_ = image.width_;
+  result.height_ = image.height_;
+  result.depth_ = target == GL_TEXTURE_3D ? image.depth_ : 1;
+  result.format_ = rgba ? GL_RGBA : GL_RGB;
+  result.type_ = half ? GL_HALF_FLOAT : GL_FLOAT;
+  int channels = rgba ? 4 : 3;
+  size_t component_bytes = half ? 2 : 4;
+  result.data_.resize(image.texels_.size() * channels * component_bytes);
+  char *out = result.data_.data();
+  for (const auto &texel : image.texels_) {
+    for (int c = 0; c < channels; c++, out += component_bytes) {
+      if (half) {
+        uint16_t value = glm::packHalf1x16(texel[c]);
+        std::memcpy(out, &value, sizeof(value));
+      } else {
+        std::memcpy(out, &texel[c], sizeof(float));
+      }
+    }
+  }
+  return result;
+}
+
+static CAtmosphereReference::SImage FromCacheImage(const CAtmosphereLUTCache::SImage &image) {
+  CAtmosphereReference::SImage result;
+  result.width_ = image.width_;
+  result.height_ = image.height_;
+  result.depth_ = std::max(1, image.depth_);
+  int channels = image.format_ == GL_RGBA ? 4 : 3;
+  size_t component_bytes = image.type_ == GL_HALF_FLOAT ? 2 : 4;
+  size_t count = static_cast<size_t>(result.width_) * result.height_ * result.depth_;
+  if (image.data_.size() != count * channels * component_bytes) {
+    return result;
+  }
+  result.texels_.assign(count, glm::vec4(0.0f));
+  const char *in = image.data_.data();
+  for (auto &texel : result.texels_) {
+    for (int c = 0; c < channels; c++, in += component_bytes) {
+      if (component_bytes == 2) {
+        uint16_t value;
+        std::memcpy(&value, in, sizeof(value));
+        texel[c] = glm::unpackHalf1x16(value);
+      } else {
+        std::memcpy(&texel[c], in, sizeof(float));
+      }
+    }
+  }
+  return result;
+}
+
+int main(int argc, char **argv) {
+  CLog::Init();
+  CSingleton<CJobSystem>()->Init();
+  unsigned int num_scattering_orders = 4;
+  bool precomputed_luminance = false;
+  bool combined = false;
+  bool half = false;
+  bool ozone = true;
+  bool constant_solar = false;
+  bool rgb_format_supported = true;
+  std::string diff_path;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--orders" && i + 1 < argc) {
+      num_scattering_orders = static_cast<unsigned int>(std::max(1, std::atoi(argv[++i])));
+    } else if (arg == "--luminance") {
+      precomputed_luminance = true;
+    } else if (arg == "--combined") {
+      combined = true;
+    } else if (arg == "--half") {
+      half = true;
+    } else if (arg == "--no-ozone") {
+      ozone = false;
+    } else if (arg == "--constant-solar") {
+      constant_solar = true;
+    } else if (arg == "--rgba") {
+      rgb_format_supported = false;
+    } else if (arg == "--out" && i + 1 < argc) {
+      CSingleton<CAtmosphereLUTCache>()->SetDirectory(argv[++i]);
+    } else if (arg == "--diff" && i + 1 < argc) {
+      diff_path = argv[++i];
+    } else {
+      GE_ERROR("Unknown argument {0}", arg);
+      return 1;
+    }
+  }
+
+  // the same parameters and key as PrecomputedAtmospherePass::Init
+  SAtmosphereParameters parameters =
+      SAtmosphereParameters::Earth(ozone, constant_solar, half, precomputed_luminance ? 15 : 3, combined);
+  uint64_t key = CAtmosphereLUTCache::Hash(parameters.Hash(rgb_format_supported), num_scattering_orders);
+
+  auto start = std::chrono::steady_clock::now();
+  CAtmosphereReference::SLuts luts = CAtmosphereReference::Precompute(parameters, num_scattering_orders);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  GE_INFO("Reference LUTs ({0} scattering orders) computed in {1:.1f} s on {2} threads", num_scattering_orders,
+          seconds, CSingleton<CJobSystem>()->GetWorkerCount() + 1);
+
+  // the texture order and formats of PrecomputedAtmosphereModel
+  struct SEntry {
+    const char *name_;
+    const CAtmosphereReference::SImage *image_;
+    GLenum target_;
+    bool rgba_;
+    bool half_;
+    int channels_;
+  };
+  std::vector<SEntry> entries = {
+      {"transmittance", &luts.transmittance_, GL_TEXTURE_2D, true, false, 3},
+      {"scattering", &luts.scattering_, GL_TEXTURE_3D, combined || !rgb_format_supported, half, combined ? 4 : 3},
+      {"irradiance", &luts.irradiance_, GL_TEXTURE_2D, true, false, 3}};
+  if (!combined) {
+    entries.push_back({"single mie", &luts.single_mie_scattering_, GL_TEXTURE_3D, !rgb_format_supported, half, 3});
+  }
+
+  if (!diff_path.empty()) {
+    uint64_t gpu_key = 0;
+    std::vector<CAtmosphereLUTCache::SImage> gpu_images;
+    if (!CAtmosphereLUTCache::ReadFile(diff_path, gpu_key, gpu_images) || gpu_images.size() != entries.size()) {
+      GE_ERROR("Cannot read {0} textures from {1}", entries.size(), diff_path);
+      return 1;
+    }
+    if (gpu_key != key) {
+      GE_WARN("{0} was computed with other parameters (key {1:x}, expected {2:x})", diff_path, gpu_key, key);
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+      CAtmosphereReference::SDiff diff =
+          CAtmosphereReference::Compare(FromCacheImage(gpu_images[i]), *entries[i].image_, entries[i].channels_);
+      GE_INFO("{0:<14} max abs {1:.3e}  max rel {2:.3e}  rmse {3:.3e}", entries[i].name_, diff.max_abs_error_,
+              diff.max_rel_error_, diff.rmse_);
+    }
+    return 0;
+  }
+
+  std::vector<CAtmosphereLUTCache::SImage> images;
+  for (const auto &entry : entries) {
+    images.push_back(ToCacheImage(*entry.image_, entry.target_, entry.rgba_, entry.half_));
+  }
+  std::string path = CSingleton<CAtmosphereLUTCache>()->GetPath(key);
+  if (!CAtmosphereLUTCache::WriteFile(path, key, images)) {
+    return 1;
+  }
+  GE_INFO("Wrote {0}", path);
+  return 0;
+}
@@ -0,0 +1,84 @@
+// offline IBL baker, runs the CPU implementation of the CIBLPass bake (SH9
+// irradiance, prefiltered cubemap, BRDF LUT) on a skybox and writes the
+// CIBLCache file the engine loads instead of baking on the GPU:
+//   IBLBaker [--out ../../cache/ibl] [+x -x +y -y +z -z face images]
+// without faces it bakes the skybox of CSkyboxPass
+#include "GEngine/ibl_baker.h"
+#include "GEngine/ibl_cache.h"
+#include "GEngine/job_system.h"
+#include "GEngine/log.h"
+#include "GEngine/singleton.h"
+#include <stb/stb_image.h>
+#include <chrono>
+
+using namespace GEngine;
+
+int main(int argc, char **argv) {
+  CLog::Init();
+  CSingleton<CJobSystem>()->Init();
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--out" && i + 1 < argc) {
+      CSingleton<CIBLCache>()->SetDirectory(argv[++i]);
+    } else if (arg.rfind("--", 0) == 0) {
+      GE_ERROR("Unknown argument {0}", arg);
+      return 1;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.empty()) {
+    paths = {"../../assets/textures/skybox_outdoor/right.png", "../../assets/textures/skybox_outdoor/left.png",
+             "../../assets/textures/skybox_outdoor/top.png",   "../../assets/textures/skybox_outdoor/bottom.png",
+             "../../assets/textures/skybox_outdoor/front.png", "../../assets/textures/skybox_outdoor/back.png"};
+  }
+  if (paths.size() != 6) {
+    GE_ERROR("Expected 6 face images, got {0}", paths.size());
+    return 1;
+  }
+
+  // decoded and hashed like CSkyboxPass::LoadCubemapFromFiles
+  struct SFace {
+    int width = 0, height = 0, components_number = 0;
+    std::vector<uint8_t> pixels;
+  };
+  std::vector<SFace> faces(6);
+  std::array<uint64_t, 6> face_hashes;
+  std::array<const uint8_t *, 6> face_pixels;
+  for (int i = 0; i < 6; i++) {
+    unsigned char *data = stbi_load(paths[i].c_str(), &faces[i].width, &faces[i].height, &faces[i].components_number, 0);
+    if (!data) {
+      GE_ERROR("Cubemap texture failed to load at path: {0}", paths[i]);
+      return 1;
+    }
+    faces[i].pixels.assign(data, data + static_cast<size_t>(faces[i].width) * faces[i].height * faces[i].components_number);
+    stbi_image_free(data);
+    if (faces[i].width != faces[0].width || faces[i].height != faces[i].width ||
+        faces[i].components_number != faces[0].components_number) {
+      GE_ERROR("Face {0} is not a {1}^2 image like the first one", paths[i], faces[0].width);
+      return 1;
+    }
+    face_hashes[i] = CIBLCache::HashFace(faces[i].width, faces[i].height, faces[i].components_number,
+                                         faces[i].pixels.data());
+    face_pixels[i] = faces[i].pixels.data();
+  }
+  // the settings of CIBLPass
+  SIBLBakeSettings settings;
+  uint64_t key = CIBLCache::GetKey(CIBLCache::HashSkybox(face_hashes), settings);
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<CIBLBaker::SCubemapLevel> chain =
+      CIBLBaker::BuildMipChain(CIBLBaker::FromPixels(face_pixels, faces[0].width, faces[0].components_number));
+  CIBLBaker::SResult result = CIBLBaker::Bake(chain, settings);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  GE_INFO("IBL of a {0}^2 skybox baked in {1:.1f} s on {2} threads", faces[0].width, seconds,
+          CSingleton<CJobSystem>()->GetWorkerCount() + 1);
+
+  std::string path = CSingleton<CIBLCache>()->GetPath(key);
+  if (!CIBLCache::WriteFile(path, key, CIBLCache::FromBake(result, settings))) {
+    return 1;
+  }
+  GE_INFO("Wrote {0}", path);
+  return 0;
+}
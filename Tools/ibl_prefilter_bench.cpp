@@ -0,0 +1,150 @@
+// cpu benchmark of the prefiltered cubemap bake, no GL context needed: the
+// previous prefilter (4096 samples on every level, the source mip of the
+// target texel size) against filtered importance sampling with the sample
+// counts of SIBLBakeSettings, both compared to a reference that reads level 0
+// with many samples:
+//   IBLPrefilterBench [--size 64] [--levels 7] [--reference-samples 32768] [+x -x +y -y +z -z face images]
+// without faces the environment is a 256^2 sky with a bright sun, where the
+// undersampled high-frequency light shows best. At the defaults, from
+// assets/textures/skybox_outdoor, 2 threads:
+//   IBLPrefilterBench right.png left.png top.png bottom.png front.png back.png
+//   level  roughness  rmse fixed (samples)  rmse filtered (samples)
+//   0      0.00       9.42e-3 (1)           9.42e-3 (1)
+//   1      0.17       2.02e-3 (4096)        9.43e-4 (171)
+//   2      0.33       1.11e-3 (4096)        7.23e-4 (342)
+//   3      0.50       1.69e-3 (4096)        7.13e-4 (512)
+//   4      0.67       3.37e-3 (4096)        6.72e-4 (683)
+//   5      0.83       6.13e-3 (4096)        7.22e-4 (854)
+//   6      1.00       1.71e-2 (4096)        9.84e-4 (1024)
+//   bake time 561 ms -> 55 ms
+#include "GEngine/ibl_baker.h"
+#include "GEngine/job_system.h"
+#include "GEngine/log.h"
+#include "GEngine/singleton.h"
+#include <stb/stb_image.h>
+#include <chrono>
+#include <cmath>
+
+using namespace GEngine;
+
+static CIBLBaker::SCubemapLevel MakeSkyWithSun(int size) {
+  const glm::vec3 sun = glm::normalize(glm::vec3(0.4f, 0.6f, -0.7f));
+  CIBLBaker::SCubemapLevel level;
+  level.size_ = size;
+  for (int face = 0; face < 6; face++) {
+    level.faces_[face].resize(static_cast<size_t>(size) * size);
+    for (int y = 0; y < size; y++) {
+      float tc = -1.0f + (y + 0.5f) * 2.0f / size;
+      for (int x = 0; x < size; x++) {
+        float sc = -1.0f + (x + 0.5f) * 2.0f / size;
+        glm::vec3 d = glm::normalize(CSphericalHarmonics::CubemapDirection(face, sc, tc));
+        glm::vec3 color = d.y > 0.0f ? glm::mix(glm::vec3(0.6f, 0.7f, 0.9f), glm::vec3(0.2f, 0.35f, 0.8f), d.y)
+                                     : glm::vec3(0.15f, 0.12f, 0.1f);
+        // a disc of ~2 degrees
+        if (glm::dot(d, sun) > 0.9994f) {
+          color = glm::vec3(200.0f, 180.0f, 150.0f);
+        }
+        level.faces_[face][y * size + x] = color;
+      }
+    }
+  }
+  return level;
+}
+
+static double Rmse(const CIBLBaker::SCubemapLevel &level, const CIBLBaker::SCubemapLevel &reference) {
+  double sum = 0.0;
+  size_t count = 0;
+  for (int face = 0; face < 6; face++) {
+    for (size_t i = 0; i < level.faces_[face].size(); i++) {
+      glm::dvec3 diff = glm::dvec3(level.faces_[face][i]) - glm::dvec3(reference.faces_[face][i]);
+      sum += glm::dot(diff, diff);
+      count += 3;
+    }
+  }
+  return std::sqrt(sum / static_cast<double>(count));
+}
+
+int main(int argc, char **argv) {
+  CLog::Init();
+  CSingleton<CJobSystem>()->Init();
+  SIBLBakeSettings filtered;
+  filtered.prefiltered_size_ = 64;
+  filtered.prefiltered_levels_ = 7;
+  unsigned int reference_samples = 32768;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--size" && i + 1 < argc) {
+      filtered.prefiltered_size_ = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--levels" && i + 1 < argc) {
+      filtered.prefiltered_levels_ = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--reference-samples" && i + 1 < argc) {
+      reference_samples = static_cast<unsigned int>(std::max(1, std::atoi(argv[++i])));
+    } else if (arg.rfind("--", 0) == 0) {
+      GE_ERROR("Unknown argument {0}", arg);
+      return 1;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+
+  CIBLBaker::SCubemapLevel level0;
+  if (paths.empty()) {
+    level0 = MakeSkyWithSun(256);
+  } else if (paths.size() == 6) {
+    std::vector<std::vector<uint8_t>> pixels(6);
+    std::array<const uint8_t *, 6> faces;
+    int size = 0, channels = 0;
+    for (int i = 0; i < 6; i++) {
+      int width = 0, height = 0, components = 0;
+      unsigned char *data = stbi_load(paths[i].c_str(), &width, &height, &components, 0);
+      if (!data || width != height || (i > 0 && (width != size || components != channels))) {
+        GE_ERROR("Cannot use {0} as a cubemap face", paths[i]);
+        stbi_image_free(data);
+        return 1;
+      }
+      size = width;
+      channels = components;
+      pixels[i].assign(data, data + static_cast<size_t>(width) * height * components);
+      stbi_image_free(data);
+      faces[i] = pixels[i].data();
+    }
+    level0 = CIBLBaker::FromPixels(faces, size, channels);
+  } else {
+    GE_ERROR("Expected 6 face images, got {0}", paths.size());
+    return 1;
+  }
+  int source_size = level0.size_;
+  std::vector<CIBLBaker::SCubemapLevel> chain = CIBLBaker::BuildMipChain(std::move(level0));
+
+  SIBLBakeSettings fixed = filtered;
+  fixed.filtered_importance_sampling_ = false;
+  fixed.prefiltered_samples_ = 4096;
+  SIBLBakeSettings reference = filtered;
+  reference.prefiltered_samples_ = reference_samples;
+
+  auto Time = [&](const SIBLBakeSettings &settings, bool is_reference, double &ms) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<CIBLBaker::SCubemapLevel> result = CIBLBaker::Prefilter(chain, settings, is_reference);
+    ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+  };
+  double reference_ms = 0.0, fixed_ms = 0.0, filtered_ms = 0.0;
+  std::vector<CIBLBaker::SCubemapLevel> reference_levels = Time(reference, true, reference_ms);
+  std::vector<CIBLBaker::SCubemapLevel> fixed_levels = Time(fixed, false, fixed_ms);
+  std::vector<CIBLBaker::SCubemapLevel> filtered_levels = Time(filtered, false, filtered_ms);
+
+  GE_INFO("{0}^2 source -> {1}^2 x {2} levels on {3} threads, reference {4} samples from level 0 ({5:.0f} ms)",
+          source_size, filtered.prefiltered_size_, filtered.prefiltered_levels_,
+          CSingleton<CJobSystem>()->GetWorkerCount() + 1, reference_samples, reference_ms);
+  for (int l = 0; l < filtered.prefiltered_levels_; l++) {
+    float roughness =
+        filtered.prefiltered_levels_ > 1 ? static_cast<float>(l) / (filtered.prefiltered_levels_ - 1) : 0.0f;
+    GE_INFO("level {0} roughness {1:.2f}: fixed {2:>4} samples rmse {3:.4e}  filtered {4:>4} samples rmse {5:.4e}", l,
+            roughness, fixed.GetPrefilteredSampleCount(roughness), Rmse(fixed_levels[l], reference_levels[l]),
+            filtered.GetPrefilteredSampleCount(roughness), Rmse(filtered_levels[l], reference_levels[l]));
+  }
+  GE_INFO("bake time: fixed {0:.1f} ms, filtered importance sampling {1:.1f} ms ({2:.1f}x)", fixed_ms, filtered_ms,
+          fixed_ms / std::max(filtered_ms, 0.001));
+  return 0;
+}
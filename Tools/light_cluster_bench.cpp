@@ -0,0 +1,52 @@
+// cpu benchmark of the clustered light binning, no GL context needed
+#include "GEngine/job_system.h"
+#include "GEngine/light_cluster.h"
+#include "GEngine/log.h"
+#include "GEngine/singleton.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <random>
+
+using namespace GEngine;
+
+int main() {
+  CLog::Init();
+  CSingleton<CJobSystem>()->Init();
+  const int kIterations = 50;
+  const float kNear = 0.1f;
+  const float kFar = 300.0f;
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 5.0f, 0.0f), glm::vec3(0.0f, 5.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, kNear, kFar);
+
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> position_x(-150.0f, 150.0f);
+  std::uniform_real_distribution<float> position_y(0.0f, 30.0f);
+  std::uniform_real_distribution<float> position_z(-300.0f, 10.0f);
+  std::uniform_real_distribution<float> radius(2.0f, 20.0f);
+
+  for (int light_count : {64, 256, 1024, 4096}) {
+    std::vector<std::shared_ptr<CLight>> lights;
+    for (int i = 0; i < light_count; i++) {
+      auto light = std::make_shared<CLight>(i % 4 == 0 ? CLight::LightType::Spot : CLight::LightType::Omni);
+      light->position_ = glm::vec3(position_x(rng), position_y(rng), position_z(rng));
+      light->radius_ = radius(rng);
+      lights.push_back(light);
+    }
+    lights.push_back(std::make_shared<CLight>(CLight::LightType::Directional));
+
+    CLightClusterBuilder builder(16, 9, 24);
+    float time_ms[2] = {0.0f, 0.0f};
+    for (int mt = 0; mt < 2; mt++) {
+      builder.SetMultithreaded(mt == 1);
+      builder.Build(lights, view, projection, kNear, kFar); // warm up
+      for (int i = 0; i < kIterations; i++) {
+        builder.Build(lights, view, projection, kNear, kFar);
+        time_ms[mt] += builder.GetBuildTime();
+      }
+      time_ms[mt] /= kIterations;
+    }
+    GE_INFO("{0} lights: single thread {1:.3f} ms, {2} threads {3:.3f} ms, {4} light indices",
+            light_count, time_ms[0], CSingleton<CJobSystem>()->GetWorkerCount() + 1, time_ms[1],
+            builder.GetLightIndices().size());
+  }
+  return 0;
+}
@@ -0,0 +1,70 @@
+// cpu benchmark of the software occlusion culler, no GL context needed:
+// a wall in front of the camera hides a grid of boxes behind it
+#include "GEngine/log.h"
+#include "GEngine/occlusion_culler.h"
+#include <chrono>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace GEngine;
+
+// 12 triangles of a unit cube, scaled & placed with model
+static void AppendBox(std::vector<glm::vec3> &positions, std::vector<unsigned int> &indices) {
+  unsigned int base = static_cast<unsigned int>(positions.size());
+  for (int i = 0; i < 8; i++) {
+    positions.push_back(glm::vec3(i & 1 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 4 ? 0.5f : -0.5f));
+  }
+  const unsigned int faces[36] = {0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1,
+                                  2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3};
+  for (unsigned int index : faces) {
+    indices.push_back(base + index);
+  }
+}
+
+int main() {
+  CLog::Init();
+  const int kIterations = 100;
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 2.0f, 10.0f), glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 300.0f);
+  glm::mat4 view_projection = projection * view;
+
+  std::vector<glm::vec3> positions;
+  std::vector<unsigned int> indices;
+  AppendBox(positions, indices);
+  glm::mat4 wall = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 4.0f, 0.0f)), glm::vec3(12.0f, 8.0f, 0.5f));
+
+  // 32 x 32 boxes behind the wall, the outer ones are visible past its sides
+  std::vector<SAABB> boxes;
+  for (int x = 0; x < 32; x++) {
+    for (int z = 0; z < 32; z++) {
+      glm::vec3 center(-48.0f + x * 3.0f, 1.0f, -3.0f - z * 3.0f);
+      SAABB box;
+      box.Expand(center - glm::vec3(1.0f));
+      box.Expand(center + glm::vec3(1.0f));
+      boxes.push_back(box);
+    }
+  }
+
+  for (int width : {128, 256, 512}) {
+    COcclusionCuller culler;
+    float raster_ms = 0.0f;
+    float test_ms = 0.0f;
+    unsigned int culled = 0;
+    for (int i = 0; i < kIterations; i++) {
+      auto start_time = std::chrono::high_resolution_clock::now();
+      culler.BeginOccluders(width, width * 9 / 16, view_projection);
+      culler.RasterizeOccluder(positions, indices, 0, static_cast<unsigned int>(indices.size()), 0, wall);
+      culler.EndOccluders();
+      auto raster_time = std::chrono::high_resolution_clock::now();
+      culled = 0;
+      for (const auto &box : boxes) {
+        culled += culler.IsVisible(box) ? 0 : 1;
+      }
+      auto end_time = std::chrono::high_resolution_clock::now();
+      raster_ms += std::chrono::duration<float, std::milli>(raster_time - start_time).count();
+      test_ms += std::chrono::duration<float, std::milli>(end_time - raster_time).count();
+    }
+    GE_INFO("{0}x{1}: rasterize + pyramid {2:.3f} ms, {3} box tests {4:.3f} ms, {5} culled",
+            width, width * 9 / 16, raster_ms / kIterations, boxes.size(), test_ms / kIterations, culled);
+  }
+  return 0;
+}
@@ -0,0 +1,104 @@
+// offline texture cooker, encodes the material textures of a model (or single
+// images) to block compressed .dds files with mips, next to the source files:
+//   TextureCooker [--bc7] [--force] [--mip-filter box|kaiser|lanczos] model.gltf ...
+//   TextureCooker [--bc7] [--force] --color a.png --normal b.png --single c.png --data d.png
+#include "GEngine/job_system.h"
+#include "GEngine/log.h"
+#include "GEngine/singleton.h"
+#include "GEngine/texture_cooker.h"
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <chrono>
+#include <map>
+
+using namespace GEngine;
+
+// same slots as CMesh::ParseMaterials
+static const std::pair<aiTextureType, ETextureUsage> kTextureUsages[] = {
+    {aiTextureType_DIFFUSE, ETextureUsage::kColor},
+    {aiTextureType_BASE_COLOR, ETextureUsage::kColor},
+    {aiTextureType_EMISSION_COLOR, ETextureUsage::kColor},
+    {aiTextureType_HEIGHT, ETextureUsage::kNormal},
+    {aiTextureType_NORMALS, ETextureUsage::kNormal},
+    {aiTextureType_OPACITY, ETextureUsage::kSingleChannel},
+    {aiTextureType_DIFFUSE_ROUGHNESS, ETextureUsage::kSingleChannel},
+    {aiTextureType_METALNESS, ETextureUsage::kSingleChannel},
+    {aiTextureType_AMBIENT_OCCLUSION, ETextureUsage::kSingleChannel},
+    // glTF metallic-roughness (g, b)
+    {aiTextureType_UNKNOWN, ETextureUsage::kData},
+};
+
+static bool CollectModelTextures(const std::string &model_path, std::map<std::string, ETextureUsage> &textures) {
+  Assimp::Importer importer;
+  const aiScene *scene = importer.ReadFile(model_path.c_str(), 0);
+  if (!scene) {
+    GE_ERROR("Cannot read model {0}: {1}", model_path, importer.GetErrorString());
+    return false;
+  }
+  auto slash_pos = model_path.find_last_of('/');
+  std::string filedir = slash_pos == std::string::npos ? "." : model_path.substr(0, slash_pos);
+  for (unsigned int m = 0; m < scene->mNumMaterials; m++) {
+    for (const auto &[type, usage] : kTextureUsages) {
+      aiString ai_path;
+      if (scene->mMaterials[m]->GetTextureCount(type) == 0 ||
+          scene->mMaterials[m]->GetTexture(type, 0, &ai_path) != AI_SUCCESS) {
+        continue;
+      }
+      std::string path(ai_path.data);
+      for (auto &c : path) {
+        c = c == '\\' ? '/' : c;
+      }
+      // a texture is cooked once, the first usage wins except that packed
+      // channels (metallic-roughness shared with ao) must not shrink to BC4
+      auto [it, inserted] = textures.insert({filedir + "/" + path, usage});
+      if (!inserted && usage == ETextureUsage::kData && it->second == ETextureUsage::kSingleChannel) {
+        it->second = ETextureUsage::kData;
+      }
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  CLog::Init();
+  CSingleton<CJobSystem>()->Init();
+  CTextureCooker::SOptions options;
+  std::map<std::string, ETextureUsage> textures;
+  const std::map<std::string, ETextureUsage> kUsageFlags = {{"--color", ETextureUsage::kColor},
+                                                            {"--normal", ETextureUsage::kNormal},
+                                                            {"--single", ETextureUsage::kSingleChannel},
+                                                            {"--data", ETextureUsage::kData}};
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--bc7") {
+      options.color_bc7_ = true;
+    } else if (arg == "--force") {
+      options.force_ = true;
+    } else if (arg == "--mip-filter" && i + 1 < argc) {
+      std::string filter(argv[++i]);
+      options.mip_filter_ = filter == "box"       ? EMipFilter::kBox
+                            : filter == "lanczos" ? EMipFilter::kLanczos
+                                                  : EMipFilter::kKaiser;
+    } else if (kUsageFlags.count(arg) && i + 1 < argc) {
+      textures[argv[++i]] = kUsageFlags.at(arg);
+    } else if (!CollectModelTextures(arg, textures)) {
+      return 1;
+    }
+  }
+  if (textures.empty()) {
+    GE_INFO("usage: TextureCooker [--bc7] [--force] [model ...] [--color|--normal|--single|--data image ...]");
+    return 1;
+  }
+
+  auto start_time = std::chrono::high_resolution_clock::now();
+  unsigned int failed = 0;
+  for (const auto &[path, usage] : textures) {
+    failed += CTextureCooker::Cook(path, usage, options) ? 0 : 1;
+  }
+  auto end_time = std::chrono::high_resolution_clock::now();
+  GE_INFO("{0} textures, {1} failed, {2:.1f} s on {3} threads", textures.size(), failed,
+          std::chrono::duration<float>(end_time - start_time).count(),
+          CSingleton<CJobSystem>()->GetWorkerCount() + 1);
+  CSingleton<CJobSystem>()->Shutdown();
+  return failed == 0 ? 0 : 1;
+}
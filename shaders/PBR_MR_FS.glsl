@@ -10,8 +10,13 @@ uniform float u_roughness;
 uniform vec3 u_basecolor;
 uniform vec3 u_view_pos;
 
-uniform samplerCube irradiance_cubemap;
+// SH9 irradiance of CIBLPass
+#include "irradiance_sh.glsl"
+uniform vec3 u_irradiance_sh[9];
 uniform samplerCube prefilter_cubemap;
+// mip_levels_ - 1 of the prefiltered map: roughness 1. The baked map and the
+// one rebuilt from the sky capture have different level counts
+uniform float u_prefilter_max_lod = 7.0;
 uniform sampler2D brdf_lut;
 
 in VS_OUT {
@@ -162,7 +167,7 @@ void main()
     Lo = vec3(0.0);
   }
   // irradiance color
-  vec4 ambient_irradiance = texture(irradiance_cubemap, fs_in.Normal);
+  vec4 ambient_irradiance = vec4(max(EvaluateIrradianceSH(u_irradiance_sh, fs_in.Normal), 0.0) / PI, 1.0);
   vec3 ibl_diffuse = ambient_irradiance.rgb * frag_attribute.base_color;
 
   vec3 F = fresnelSchlickRoughness(max(dot(N, V), 0.0), env_ibl.F0, frag_attribute.roughness);
@@ -170,8 +175,7 @@ void main()
   vec3 kD = (vec3(1.0) - kS) * (1.0 - frag_attribute.metalness);
 
   // ibl specular
-  const float MAX_REFLECTION_LOD = 8.0;
-  vec4 prefilteredColor = textureLod(prefilter_cubemap, R, MAX_REFLECTION_LOD * frag_attribute.roughness);    
+  vec4 prefilteredColor = textureLod(prefilter_cubemap, R, u_prefilter_max_lod * frag_attribute.roughness);
   env_ibl.brdf  = texture(brdf_lut, vec2(max(dot(N, V), 0.0), frag_attribute.roughness)).rg;
   vec3 ibl_specular = prefilteredColor.rgb * (F * env_ibl.brdf.x + env_ibl.brdf.y);
 
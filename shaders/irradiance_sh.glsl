@@ -0,0 +1,9 @@
+// irradiance from the premultiplied SH9 coefficients of CSphericalHarmonics
+// (SIrradianceSH), n in the world space of the environment
+vec3 EvaluateIrradianceSH(vec3 sh[9], vec3 n)
+{
+    return sh[0]
+         + sh[1] * n.y + sh[2] * n.z + sh[3] * n.x
+         + sh[4] * (n.x * n.y) + sh[5] * (n.y * n.z) + sh[6] * (3.0 * n.z * n.z - 1.0)
+         + sh[7] * (n.x * n.z) + sh[8] * (n.x * n.x - n.y * n.y);
+}
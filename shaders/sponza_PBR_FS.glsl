@@ -6,30 +6,17 @@ in VS_OUT {
     vec2 TexCoords;
     mat3 TBN;
     vec3 Normal;
-    struct PointLight {
-        vec3 position;
-        vec3 color;
-        float intensity;
-        float attenuation;
-    }lights[3];
 }fs_in;
 
 uniform sampler2D texture_diffuse;
-uniform bool has_diffuse_texture;
 uniform bool u_linear_diffuse;
 uniform sampler2D texture_base_color;
-uniform bool has_base_color_texture;
 uniform sampler2D texture_normal;
-uniform bool has_normal_texture;
 uniform bool u_normal_map_flip_green_channel;
 uniform sampler2D texture_roughness;
-uniform bool has_roughness_texture;
 uniform sampler2D texture_metallic;
-uniform bool has_metallic_texture;
 uniform sampler2D texture_ao;
-uniform bool has_ao_texture;
 uniform sampler2D texture_emissive;
-uniform bool has_alpha_texture;
 uniform sampler2D texture_alpha;
 
 uniform sampler2D texture_metallic_roughness;
@@ -38,6 +25,61 @@ uniform float u_metallic;
 uniform float u_roughness;
 uniform vec3 u_basecolor;
 
+#ifdef MATERIAL_TEXTURE_ARRAYS
+// textures of every material in size-bucketed arrays, see CMaterialTextureArrays
+uniform sampler2DArray u_material_arrays[8];
+uniform isamplerBuffer u_material_slots;  // (array << 16 | layer) per slot, -1 if none
+uniform samplerBuffer u_material_params;  // (base color, metallic), (roughness, 0, 0, 0)
+uniform int u_material_index;
+
+vec4 SampleMaterial(int slot, vec2 uv) {
+  int array_layer = texelFetch(u_material_slots, u_material_index)[slot];
+  // the index only depends on a uniform, so it is dynamically uniform
+  return texture(u_material_arrays[array_layer >> 16], vec3(uv, float(array_layer & 0xFFFF)));
+}
+#define BASE_COLOR_MAP(uv)         SampleMaterial(0, uv)
+#define NORMAL_MAP(uv)             SampleMaterial(1, uv)
+#define METALLIC_ROUGHNESS_MAP(uv) SampleMaterial(2, uv)
+#define AO_MAP(uv)                 SampleMaterial(3, uv)
+#define MATERIAL_BASE_COLOR        texelFetch(u_material_params, u_material_index * 2).rgb
+#define MATERIAL_METALLIC          texelFetch(u_material_params, u_material_index * 2).a
+#define MATERIAL_ROUGHNESS         texelFetch(u_material_params, u_material_index * 2 + 1).r
+#else
+#define BASE_COLOR_MAP(uv)         texture(texture_base_color, uv)
+#define NORMAL_MAP(uv)             texture(texture_normal, uv)
+#define METALLIC_ROUGHNESS_MAP(uv) texture(texture_metallic_roughness, uv)
+#define AO_MAP(uv)                 texture(texture_ao, uv)
+#define MATERIAL_BASE_COLOR        u_basecolor
+#define MATERIAL_METALLIC          u_metallic
+#define MATERIAL_ROUGHNESS         u_roughness
+#endif
+
+// clustered lights, filled by CLightCullingPass
+uniform samplerBuffer u_light_data;     // 4 texels per light
+uniform usamplerBuffer u_cluster_grid;  // (offset, count) per cluster
+uniform usamplerBuffer u_light_indices;
+uniform ivec3 u_cluster_dims;
+uniform vec2 u_cluster_z_params;        // slice = log(depth) * x - y
+uniform vec4 u_viewport;
+uniform int u_global_light_count;       // directional & ambient lights
+
+// cascaded shadows of the sun, filled by CCascadedShadowPass
+uniform sampler2DArrayShadow u_shadow_map;
+uniform mat4 u_cascade_matrices[4];     // view space -> shadow map space
+uniform vec4 u_cascade_splits;          // far view depth of each cascade
+uniform int u_cascade_count;
+
+// aerial perspective froxels of PrecomputedAtmospherePass: (screen uv,
+// sqrt(view depth / distance)) -> (in-scattering, transmittance)
+uniform sampler3D u_aerial_perspective;
+uniform float u_aerial_perspective_distance; // 0: disabled
+
+// ambient irradiance of CIBLPass, SH9 of the environment in world space
+#include "irradiance_sh.glsl"
+uniform bool u_use_irradiance_sh;
+uniform vec3 u_irradiance_sh[9];
+uniform mat3 u_world_from_view;
+
 #define PI 3.1415926
 
 struct FragAttribute {
@@ -106,7 +148,7 @@ float GeometryHammon(float NdotV, float NdotL, float a) {
   return nom / denom;
 }
 
-// TODO: 1. replace ambient lighting with IBL (environment lighting)
+// TODO: 1. specular IBL from the prefiltered map
 //       2. improve tone mapping method for hdr effect
 
 vec3 CookTorranceBRDF(FragAttribute frag_attribute, vec3 viewdir, vec3 lightdir, vec3 radiance) {
@@ -142,21 +184,90 @@ vec3 CookTorranceBRDF(FragAttribute frag_attribute, vec3 viewdir, vec3 lightdir,
   return color;
 }
 
+#define LIGHT_OMNI        0
+#define LIGHT_SPOT        1
+#define LIGHT_DIRECTIONAL 2
+#define LIGHT_AMBIENT     3
+
+float ShadowFactor(vec3 frag_pos) {
+  float depth = -frag_pos.z;
+  int cascade = 0;
+  while(cascade < u_cascade_count && depth > u_cascade_splits[cascade]) {
+    cascade++;
+  }
+  // cascades refreshed a few frames ago may not cover the fragment any more,
+  // the next (larger) one might. Past the last one it is lit
+  for(; cascade < u_cascade_count; cascade++) {
+    vec4 shadow_coord = u_cascade_matrices[cascade] * vec4(frag_pos, 1.0);
+    if(any(lessThan(shadow_coord.xyz, vec3(0.0))) || any(greaterThan(shadow_coord.xyz, vec3(1.0)))) {
+      continue;
+    }
+    // 3x3 pcf on top of the hardware 2x2
+    vec2 texel = 1.0 / vec2(textureSize(u_shadow_map, 0).xy);
+    float visibility = 0.0;
+    for(int x=-1; x<=1; x++) {
+      for(int y=-1; y<=1; y++) {
+        visibility += texture(u_shadow_map, vec4(shadow_coord.xy + vec2(x, y) * texel, float(cascade), shadow_coord.z));
+      }
+    }
+    // fade out over the last 10% of the shadow distance
+    float shadow_distance = u_cascade_splits[u_cascade_count - 1];
+    float fade = clamp((shadow_distance - depth) / (0.1 * shadow_distance), 0.0, 1.0);
+    return mix(1.0, visibility / 9.0, fade);
+  }
+  return 1.0;
+}
+
+vec3 ShadeLight(int light_index, vec3 frag_pos, vec3 view_dir) {
+  vec4 position_radius = texelFetch(u_light_data, light_index * 4 + 0);
+  vec4 color_type      = texelFetch(u_light_data, light_index * 4 + 1);
+  vec4 direction_cos   = texelFetch(u_light_data, light_index * 4 + 2);
+  vec4 cos_inner_shadow = texelFetch(u_light_data, light_index * 4 + 3);
+  int type = int(color_type.w);
+
+  if(type == LIGHT_AMBIENT) {
+    return color_type.rgb * frag_attribute.base_color * frag_attribute.ao;
+  }
+  if(type == LIGHT_DIRECTIONAL) {
+    float shadow = cos_inner_shadow.y > 0.5 ? ShadowFactor(frag_pos) : 1.0;
+    return CookTorranceBRDF(frag_attribute, view_dir, -direction_cos.xyz, color_type.rgb * shadow);
+  }
+  vec3 pos2frag = frag_pos - position_radius.xyz;
+  float distance2 = dot(pos2frag, pos2frag);
+  float m = distance2 / (position_radius.w * position_radius.w);
+  float h = clamp(1.0 - m * m, 0.0, 1.0);
+  float attenuation = h * h / (distance2 + 1.0);
+  vec3 light_dir = normalize(-pos2frag);
+  if(type == LIGHT_SPOT) {
+    float cos_angle = dot(-light_dir, direction_cos.xyz);
+    attenuation *= smoothstep(direction_cos.w, cos_inner_shadow.x, cos_angle);
+  }
+  return CookTorranceBRDF(frag_attribute, view_dir, light_dir, color_type.rgb * attenuation);
+}
+
 void main()
 { 
+  // material permutations are #defines, see CShaderVariants
   frag_attribute.normal = normalize(fs_in.Normal); 
   // it seems something wrong with the normal map of sponza.obj
-  if(has_normal_texture) {
-      frag_attribute.normal = texture(texture_normal, fs_in.TexCoords).rgb;
-      frag_attribute.normal = frag_attribute.normal * 2.0 - vec3(1.0);
-      // frag_attribute.normal = normalize(frag_attribute.normal);
-      frag_attribute.normal = normalize(fs_in.TBN * frag_attribute.normal);
-  }
-  vec4 diiffuse_rgba = texture(texture_base_color, fs_in.TexCoords);
+#ifdef HAS_NORMAL_TEXTURE
+  // z is rebuilt from xy, cooked normal maps are BC5 (two channels)
+  vec2 normal_xy = NORMAL_MAP(fs_in.TexCoords).rg * 2.0 - vec2(1.0);
+  frag_attribute.normal = vec3(normal_xy, sqrt(max(1.0 - dot(normal_xy, normal_xy), 0.0)));
+  // frag_attribute.normal = normalize(frag_attribute.normal);
+  frag_attribute.normal = normalize(fs_in.TBN * frag_attribute.normal);
+#endif
+#ifdef HAS_BASE_COLOR_TEXTURE
+  vec4 diiffuse_rgba = BASE_COLOR_MAP(fs_in.TexCoords);
+#ifdef ALPHA_TEST
   if(diiffuse_rgba.a < 0.5) {
     discard;
   }
+#endif
   frag_attribute.base_color = ToLinear(diiffuse_rgba.rgb);
+#else
+  frag_attribute.base_color = MATERIAL_BASE_COLOR;
+#endif
   // if(has_base_color_texture) {
   //   frag_attribute.base_color = ToLinear(texture(texture_base_color, fs_in.TexCoords).rgb);
   // }
@@ -165,24 +276,48 @@ void main()
   // }
   
   frag_attribute.ao = 1.0;
-  if(has_ao_texture) {
-    frag_attribute.ao = texture(texture_ao, fs_in.TexCoords).r;
-  }
-
-  vec3 metalness_roughness = texture(texture_metallic_roughness, fs_in.TexCoords).rgb;
+#ifdef HAS_AO_TEXTURE
+  frag_attribute.ao = AO_MAP(fs_in.TexCoords).r;
+#endif
 
+#ifdef HAS_METALLIC_ROUGHNESS_TEXTURE
+  vec3 metalness_roughness = METALLIC_ROUGHNESS_MAP(fs_in.TexCoords).rgb;
   frag_attribute.roughness = metalness_roughness.g;
   frag_attribute.metalness = metalness_roughness.b;
+#else
+  frag_attribute.roughness = MATERIAL_ROUGHNESS;
+  frag_attribute.metalness = MATERIAL_METALLIC;
+#endif
   
   vec3 Lo = vec3(0.0);
-  for(int i=0; i<3; i++) {
-    vec3 light_dir = normalize(fs_in.lights[i].position - fs_in.FragPosViewspace);
-    vec3 view_dir = normalize(-fs_in.FragPosViewspace);
-    vec3 radiance = fs_in.lights[i].color * fs_in.lights[i].attenuation * fs_in.lights[i].intensity;
-    Lo += CookTorranceBRDF(frag_attribute, view_dir, light_dir, radiance);
+  vec3 view_dir = normalize(-fs_in.FragPosViewspace);
+  for(int i=0; i<u_global_light_count; i++) {
+    Lo += ShadeLight(i, fs_in.FragPosViewspace, view_dir);
+  }
+  // find the cluster of this fragment
+  vec2 tile_uv = (gl_FragCoord.xy - u_viewport.xy) / u_viewport.zw;
+  ivec2 tile = clamp(ivec2(tile_uv * vec2(u_cluster_dims.xy)), ivec2(0), u_cluster_dims.xy - 1);
+  float depth = -fs_in.FragPosViewspace.z;
+  int slice = clamp(int(log(depth) * u_cluster_z_params.x - u_cluster_z_params.y), 0, u_cluster_dims.z - 1);
+  int cluster = tile.x + u_cluster_dims.x * (tile.y + u_cluster_dims.y * slice);
+  uvec2 offset_count = texelFetch(u_cluster_grid, cluster).xy;
+  for(uint i=0u; i<offset_count.y; i++) {
+    int light_index = int(texelFetch(u_light_indices, int(offset_count.x + i)).r);
+    Lo += ShadeLight(light_index, fs_in.FragPosViewspace, view_dir);
   }
   vec3 ambient = vec3(0.03) * frag_attribute.base_color;
+  if (u_use_irradiance_sh) {
+    vec3 irradiance = max(EvaluateIrradianceSH(u_irradiance_sh, u_world_from_view * frag_attribute.normal), 0.0);
+    ambient = (1.0 - frag_attribute.metalness) * frag_attribute.base_color / PI * irradiance;
+  }
   Lo += ambient * frag_attribute.ao;
+  if (u_aerial_perspective_distance > 0.0) {
+    float w = sqrt(depth / u_aerial_perspective_distance);
+    vec4 aerial_perspective = texture(u_aerial_perspective, vec3(tile_uv, w));
+    // the first slice is at half a froxel, fade towards the eye
+    float fade = clamp(2.0 * w * float(textureSize(u_aerial_perspective, 0).z), 0.0, 1.0);
+    Lo = Lo * mix(1.0, aerial_perspective.a, fade) + aerial_perspective.rgb * fade;
+  }
   Lo = ACESToneMapping(Lo, 1.0);
   // Lo = ReinhardToneMapping(Lo, 1.0);
   Lo = ToSRGB(Lo);